@@ -0,0 +1,21 @@
+#include "deletionqueue.h"
+
+namespace vpa {
+    void DeletionQueue::Push(uint64_t frame, std::function<void(void)> deleter) {
+        m_entries.enqueue({ frame, deleter });
+    }
+
+    void DeletionQueue::Collect(uint64_t completedFrame) {
+        while (!m_entries.isEmpty() && m_entries.head().frame <= completedFrame) {
+            Entry entry = m_entries.dequeue();
+            entry.deleter();
+        }
+    }
+
+    void DeletionQueue::Flush() {
+        while (!m_entries.isEmpty()) {
+            Entry entry = m_entries.dequeue();
+            entry.deleter();
+        }
+    }
+}
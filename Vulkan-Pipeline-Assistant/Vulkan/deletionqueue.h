@@ -0,0 +1,32 @@
+#ifndef DELETIONQUEUE_H
+#define DELETIONQUEUE_H
+
+#include <QQueue>
+#include <functional>
+
+#include "../common.h"
+
+namespace vpa {
+    // Holds deleters for vulkan objects which may still be referenced by submitted frames.
+    // Entries are tagged with the last frame which could use them and run once that frame has completed.
+    class DeletionQueue final {
+    public:
+        // Frames must be pushed in non decreasing order
+        void Push(uint64_t frame, std::function<void(void)> deleter);
+        // Runs every deleter tagged with a frame at or before completedFrame
+        void Collect(uint64_t completedFrame);
+        // Runs every deleter regardless of frame, only valid once the device is idle
+        void Flush();
+        int Size() const { return m_entries.size(); }
+
+    private:
+        struct Entry {
+            uint64_t frame;
+            std::function<void(void)> deleter;
+        };
+
+        QQueue<Entry> m_entries;
+    };
+}
+
+#endif // DELETIONQUEUE_H
@@ -0,0 +1,137 @@
+#include "descriptorbenchmark.h"
+
+#include <QVulkanDeviceFunctions>
+#include <QElapsedTimer>
+
+#include "vulkanmain.h"
+#include "memoryallocator.h"
+#include "descriptorcache.h"
+
+namespace vpa {
+    static constexpr int Iterations = 1000;
+    static constexpr uint32_t BindingCounts[] = { 1, 16, 256 };
+
+    // Everything created for one binding count, destroyed together whether or not the run succeeded
+    struct BenchmarkObjects {
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+        VkDescriptorPool pool = VK_NULL_HANDLE;
+        VkDescriptorUpdateTemplateKHR updateTemplate = VK_NULL_HANDLE;
+    };
+
+    static void DestroyObjects(VulkanMain* main, BenchmarkObjects& objects) {
+        QVulkanDeviceFunctions* funcs = main->Details().deviceFunctions;
+        if (objects.updateTemplate != VK_NULL_HANDLE) {
+            main->Details().extensionFunctions.vkDestroyDescriptorUpdateTemplateKHR(main->Device(), objects.updateTemplate, nullptr);
+        }
+        DESTROY_HANDLE(main->Device(), objects.pool, funcs->vkDestroyDescriptorPool);
+        DESTROY_HANDLE(main->Device(), objects.layout, funcs->vkDestroyDescriptorSetLayout);
+    }
+
+    static VPAError BenchmarkBindings(VulkanMain* main, const Allocation& buffer, uint32_t bindingCount, BenchmarkObjects& objects, DescriptorBenchmarkResult& result) {
+        QVulkanDeviceFunctions* funcs = main->Details().deviceFunctions;
+        const ExtensionFunctions& extFuncs = main->Details().extensionFunctions;
+        result.bindings = bindingCount;
+
+        QVector<VkDescriptorSetLayoutBinding> bindings(int(bindingCount));
+        QVector<VkDescriptorUpdateTemplateEntryKHR> entries(int(bindingCount));
+        for (uint32_t i = 0; i < bindingCount; ++i) {
+            bindings[int(i)] = {};
+            bindings[int(i)].binding = i;
+            bindings[int(i)].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            bindings[int(i)].descriptorCount = 1;
+            bindings[int(i)].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+            entries[int(i)] = {};
+            entries[int(i)].dstBinding = i;
+            entries[int(i)].descriptorCount = 1;
+            entries[int(i)].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            entries[int(i)].offset = i * sizeof(DescriptorData);
+            entries[int(i)].stride = sizeof(DescriptorData);
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = bindingCount;
+        layoutInfo.pBindings = bindings.data();
+        VPA_VKCRITICAL_PASS(funcs->vkCreateDescriptorSetLayout(main->Device(), &layoutInfo, nullptr, &objects.layout), "create benchmark descriptor set layout");
+
+        VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bindingCount };
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+        VPA_VKCRITICAL_PASS(funcs->vkCreateDescriptorPool(main->Device(), &poolInfo, nullptr, &objects.pool), "create benchmark descriptor pool");
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = objects.pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &objects.layout;
+        VPA_VKCRITICAL_PASS(funcs->vkAllocateDescriptorSets(main->Device(), &allocInfo, &set), "allocate benchmark descriptor set");
+
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = buffer.buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = buffer.size;
+
+        // Built per update the way sets were written before templates, one write and one info per binding
+        QElapsedTimer timer;
+        timer.start();
+        for (int iteration = 0; iteration < Iterations; ++iteration) {
+            QVector<VkDescriptorBufferInfo> bufferInfos;
+            QVector<VkWriteDescriptorSet> writes;
+            bufferInfos.reserve(int(bindingCount));
+            for (uint32_t i = 0; i < bindingCount; ++i) {
+                bufferInfos.push_back(bufferInfo);
+                VkWriteDescriptorSet write = {};
+                write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.dstSet = set;
+                write.dstBinding = i;
+                write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                write.descriptorCount = 1;
+                write.pBufferInfo = &bufferInfos.last();
+                writes.push_back(write);
+            }
+            funcs->vkUpdateDescriptorSets(main->Device(), uint32_t(writes.size()), writes.data(), 0, nullptr);
+        }
+        result.writeMicroseconds = double(timer.nsecsElapsed()) / 1000.0 / Iterations;
+
+        if (!extFuncs.vkCreateDescriptorUpdateTemplateKHR) return VPA_OK;
+        VkDescriptorUpdateTemplateCreateInfoKHR templateInfo = {};
+        templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+        templateInfo.descriptorUpdateEntryCount = bindingCount;
+        templateInfo.pDescriptorUpdateEntries = entries.data();
+        templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+        templateInfo.descriptorSetLayout = objects.layout;
+        VPA_VKCRITICAL_PASS(extFuncs.vkCreateDescriptorUpdateTemplateKHR(main->Device(), &templateInfo, nullptr, &objects.updateTemplate), "create benchmark update template");
+
+        // The packed array lives as long as the set, as it does in Descriptors
+        QVector<DescriptorData> data(int(bindingCount));
+        timer.restart();
+        for (int iteration = 0; iteration < Iterations; ++iteration) {
+            for (DescriptorData& element : data) element.buffer = bufferInfo;
+            extFuncs.vkUpdateDescriptorSetWithTemplateKHR(main->Device(), set, objects.updateTemplate, data.constData());
+        }
+        result.templateMicroseconds = double(timer.nsecsElapsed()) / 1000.0 / Iterations;
+        return VPA_OK;
+    }
+
+    VPAError BenchmarkDescriptorUpdates(VulkanMain* main, MemoryAllocator* allocator, QVector<DescriptorBenchmarkResult>& results) {
+        results.clear();
+        Allocation buffer;
+        VPA_PASS_ERROR(allocator->Allocate(256, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, "descriptor benchmark", buffer));
+
+        VPAError err = VPA_OK;
+        for (uint32_t bindingCount : BindingCounts) {
+            BenchmarkObjects objects;
+            DescriptorBenchmarkResult result;
+            err = BenchmarkBindings(main, buffer, bindingCount, objects, result);
+            DestroyObjects(main, objects);
+            if (err != VPA_OK) break;
+            results.push_back(result);
+        }
+        allocator->Deallocate(buffer);
+        return err;
+    }
+}
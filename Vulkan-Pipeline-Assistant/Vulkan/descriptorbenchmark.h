@@ -0,0 +1,23 @@
+#ifndef DESCRIPTORBENCHMARK_H
+#define DESCRIPTORBENCHMARK_H
+
+#include <QVector>
+
+#include "../common.h"
+
+namespace vpa {
+    class VulkanMain;
+    class MemoryAllocator;
+
+    struct DescriptorBenchmarkResult {
+        uint32_t bindings = 0;
+        double writeMicroseconds = 0.0; // Per update of every binding with one VkWriteDescriptorSet each
+        double templateMicroseconds = 0.0; // Per update through an update template, 0 when templates aren't supported
+    };
+
+    // Times repeated updates of a set of 1, 16 and 256 uniform buffer bindings written each way.
+    // The sets are never bound, so this can run between frames without waiting on the device.
+    VPAError BenchmarkDescriptorUpdates(VulkanMain* main, MemoryAllocator* allocator, QVector<DescriptorBenchmarkResult>& results);
+}
+
+#endif // DESCRIPTORBENCHMARK_H
@@ -0,0 +1,259 @@
+#include "descriptorcache.h"
+
+#include <QVulkanDeviceFunctions>
+
+#include "vulkanmain.h"
+
+namespace vpa {
+    template<typename T>
+    static void AppendBytes(QByteArray& key, const T& value) {
+        key.append(reinterpret_cast<const char*>(&value), int(sizeof(T)));
+    }
+
+    DescriptorCache::DescriptorCache(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs) : m_main(main), m_deviceFuncs(deviceFuncs), m_uses(0) {
+        m_statistics.updateTemplates = m_main->Details().extensionFunctions.vkCreateDescriptorUpdateTemplateKHR != nullptr;
+    }
+
+    DescriptorCache::~DescriptorCache() {
+        // Only destroyed once the device is idle and every Descriptors has released its pool
+        for (PipelineLayoutEntry& entry : m_pipelineLayouts) {
+            DESTROY_HANDLE(m_main->Device(), entry.layout, m_deviceFuncs->vkDestroyPipelineLayout);
+        }
+        for (SetLayoutEntry& entry : m_setLayouts) {
+            DestroyUpdateTemplate(entry.updateTemplate);
+            DESTROY_HANDLE(m_main->Device(), entry.layout, m_deviceFuncs->vkDestroyDescriptorSetLayout);
+        }
+        for (VkDescriptorPool pool : m_pools.keys()) {
+            DESTROY_HANDLE(m_main->Device(), pool, m_deviceFuncs->vkDestroyDescriptorPool);
+        }
+    }
+
+    VPAError DescriptorCache::AcquireSetLayout(const VkDescriptorSetLayoutCreateInfo& info, VkDescriptorSetLayout& layout) {
+        const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT* bindingFlags = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT*>(info.pNext);
+        if (bindingFlags && (bindingFlags->sType != VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT || bindingFlags->pNext != nullptr)) {
+            return VPA_CRITICAL("Descriptor set layout create info with a pNext chain other than binding flags can't be cached");
+        }
+        const QByteArray key = SetLayoutKey(info);
+        auto it = m_setLayouts.find(key);
+        if (it != m_setLayouts.end()) {
+            ++it->references;
+            it->lastUsed = ++m_uses;
+            ++m_statistics.setLayoutsReused;
+            layout = it->layout;
+            return VPA_OK;
+        }
+
+        SetLayoutEntry entry;
+        VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreateDescriptorSetLayout(m_main->Device(), &info, nullptr, &entry.layout), "create cached descriptor set layout");
+        entry.updateTemplate = CreateUpdateTemplate(info, entry.layout);
+        entry.references = 1;
+        entry.lastUsed = ++m_uses;
+        m_setLayouts.insert(key, entry);
+        m_setLayoutKeys.insert(entry.layout, key);
+        ++m_statistics.setLayoutsCreated;
+        layout = entry.layout;
+        EvictUnused();
+        return VPA_OK;
+    }
+
+    void DescriptorCache::ReleaseSetLayout(VkDescriptorSetLayout& layout) {
+        auto key = m_setLayoutKeys.find(layout);
+        layout = VK_NULL_HANDLE;
+        if (key == m_setLayoutKeys.end()) return;
+        --m_setLayouts[*key].references;
+    }
+
+    VkDescriptorUpdateTemplateKHR DescriptorCache::UpdateTemplate(VkDescriptorSetLayout layout) const {
+        auto key = m_setLayoutKeys.find(layout);
+        if (key == m_setLayoutKeys.end()) return VK_NULL_HANDLE;
+        return m_setLayouts[*key].updateTemplate;
+    }
+
+    VPAError DescriptorCache::AcquirePipelineLayout(const VkPipelineLayoutCreateInfo& info, VkPipelineLayout& layout) {
+        if (info.pNext != nullptr) return VPA_CRITICAL("Pipeline layout create info with a pNext chain can't be cached");
+        const QByteArray key = PipelineLayoutKey(info);
+        auto it = m_pipelineLayouts.find(key);
+        if (it != m_pipelineLayouts.end()) {
+            ++it->references;
+            it->lastUsed = ++m_uses;
+            ++m_statistics.pipelineLayoutsReused;
+            layout = it->layout;
+            return VPA_OK;
+        }
+
+        PipelineLayoutEntry entry;
+        VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreatePipelineLayout(m_main->Device(), &info, nullptr, &entry.layout), "create cached pipeline layout");
+        entry.references = 1;
+        entry.lastUsed = ++m_uses;
+        for (uint32_t i = 0; i < info.setLayoutCount; ++i) {
+            auto setKey = m_setLayoutKeys.find(info.pSetLayouts[i]);
+            if (setKey == m_setLayoutKeys.end()) continue;
+            ++m_setLayouts[*setKey].references;
+            entry.setLayouts.push_back(info.pSetLayouts[i]);
+        }
+        m_pipelineLayouts.insert(key, entry);
+        m_pipelineLayoutKeys.insert(entry.layout, key);
+        ++m_statistics.pipelineLayoutsCreated;
+        layout = entry.layout;
+        EvictUnused();
+        return VPA_OK;
+    }
+
+    void DescriptorCache::ReleasePipelineLayout(VkPipelineLayout& layout) {
+        auto key = m_pipelineLayoutKeys.find(layout);
+        layout = VK_NULL_HANDLE;
+        if (key == m_pipelineLayoutKeys.end()) return;
+        --m_pipelineLayouts[*key].references;
+    }
+
+    VPAError DescriptorCache::AcquirePool(const QVector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets, VkDescriptorPoolCreateFlags flags, VkDescriptorPool& pool) {
+        for (int i = 0; i < m_freePools.size(); ++i) {
+            if (!Fits(m_pools[m_freePools[i]], poolSizes, maxSets, flags)) continue;
+            pool = m_freePools[i];
+            m_freePools.remove(i);
+            ++m_statistics.poolsReused;
+            m_statistics.freePools = uint32_t(m_freePools.size());
+            return VPA_OK;
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT | flags;
+        poolInfo.pNext = nullptr;
+        poolInfo.poolSizeCount = uint32_t(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = maxSets;
+        VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreateDescriptorPool(m_main->Device(), &poolInfo, nullptr, &pool), "create descriptor pool");
+
+        PoolEntry entry;
+        for (const VkDescriptorPoolSize& size : poolSizes) entry.capacity[int(size.type)] += size.descriptorCount;
+        entry.maxSets = maxSets;
+        entry.flags = flags;
+        m_pools.insert(pool, entry);
+        ++m_statistics.poolsCreated;
+        return VPA_OK;
+    }
+
+    void DescriptorCache::ReleasePool(VkDescriptorPool& pool) {
+        if (pool == VK_NULL_HANDLE || !m_pools.contains(pool)) return;
+        // Frees every set still allocated from the pool
+        m_deviceFuncs->vkResetDescriptorPool(m_main->Device(), pool, 0);
+        m_freePools.push_back(pool);
+        pool = VK_NULL_HANDLE;
+        if (m_freePools.size() > MaxFreePools) {
+            // Nothing can be using a released pool, so there is no need to defer this
+            VkDescriptorPool oldest = m_freePools.takeFirst();
+            m_pools.remove(oldest);
+            DESTROY_HANDLE(m_main->Device(), oldest, m_deviceFuncs->vkDestroyDescriptorPool);
+        }
+        m_statistics.freePools = uint32_t(m_freePools.size());
+    }
+
+    QByteArray DescriptorCache::SetLayoutKey(const VkDescriptorSetLayoutCreateInfo& info) {
+        QByteArray key;
+        AppendBytes(key, info.flags);
+        for (uint32_t i = 0; i < info.bindingCount; ++i) {
+            const VkDescriptorSetLayoutBinding& binding = info.pBindings[i];
+            AppendBytes(key, binding.binding);
+            AppendBytes(key, binding.descriptorType);
+            AppendBytes(key, binding.descriptorCount);
+            AppendBytes(key, binding.stageFlags);
+        }
+        const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT* bindingFlags = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfoEXT*>(info.pNext);
+        if (bindingFlags) {
+            for (uint32_t i = 0; i < bindingFlags->bindingCount; ++i) AppendBytes(key, bindingFlags->pBindingFlags[i]);
+        }
+        return key;
+    }
+
+    QByteArray DescriptorCache::PipelineLayoutKey(const VkPipelineLayoutCreateInfo& info) {
+        QByteArray key;
+        AppendBytes(key, info.flags);
+        AppendBytes(key, info.setLayoutCount);
+        for (uint32_t i = 0; i < info.setLayoutCount; ++i) AppendBytes(key, info.pSetLayouts[i]);
+        for (uint32_t i = 0; i < info.pushConstantRangeCount; ++i) {
+            AppendBytes(key, info.pPushConstantRanges[i].stageFlags);
+            AppendBytes(key, info.pPushConstantRanges[i].offset);
+            AppendBytes(key, info.pPushConstantRanges[i].size);
+        }
+        return key;
+    }
+
+    VkDescriptorUpdateTemplateKHR DescriptorCache::CreateUpdateTemplate(const VkDescriptorSetLayoutCreateInfo& info, VkDescriptorSetLayout layout) {
+        const ExtensionFunctions& extFuncs = m_main->Details().extensionFunctions;
+        // Pushed sets are written while recording instead. Partially bound arrays are written an element at a time, a template would write every element.
+        const VkDescriptorSetLayoutCreateFlags untemplated = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR | VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+        if (!extFuncs.vkCreateDescriptorUpdateTemplateKHR || info.bindingCount == 0 || (info.flags & untemplated)) return VK_NULL_HANDLE;
+
+        QVector<VkDescriptorUpdateTemplateEntryKHR> entries(int(info.bindingCount));
+        size_t element = 0;
+        for (uint32_t i = 0; i < info.bindingCount; ++i) {
+            entries[int(i)].dstBinding = info.pBindings[i].binding;
+            entries[int(i)].dstArrayElement = 0;
+            entries[int(i)].descriptorCount = info.pBindings[i].descriptorCount;
+            entries[int(i)].descriptorType = info.pBindings[i].descriptorType;
+            entries[int(i)].offset = element * sizeof(DescriptorData);
+            entries[int(i)].stride = sizeof(DescriptorData);
+            element += info.pBindings[i].descriptorCount;
+        }
+
+        VkDescriptorUpdateTemplateCreateInfoKHR templateInfo = {};
+        templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+        templateInfo.descriptorUpdateEntryCount = uint32_t(entries.size());
+        templateInfo.pDescriptorUpdateEntries = entries.data();
+        templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+        templateInfo.descriptorSetLayout = layout;
+
+        VkDescriptorUpdateTemplateKHR updateTemplate = VK_NULL_HANDLE;
+        if (extFuncs.vkCreateDescriptorUpdateTemplateKHR(m_main->Device(), &templateInfo, nullptr, &updateTemplate) != VK_SUCCESS) return VK_NULL_HANDLE;
+        return updateTemplate;
+    }
+
+    void DescriptorCache::DestroyUpdateTemplate(VkDescriptorUpdateTemplateKHR& updateTemplate) {
+        if (updateTemplate == VK_NULL_HANDLE) return;
+        m_main->Details().extensionFunctions.vkDestroyDescriptorUpdateTemplateKHR(m_main->Device(), updateTemplate, nullptr);
+        updateTemplate = VK_NULL_HANDLE;
+    }
+
+    bool DescriptorCache::Fits(const PoolEntry& entry, const QVector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets, VkDescriptorPoolCreateFlags flags) {
+        if (maxSets > entry.maxSets || flags != entry.flags) return false;
+        QHash<int, uint32_t> needed;
+        for (const VkDescriptorPoolSize& size : poolSizes) needed[int(size.type)] += size.descriptorCount;
+        for (auto it = needed.begin(); it != needed.end(); ++it) {
+            if (it.value() > entry.capacity.value(it.key())) return false;
+        }
+        return true;
+    }
+
+    void DescriptorCache::EvictUnused() {
+        // Pipeline layouts go first as they hold references to set layouts
+        int unused = 0;
+        for (const PipelineLayoutEntry& entry : m_pipelineLayouts) if (entry.references == 0) ++unused;
+        while (unused > MaxUnusedLayouts) {
+            auto oldest = m_pipelineLayouts.end();
+            for (auto it = m_pipelineLayouts.begin(); it != m_pipelineLayouts.end(); ++it) {
+                if (it->references == 0 && (oldest == m_pipelineLayouts.end() || it->lastUsed < oldest->lastUsed)) oldest = it;
+            }
+            for (VkDescriptorSetLayout setLayout : oldest->setLayouts) ReleaseSetLayout(setLayout);
+            m_pipelineLayoutKeys.remove(oldest->layout);
+            m_main->RetireHandle(oldest->layout, &QVulkanDeviceFunctions::vkDestroyPipelineLayout);
+            m_pipelineLayouts.erase(oldest);
+            --unused;
+        }
+
+        unused = 0;
+        for (const SetLayoutEntry& entry : m_setLayouts) if (entry.references == 0) ++unused;
+        while (unused > MaxUnusedLayouts) {
+            auto oldest = m_setLayouts.end();
+            for (auto it = m_setLayouts.begin(); it != m_setLayouts.end(); ++it) {
+                if (it->references == 0 && (oldest == m_setLayouts.end() || it->lastUsed < oldest->lastUsed)) oldest = it;
+            }
+            // Sets allocated with the layout may still be bound by a frame in flight. Templates are only read on the host.
+            DestroyUpdateTemplate(oldest->updateTemplate);
+            m_setLayoutKeys.remove(oldest->layout);
+            m_main->RetireHandle(oldest->layout, &QVulkanDeviceFunctions::vkDestroyDescriptorSetLayout);
+            m_setLayouts.erase(oldest);
+            --unused;
+        }
+    }
+}
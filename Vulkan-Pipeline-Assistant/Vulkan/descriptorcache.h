@@ -0,0 +1,103 @@
+#ifndef DESCRIPTORCACHE_H
+#define DESCRIPTORCACHE_H
+
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+#include <vulkan/vulkan.h>
+
+#include "../common.h"
+
+class QVulkanDeviceFunctions;
+namespace vpa {
+    class VulkanMain;
+
+    // One element of the packed array an update template reads, every descriptor of a set in the binding order of its layout create info
+    union DescriptorData {
+        VkDescriptorBufferInfo buffer;
+        VkDescriptorImageInfo image;
+    };
+
+    struct DescriptorCacheStatistics {
+        uint32_t setLayoutsCreated = 0;
+        uint32_t setLayoutsReused = 0;
+        uint32_t pipelineLayoutsCreated = 0;
+        uint32_t pipelineLayoutsReused = 0;
+        uint32_t poolsCreated = 0;
+        uint32_t poolsReused = 0; // Reset and handed out again instead of being recreated
+        uint32_t freePools = 0;
+        bool updateTemplates = false; // Set layouts come with an update template
+    };
+
+    // Descriptor set layouts, pipeline layouts and pools kept across shader reloads.
+    // Layouts are reference counted and shared by identical create infos, so reloading shaders with an unchanged interface creates none.
+    class DescriptorCache final {
+    public:
+        // Unreferenced layouts beyond this are destroyed when the next one is created, least recently used first
+        static constexpr int MaxUnusedLayouts = 16;
+        // Released pools beyond this are destroyed rather than kept for reuse
+        static constexpr int MaxFreePools = 4;
+
+        DescriptorCache(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs);
+        ~DescriptorCache();
+
+        // Every acquire must be matched by a release. Immutable samplers aren't part of the key so they must be null, pNext may only hold binding flags.
+        VPAError AcquireSetLayout(const VkDescriptorSetLayoutCreateInfo& info, VkDescriptorSetLayout& layout);
+        void ReleaseSetLayout(VkDescriptorSetLayout& layout);
+        // Writes a whole set from DescriptorData packed in the order of the layout bindings, null if templates aren't supported
+        VkDescriptorUpdateTemplateKHR UpdateTemplate(VkDescriptorSetLayout layout) const;
+        // Keyed on the set layout handles, each pipeline layout holds a reference to its set layouts so a handle can't be reused under it
+        VPAError AcquirePipelineLayout(const VkPipelineLayoutCreateInfo& info, VkPipelineLayout& layout);
+        void ReleasePipelineLayout(VkPipelineLayout& layout);
+
+        // Hands out a released pool with the same flags and at least the given capacity if there is one
+        VPAError AcquirePool(const QVector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets, VkDescriptorPoolCreateFlags flags, VkDescriptorPool& pool);
+        // No set allocated from the pool may still be in use by a frame, it is reset straight away
+        void ReleasePool(VkDescriptorPool& pool);
+
+        const DescriptorCacheStatistics& Statistics() const { return m_statistics; }
+
+    private:
+        struct SetLayoutEntry {
+            VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+            VkDescriptorUpdateTemplateKHR updateTemplate = VK_NULL_HANDLE;
+            uint32_t references = 0;
+            uint64_t lastUsed = 0;
+        };
+
+        struct PipelineLayoutEntry {
+            VkPipelineLayout layout = VK_NULL_HANDLE;
+            uint32_t references = 0;
+            uint64_t lastUsed = 0;
+            QVector<VkDescriptorSetLayout> setLayouts;
+        };
+
+        struct PoolEntry {
+            QHash<int, uint32_t> capacity; // Descriptor count per VkDescriptorType
+            uint32_t maxSets = 0;
+            VkDescriptorPoolCreateFlags flags = 0; // Beyond VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, which every pool has
+        };
+
+        static QByteArray SetLayoutKey(const VkDescriptorSetLayoutCreateInfo& info);
+        static QByteArray PipelineLayoutKey(const VkPipelineLayoutCreateInfo& info);
+        // Null if templates aren't supported or creation failed, in which case sets are written the usual way
+        VkDescriptorUpdateTemplateKHR CreateUpdateTemplate(const VkDescriptorSetLayoutCreateInfo& info, VkDescriptorSetLayout layout);
+        void DestroyUpdateTemplate(VkDescriptorUpdateTemplateKHR& updateTemplate);
+        static bool Fits(const PoolEntry& entry, const QVector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets, VkDescriptorPoolCreateFlags flags);
+        // Only called when a layout is created, so releasing everything while the renderer is torn down retires nothing
+        void EvictUnused();
+
+        VulkanMain* m_main;
+        QVulkanDeviceFunctions* m_deviceFuncs;
+        QHash<QByteArray, SetLayoutEntry> m_setLayouts;
+        QHash<QByteArray, PipelineLayoutEntry> m_pipelineLayouts;
+        QHash<VkDescriptorSetLayout, QByteArray> m_setLayoutKeys;
+        QHash<VkPipelineLayout, QByteArray> m_pipelineLayoutKeys;
+        QHash<VkDescriptorPool, PoolEntry> m_pools; // Every pool created, handed out or not
+        QVector<VkDescriptorPool> m_freePools; // Oldest release first
+        uint64_t m_uses;
+        DescriptorCacheStatistics m_statistics;
+    };
+}
+
+#endif // DESCRIPTORCACHE_H
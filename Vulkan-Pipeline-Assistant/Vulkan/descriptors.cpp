@@ -3,16 +3,56 @@
 #include <QWindow>
 #include <QHash>
 #include <QVulkanDeviceFunctions>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QtConcurrent/QtConcurrentRun>
 #include <algorithm>
 
 #include "vulkanmain.h"
+#include "textureparser.h"
+#include "textureencoder.h"
+#include "texturecache.h"
 
 namespace vpa {
+    // Sets are replaced rather than updated while older copies may still be in use by frames in flight, the pool holds this many copies of each
+    constexpr uint32_t SetCopies = MaxFramesInFlight + 1;
+    // Elements can be added to a runtime array while earlier copies of its set are bound, as long as those don't use them
+    constexpr VkDescriptorBindingFlagsEXT BindlessBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+            | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+
     double Descriptors::s_aspectRatio = 0.0;
 
-    Descriptors::Descriptors(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs, MemoryAllocator* allocator, uint32_t attachmentCount,
-                             const DescriptorLayoutMap& layoutMap, const QVector<SpvResource*>& pushConstants, VkPhysicalDeviceLimits limits, VPAError& err)
-        : m_main(main), m_deviceFuncs(deviceFuncs), m_allocator(allocator), m_descriptorPool(VK_NULL_HANDLE), m_limits(limits) {
+    // Layers beyond the first are only visible to shaders that declare an arrayed or cube image
+    static VkImageViewType ViewType(const SpvImageType* type, const VkImageCreateInfo& createInfo) {
+        if (type->imageTypename == SpvImageTypeName::TexCube && (createInfo.flags & VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT)) {
+            return type->isArrayed ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE;
+        }
+        return type->isArrayed ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+    }
+
+    // Keeps the descriptor and resource but none of the handles
+    static ImageInfo UnloadedCopy(const ImageInfo& imageInfo) {
+        ImageInfo copy = imageInfo;
+        copy.view = VK_NULL_HANDLE;
+        copy.sampler = VK_NULL_HANDLE;
+        copy.descriptor.allocation = Allocation();
+        copy.residentKey.clear();
+        return copy;
+    }
+
+    // An element added to a runtime array which hasn't finished loading, and so was never written
+    static bool Reserved(const ImageInfo& imageInfo) {
+        return imageInfo.descriptor.bindless && imageInfo.view == VK_NULL_HANDLE;
+    }
+
+    Descriptors::Descriptors(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs, MemoryAllocator* allocator, SamplerCache* samplers, TextureCache* textures,
+                             DescriptorCache* layouts, uint32_t attachmentCount, const DescriptorLayoutMap& layoutMap, const QVector<SpvResource*>& pushConstants, VkPhysicalDeviceLimits limits, const TextureConfig& textureConfig,
+                             const DescriptorConfig& descriptorConfig, VPAError& err)
+        : m_main(main), m_deviceFuncs(deviceFuncs), m_allocator(allocator), m_samplers(samplers), m_textures(textures), m_layouts(layouts), m_descriptorPool(VK_NULL_HANDLE),
+          m_descriptorConfig(descriptorConfig), m_pushSetIndex(-1), m_offsetsBeforePush(0), m_bindlessDescriptors(0), m_ringData(nullptr), m_ringSlice(0), m_limits(limits), m_textureConfig(textureConfig), m_buildMilliseconds(0.0f) {
+        QElapsedTimer timer;
+        timer.start();
+        m_textures->SetBudget(VkDeviceSize(m_textureConfig.residencyBudget) << 20);
         s_aspectRatio = double(m_main->Details().window->width()) / double(m_main->Details().window->height());
 
         QVector<VkDescriptorPoolSize> poolSizes = {
@@ -22,27 +62,34 @@ namespace vpa {
         };
 
         uint32_t setCount = 0;
-        EnumerateShaderRequirements(poolSizes, m_descriptorLayouts, setCount, layoutMap, pushConstants);
+        err = EnumerateShaderRequirements(poolSizes, m_descriptorLayouts, setCount, layoutMap, pushConstants);
+        if (err != VPA_OK) return;
         EnumerateBuiltInRequirements(poolSizes, m_builtInLayouts, setCount, attachmentCount);
+        for (VkDescriptorPoolSize& poolSize : poolSizes) {
+            poolSize.descriptorCount *= SetCopies;
+        }
 
-        VkDescriptorPoolCreateInfo poolInfo = {};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.flags = 0;
-        poolInfo.pNext = nullptr;
-        poolInfo.poolSizeCount = uint32_t(poolSizes.size());
-        poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = setCount;
+        // The pool of the previous shaders is reset and reused when the interface hasn't grown
+        const VkDescriptorPoolCreateFlags poolFlags = m_bindlessSets.isEmpty() ? 0 : VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        err = m_layouts->AcquirePool(poolSizes, setCount * SetCopies, poolFlags, m_descriptorPool);
+        if (err != VPA_OK) return;
 
-        VPA_VKCRITICAL_CTOR_PASS(m_deviceFuncs->vkCreateDescriptorPool(m_main->Device(), &poolInfo, nullptr, &m_descriptorPool), "create descriptor pool", err);
+        // Sets can't be allocated with a push descriptor layout, its place is left null
+        QVector<VkDescriptorSetLayout> allocatedLayouts = m_descriptorLayouts;
+        if (m_pushSetIndex >= 0) allocatedLayouts.remove(m_pushSetIndex);
+        QVector<VkDescriptorSet> allocatedSets(allocatedLayouts.size(), VK_NULL_HANDLE);
 
         VkDescriptorSetAllocateInfo allocInfo = {};
         allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
         allocInfo.descriptorPool = m_descriptorPool;
-        allocInfo.descriptorSetCount = uint32_t(m_descriptorLayouts.size());
-        allocInfo.pSetLayouts = m_descriptorLayouts.data();
+        allocInfo.descriptorSetCount = uint32_t(allocatedLayouts.size());
+        allocInfo.pSetLayouts = allocatedLayouts.data();
 
-        m_descriptorSets.resize(m_descriptorLayouts.size());
-        VPA_VKCRITICAL_CTOR_PASS(m_deviceFuncs->vkAllocateDescriptorSets(m_main->Device(), &allocInfo, &m_descriptorSets[0]), "allocate shader descriptor sets", err);
+        if (!allocatedLayouts.isEmpty()) {
+            VPA_VKCRITICAL_CTOR_PASS(m_deviceFuncs->vkAllocateDescriptorSets(m_main->Device(), &allocInfo, allocatedSets.data()), "allocate shader descriptor sets", err);
+        }
+        if (m_pushSetIndex >= 0) allocatedSets.insert(m_pushSetIndex, VK_NULL_HANDLE);
+        m_descriptorSets = allocatedSets;
 
         allocInfo.descriptorSetCount = uint32_t(m_builtInLayouts.size());
         allocInfo.pSetLayouts = m_builtInLayouts.data();
@@ -52,47 +99,215 @@ namespace vpa {
 
         WriteShaderDescriptors();
 
+        m_buildMilliseconds = float(timer.nsecsElapsed()) / 1000000.0f;
         err = VPA_OK;
     }
 
     Descriptors::~Descriptors() {
+        for (PendingImage* pending : m_pendingImages) {
+            pending->decode.waitForFinished();
+            if (pending->uploaded) {
+                m_allocator->WaitTransfer(pending->transfer);
+                DestroyImage(pending->image);
+            }
+            delete pending;
+        }
         for (auto buffers : m_buffers) {
             for (BufferInfo& buffer : buffers) {
                 m_allocator->Deallocate(buffer.descriptor.allocation);
             }
         }
+        if (m_ringData) m_allocator->UnmapMemory(m_ring);
+        m_allocator->Deallocate(m_ring);
         for (auto images : m_images) {
             for (ImageInfo& image : images) {
                 DestroyImage(image);
             }
         }
         for (auto& layout : m_descriptorLayouts) {
-            DESTROY_HANDLE(m_main->Device(), layout, m_deviceFuncs->vkDestroyDescriptorSetLayout);
+            m_layouts->ReleaseSetLayout(layout);
         }
         for (auto& layout : m_builtInLayouts) {
-            DESTROY_HANDLE(m_main->Device(), layout, m_deviceFuncs->vkDestroyDescriptorSetLayout);
+            m_layouts->ReleaseSetLayout(layout);
         }
-        DESTROY_HANDLE(m_main->Device(), m_descriptorPool, m_deviceFuncs->vkDestroyDescriptorPool);
+        // Only destroyed once frames using the sets have completed, so the pool can be reset for the next shaders
+        m_layouts->ReleasePool(m_descriptorPool);
     }
 
     unsigned char* Descriptors::MapBufferPointer(uint32_t set, int index) {
-        m_deviceFuncs->vkDeviceWaitIdle(m_main->Device());
-        Allocation& allocation = m_buffers[set][index].descriptor.allocation;
-        return m_allocator->MapMemory(allocation);
+        BufferInfo& buffer = m_buffers[set][index];
+        if (buffer.dynamic) return buffer.hostData.data();
+        // Static buffers have a single copy which the frames in flight may still be reading
+        m_main->WaitForFramesInFlight();
+        return m_allocator->MapMemory(buffer.descriptor.allocation);
     }
 
     void Descriptors::UnmapBufferPointer(uint32_t set, int index) {
-        Allocation& allocation = m_buffers[set][index].descriptor.allocation;
-        m_allocator->UnmapMemory(allocation);
+        BufferInfo& buffer = m_buffers[set][index];
+        if (!buffer.dynamic) m_allocator->UnmapMemory(buffer.descriptor.allocation);
         m_main->RequestUpdate();
     }
 
     void Descriptors::LoadImage(const uint32_t set, const int index, const QString name) {
-        m_deviceFuncs->vkDeviceWaitIdle(m_main->Device());
-        ImageInfo& imageInfo = m_images[set][index];
-        DestroyImage(imageInfo);
-        CreateImage(imageInfo, name, true);
-        m_main->RequestUpdate();
+        for (PendingImage* pending : m_pendingImages) {
+            if (pending->set == set && pending->index == index) pending->superseded = true;
+        }
+
+        PendingImage* pending = new PendingImage();
+        pending->set = set;
+        pending->index = index;
+        pending->source = name;
+        pending->image = UnloadedCopy(m_images[set][index]);
+        const DecodeSettings settings = MakeDecodeSettings(pending->image);
+        pending->residentKey = ResidentKey(pending->image, name, settings);
+
+        // Already on the device, so it can be swapped in straight away
+        if (!pending->residentKey.isEmpty() && m_textures->Acquire(pending->residentKey, pending->image)) {
+            if (CompleteImage(pending->image) == VPA_OK) ReplaceImage(set, index, pending->image);
+            else DestroyImage(pending->image);
+            delete pending;
+            return;
+        }
+
+        // Nothing renders while idle, so the frame which uploads the image has to be asked for
+        VulkanMain* main = m_main;
+        QObject::connect(&pending->decode, &QFutureWatcher<DecodedImage>::finished, [main]() { main->RequestUpdate(); });
+        pending->decode.setFuture(QtConcurrent::run([name, settings]() { return DecodeImage(name, settings); }));
+        m_pendingImages.push_back(pending);
+    }
+
+    void Descriptors::CompletePendingImages() {
+        bool uploading = false;
+        for (int i = 0; i < m_pendingImages.size();) {
+            PendingImage* pending = m_pendingImages[i];
+            if (!pending->uploaded) {
+                if (!pending->decode.isFinished()) {
+                    ++i;
+                    continue;
+                }
+                if (pending->superseded || CreateImage(pending->image, pending->decode.result(), &pending->transfer) != VPA_OK) {
+                    delete pending;
+                    m_pendingImages.remove(i);
+                    continue;
+                }
+                pending->uploaded = true;
+            }
+            if (!m_allocator->TransferComplete(pending->transfer)) {
+                uploading = true;
+                ++i;
+                continue;
+            }
+
+            // Superseded images were never written to a set, so they can go straight away
+            if (pending->superseded) DestroyImage(pending->image);
+            else {
+                if (pending->image.mipGeneration == MipGeneration::Blit) pending->image.mipMilliseconds = pending->transfer.blitMilliseconds;
+                if (!pending->residentKey.isEmpty()) m_textures->Insert(pending->residentKey, pending->image);
+                ReplaceImage(pending->set, pending->index, pending->image);
+            }
+            delete pending;
+            m_pendingImages.remove(i);
+        }
+        // Transfer fences aren't signalled back to the GUI thread, so frames keep coming until they complete
+        if (uploading) m_main->RequestUpdate();
+    }
+
+    VPAError Descriptors::AddArrayImage(uint32_t set, int index, const QString& name, int& newIndex) {
+        QVector<ImageInfo>& images = m_images[set];
+        if (!images[index].descriptor.bindless) return VPA_WARN("Images can only be added to runtime arrays");
+        // Elements added since the set was built are at the end of the set's images rather than after the rest of the array
+        int last = index;
+        for (int i = 0; i < images.size(); ++i) {
+            if (images[i].descriptor.binding == images[index].descriptor.binding && images[i].descriptor.arrayElement > images[last].descriptor.arrayElement) last = i;
+        }
+        if (images[last].descriptor.arrayElement + 1 >= images[last].descriptor.arraySize) {
+            return VPA_WARN("Runtime array " + images[last].descriptor.resource->name + " is full, its capacity is in the preview settings");
+        }
+
+        // The element is reserved now and loaded in the background like any other image, it's written once its upload completes
+        ImageInfo image = UnloadedCopy(images[last]);
+        image.descriptor.arrayElement++;
+        image.descriptor.dataIndex++;
+        image.source = name;
+        images.push_back(image);
+        newIndex = images.size() - 1;
+        LoadImage(set, newIndex, name);
+        return VPA_OK;
+    }
+
+    void Descriptors::WriteDynamicBuffers(uint32_t frameIndex) {
+        if (!m_ringData) return;
+        // Every buffer is copied whether or not it changed, which is part of the cost being compared with static buffers
+        const uint32_t offset = uint32_t(m_ringSlice * frameIndex);
+        for (int i = 0; i < m_dynamicBuffers.size(); ++i) {
+            const BufferInfo& buffer = m_buffers[m_dynamicBuffers[i].first][m_dynamicBuffers[i].second];
+            memcpy(m_ringData + offset + buffer.bufferInfo.offset, buffer.hostData.constData(), size_t(buffer.hostData.size()));
+            m_dynamicOffsets[i] = offset;
+        }
+    }
+
+    void Descriptors::SetTextureConfig(const TextureConfig& textures) {
+        const bool reload = textures.mipGeneration != m_textureConfig.mipGeneration || textures.mipLevels != m_textureConfig.mipLevels
+                || textures.transcode != m_textureConfig.transcode;
+        const bool lodBiasChanged = textures.lodBias != m_textureConfig.lodBias;
+        m_textureConfig = textures;
+        m_textures->SetBudget(VkDeviceSize(m_textureConfig.residencyBudget) << 20);
+        if (!reload) {
+            if (lodBiasChanged) {
+                for (uint32_t set : m_images.keys()) UpdateSamplers(set);
+            }
+            return;
+        }
+
+        // Images still loading are reloaded with the new settings here instead
+        QHash<QPair<uint32_t, int>, QString> latestSources;
+        for (PendingImage* pending : m_pendingImages) {
+            if (!pending->superseded) latestSources[qMakePair(pending->set, pending->index)] = pending->source;
+            pending->superseded = true;
+        }
+        for (auto it = m_images.begin(); it != m_images.end(); ++it) {
+            for (int i = 0; i < it.value().size(); ++i) {
+                ImageInfo newImage = UnloadedCopy(it.value()[i]);
+                const QString source = latestSources.value(qMakePair(it.key(), i), it.value()[i].source);
+                if (CreateImage(newImage, source, false) == VPA_OK) ReplaceImage(it.key(), i, newImage);
+            }
+        }
+    }
+
+    void Descriptors::SetSamplerState(uint32_t set, int index, const SamplerState& state) {
+        for (PendingImage* pending : m_pendingImages) {
+            if (pending->set == set && pending->index == index) pending->image.samplerState = state;
+        }
+        m_images[set][index].samplerState = state;
+        m_textures->RememberBinding(BindingKey(m_images[set][index].descriptor), m_images[set][index].source, state);
+        UpdateSamplers(set);
+    }
+
+    TextureStatistics Descriptors::Statistics() const {
+        TextureStatistics statistics;
+        statistics.blitsTimed = m_allocator->CanTimeTransfers();
+        for (const QVector<ImageInfo>& images : m_images) {
+            for (const ImageInfo& image : images) {
+                if (Reserved(image)) continue;
+                statistics.imageCount++;
+                statistics.maxMipLevels = qMax(statistics.maxMipLevels, image.mipLevels);
+                statistics.bytes += image.descriptor.allocation.size;
+                if (image.transcoded) {
+                    statistics.transcoded++;
+                    if (image.cacheHit) statistics.cacheHits++;
+                    statistics.transcodeMilliseconds += image.transcodeMilliseconds;
+                }
+                else if (image.precompressed) statistics.precompressed++;
+                else statistics.generated[size_t(image.mipGeneration)]++;
+                statistics.uploadMilliseconds += image.uploadMilliseconds;
+                statistics.mipMilliseconds += image.mipMilliseconds;
+                if (image.descriptor.bindless) {
+                    statistics.arrayImages++;
+                    if (image.descriptor.arrayElement == 0) statistics.arrayCapacity += image.descriptor.arraySize;
+                }
+            }
+        }
+        return statistics;
     }
 
     unsigned char* Descriptors::PushConstantData(ShaderStage stage) {
@@ -105,8 +320,45 @@ namespace vpa {
 
 
     void Descriptors::CmdBindSets(VkCommandBuffer cmdBuf, VkPipelineLayout pipelineLayout) const {
-        // TODO dynamic offset support
-        m_deviceFuncs->vkCmdBindDescriptorSets(cmdBuf,VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, uint32_t(m_descriptorSets.size()), m_descriptorSets.data(), 0, nullptr);
+        if (m_pushSetIndex < 0) {
+            m_deviceFuncs->vkCmdBindDescriptorSets(cmdBuf,VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, uint32_t(m_descriptorSets.size()), m_descriptorSets.data(),
+                                                   uint32_t(m_dynamicOffsets.size()), m_dynamicOffsets.data());
+            return;
+        }
+
+        // Sets either side of the pushed one are bound separately, the pushed set has no dynamic offsets of its own
+        const uint32_t pushIndex = uint32_t(m_pushSetIndex);
+        const uint32_t afterCount = uint32_t(m_descriptorSets.size()) - pushIndex - 1;
+        if (pushIndex > 0) {
+            m_deviceFuncs->vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, pushIndex, m_descriptorSets.data(),
+                                                   uint32_t(m_offsetsBeforePush), m_dynamicOffsets.data());
+        }
+        if (afterCount > 0) {
+            m_deviceFuncs->vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, pushIndex + 1, afterCount, m_descriptorSets.data() + pushIndex + 1,
+                                                   uint32_t(m_dynamicOffsets.size() - m_offsetsBeforePush), m_dynamicOffsets.data() + m_offsetsBeforePush);
+        }
+
+        const uint32_t set = uint32_t(m_descriptorConfig.pushDescriptorSet);
+        const QVector<DescriptorData>& data = m_setData[m_pushSetIndex];
+        QVector<VkWriteDescriptorSet> writes;
+        auto makeWrite = [](const DescriptorInfo& descriptor) {
+            VkWriteDescriptorSet write = {};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstBinding = descriptor.binding;
+            write.dstArrayElement = descriptor.arrayElement;
+            write.descriptorType = descriptor.layoutBinding.descriptorType;
+            write.descriptorCount = 1;
+            return write;
+        };
+        for (const BufferInfo& buffer : m_buffers.value(set)) {
+            writes.push_back(makeWrite(buffer.descriptor));
+            writes.last().pBufferInfo = &data[int(buffer.descriptor.dataIndex)].buffer;
+        }
+        for (const ImageInfo& image : m_images.value(set)) {
+            writes.push_back(makeWrite(image.descriptor));
+            writes.last().pImageInfo = &data[int(image.descriptor.dataIndex)].image;
+        }
+        m_main->Details().extensionFunctions.vkCmdPushDescriptorSetKHR(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, pushIndex, uint32_t(writes.size()), writes.data());
     }
 
     void Descriptors::CmdPushConstants(VkCommandBuffer cmdBuf, VkPipelineLayout pipelineLayout) const {
@@ -118,6 +370,14 @@ namespace vpa {
         }
     }
 
+    VPAError Descriptors::RenewBuiltInSet(BuiltInSets set) {
+        VkDescriptorSet newSet = VK_NULL_HANDLE;
+        VPA_PASS_ERROR(AllocateSet(m_builtInLayouts[int(set)], newSet));
+        RetireSet(m_builtInSets[int(set)]);
+        m_builtInSets[int(set)] = newSet;
+        return VPA_OK;
+    }
+
     const QVector<VkDescriptorSetLayout>& Descriptors::DescriptorSetLayouts() const {
         return m_descriptorLayouts;
     }
@@ -130,7 +390,8 @@ namespace vpa {
 
         QSet<uint32_t> setIndices;
         if (!layoutMap.empty()) {
-            BuildDescriptors(setIndices, poolSizes, layoutMap);
+            VPA_PASS_ERROR(BuildDescriptors(setIndices, poolSizes, layoutMap));
+            VPA_PASS_ERROR(CreateDynamicRing());
         }
         for (auto res : pushConstants) {
             m_pushConstants[reinterpret_cast<const SpvPushConstantGroup*>(res->group)->stage] = CreatePushConstant(res);
@@ -150,19 +411,50 @@ namespace vpa {
                 uint32_t set = *(setIndicesVec.begin() + i);
                 m_descriptorSetIndexMap[set] = i;
                 QVector<VkDescriptorSetLayoutBinding> bindings;
+                QVector<VkDescriptorBindingFlagsEXT> bindingFlags;
+                uint32_t dataCount = 0;
                 for (auto& buf : m_buffers[set]) {
                     bindings.push_back(buf.descriptor.layoutBinding);
+                    bindingFlags.push_back(0);
+                    buf.descriptor.dataIndex = dataCount;
+                    dataCount += buf.descriptor.layoutBinding.descriptorCount;
                 }
+                // Elements of an array follow its first element, they share its binding and are packed one after another
+                uint32_t arrayStart = 0;
                 for (auto& img : m_images[set]) {
-                    bindings.push_back(img.descriptor.layoutBinding);
+                    if (img.descriptor.arrayElement == 0) {
+                        bindings.push_back(img.descriptor.layoutBinding);
+                        bindingFlags.push_back(img.descriptor.bindless ? BindlessBindingFlags : 0);
+                        arrayStart = dataCount;
+                        dataCount += img.descriptor.layoutBinding.descriptorCount;
+                    }
+                    img.descriptor.dataIndex = arrayStart + img.descriptor.arrayElement;
                 }
+                m_setData.push_back(QVector<DescriptorData>(int(dataCount)));
+
+                VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+                bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+                bindingFlagsInfo.bindingCount = uint32_t(bindingFlags.size());
+                bindingFlagsInfo.pBindingFlags = bindingFlags.data();
 
                 VkDescriptorSetLayoutCreateInfo layoutInfo = {};
                 layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
                 layoutInfo.bindingCount = uint32_t(bindings.size());
                 layoutInfo.pBindings = bindings.data();
                 layoutInfo.pNext = nullptr;
-                VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreateDescriptorSetLayout(m_main->Device(), &layoutInfo, nullptr, &layouts[i]), qPrintable("create descriptor set layout for set " + QString(set)));
+                if (m_bindlessSets.contains(set)) {
+                    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+                    layoutInfo.pNext = &bindingFlagsInfo;
+                }
+                if (Pushed(set)) {
+                    VPA_PASS_ERROR(VPAAssert(dataCount <= m_main->Details().maxPushDescriptors, "Num descriptors in the pushed set beyond maxPushDescriptors"));
+                    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+                    m_pushSetIndex = i;
+                }
+                VPA_PASS_ERROR(m_layouts->AcquireSetLayout(layoutInfo, layouts[i]));
+            }
+            for (const QPair<uint32_t, int>& index : m_dynamicBuffers) {
+                if (m_descriptorSetIndexMap[index.first] < m_pushSetIndex) ++m_offsetsBeforePush;
             }
         }
 
@@ -182,7 +474,7 @@ namespace vpa {
         outputLayoutBinding.pImmutableSamplers = nullptr;
         outputLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-        poolSizes[4].descriptorCount++;
+        poolSizes[4].descriptorCount += attachmentCount;
 
         VkDescriptorSetLayoutCreateInfo layoutInfo = {};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -190,7 +482,7 @@ namespace vpa {
         layoutInfo.pBindings = &outputLayoutBinding;
         layoutInfo.pNext = nullptr;
 
-        VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreateDescriptorSetLayout(m_main->Device(), &layoutInfo, nullptr, &layouts[int(BuiltInSets::OutputPostPass)]), "create descriptor set layout for output set ");
+        VPA_PASS_ERROR(m_layouts->AcquireSetLayout(layoutInfo, layouts[int(BuiltInSets::OutputPostPass)]));
 
         return VPA_OK;
     }
@@ -198,16 +490,35 @@ namespace vpa {
     VPAError Descriptors::Validate(size_t numSets, const QVector<VkDescriptorPoolSize>& poolSizes) {
         VPA_PASS_ERROR(VPAAssert(numSets <= m_limits.maxBoundDescriptorSets, "setLayoutCount must be less than or equal to VkPhysicalDeviceLimits::maxBoundDescriptorSets"));
 
-        VPA_PASS_ERROR(VPAAssert((poolSizes[4].descriptorCount - 1) <= m_limits.maxDescriptorSetSamplers, "Num samplers beyond maxDescriptorSetSamplers, https://www.khronos.org/registry/vulkan/specs/1.1-extensions/man/html/VkPipelineLayoutCreateInfo.html"));
+        // Runtime arrays were clamped to the update after bind limits, which they count against instead
+        const uint32_t sampledImages = poolSizes[4].descriptorCount - m_bindlessDescriptors;
+        VPA_PASS_ERROR(VPAAssert((sampledImages - 1) <= m_limits.maxDescriptorSetSamplers, "Num samplers beyond maxDescriptorSetSamplers, https://www.khronos.org/registry/vulkan/specs/1.1-extensions/man/html/VkPipelineLayoutCreateInfo.html"));
         VPA_PASS_ERROR(VPAAssert((poolSizes[0].descriptorCount - 1) <= m_limits.maxDescriptorSetUniformBuffers, "Num uniform buffers beyond maxDescriptorSetUniformBuffers, https://www.khronos.org/registry/vulkan/specs/1.1-extensions/man/html/VkPipelineLayoutCreateInfo.html"));
         VPA_PASS_ERROR(VPAAssert((poolSizes[2].descriptorCount - 1) <= m_limits.maxDescriptorSetStorageBuffers, "Num storage buffers beyond maxDescriptorSetStorageBuffers, https://www.khronos.org/registry/vulkan/specs/1.1-extensions/man/html/VkPipelineLayoutCreateInfo.html"));
-        VPA_PASS_ERROR(VPAAssert((poolSizes[4].descriptorCount - 1) <= m_limits.maxDescriptorSetSampledImages, "Num sampled images beyond maxDescriptorSetSampledImages, https://www.khronos.org/registry/vulkan/specs/1.1-extensions/man/html/VkPipelineLayoutCreateInfo.html"));
+        VPA_PASS_ERROR(VPAAssert((sampledImages - 1) <= m_limits.maxDescriptorSetSampledImages, "Num sampled images beyond maxDescriptorSetSampledImages, https://www.khronos.org/registry/vulkan/specs/1.1-extensions/man/html/VkPipelineLayoutCreateInfo.html"));
         VPA_PASS_ERROR(VPAAssert((poolSizes[5].descriptorCount - 1) <= m_limits.maxDescriptorSetStorageImages, "Num storage images beyond maxDescriptorSetStorageImages, https://www.khronos.org/registry/vulkan/specs/1.1-extensions/man/html/VkPipelineLayoutCreateInfo.html"));
 
+        uint32_t uniformDynamic = 0;
+        uint32_t storageDynamic = 0;
+        for (const QPair<uint32_t, int>& index : m_dynamicBuffers) {
+            if (m_buffers[index.first][index.second].usage == VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) ++uniformDynamic;
+            else ++storageDynamic;
+        }
+        VPA_PASS_ERROR(VPAAssert(uniformDynamic <= m_limits.maxDescriptorSetUniformBuffersDynamic, "Num dynamic uniform buffers beyond maxDescriptorSetUniformBuffersDynamic"));
+        VPA_PASS_ERROR(VPAAssert(storageDynamic <= m_limits.maxDescriptorSetStorageBuffersDynamic, "Num dynamic storage buffers beyond maxDescriptorSetStorageBuffersDynamic"));
+
         return VPA_OK;
     }
 
     VPAError Descriptors::BuildDescriptors(QSet<uint32_t>& sets, QVector<VkDescriptorPoolSize>& poolSizes, const DescriptorLayoutMap& layoutMap) {
+        // Known before any buffer is created, as buffers in an update after bind set can't be dynamic
+        for (const SpvResource* resource : layoutMap) {
+            if (resource->group->Group() == SpvGroupName::Image && resource->type->Type() == SpvTypeName::Array
+                    && reinterpret_cast<const SpvArrayType*>(resource->type)->Unsized()) {
+                m_bindlessSets.insert(reinterpret_cast<const SpvDescriptorGroup*>(resource->group)->set);
+            }
+        }
+
         for (auto key : layoutMap.keys()) {
             DescriptorInfo descriptor = {};
             descriptor.set = key.first;
@@ -228,16 +539,7 @@ namespace vpa {
                 }
             }
             else if (descriptor.type == SpvGroupName::Image) {
-                ImageInfo info = {};
-                info.descriptor = descriptor;
-                VPA_PASS_ERROR(CreateImage(info, TEXDIR"default.png", false));
-                m_images[key.first].push_back(info);
-                if (reinterpret_cast<const SpvImageType*>(descriptor.resource->type)->sampled) {
-                    poolSizes[4].descriptorCount++;
-                }
-                else {
-                    poolSizes[5].descriptorCount++;
-                }
+                VPA_PASS_ERROR(BuildImages(descriptor, poolSizes));
             }
             else {
                 return VPA_WARN("Unsupported resource in shader.");
@@ -247,21 +549,71 @@ namespace vpa {
         return VPA_OK;
     }
 
+    VPAError Descriptors::BuildImages(const DescriptorInfo& descriptor, QVector<VkDescriptorPoolSize>& poolSizes) {
+        const bool sampled = ImageElementType(descriptor.resource->type)->sampled;
+        DescriptorInfo arrayDescriptor = descriptor;
+        uint32_t loadedCount = 1;
+        if (descriptor.resource->type->Type() == SpvTypeName::Array) {
+            const SpvArrayType* arrayType = reinterpret_cast<const SpvArrayType*>(descriptor.resource->type);
+            arrayDescriptor.arraySize = uint32_t(arrayType->ElementCount());
+            loadedCount = arrayDescriptor.arraySize;
+            if (arrayType->Unsized()) {
+                if (!sampled || Pushed(descriptor.set) || m_main->Details().maxBindlessImages == 0) {
+                    return VPA_CRITICAL("Runtime array " + descriptor.resource->name + " needs VK_EXT_descriptor_indexing, can only hold sampled images and can't be in a pushed set");
+                }
+                arrayDescriptor.bindless = true;
+                arrayDescriptor.arraySize = qBound(1u, m_descriptorConfig.bindlessCapacity, m_main->Details().maxBindlessImages);
+                loadedCount = 1;
+                m_bindlessDescriptors += arrayDescriptor.arraySize;
+            }
+        }
+
+        for (uint32_t element = 0; element < arrayDescriptor.arraySize; ++element) {
+            ImageInfo info = {};
+            info.descriptor = arrayDescriptor;
+            info.descriptor.arrayElement = element;
+            // Bindings keep the image and sampler chosen for them before the shaders were reloaded, runtime arrays keep the elements they had
+            const TextureBinding binding = m_textures->Binding(BindingKey(info.descriptor));
+            if (element >= loadedCount && binding.source.isEmpty()) break;
+            info.samplerState = binding.samplerState;
+            if (binding.source.isEmpty() || CreateImage(info, binding.source, false) != VPA_OK) {
+                VPA_PASS_ERROR(CreateImage(info, TEXDIR"default.png", false));
+            }
+            m_images[descriptor.set].push_back(info);
+        }
+        poolSizes[sampled ? 4 : 5].descriptorCount += arrayDescriptor.arraySize;
+        return VPA_OK;
+    }
+
     VPAError Descriptors::CreateBuffer(DescriptorInfo& descriptor, const SpvResource* resource, BufferInfo& info) {
         info = {};
         info.usage = descriptor.type == SpvGroupName::UniformBuffer ? VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT : VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
         info.descriptor = descriptor;
-        VPA_PASS_ERROR(m_allocator->Allocate(reinterpret_cast<const SpvStructType*>(resource->type)->size, info.usage, resource->name, info.descriptor.allocation));
+        // Push descriptor and update after bind set layouts can't hold dynamic descriptors
+        info.dynamic = !Pushed(descriptor.set) && !m_bindlessSets.contains(descriptor.set) && m_descriptorConfig.dynamicBuffers.contains(BindingKey(descriptor));
+        const VkDeviceSize size = reinterpret_cast<const SpvStructType*>(resource->type)->size;
 
+        // Dynamic buffers are given their place in the ring by CreateDynamicRing once every buffer is known
         info.bufferInfo = {};
-        info.bufferInfo.buffer = info.descriptor.allocation.buffer;
         info.bufferInfo.offset = 0;
-        info.bufferInfo.range = info.descriptor.allocation.size;
+        info.bufferInfo.range = size;
+        if (info.dynamic) {
+            info.hostData.fill(0, int(size));
+        }
+        else {
+            VPA_PASS_ERROR(m_allocator->Allocate(size, info.usage, resource->name, info.descriptor.allocation));
+            info.bufferInfo.buffer = info.descriptor.allocation.buffer;
+        }
 
         info.descriptor.layoutBinding = {};
         info.descriptor.layoutBinding.binding = info.descriptor.binding;
         info.descriptor.layoutBinding.descriptorCount = 1;
-        info.descriptor.layoutBinding.descriptorType = descriptor.type == SpvGroupName::UniformBuffer ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        if (descriptor.type == SpvGroupName::UniformBuffer) {
+            info.descriptor.layoutBinding.descriptorType = info.dynamic ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        }
+        else {
+            info.descriptor.layoutBinding.descriptorType = info.dynamic ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
         info.descriptor.layoutBinding.binding = info.descriptor.binding;
         info.descriptor.layoutBinding.pImmutableSamplers = nullptr;
         info.descriptor.layoutBinding.stageFlags = reinterpret_cast<const SpvDescriptorGroup*>(resource->group)->stageFlags;
@@ -269,68 +621,261 @@ namespace vpa {
         return VPA_OK;
     }
 
-    VPAError Descriptors::CreateImage(ImageInfo& imageInfo, const QString& name, bool writeSet) {
+    VPAError Descriptors::CreateDynamicRing() {
+        for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+            for (int i = 0; i < it.value().size(); ++i) {
+                if (it.value()[i].dynamic) m_dynamicBuffers.push_back(qMakePair(it.key(), i));
+            }
+        }
+        if (m_dynamicBuffers.isEmpty()) return VPA_OK;
+        std::sort(m_dynamicBuffers.begin(), m_dynamicBuffers.end(), [this](const QPair<uint32_t, int>& a, const QPair<uint32_t, int>& b) {
+            return qMakePair(a.first, m_buffers[a.first][a.second].descriptor.binding) < qMakePair(b.first, m_buffers[b.first][b.second].descriptor.binding);
+        });
+
+        // Offsets within a slice follow the alignment of each buffer's type, slices follow both so any frame's offset suits every binding
+        auto align = [](VkDeviceSize offset, VkDeviceSize alignment) { return (offset + alignment - 1) / alignment * alignment; };
+        VkBufferUsageFlags usage = 0;
+        for (const QPair<uint32_t, int>& index : m_dynamicBuffers) {
+            BufferInfo& buffer = m_buffers[index.first][index.second];
+            const VkDeviceSize alignment = buffer.usage == VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT ? m_limits.minUniformBufferOffsetAlignment : m_limits.minStorageBufferOffsetAlignment;
+            buffer.bufferInfo.offset = align(m_ringSlice, alignment);
+            m_ringSlice = buffer.bufferInfo.offset + buffer.bufferInfo.range;
+            usage |= buffer.usage;
+        }
+        m_ringSlice = align(m_ringSlice, qMax(m_limits.minUniformBufferOffsetAlignment, m_limits.minStorageBufferOffsetAlignment));
+
+        VPA_PASS_ERROR(m_allocator->Allocate(m_ringSlice * MaxFramesInFlight, usage, "Dynamic buffer ring", m_ring));
+        m_ringData = m_allocator->MapMemory(m_ring);
+        if (!m_ringData) return VPA_CRITICAL("Failed to map the dynamic buffer ring");
+        for (const QPair<uint32_t, int>& index : m_dynamicBuffers) {
+            m_buffers[index.first][index.second].bufferInfo.buffer = m_ring.buffer;
+        }
+        m_dynamicOffsets.fill(0, m_dynamicBuffers.size());
+        return VPA_OK;
+    }
+
+    DecodeSettings Descriptors::MakeDecodeSettings(const ImageInfo& imageInfo) const {
+        DecodeSettings settings;
+        settings.textures = m_textureConfig;
+        settings.sampled = ImageElementType(imageInfo.descriptor.resource->type)->sampled;
+        settings.transcode = m_textureConfig.transcode && settings.sampled && m_main->SampledFormatSupported(VK_FORMAT_BC1_RGB_UNORM_BLOCK)
+                && m_main->SampledFormatSupported(VK_FORMAT_BC3_UNORM_BLOCK);
+        settings.blit = m_allocator->CanBlit() && m_main->LinearBlitSupported(VK_FORMAT_R8G8B8A8_UNORM);
+        return settings;
+    }
+
+    QString Descriptors::ResidentKey(const ImageInfo& imageInfo, const QString& name, const DecodeSettings& settings) {
+        if (!settings.sampled) return QString();
+        return TextureCache::MakeKey(name, settings, ImageElementType(imageInfo.descriptor.resource->type));
+    }
+
+    QString Descriptors::BindingKey(const DescriptorInfo& descriptor) {
+        const QString key = QString("%1/%2/%3").arg(descriptor.set).arg(descriptor.binding).arg(descriptor.resource->name);
+        if (descriptor.arrayElement == 0) return key;
+        return key + QString("[%1]").arg(descriptor.arrayElement);
+    }
+
+    DecodedImage Descriptors::DecodeImage(const QString& name, const DecodeSettings& settings) {
+        DecodedImage decoded;
+        decoded.source = name;
+        decoded.path = name;
+        decoded.container = TextureFile::IsContainer(name);
+        if (decoded.container) return decoded;
+
+        if (settings.transcode) {
+            // Turning mip generation off still gives a single level, anything else is the cached chain
+            const uint32_t mipLevels = settings.textures.mipGeneration == MipGeneration::None ? 1 : settings.textures.mipLevels;
+            decoded.path = TextureEncoder::CachePath(name, mipLevels);
+            decoded.container = true;
+            decoded.transcoded = true;
+            decoded.cacheHit = QFileInfo::exists(decoded.path);
+            if (decoded.cacheHit) return decoded;
+
+            QElapsedTimer timer;
+            timer.start();
+            QString error;
+            if (TextureEncoder::Transcode(name, decoded.path, mipLevels, error)) {
+                decoded.transcodeMilliseconds = float(timer.nsecsElapsed()) / 1000000.0f;
+                return decoded;
+            }
+            // The texture cache is only an optimisation, so the image is decoded as is instead
+            decoded.warning = "Couldn't transcode " + name + ", loading it uncompressed. " + error;
+            decoded.path = name;
+            decoded.container = false;
+            decoded.transcoded = false;
+        }
+
         QImage image(name);
-        if (image.isNull()) return VPA_CRITICAL("Failed to load image " + name);
+        if (image.isNull()) {
+            decoded.error = "Failed to load image " + name;
+            return decoded;
+        }
         image = image.convertToFormat(QImage::Format_RGBA8888);
 
-        VkImageCreateInfo createInfo = MakeImageCreateInfo(reinterpret_cast<const SpvImageType*>(imageInfo.descriptor.resource->type),
-                                                           uint32_t(image.width()), uint32_t(image.height()), 1);
+        // Storage images are written per texel, so only sampled images get a chain
+        if (settings.sampled && settings.textures.mipGeneration != MipGeneration::None) {
+            decoded.mipLevels = TextureEncoder::MipChainLength(uint32_t(image.width()), uint32_t(image.height()));
+            if (settings.textures.mipLevels > 0) decoded.mipLevels = qMin(decoded.mipLevels, settings.textures.mipLevels);
+        }
+        decoded.mipGeneration = decoded.mipLevels > 1 ? settings.textures.mipGeneration : MipGeneration::None;
+        if (decoded.mipGeneration == MipGeneration::Blit && !settings.blit) decoded.mipGeneration = MipGeneration::Cpu;
+
+        QElapsedTimer timer;
+        timer.start();
+        decoded.levels = { image };
+        if (decoded.mipGeneration == MipGeneration::Cpu) {
+            while (uint32_t(decoded.levels.size()) < decoded.mipLevels) decoded.levels.push_back(TextureEncoder::Downsample(decoded.levels.last()));
+            decoded.mipMilliseconds = float(timer.nsecsElapsed()) / 1000000.0f;
+        }
+        return decoded;
+    }
 
-        size_t size = size_t(image.width()) * size_t(image.height()) * 4;
+    VPAError Descriptors::UploadDecodedImage(ImageInfo& imageInfo, const DecodedImage& decoded, VkImageCreateInfo& createInfo, PendingTransfer* pending) {
+        const SpvImageType* type = ImageElementType(imageInfo.descriptor.resource->type);
+        const QImage& image = decoded.levels.first();
+        imageInfo.mipLevels = decoded.mipLevels;
+        imageInfo.mipGeneration = decoded.mipGeneration;
+        imageInfo.mipMilliseconds = decoded.mipMilliseconds;
+        createInfo = MakeImageCreateInfo(type, uint32_t(image.width()), uint32_t(image.height()), 1, imageInfo.mipLevels);
+
+        QElapsedTimer timer;
+        timer.start();
+        size_t size = 0;
+        uint32_t width = uint32_t(image.width());
+        uint32_t height = uint32_t(image.height());
+        for (uint32_t level = 0; level < imageInfo.mipLevels; ++level) {
+            size += size_t(width) * size_t(height) * 4;
+            width = qMax(width / 2, 1u);
+            height = qMax(height / 2, 1u);
+        }
         VPA_PASS_ERROR(m_allocator->Allocate(size, createInfo, imageInfo.descriptor.resource->name, imageInfo.descriptor.allocation));
 
-        VkShaderStageFlags shaderStageFlags = reinterpret_cast<const SpvDescriptorGroup*>(imageInfo.descriptor.resource->group)->stageFlags;
-        VkPipelineStageFlags finalStageFlags = StageFlagsToPipelineFlags(shaderStageFlags);
+        VkPipelineStageFlags finalStageFlags = StageFlagsToPipelineFlags(reinterpret_cast<const SpvDescriptorGroup*>(imageInfo.descriptor.resource->group)->stageFlags);
+        float blitMilliseconds = 0.0f;
+        VPAError err = m_allocator->TransferImageMemory(imageInfo.descriptor.allocation, createInfo.extent, decoded.levels, imageInfo.mipLevels, finalStageFlags,
+                                                        blitMilliseconds, pending);
+        if (err != VPA_OK) {
+            DestroyImage(imageInfo);
+            return err;
+        }
+        if (imageInfo.mipGeneration == MipGeneration::Blit) imageInfo.mipMilliseconds = blitMilliseconds;
+        imageInfo.uploadMilliseconds = decoded.mipMilliseconds + float(timer.nsecsElapsed()) / 1000000.0f;
+        return VPA_OK;
+    }
 
-        VPAError err = VPA_OK;
-        err = m_allocator->TransferImageMemory(imageInfo.descriptor.allocation, createInfo.extent, image, finalStageFlags);
+    VPAError Descriptors::UploadContainerImage(ImageInfo& imageInfo, const QString& path, VkImageCreateInfo& createInfo, PendingTransfer* pending) {
+        const SpvImageType* type = ImageElementType(imageInfo.descriptor.resource->type);
+        if (!type->sampled) return VPA_CRITICAL("KTX2 and DDS images can only be sampled, " + path + " is bound to a storage image");
+        TextureFile file;
+        VPAError err = file.Open(path);
+        if (err != VPA_OK) return VPA_CRITICAL(VPAError::lastMessage);
+        if (!m_main->SampledFormatSupported(file.Format())) return VPA_CRITICAL(QString("The device can't sample format %1 of %2").arg(file.Format()).arg(path));
+
+        // The chain is uploaded as stored, the level setting can only drop levels from it
+        imageInfo.mipGeneration = MipGeneration::None;
+        imageInfo.mipLevels = file.MipLevels();
+        if (m_textureConfig.mipLevels > 0) imageInfo.mipLevels = qMin(imageInfo.mipLevels, m_textureConfig.mipLevels);
+        createInfo = MakeImageCreateInfo(type, file.Extent().width, file.Extent().height, 1, imageInfo.mipLevels);
+        createInfo.format = file.Format();
+        createInfo.arrayLayers = file.ArrayLayers();
+        if (file.IsCube()) createInfo.flags |= VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+
+        QElapsedTimer timer;
+        timer.start();
+        QVector<ImageUploadRegion> regions;
+        VkDeviceSize size = 0;
+        for (const ImageUploadRegion& region : file.Regions()) {
+            if (region.mipLevel >= imageInfo.mipLevels) break;
+            regions.push_back(region);
+            size += region.size;
+        }
+        VPA_PASS_ERROR(m_allocator->Allocate(size, createInfo, imageInfo.descriptor.resource->name, imageInfo.descriptor.allocation));
+
+        // Regions are copied in to staging memory before this returns, so the file can be closed while the transfer is in flight
+        VkPipelineStageFlags finalStageFlags = StageFlagsToPipelineFlags(reinterpret_cast<const SpvDescriptorGroup*>(imageInfo.descriptor.resource->group)->stageFlags);
+        err = m_allocator->TransferImageRegions(imageInfo.descriptor.allocation, regions, imageInfo.mipLevels, createInfo.arrayLayers, finalStageFlags, pending);
         if (err != VPA_OK) {
             DestroyImage(imageInfo);
             return err;
         }
+        imageInfo.uploadMilliseconds = float(timer.nsecsElapsed()) / 1000000.0f;
+        return VPA_OK;
+    }
+
+    VPAError Descriptors::CreateImage(ImageInfo& imageInfo, const QString& name, bool writeSet) {
+        const DecodeSettings settings = MakeDecodeSettings(imageInfo);
+        const QString key = ResidentKey(imageInfo, name, settings);
+        if (!key.isEmpty() && m_textures->Acquire(key, imageInfo)) {
+            VPAError err = CompleteImage(imageInfo);
+            if (err != VPA_OK) {
+                DestroyImage(imageInfo);
+                return err;
+            }
+        }
+        else {
+            VPA_PASS_ERROR(CreateImage(imageInfo, DecodeImage(name, settings), nullptr));
+            if (!key.isEmpty()) m_textures->Insert(key, imageInfo);
+        }
+        if (writeSet) WriteImage(imageInfo);
+        return VPA_OK;
+    }
+
+    VPAError Descriptors::CreateImage(ImageInfo& imageInfo, const DecodedImage& decoded, PendingTransfer* pending) {
+        imageInfo.source = decoded.source;
+        imageInfo.precompressed = decoded.container && !decoded.transcoded;
+        imageInfo.transcoded = decoded.transcoded;
+        imageInfo.cacheHit = decoded.cacheHit;
+        imageInfo.transcodeMilliseconds = decoded.transcodeMilliseconds;
+        imageInfo.mipMilliseconds = 0.0f;
+        if (!decoded.error.isEmpty()) return VPA_CRITICAL(decoded.error);
+        if (!decoded.warning.isEmpty()) {
+            VPA_WARN(decoded.warning);
+            qWarning("%s", qPrintable(decoded.warning));
+        }
+
+        VkImageCreateInfo createInfo = {};
+        if (decoded.container) {
+            VPAError err = UploadContainerImage(imageInfo, decoded.path, createInfo, pending);
+            // A damaged cache file is encoded again next time
+            if (err != VPA_OK && decoded.cacheHit) QFile::remove(decoded.path);
+            VPA_PASS_ERROR(err);
+        }
+        else {
+            VPA_PASS_ERROR(UploadDecodedImage(imageInfo, decoded, createInfo, pending));
+        }
+
+        VPAError err = VPA_OK;
 
         VkImageViewCreateInfo viewInfo = {};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         viewInfo.image = imageInfo.descriptor.allocation.image;
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.viewType = ViewType(ImageElementType(imageInfo.descriptor.resource->type), createInfo);
         viewInfo.format = createInfo.format;
         viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         viewInfo.subresourceRange.baseMipLevel = 0;
         viewInfo.subresourceRange.levelCount = createInfo.mipLevels;
         viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = createInfo.arrayLayers;
+        viewInfo.subresourceRange.layerCount = viewInfo.viewType == VK_IMAGE_VIEW_TYPE_2D ? 1 : createInfo.arrayLayers;
 
         VPA_VKCRITICAL(m_deviceFuncs->vkCreateImageView(m_main->Device(), &viewInfo, nullptr, &imageInfo.view),
                          qPrintable("create image view for allocation '" + imageInfo.descriptor.allocation.name + "'"), err);
         if (err != VPA_OK) {
+            if (pending) m_allocator->WaitTransfer(*pending);
             DestroyImage(imageInfo);
             return err;
         }
 
-        VkSamplerCreateInfo samplerInfo = {};
-        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-        samplerInfo.magFilter = VK_FILTER_LINEAR;
-        samplerInfo.minFilter = VK_FILTER_LINEAR;
-        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.anisotropyEnable = VK_FALSE;
-        samplerInfo.maxAnisotropy = 0.0f;
-        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-        samplerInfo.unnormalizedCoordinates = VK_FALSE;
-        samplerInfo.compareEnable = VK_FALSE;
-        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        samplerInfo.mipLodBias = 0.0f;
-        samplerInfo.minLod = 0.0f;
-        samplerInfo.maxLod = 1.0f;
-        VPA_VKCRITICAL(m_deviceFuncs->vkCreateSampler(m_main->Device(), &samplerInfo, nullptr, &imageInfo.sampler),
-                         qPrintable("create sampler for allocation '" + imageInfo.descriptor.allocation.name + "'"), err);
+        err = CompleteImage(imageInfo);
         if (err != VPA_OK) {
+            if (pending) m_allocator->WaitTransfer(*pending);
             DestroyImage(imageInfo);
             return err;
         }
+        return VPA_OK;
+    }
+
+    VPAError Descriptors::CompleteImage(ImageInfo& imageInfo) {
+        VPA_PASS_ERROR(AcquireSampler(imageInfo, imageInfo.sampler));
 
         imageInfo.imageInfo = {};
         imageInfo.imageInfo.imageView = imageInfo.view;
@@ -339,32 +884,192 @@ namespace vpa {
 
         imageInfo.descriptor.layoutBinding = {};
         imageInfo.descriptor.layoutBinding.binding = imageInfo.descriptor.binding;
-        imageInfo.descriptor.layoutBinding.descriptorCount = 1;
-        imageInfo.descriptor.layoutBinding.descriptorType = reinterpret_cast<const SpvImageType*>(imageInfo.descriptor.resource->type)->sampled ?
+        imageInfo.descriptor.layoutBinding.descriptorCount = imageInfo.descriptor.arraySize;
+        imageInfo.descriptor.layoutBinding.descriptorType = ImageElementType(imageInfo.descriptor.resource->type)->sampled ?
                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
         imageInfo.descriptor.layoutBinding.pImmutableSamplers = nullptr;
-        imageInfo.descriptor.layoutBinding.stageFlags = shaderStageFlags;
-
-        if (writeSet) {
-            QVector<VkWriteDescriptorSet> writes;
-            imageInfo.descriptor.writeSet = {};
-            imageInfo.descriptor.writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            imageInfo.descriptor.writeSet.dstSet = m_descriptorSets[m_descriptorSetIndexMap[imageInfo.descriptor.set]];
-            imageInfo.descriptor.writeSet.dstBinding = imageInfo.descriptor.binding;
-            imageInfo.descriptor.writeSet.dstArrayElement = 0;
-            imageInfo.descriptor.writeSet.descriptorType = imageInfo.descriptor.layoutBinding.descriptorType;
-            imageInfo.descriptor.writeSet.descriptorCount = 1;
-            imageInfo.descriptor.writeSet.pImageInfo = &imageInfo.imageInfo;
-            writes.push_back(imageInfo.descriptor.writeSet);
-            m_deviceFuncs->vkUpdateDescriptorSets(m_main->Device(), uint32_t(writes.size()), writes.data(), 0, nullptr);
+        imageInfo.descriptor.layoutBinding.stageFlags = reinterpret_cast<const SpvDescriptorGroup*>(imageInfo.descriptor.resource->group)->stageFlags;
+        return VPA_OK;
+    }
+
+    VPAError Descriptors::AcquireSampler(const ImageInfo& imageInfo, VkSampler& sampler) {
+        const float lodBias = qBound(-m_limits.maxSamplerLodBias, m_textureConfig.lodBias, m_limits.maxSamplerLodBias);
+        return m_samplers->Acquire(SamplerCache::MakeCreateInfo(imageInfo.samplerState, lodBias, float(imageInfo.mipLevels)), sampler);
+    }
+
+    void Descriptors::UpdateSamplers(uint32_t set) {
+        // Loads in progress have a sampler once their upload is submitted, it is replaced before they are swapped in
+        for (PendingImage* pending : m_pendingImages) {
+            VkSampler sampler = VK_NULL_HANDLE;
+            if (pending->set != set || !pending->uploaded || AcquireSampler(pending->image, sampler) != VPA_OK) continue;
+            m_samplers->Release(pending->image.sampler);
+            pending->image.sampler = sampler;
+            pending->image.imageInfo.sampler = sampler;
+        }
+
+        QVector<ImageInfo>& images = m_images[set];
+        QVector<VkSampler> samplers(images.size(), VK_NULL_HANDLE);
+        for (int i = 0; i < images.size(); ++i) {
+            if (Reserved(images[i]) || AcquireSampler(images[i], samplers[i]) == VPA_OK) continue;
+            for (VkSampler& sampler : samplers) m_samplers->Release(sampler);
+            return;
+        }
+        // The set may be bound by a frame in flight, so the new samplers are written to a copy of it. Unchanged samplers are the same handle.
+        if (RenewShaderSet(set) != VPA_OK) {
+            for (VkSampler& sampler : samplers) m_samplers->Release(sampler);
+            return;
+        }
+        QVector<DescriptorData>& data = m_setData[m_descriptorSetIndexMap[set]];
+        for (int i = 0; i < images.size(); ++i) {
+            if (Reserved(images[i])) continue;
+            m_samplers->Release(images[i].sampler);
+            images[i].sampler = samplers[i];
+            images[i].imageInfo.sampler = samplers[i];
+            data[int(images[i].descriptor.dataIndex)].image = images[i].imageInfo;
+        }
+        // One template update rewrites every image in the set
+        if (!WriteSetWithTemplate(set)) {
+            for (ImageInfo& image : images) {
+                if (!Reserved(image)) WriteImageDescriptor(image);
+            }
+        }
+        m_main->RequestUpdate();
+    }
+
+    void Descriptors::ReplaceImage(uint32_t set, int index, ImageInfo& newImage) {
+        // The set may be bound by a frame in flight, so the new image is written to a copy of it. No frame uses a reserved element, so it's written in place.
+        if (!Reserved(m_images[set][index]) && RenewShaderSet(set) != VPA_OK) {
+            DestroyImage(newImage);
+            return;
+        }
+        ImageInfo& imageInfo = m_images[set][index];
+        RetireImage(imageInfo);
+        imageInfo = newImage;
+        WriteImage(imageInfo);
+        m_textures->RememberBinding(BindingKey(imageInfo.descriptor), imageInfo.source, imageInfo.samplerState);
+        m_main->RequestUpdate();
+    }
+
+    void Descriptors::WriteImage(ImageInfo& imageInfo) {
+        m_setData[m_descriptorSetIndexMap[imageInfo.descriptor.set]][int(imageInfo.descriptor.dataIndex)].image = imageInfo.imageInfo;
+        if (!WriteSetWithTemplate(imageInfo.descriptor.set)) WriteImageDescriptor(imageInfo);
+    }
+
+    void Descriptors::WriteImageDescriptor(ImageInfo& imageInfo) {
+        imageInfo.descriptor.writeSet = {};
+        imageInfo.descriptor.writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        imageInfo.descriptor.writeSet.dstSet = m_descriptorSets[m_descriptorSetIndexMap[imageInfo.descriptor.set]];
+        imageInfo.descriptor.writeSet.dstBinding = imageInfo.descriptor.binding;
+        imageInfo.descriptor.writeSet.dstArrayElement = imageInfo.descriptor.arrayElement;
+        imageInfo.descriptor.writeSet.descriptorType = imageInfo.descriptor.layoutBinding.descriptorType;
+        imageInfo.descriptor.writeSet.descriptorCount = 1;
+        imageInfo.descriptor.writeSet.pImageInfo = &imageInfo.imageInfo;
+        m_deviceFuncs->vkUpdateDescriptorSets(m_main->Device(), 1, &imageInfo.descriptor.writeSet, 0, nullptr);
+    }
+
+    bool Descriptors::WriteSetWithTemplate(uint32_t set) {
+        if (Pushed(set)) return true;
+        const int setIndex = m_descriptorSetIndexMap[set];
+        VkDescriptorUpdateTemplateKHR updateTemplate = m_layouts->UpdateTemplate(m_descriptorLayouts[setIndex]);
+        if (updateTemplate == VK_NULL_HANDLE) return false;
+        m_main->Details().extensionFunctions.vkUpdateDescriptorSetWithTemplateKHR(m_main->Device(), m_descriptorSets[setIndex], updateTemplate, m_setData[setIndex].constData());
+        return true;
+    }
+
+    bool Descriptors::Pushed(uint32_t set) const {
+        return m_descriptorConfig.pushDescriptorSet >= 0 && uint32_t(m_descriptorConfig.pushDescriptorSet) == set
+                && m_main->Details().extensionFunctions.vkCmdPushDescriptorSetKHR;
+    }
+
+    VPAError Descriptors::AllocateSet(VkDescriptorSetLayout layout, VkDescriptorSet& set) {
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        VkResult result = m_deviceFuncs->vkAllocateDescriptorSets(m_main->Device(), &allocInfo, &set);
+        if (result != VK_SUCCESS) {
+            // Every spare copy is still held by a frame in flight
+            m_main->WaitForFramesInFlight();
+            result = m_deviceFuncs->vkAllocateDescriptorSets(m_main->Device(), &allocInfo, &set);
+        }
+        VPA_VKCRITICAL_PASS(result, "allocate replacement descriptor set");
+        return VPA_OK;
+    }
+
+    VPAError Descriptors::RenewShaderSet(uint32_t set) {
+        // Pushes are recorded by value, so frames in flight never see later writes
+        if (Pushed(set)) return VPA_OK;
+        int setIndex = m_descriptorSetIndexMap[set];
+        VkDescriptorSet oldSet = m_descriptorSets[setIndex];
+        VkDescriptorSet newSet = VK_NULL_HANDLE;
+        VPA_PASS_ERROR(AllocateSet(m_descriptorLayouts[setIndex], newSet));
+
+        QVector<VkCopyDescriptorSet> copies;
+        // Images are copied an element at a time, as reserved elements of a runtime array and those past the last one added were never written
+        auto addCopy = [&copies, oldSet, newSet](const DescriptorInfo& descriptor, uint32_t count) {
+            VkCopyDescriptorSet copy = {};
+            copy.sType = VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET;
+            copy.srcSet = oldSet;
+            copy.srcBinding = descriptor.binding;
+            copy.srcArrayElement = descriptor.arrayElement;
+            copy.dstSet = newSet;
+            copy.dstBinding = descriptor.binding;
+            copy.dstArrayElement = descriptor.arrayElement;
+            copy.descriptorCount = count;
+            copies.push_back(copy);
+        };
+        for (const BufferInfo& buffer : m_buffers[set]) addCopy(buffer.descriptor, buffer.descriptor.layoutBinding.descriptorCount);
+        for (const ImageInfo& image : m_images[set]) {
+            if (!Reserved(image)) addCopy(image.descriptor, 1);
         }
+        m_deviceFuncs->vkUpdateDescriptorSets(m_main->Device(), 0, nullptr, uint32_t(copies.size()), copies.data());
+
+        RetireSet(oldSet);
+        m_descriptorSets[setIndex] = newSet;
         return VPA_OK;
     }
 
+    void Descriptors::RetireSet(VkDescriptorSet set) {
+        if (set == VK_NULL_HANDLE) return;
+        VkDevice device = m_main->Device();
+        VkDescriptorPool pool = m_descriptorPool;
+        QVulkanDeviceFunctions* funcs = m_deviceFuncs;
+        m_main->Retire([device, pool, funcs, set]() { funcs->vkFreeDescriptorSets(device, pool, 1, &set); });
+    }
+
+    void Descriptors::RetireImage(ImageInfo& imageInfo) {
+        // Destroying the sampler is deferred by the cache
+        m_samplers->Release(imageInfo.sampler);
+        // Shared images stay resident until the cache evicts them
+        if (m_textures->Release(imageInfo)) return;
+        m_main->RetireHandle(imageInfo.view, &QVulkanDeviceFunctions::vkDestroyImageView);
+        MemoryAllocator* allocator = m_allocator;
+        Allocation allocation = imageInfo.descriptor.allocation;
+        m_main->Retire([allocator, allocation]() mutable { allocator->Deallocate(allocation); });
+        imageInfo.descriptor.allocation = Allocation();
+    }
+
     void Descriptors::WriteShaderDescriptors() {
+        for (auto& buffers : m_buffers) {
+            for (const BufferInfo& buffer : buffers) {
+                m_setData[m_descriptorSetIndexMap[buffer.descriptor.set]][int(buffer.descriptor.dataIndex)].buffer = buffer.bufferInfo;
+            }
+        }
+        for (auto& images : m_images) {
+            for (const ImageInfo& image : images) {
+                m_setData[m_descriptorSetIndexMap[image.descriptor.set]][int(image.descriptor.dataIndex)].image = image.imageInfo;
+            }
+        }
+        bool templated = true;
+        for (uint32_t set : m_descriptorSetIndexMap.keys()) templated &= WriteSetWithTemplate(set);
+        if (templated) return;
+
         QVector<VkWriteDescriptorSet> writes;
         for (auto& buffers : m_buffers) {
             for (BufferInfo& buffer : buffers) {
+                if (Pushed(buffer.descriptor.set)) continue;
                 buffer.descriptor.writeSet = {};
                 buffer.descriptor.writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
                 buffer.descriptor.writeSet.dstSet = m_descriptorSets[m_descriptorSetIndexMap[buffer.descriptor.set]];
@@ -379,11 +1084,12 @@ namespace vpa {
 
         for (auto& images : m_images) {
             for (ImageInfo& image : images) {
+                if (Pushed(image.descriptor.set)) continue;
                 image.descriptor.writeSet = {};
                 image.descriptor.writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
                 image.descriptor.writeSet.dstSet = m_descriptorSets[m_descriptorSetIndexMap[image.descriptor.set]];
                 image.descriptor.writeSet.dstBinding = image.descriptor.binding;
-                image.descriptor.writeSet.dstArrayElement = 0;
+                image.descriptor.writeSet.dstArrayElement = image.descriptor.arrayElement;
                 image.descriptor.writeSet.descriptorType = image.descriptor.layoutBinding.descriptorType;
                 image.descriptor.writeSet.descriptorCount = 1;
                 image.descriptor.writeSet.pImageInfo = &image.imageInfo;
@@ -429,7 +1135,8 @@ namespace vpa {
     }
 
     void Descriptors::DestroyImage(ImageInfo& imageInfo) {
-        DESTROY_HANDLE(m_main->Device(), imageInfo.sampler, m_deviceFuncs->vkDestroySampler);
+        m_samplers->Release(imageInfo.sampler);
+        if (m_textures->Release(imageInfo)) return;
         DESTROY_HANDLE(m_main->Device(), imageInfo.view, m_deviceFuncs->vkDestroyImageView);
         m_allocator->Deallocate(imageInfo.descriptor.allocation);
     }
@@ -458,11 +1165,13 @@ namespace vpa {
         return DefaultProjectionMatrix() * DefaultViewMatrix() * DefaultModelMatrix();
     }
 
-    VkImageCreateInfo Descriptors::MakeImageCreateInfo(const SpvImageType* type, uint32_t width, uint32_t height, uint32_t depth) const {
+    VkImageCreateInfo Descriptors::MakeImageCreateInfo(const SpvImageType* type, uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels) const {
         VkImageCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         createInfo.usage = type->sampled ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_STORAGE_BIT;
         createInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        // Each level is blitted from the one above
+        if (mipLevels > 1) createInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
         createInfo.flags = 0;
         createInfo.pNext = nullptr;
 
@@ -471,7 +1180,7 @@ namespace vpa {
         createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
         createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         createInfo.imageType = VK_IMAGE_TYPE_2D;
-        createInfo.mipLevels = 1;
+        createInfo.mipLevels = mipLevels;
         createInfo.arrayLayers = 1;
         createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -3,19 +3,30 @@
 
 #include <QVector>
 #include <QHash>
+#include <QSet>
 #include <QMap>
 #include <QMatrix4x4>
+#include <QImage>
+#include <QFutureWatcher>
 
 #include "../common.h"
 #include "spirvresource.h"
 #include "memoryallocator.h"
+#include "pipelineconfig.h"
+#include "samplercache.h"
+#include "descriptorcache.h"
 
 namespace vpa {
     class VulkanMain;
+    class TextureCache;
 
     struct DescriptorInfo {
         uint32_t set = 0;
         uint32_t binding = 0;
+        uint32_t dataIndex = 0; // Position in the packed update data of the set
+        uint32_t arrayElement = 0; // Each element of an array of images has its own ImageInfo
+        uint32_t arraySize = 1; // Descriptors in the binding, the capacity of runtime arrays
+        bool bindless = false; // Runtime array with a partially bound update after bind binding, only elements added so far are written
         VkDescriptorSetLayoutBinding layoutBinding;
         VkWriteDescriptorSet writeSet;
         SpvGroupName type;
@@ -27,13 +38,79 @@ namespace vpa {
         VkDescriptorBufferInfo bufferInfo;
         VkBufferUsageFlags usage = 0;
         DescriptorInfo descriptor;
+        bool dynamic = false; // Bound at a dynamic offset in to the ring of the Descriptors rather than having its own allocation
+        QVector<unsigned char> hostData; // What MapBufferPointer hands out for dynamic buffers, copied in to the ring every frame
     };
 
     struct ImageInfo {
         VkDescriptorImageInfo imageInfo;
         VkImageView view = VK_NULL_HANDLE;
-        VkSampler sampler = VK_NULL_HANDLE;
+        VkSampler sampler = VK_NULL_HANDLE; // Owned by the sampler cache
+        SamplerState samplerState;
         DescriptorInfo descriptor;
+        QString source;
+        uint32_t mipLevels = 1;
+        MipGeneration mipGeneration = MipGeneration::None; // What was actually used after any fallback
+        bool precompressed = false; // Every level and layer read as stored from a KTX2 or DDS file
+        bool transcoded = false; // Encoded to BCn and read back from the texture cache
+        bool cacheHit = false;
+        float transcodeMilliseconds = 0.0f; // 0 when read from the cache
+        float uploadMilliseconds = 0.0f; // Including mip generation
+        float mipMilliseconds = 0.0f; // GPU time of blits, CPU time of downsampling. Background loads have their blits timed once the upload completes
+        QString residentKey; // Set when the image and view are owned by the texture cache
+    };
+
+    // What DecodeImage needs to know about the device and descriptor, worked out on the GUI thread
+    struct DecodeSettings {
+        TextureConfig textures;
+        bool sampled = true;
+        bool transcode = false; // Transcoding is enabled and BC1 and BC3 can be sampled
+        bool blit = false; // Mips of RGBA8 images can be blitted
+    };
+
+    // The host side of loading an image, which can run on a worker thread
+    struct DecodedImage {
+        QString source;
+        QString path; // What is uploaded, either source or its transcoded copy in the texture cache
+        bool container = false;
+        QVector<QImage> levels; // Only for images decoded through QImage, any further levels are blitted
+        uint32_t mipLevels = 1;
+        MipGeneration mipGeneration = MipGeneration::None;
+        bool transcoded = false;
+        bool cacheHit = false;
+        float transcodeMilliseconds = 0.0f;
+        float mipMilliseconds = 0.0f;
+        QString error; // VPAError::lastMessage isn't safe to set off the GUI thread
+        QString warning; // Transcoding failed and the image was decoded as is, reported once back on the GUI thread
+    };
+
+    // An image loaded in the background, the one it replaces stays bound until its upload has completed
+    struct PendingImage {
+        uint32_t set = 0;
+        int index = 0;
+        QString source;
+        QString residentKey; // Where the image goes in the texture cache once swapped in, empty for storage images
+        bool superseded = false; // Another image was loaded for the same descriptor before this one was swapped in
+        bool uploaded = false;
+        QFutureWatcher<DecodedImage> decode;
+        ImageInfo image;
+        PendingTransfer transfer;
+    };
+
+    struct TextureStatistics {
+        uint32_t imageCount = 0;
+        uint32_t maxMipLevels = 0;
+        VkDeviceSize bytes = 0; // Every level of every image
+        uint32_t generated[size_t(MipGeneration::Count_)] = {}; // Images per mip generation method
+        uint32_t precompressed = 0;
+        uint32_t transcoded = 0;
+        uint32_t cacheHits = 0;
+        float transcodeMilliseconds = 0.0f;
+        float uploadMilliseconds = 0.0f;
+        float mipMilliseconds = 0.0f;
+        bool blitsTimed = false; // The transfer queue writes timestamps, without them blits count as 0 ms
+        uint32_t arrayImages = 0; // Loaded in to runtime arrays
+        uint32_t arrayCapacity = 0; // Descriptors of every runtime array
     };
 
     struct PushConstantInfo {
@@ -51,21 +128,45 @@ namespace vpa {
         static constexpr float NearPlane = 1.0f;
         static constexpr float FarPlane = 100.0f;
     public:
-        Descriptors(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs, MemoryAllocator* allocator, uint32_t attachmentCount,
-                    const DescriptorLayoutMap& layoutMap, const QVector<SpvResource*>& pushConstants, VkPhysicalDeviceLimits limits, VPAError& err);
+        Descriptors(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs, MemoryAllocator* allocator, SamplerCache* samplers, TextureCache* textures,
+                    DescriptorCache* layouts, uint32_t attachmentCount, const DescriptorLayoutMap& layoutMap, const QVector<SpvResource*>& pushConstants, VkPhysicalDeviceLimits limits, const TextureConfig& textureConfig,
+                    const DescriptorConfig& descriptorConfig, VPAError& err);
         ~Descriptors();
 
         const QHash<uint32_t, QVector<BufferInfo>>& Buffers() const { return m_buffers; }
         const QHash<uint32_t, QVector<ImageInfo>>& Images() const { return m_images; }
         const QMap<ShaderStage, PushConstantInfo>& PushConstants() const { return m_pushConstants; }
+        // Time taken by the constructor, which is most of a shader reload
+        float BuildMilliseconds() const { return m_buildMilliseconds; }
+        uint32_t DynamicBufferCount() const { return uint32_t(m_dynamicBuffers.size()); }
+        // Shader set number of the set pushed in to the command buffer, -1 if every set is allocated
+        int PushedSet() const { return m_pushSetIndex < 0 ? -1 : m_descriptorConfig.pushDescriptorSet; }
+        VkDeviceSize RingBytes() const { return m_ring.size; }
+        // Identifies the binding across shader reloads
+        static QString BindingKey(const DescriptorInfo& descriptor);
 
         unsigned char* MapBufferPointer(uint32_t set, int index);
         void UnmapBufferPointer(uint32_t set, int index);
+        // Decodes on the global thread pool and uploads without waiting, the previous image is used until the new one is resident
         void LoadImage(const uint32_t set, const int index, const QString name);
+        // Swaps in images from LoadImage which have finished uploading, called before the sets are bound for a frame
+        void CompletePendingImages();
+        // Reserves the element after the last one of the runtime array holding the image at index and loads the image in to it like LoadImage. The binding is
+        // update after bind and partially bound, so the current set is written in place once it's uploaded and no layout, set or pipeline is rebuilt.
+        // newIndex is the new image's index in the set.
+        VPAError AddArrayImage(uint32_t set, int index, const QString& name, int& newIndex);
+        // Copies dynamic buffers in to the ring slice of the frame in flight, whose previous use has completed, and selects it for CmdBindSets
+        void WriteDynamicBuffers(uint32_t frameIndex);
+        // Reloads every image from its source with the new mip settings, synchronously so the mip timings can be compared.
+        // Changing only the LOD bias swaps the samplers and the residency budget only trims the texture cache, neither reloads the images.
+        void SetTextureConfig(const TextureConfig& textures);
+        void SetSamplerState(uint32_t set, int index, const SamplerState& state);
+        TextureStatistics Statistics() const;
         unsigned char* PushConstantData(ShaderStage stage);
         // CompletePushConstantData should be called after modifying any push constant data to update the display.
         void CompletePushConstantData();
 
+        // The pushed set's writes are rebuilt each time, which is the recording cost push descriptors trade the set updates for
         void CmdBindSets(VkCommandBuffer cmdBuf, VkPipelineLayout pipelineLayout) const;
         void CmdPushConstants(VkCommandBuffer cmdBuf, VkPipelineLayout pipelineLayout) const;
 
@@ -74,6 +175,8 @@ namespace vpa {
 
         VkDescriptorSetLayout* BuiltInSetLayout(BuiltInSets set) { return &m_builtInLayouts[int(set)]; }
         VkDescriptorSet BuiltInSet(BuiltInSets set) const { return m_builtInSets[int(set)]; }
+        // Replaces a built in set with a newly allocated one, the old set is freed when frames using it complete
+        VPAError RenewBuiltInSet(BuiltInSets set);
 
         static const QMatrix4x4 DefaultModelMatrix();
         static const QMatrix4x4 DefaultViewMatrix();
@@ -86,9 +189,39 @@ namespace vpa {
 
         VPAError Validate(size_t numSets, const QVector<VkDescriptorPoolSize>& poolSizes);
         VPAError BuildDescriptors(QSet<uint32_t>& sets, QVector<VkDescriptorPoolSize>& poolSizes, const DescriptorLayoutMap& layoutMap);
+        // Every element of a sized array is loaded, runtime arrays only have the elements they had before the shaders were reloaded
+        VPAError BuildImages(const DescriptorInfo& descriptor, QVector<VkDescriptorPoolSize>& poolSizes);
         VPAError CreateBuffer(DescriptorInfo& descriptor, const SpvResource* resource, BufferInfo& info);
+        // One slice per frame in flight, each holding every dynamic buffer at its own offset
+        VPAError CreateDynamicRing();
         VPAError CreateImage(ImageInfo& imageInfo, const QString& name, bool writeSet);
+        // The upload is left in flight when pending is given
+        VPAError CreateImage(ImageInfo& imageInfo, const DecodedImage& decoded, PendingTransfer* pending);
+        DecodeSettings MakeDecodeSettings(const ImageInfo& imageInfo) const;
+        // Empty for storage images, which shaders can write to so are never shared
+        static QString ResidentKey(const ImageInfo& imageInfo, const QString& name, const DecodeSettings& settings);
+        // Decoded through QImage to RGBA8 with a generated mip chain, or transcoded in to the texture cache
+        static DecodedImage DecodeImage(const QString& name, const DecodeSettings& settings);
+        VPAError UploadDecodedImage(ImageInfo& imageInfo, const DecodedImage& decoded, VkImageCreateInfo& createInfo, PendingTransfer* pending);
+        VPAError UploadContainerImage(ImageInfo& imageInfo, const QString& path, VkImageCreateInfo& createInfo, PendingTransfer* pending);
+        void ReplaceImage(uint32_t set, int index, ImageInfo& newImage);
+        VPAError AcquireSampler(const ImageInfo& imageInfo, VkSampler& sampler);
+        // Fills in the sampler and descriptor details once the view exists
+        VPAError CompleteImage(ImageInfo& imageInfo);
+        // Gives every image in the set a sampler matching its current state
+        void UpdateSamplers(uint32_t set);
         void WriteShaderDescriptors();
+        // Updates the packed data of the set and writes the set through its template, or just this binding without one
+        void WriteImage(ImageInfo& imageInfo);
+        void WriteImageDescriptor(ImageInfo& imageInfo);
+        // False if the layout of the set has no update template
+        bool WriteSetWithTemplate(uint32_t set);
+        // Pushed sets are only ever written by CmdBindSets, from the same packed data templates read
+        bool Pushed(uint32_t set) const;
+        VPAError AllocateSet(VkDescriptorSetLayout layout, VkDescriptorSet& set);
+        VPAError RenewShaderSet(uint32_t set);
+        void RetireSet(VkDescriptorSet set);
+        void RetireImage(ImageInfo& imageInfo);
 
         PushConstantInfo CreatePushConstant(SpvResource* resource);
         void BuildPushConstantRanges();
@@ -96,25 +229,43 @@ namespace vpa {
         VkPipelineStageFlags StageFlagsToPipelineFlags(VkShaderStageFlags stageFlags);
         void DestroyImage(ImageInfo& imageInfo);
 
-        VkImageCreateInfo MakeImageCreateInfo(const SpvImageType* type, uint32_t width, uint32_t height, uint32_t depth) const;
+        VkImageCreateInfo MakeImageCreateInfo(const SpvImageType* type, uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels) const;
 
         VulkanMain* m_main;
         QVulkanDeviceFunctions* m_deviceFuncs;
 
         MemoryAllocator* m_allocator;
+        SamplerCache* m_samplers;
+        TextureCache* m_textures;
+        DescriptorCache* m_layouts;
         QHash<uint32_t, QVector<BufferInfo>> m_buffers;
         QHash<uint32_t, QVector<ImageInfo>> m_images;
         QMap<ShaderStage, PushConstantInfo> m_pushConstants;
+        QVector<PendingImage*> m_pendingImages;
 
         QVector<VkPushConstantRange> m_pushConstantRanges;
         QHash<uint32_t, int> m_descriptorSetIndexMap;
         QVector<VkDescriptorSet> m_descriptorSets;
         QVector<VkDescriptorSetLayout> m_descriptorLayouts;
+        QVector<QVector<DescriptorData>> m_setData; // By set index, what the update templates read
         QVector<VkDescriptorSet> m_builtInSets;
         QVector<VkDescriptorSetLayout> m_builtInLayouts;
         VkDescriptorPool m_descriptorPool;
 
+        DescriptorConfig m_descriptorConfig;
+        int m_pushSetIndex; // Index in to the layouts of the set built with the push descriptor flag, which has no allocated set
+        int m_offsetsBeforePush; // Dynamic offsets of sets bound before the pushed set
+        QSet<uint32_t> m_bindlessSets; // Sets holding a runtime array, whose layouts are update after bind so can't have dynamic buffers
+        uint32_t m_bindlessDescriptors; // Counted against the update after bind limits rather than the usual ones
+        QVector<QPair<uint32_t, int>> m_dynamicBuffers; // Set and index in set then binding order, the order dynamic offsets are given in
+        QVector<uint32_t> m_dynamicOffsets;
+        Allocation m_ring;
+        unsigned char* m_ringData; // Mapped for as long as the ring exists
+        VkDeviceSize m_ringSlice;
+
         VkPhysicalDeviceLimits m_limits;
+        TextureConfig m_textureConfig;
+        float m_buildMilliseconds;
 
         static double s_aspectRatio;
     };
@@ -0,0 +1,232 @@
+#include "gltfparser.h"
+
+#include <QFileInfo>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QUrl>
+
+namespace vpa {
+    static constexpr uint32_t GlbMagic = 0x46546C67; // "glTF"
+    static constexpr uint32_t GlbJsonChunk = 0x4E4F534A; // "JSON"
+    static constexpr uint32_t GlbBinaryChunk = 0x004E4942; // "BIN"
+    static constexpr int TriangleMode = 4;
+
+    template<typename T>
+    static T ReadValue(const uchar* data) {
+        T value;
+        memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    static uint32_t ComponentsOf(const QString& type) {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        return 0;
+    }
+
+    uint32_t GltfAccessor::ComponentSize() const {
+        switch (componentType) {
+        case GltfComponentType::Byte:
+        case GltfComponentType::UnsignedByte:
+            return 1;
+        case GltfComponentType::Short:
+        case GltfComponentType::UnsignedShort:
+            return 2;
+        case GltfComponentType::UnsignedInt:
+        case GltfComponentType::Float:
+            return 4;
+        }
+        return 0;
+    }
+
+    void GltfAccessor::Read(uint32_t element, float* out) const {
+        const uchar* in = data + size_t(element) * stride;
+        for (uint32_t c = 0; c < components; ++c) {
+            switch (componentType) {
+            case GltfComponentType::Byte: {
+                float value = float(ReadValue<int8_t>(in + c));
+                out[c] = normalised ? qMax(value / 127.0f, -1.0f) : value;
+                break;
+            }
+            case GltfComponentType::UnsignedByte: {
+                float value = float(ReadValue<uint8_t>(in + c));
+                out[c] = normalised ? value / 255.0f : value;
+                break;
+            }
+            case GltfComponentType::Short: {
+                float value = float(ReadValue<int16_t>(in + 2 * c));
+                out[c] = normalised ? qMax(value / 32767.0f, -1.0f) : value;
+                break;
+            }
+            case GltfComponentType::UnsignedShort: {
+                float value = float(ReadValue<uint16_t>(in + 2 * c));
+                out[c] = normalised ? value / 65535.0f : value;
+                break;
+            }
+            case GltfComponentType::UnsignedInt:
+                out[c] = float(ReadValue<uint32_t>(in + 4 * c));
+                break;
+            case GltfComponentType::Float:
+                out[c] = ReadValue<float>(in + 4 * c);
+                break;
+            }
+        }
+    }
+
+    uint32_t GltfAccessor::ReadIndex(uint32_t element) const {
+        const uchar* in = data + size_t(element) * stride;
+        if (componentType == GltfComponentType::UnsignedByte) return ReadValue<uint8_t>(in);
+        if (componentType == GltfComponentType::UnsignedShort) return ReadValue<uint16_t>(in);
+        return ReadValue<uint32_t>(in);
+    }
+
+    GltfFile::~GltfFile() {
+        Close();
+    }
+
+    VPAError GltfFile::Open(const QString& path) {
+        Close();
+        qint64 size = 0;
+        const uchar* data = Map(path, size);
+        if (!data) return VPA_WARN("Could not map " + path);
+        QString directory = QFileInfo(path).absolutePath();
+
+        if (size < 12 || ReadValue<uint32_t>(data) != GlbMagic) {
+            return ParseJson(QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(size)), directory, { nullptr, 0 });
+        }
+
+        // Binary glTF, a JSON chunk optionally followed by the binary chunk which buffer 0 refers to
+        if (ReadValue<uint32_t>(data + 4) != 2) return VPA_WARN("Unsupported glb version in " + path);
+        qint64 length = qMin(qint64(ReadValue<uint32_t>(data + 8)), size);
+        QByteArray json;
+        Buffer binary = { nullptr, 0 };
+        for (qint64 offset = 12; offset + 8 <= length;) {
+            uint32_t chunkLength = ReadValue<uint32_t>(data + offset);
+            uint32_t chunkType = ReadValue<uint32_t>(data + offset + 4);
+            if (offset + 8 + chunkLength > length) return VPA_WARN("Truncated glb chunk in " + path);
+            const uchar* chunk = data + offset + 8;
+            if (chunkType == GlbJsonChunk && json.isEmpty()) json = QByteArray::fromRawData(reinterpret_cast<const char*>(chunk), int(chunkLength));
+            else if (chunkType == GlbBinaryChunk && !binary.data) binary = { chunk, qint64(chunkLength) };
+            offset += 8 + chunkLength;
+        }
+        if (json.isEmpty()) return VPA_WARN("No JSON chunk in " + path);
+        return ParseJson(json, directory, binary);
+    }
+
+    void GltfFile::Close() {
+        for (QFile* file : m_files) {
+            file->close();
+            delete file;
+        }
+        m_files.clear();
+        m_embeddedBuffers.clear();
+        m_buffers.clear();
+        m_primitives.clear();
+    }
+
+    const uchar* GltfFile::Map(const QString& path, qint64& size) {
+        QFile* file = new QFile(path);
+        if (!file->open(QIODevice::ReadOnly) || file->size() == 0) {
+            delete file;
+            return nullptr;
+        }
+        size = file->size();
+        const uchar* data = file->map(0, size);
+        if (!data) {
+            delete file;
+            return nullptr;
+        }
+        m_files.push_back(file);
+        return data;
+    }
+
+    VPAError GltfFile::ParseJson(const QByteArray& json, const QString& directory, const Buffer& glbBinary) {
+        QJsonParseError parseError;
+        QJsonDocument document = QJsonDocument::fromJson(json, &parseError);
+        if (document.isNull()) return VPA_WARN("Invalid glTF JSON: " + parseError.errorString());
+        const QJsonObject root = document.object();
+
+        // Buffers are mapped in place, embedded base64 ones have to be decoded
+        for (const QJsonValue& value : root["buffers"].toArray()) {
+            const QJsonObject buffer = value.toObject();
+            QString uri = buffer["uri"].toString();
+            qint64 byteLength = qint64(buffer["byteLength"].toDouble());
+            Buffer mapped = { nullptr, 0 };
+            if (uri.isEmpty()) {
+                mapped = glbBinary;
+            }
+            else if (uri.startsWith("data:")) {
+                m_embeddedBuffers.push_back(QByteArray::fromBase64(uri.mid(uri.indexOf(',') + 1).toLatin1()));
+                mapped = { reinterpret_cast<const uchar*>(m_embeddedBuffers.last().constData()), qint64(m_embeddedBuffers.last().size()) };
+            }
+            else {
+                mapped.data = Map(QDir(directory).filePath(QUrl::fromPercentEncoding(uri.toUtf8())), mapped.size);
+            }
+            if (!mapped.data || mapped.size < byteLength) return VPA_WARN("Missing or truncated glTF buffer " + uri);
+            m_buffers.push_back(mapped);
+        }
+
+        const QJsonArray bufferViews = root["bufferViews"].toArray();
+        const QJsonArray accessors = root["accessors"].toArray();
+        auto makeAccessor = [this, &bufferViews, &accessors](int index, GltfAccessor& accessor) -> VPAError {
+            if (index < 0 || index >= accessors.size()) return VPA_WARN("glTF accessor " + QString::number(index) + " out of range");
+            const QJsonObject object = accessors[index].toObject();
+            if (object.contains("sparse")) return VPA_WARN("Sparse glTF accessors are not supported");
+            if (!object.contains("bufferView")) return VPA_WARN("glTF accessors without a buffer view are not supported");
+            accessor.count = uint32_t(object["count"].toInt());
+            accessor.components = ComponentsOf(object["type"].toString());
+            accessor.componentType = GltfComponentType(object["componentType"].toInt());
+            accessor.normalised = object["normalized"].toBool(false);
+            if (accessor.components == 0 || accessor.ComponentSize() == 0) return VPA_WARN("Unsupported glTF accessor type " + object["type"].toString());
+
+            int viewIndex = object["bufferView"].toInt();
+            if (viewIndex < 0 || viewIndex >= bufferViews.size()) return VPA_WARN("glTF buffer view " + QString::number(viewIndex) + " out of range");
+            const QJsonObject view = bufferViews[viewIndex].toObject();
+            int bufferIndex = view["buffer"].toInt();
+            if (bufferIndex < 0 || bufferIndex >= m_buffers.size()) return VPA_WARN("glTF buffer " + QString::number(bufferIndex) + " out of range");
+            qint64 viewOffset = qint64(view["byteOffset"].toDouble(0));
+            qint64 viewLength = qint64(view["byteLength"].toDouble());
+            qint64 accessorOffset = qint64(object["byteOffset"].toDouble(0));
+            accessor.stride = view.contains("byteStride") ? uint32_t(view["byteStride"].toInt()) : accessor.ElementSize();
+
+            // Every element has to lie within the view and the view within the buffer
+            qint64 span = accessor.count > 0 ? qint64(accessor.count - 1) * accessor.stride + accessor.ElementSize() : 0;
+            if (viewOffset + viewLength > m_buffers[bufferIndex].size || accessorOffset + span > viewLength) return VPA_WARN("glTF accessor exceeds its buffer view");
+            accessor.data = m_buffers[bufferIndex].data + viewOffset + accessorOffset;
+            return VPA_OK;
+        };
+
+        // Node transforms aren't applied, every primitive is drawn in its mesh's own space
+        for (const QJsonValue& mesh : root["meshes"].toArray()) {
+            for (const QJsonValue& value : mesh.toObject()["primitives"].toArray()) {
+                const QJsonObject object = value.toObject();
+                if (object["mode"].toInt(TriangleMode) != TriangleMode) {
+                    qDebug("Skipping glTF primitive which isn't a triangle list");
+                    continue;
+                }
+                GltfPrimitive primitive;
+                const QJsonObject attributes = object["attributes"].toObject();
+                for (auto it = attributes.constBegin(); it != attributes.constEnd(); ++it) {
+                    GltfAccessor accessor;
+                    VPA_PASS_ERROR(makeAccessor(it.value().toInt(), accessor));
+                    primitive.attributes.insert(it.key(), accessor);
+                }
+                if (!primitive.attributes.contains("POSITION")) continue;
+                if (object.contains("indices")) {
+                    VPA_PASS_ERROR(makeAccessor(object["indices"].toInt(), primitive.indices));
+                    if (primitive.indices.components != 1 || (primitive.indices.componentType != GltfComponentType::UnsignedByte
+                            && primitive.indices.componentType != GltfComponentType::UnsignedShort && primitive.indices.componentType != GltfComponentType::UnsignedInt)) {
+                        return VPA_WARN("Invalid glTF index accessor");
+                    }
+                }
+                m_primitives.push_back(primitive);
+            }
+        }
+        if (m_primitives.isEmpty()) return VPA_WARN("No triangle primitives with positions in glTF file");
+        return VPA_OK;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef GLTFPARSER_H
+#define GLTFPARSER_H
+
+#include <QVector>
+#include <QHash>
+#include <QFile>
+
+#include "../common.h"
+
+namespace vpa {
+    // Component types as the GL enums glTF stores them as
+    enum class GltfComponentType : uint32_t {
+        Byte = 5120,
+        UnsignedByte = 5121,
+        Short = 5122,
+        UnsignedShort = 5123,
+        UnsignedInt = 5125,
+        Float = 5126
+    };
+
+    // A view of accessor elements in the mapped file, nothing is copied out of the buffer
+    struct GltfAccessor {
+        const uchar* data = nullptr; // First element
+        uint32_t count = 0;
+        uint32_t stride = 0; // Bytes from one element to the next
+        uint32_t components = 0;
+        GltfComponentType componentType = GltfComponentType::Float;
+        bool normalised = false;
+
+        uint32_t ComponentSize() const;
+        uint32_t ElementSize() const { return components * ComponentSize(); }
+        bool Tight() const { return stride == ElementSize(); }
+        // Converts an element to floats, normalised integers are decoded as glTF specifies. Unused components of out are left untouched.
+        void Read(uint32_t element, float* out) const;
+        uint32_t ReadIndex(uint32_t element) const;
+    };
+
+    // A triangle list primitive, attributes are keyed by semantic such as POSITION or TEXCOORD_0
+    struct GltfPrimitive {
+        QHash<QString, GltfAccessor> attributes;
+        GltfAccessor indices; // Count of 0 for non indexed primitives
+    };
+
+    // Maps a .glb, or a .gltf and its external buffers, and exposes the triangle primitives of every mesh.
+    // Accessors point in to the mapping so the file must stay open while they are used.
+    class GltfFile final {
+    public:
+        GltfFile() = default;
+        ~GltfFile();
+
+        VPAError Open(const QString& path);
+        void Close();
+
+        const QVector<GltfPrimitive>& Primitives() const { return m_primitives; }
+
+    private:
+        struct Buffer {
+            const uchar* data;
+            qint64 size;
+        };
+
+        VPAError ParseJson(const QByteArray& json, const QString& directory, const Buffer& glbBinary);
+        const uchar* Map(const QString& path, qint64& size);
+
+        QVector<QFile*> m_files;
+        QVector<QByteArray> m_embeddedBuffers; // Decoded data uris, the only buffers which are copied
+        QVector<Buffer> m_buffers;
+        QVector<GltfPrimitive> m_primitives;
+    };
+}
+
+#endif // GLTFPARSER_H
@@ -5,12 +5,17 @@
 #include <QImage>
 #include <QMessageBox>
 #include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
 
 #include "common.h"
 #include "vulkanmain.h"
 
 namespace vpa {
-    MemoryAllocator::MemoryAllocator(QVulkanDeviceFunctions* deviceFuncs, VulkanMain* main, VPAError& err) : m_deviceFuncs(deviceFuncs), m_main(main) {
+    MemoryAllocator::MemoryAllocator(QVulkanDeviceFunctions* deviceFuncs, VulkanMain* main, VPAError& err)
+        : m_deviceFuncs(deviceFuncs), m_main(main), m_transferQueueGraphics(false), m_transferTimestampBits(0) {
         QVulkanFunctions* funcs = m_main->Details().functions;
         uint32_t queueCount = 0;
         funcs->vkGetPhysicalDeviceQueueFamilyProperties(m_main->Details().physicalDevice, &queueCount, nullptr);
@@ -19,6 +24,8 @@ namespace vpa {
         for (uint32_t i = 0; i < uint32_t(queueFamilies.size()); ++i) {
             if (queueFamilies[int(i)].queueFlags & VK_QUEUE_TRANSFER_BIT) {
                 m_transferQueueIdx = i;
+                m_transferQueueGraphics = (queueFamilies[int(i)].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+                m_transferTimestampBits = queueFamilies[int(i)].timestampValidBits;
                 break;
             } // TODO refactor this in to the main details
         }
@@ -38,6 +45,14 @@ namespace vpa {
         allocInfo.commandBufferCount = 1;
 
         VPA_VKCRITICAL_CTOR_PASS(m_deviceFuncs->vkAllocateCommandBuffers(m_main->Device(), &allocInfo, &m_commandBuffer), "command buffer allocation", err);
+
+        const VkPhysicalDeviceMemoryProperties& memoryProperties = m_main->Details().memoryProperties;
+        m_statistics.heaps.resize(int(memoryProperties.memoryHeapCount));
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i) {
+            m_statistics.heaps[int(i)].size = memoryProperties.memoryHeaps[i].size;
+            m_statistics.heaps[int(i)].flags = memoryProperties.memoryHeaps[i].flags;
+        }
+        m_statistics.budgetSupported = m_main->Details().memoryBudgetSupported;
     }
 
     MemoryAllocator::~MemoryAllocator() {
@@ -61,6 +76,7 @@ namespace vpa {
         allocation.name = name;
         allocation.type = AllocationType::Buffer;
         allocation.size = size;
+        allocation.ownsMemory = true;
 
         VkBufferCreateInfo bufInfo = {};
         bufInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -85,6 +101,9 @@ namespace vpa {
             Deallocate(allocation);
             return err;
         }
+        allocation.memorySize = memReq.size;
+        allocation.memoryTypeIndex = memAllocInfo.memoryTypeIndex;
+        TrackAllocation(allocation);
         VPA_VKCRITICAL(m_deviceFuncs->vkBindBufferMemory(m_main->Device(), allocation.buffer, allocation.memory, 0), qPrintable("bind buffer memory for allocation '" + allocation.name + "'"), err);
         if (err != VPA_OK) {
             Deallocate(allocation);
@@ -100,6 +119,7 @@ namespace vpa {
         allocation.name = name;
         allocation.type = AllocationType::Image;
         allocation.size = size;
+        allocation.ownsMemory = true;
 
         VPAError err = VPA_OK;
         VPA_VKCRITICAL(m_deviceFuncs->vkCreateImage(m_main->Device(), &createInfo, nullptr, &allocation.image), qPrintable("create image for allocation '" + allocation.name + "'"), err);
@@ -109,6 +129,7 @@ namespace vpa {
         }
         VkMemoryRequirements memReq;
         m_deviceFuncs->vkGetImageMemoryRequirements(m_main->Device(), allocation.image, &memReq);
+        if (allocation.size == 0) allocation.size = memReq.size; // Attachments have no pixel data so take their size from the requirements
 
         VkMemoryAllocateInfo memAllocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, memReq.size, m_main->Details().deviceLocalMemoryIndex };
 
@@ -117,6 +138,9 @@ namespace vpa {
             Deallocate(allocation);
             return err;
         }
+        allocation.memorySize = memReq.size;
+        allocation.memoryTypeIndex = memAllocInfo.memoryTypeIndex;
+        TrackAllocation(allocation);
         VPA_VKCRITICAL(m_deviceFuncs->vkBindImageMemory(m_main->Device(), allocation.image, allocation.memory, 0), qPrintable("bind image memory for allocation '" + allocation.name + "'"), err);
         if (err != VPA_OK) {
             Deallocate(allocation);
@@ -125,6 +149,67 @@ namespace vpa {
         return VPA_OK;
     }
 
+    VPAError MemoryAllocator::AllocateAliased(QVector<AliasedImageInfo>& images, QString name, Allocation& block, VkDeviceSize& unaliasedSize) {
+        block.name = name;
+        block.type = AllocationType::Image;
+        block.size = 0;
+        unaliasedSize = 0;
+
+        VPAError err = VPA_OK;
+        QVector<VkDeviceSize> offsets = QVector<VkDeviceSize>(images.size());
+        QMap<uint32_t, VkDeviceSize> groupSizes;
+        uint32_t typeBits = ~0U;
+        for (int i = 0; i < images.size(); ++i) {
+            Allocation& allocation = *images[i].allocation;
+            allocation.name = images[i].name;
+            allocation.type = AllocationType::Image;
+            allocation.ownsMemory = false;
+            VPA_VKCRITICAL(m_deviceFuncs->vkCreateImage(m_main->Device(), &images[i].createInfo, nullptr, &allocation.image), qPrintable("create image for aliased allocation '" + allocation.name + "'"), err);
+            if (err != VPA_OK) break;
+
+            VkMemoryRequirements memReq;
+            m_deviceFuncs->vkGetImageMemoryRequirements(m_main->Device(), allocation.image, &memReq);
+            allocation.size = memReq.size;
+            unaliasedSize += memReq.size;
+            typeBits &= memReq.memoryTypeBits;
+
+            // Each group is packed from the start of the block so groups overlap each other
+            VkDeviceSize& groupSize = groupSizes[images[i].group];
+            offsets[i] = (groupSize + memReq.alignment - 1) / memReq.alignment * memReq.alignment;
+            groupSize = offsets[i] + memReq.size;
+            block.size = qMax(block.size, groupSize);
+        }
+
+        uint32_t typeIndex = FindMemoryType(typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+        if (typeIndex == ~0U) typeIndex = FindMemoryType(typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (err == VPA_OK && typeIndex == ~0U) err = VPA_CRITICAL("No device local memory type can hold the images of aliased allocation '" + name + "'");
+
+        if (err == VPA_OK && block.size > 0) {
+            VkMemoryAllocateInfo memAllocInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, block.size, typeIndex };
+            VPA_VKCRITICAL(m_deviceFuncs->vkAllocateMemory(m_main->Device(), &memAllocInfo, nullptr, &block.memory), qPrintable("allocate memory for aliased allocation '" + name + "'"), err);
+            if (err == VPA_OK) {
+                block.memorySize = block.size;
+                block.memoryTypeIndex = typeIndex;
+                TrackAllocation(block);
+            }
+        }
+
+        for (int i = 0; i < images.size() && err == VPA_OK; ++i) {
+            Allocation& allocation = *images[i].allocation;
+            allocation.memory = block.memory;
+            allocation.memoryTypeIndex = typeIndex;
+            VPA_VKCRITICAL(m_deviceFuncs->vkBindImageMemory(m_main->Device(), allocation.image, block.memory, offsets[i]), qPrintable("bind image memory for aliased allocation '" + allocation.name + "'"), err);
+        }
+
+        if (err != VPA_OK) {
+            for (AliasedImageInfo& image : images) {
+                Deallocate(*image.allocation);
+            }
+            Deallocate(block);
+        }
+        return err;
+    }
+
     void MemoryAllocator::Deallocate(Allocation& allocation) {
         if (allocation.type == AllocationType::Buffer) {
             DESTROY_HANDLE(m_main->Device(), allocation.buffer, m_deviceFuncs->vkDestroyBuffer);
@@ -132,34 +217,187 @@ namespace vpa {
         else {
             DESTROY_HANDLE(m_main->Device(), allocation.image, m_deviceFuncs->vkDestroyImage);
         }
-        DESTROY_HANDLE(m_main->Device(), allocation.memory, m_deviceFuncs->vkFreeMemory);
+        if (allocation.ownsMemory) {
+            if (allocation.memory != VK_NULL_HANDLE) TrackDeallocation(allocation);
+            DESTROY_HANDLE(m_main->Device(), allocation.memory, m_deviceFuncs->vkFreeMemory);
+        }
+        else {
+            allocation.memory = VK_NULL_HANDLE;
+        }
         allocation.size = 0;
+        allocation.memorySize = 0;
     }
 
-    VPAError MemoryAllocator::TransferImageMemory(Allocation& imageAllocation, const VkExtent3D extent, const QImage& image, VkPipelineStageFlags finalStageFlags) {
-        Allocation stagingAllocation;
-        VPA_PASS_ERROR(Allocate(imageAllocation.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, "staging_buffer", stagingAllocation));
+    VPAError MemoryAllocator::TransferImageMemory(Allocation& imageAllocation, const VkExtent3D extent, const QVector<QImage>& levels, uint32_t mipLevels,
+                                                  VkPipelineStageFlags finalStageFlags, float& blitMilliseconds, PendingTransfer* pending) {
+        blitMilliseconds = 0.0f;
+        const uint32_t uploadedLevels = uint32_t(levels.size());
+        const bool blit = uploadedLevels < mipLevels;
+        if (uploadedLevels == 0 || (blit && !m_transferQueueGraphics)) return VPA_CRITICAL("Can't generate mip levels for allocation '" + imageAllocation.name + "'");
 
-        uint32_t rowLength = uint32_t(image.width()) * 4;
+        VkDeviceSize stagingSize = 0;
+        for (const QImage& level : levels) {
+            stagingSize += VkDeviceSize(level.width()) * VkDeviceSize(level.height()) * 4;
+        }
+        Allocation stagingAllocation;
+        VPA_PASS_ERROR(Allocate(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, "staging_buffer", stagingAllocation));
 
+        QVector<VkBufferImageCopy> copyRegions;
         unsigned char* stagingData = MapMemory(stagingAllocation);
-        for (int y = 0; y < image.height(); ++y) {
-            const unsigned char* line = image.constScanLine(y);
-            memcpy(stagingData, line, rowLength);
-            stagingData += rowLength;
+        VkDeviceSize bufferOffset = 0;
+        for (uint32_t i = 0; i < uploadedLevels; ++i) {
+            const QImage& level = levels[int(i)];
+            uint32_t rowLength = uint32_t(level.width()) * 4;
+            for (int y = 0; y < level.height(); ++y) {
+                memcpy(stagingData + bufferOffset + VkDeviceSize(y) * rowLength, level.constScanLine(y), rowLength);
+            }
+
+            VkBufferImageCopy copyRegion = {};
+            copyRegion.imageExtent = { uint32_t(level.width()), uint32_t(level.height()), extent.depth };
+            copyRegion.imageOffset = { 0, 0, 0 };
+            copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copyRegion.imageSubresource.mipLevel = i;
+            copyRegion.imageSubresource.layerCount = 1;
+            copyRegion.imageSubresource.baseArrayLayer = 0;
+            copyRegion.bufferOffset = bufferOffset;
+            copyRegion.bufferRowLength = 0;
+            copyRegion.bufferImageHeight = 0;
+            copyRegions.push_back(copyRegion);
+            bufferOffset += VkDeviceSize(rowLength) * VkDeviceSize(level.height());
         }
         UnmapMemory(stagingAllocation);
 
-        VkBufferImageCopy copyRegion = {};
-        copyRegion.imageExtent = extent;
-        copyRegion.imageOffset = { 0, 0, 0 };
-        copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copyRegion.imageSubresource.mipLevel = 0;
-        copyRegion.imageSubresource.layerCount = 1;
-        copyRegion.imageSubresource.baseArrayLayer = 0;
-        copyRegion.bufferOffset = 0;
-        copyRegion.bufferRowLength = 0;
-        copyRegion.bufferImageHeight = 0;
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = imageAllocation.image;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        auto levelBarrier = [this, &barrier, &commandBuffer](uint32_t baseLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout,
+                VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+            if (levelCount == 0) return;
+            barrier.subresourceRange.baseMipLevel = baseLevel;
+            barrier.subresourceRange.levelCount = levelCount;
+            barrier.oldLayout = oldLayout;
+            barrier.newLayout = newLayout;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstAccessMask = dstAccess;
+            m_deviceFuncs->vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        };
+
+        VPAError err = BeginTransfer(imageAllocation.name, pending, commandBuffer);
+        if (err != VPA_OK) {
+            Deallocate(stagingAllocation);
+            return err;
+        }
+
+        levelBarrier(0, mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+                     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        m_deviceFuncs->vkCmdCopyBufferToImage(commandBuffer, stagingAllocation.buffer, imageAllocation.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                              uint32_t(copyRegions.size()), copyRegions.data());
+
+        // TODO decide how to include storage image with  | VK_ACCESS_SHADER_WRITE_BIT
+        if (!blit) {
+            levelBarrier(0, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, finalStageFlags);
+            return SubmitTransfer(imageAllocation.name, commandBuffer, stagingAllocation, pending);
+        }
+
+        // Timestamps on either side of the blits, each is written once the transfers recorded before it have completed
+        VkQueryPool timestamps = VK_NULL_HANDLE;
+        if (m_transferTimestampBits > 0) {
+            VkQueryPoolCreateInfo queryInfo = {};
+            queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryInfo.queryCount = 2;
+            if (m_deviceFuncs->vkCreateQueryPool(m_main->Device(), &queryInfo, nullptr, &timestamps) != VK_SUCCESS) timestamps = VK_NULL_HANDLE;
+        }
+        if (timestamps != VK_NULL_HANDLE) {
+            m_deviceFuncs->vkCmdResetQueryPool(commandBuffer, timestamps, 0, 2);
+            m_deviceFuncs->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, timestamps, 0);
+        }
+
+        int32_t width = levels.last().width();
+        int32_t height = levels.last().height();
+        for (uint32_t level = uploadedLevels; level < mipLevels; ++level) {
+            levelBarrier(level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+            VkImageBlit region = {};
+            region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+            region.srcOffsets[1] = { width, height, 1 };
+            width = qMax(width / 2, 1);
+            height = qMax(height / 2, 1);
+            region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+            region.dstOffsets[1] = { width, height, 1 };
+            m_deviceFuncs->vkCmdBlitImage(commandBuffer, imageAllocation.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                          imageAllocation.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+        }
+        if (timestamps != VK_NULL_HANDLE) m_deviceFuncs->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, timestamps, 1);
+
+        // Uploaded levels before the last are still transfer destinations, as is the smallest level
+        levelBarrier(0, uploadedLevels - 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, finalStageFlags);
+        levelBarrier(uploadedLevels - 1, mipLevels - uploadedLevels, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
+                     VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, finalStageFlags);
+        levelBarrier(mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, finalStageFlags);
+        VPAError err = SubmitTransfer(imageAllocation.name, commandBuffer, stagingAllocation, pending);
+        if (err == VPA_OK && pending) {
+            // Read by TransferComplete once the fence signals
+            pending->timestamps = timestamps;
+            timestamps = VK_NULL_HANDLE;
+        }
+        else if (err == VPA_OK) blitMilliseconds = TimestampMilliseconds(timestamps);
+        DESTROY_HANDLE(m_main->Device(), timestamps, m_deviceFuncs->vkDestroyQueryPool);
+        return err;
+    }
+
+    float MemoryAllocator::TimestampMilliseconds(VkQueryPool timestamps) const {
+        uint64_t results[2];
+        if (timestamps == VK_NULL_HANDLE || m_deviceFuncs->vkGetQueryPoolResults(m_main->Device(), timestamps, 0, 2, sizeof(results), results,
+                sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return 0.0f;
+        const uint64_t mask = m_transferTimestampBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << m_transferTimestampBits) - 1;
+        const uint64_t ticks = ((results[1] & mask) - (results[0] & mask)) & mask;
+        return float(double(ticks) * double(m_main->Limits().timestampPeriod) / 1e6);
+    }
+
+    VPAError MemoryAllocator::TransferImageRegions(Allocation& imageAllocation, const QVector<ImageUploadRegion>& regions, uint32_t mipLevels, uint32_t arrayLayers,
+                                                   VkPipelineStageFlags finalStageFlags, PendingTransfer* pending) {
+        // Offsets must be a multiple of the block size and of 4, 16 covers every format
+        auto align = [](VkDeviceSize offset) { return (offset + 15) & ~VkDeviceSize(15); };
+        VkDeviceSize stagingSize = 0;
+        for (const ImageUploadRegion& region : regions) {
+            stagingSize = align(stagingSize) + region.size;
+        }
+        Allocation stagingAllocation;
+        VPA_PASS_ERROR(Allocate(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, "staging_buffer", stagingAllocation));
+
+        QVector<VkBufferImageCopy> copyRegions;
+        copyRegions.reserve(regions.size());
+        unsigned char* stagingData = MapMemory(stagingAllocation);
+        VkDeviceSize bufferOffset = 0;
+        for (const ImageUploadRegion& region : regions) {
+            bufferOffset = align(bufferOffset);
+            memcpy(stagingData + bufferOffset, region.data, region.size);
+
+            VkBufferImageCopy copyRegion = {};
+            copyRegion.imageExtent = region.extent;
+            copyRegion.imageOffset = { 0, 0, 0 };
+            copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copyRegion.imageSubresource.mipLevel = region.mipLevel;
+            copyRegion.imageSubresource.layerCount = 1;
+            copyRegion.imageSubresource.baseArrayLayer = region.arrayLayer;
+            copyRegion.bufferOffset = bufferOffset;
+            copyRegion.bufferRowLength = 0;
+            copyRegion.bufferImageHeight = 0;
+            copyRegions.push_back(copyRegion);
+            bufferOffset += region.size;
+        }
+        UnmapMemory(stagingAllocation);
 
         VkImageMemoryBarrier barrier = {};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -169,39 +407,195 @@ namespace vpa {
         barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
         barrier.image = imageAllocation.image;
         barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.levelCount = mipLevels;
         barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
+        barrier.subresourceRange.layerCount = arrayLayers;
         barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         barrier.srcAccessMask = 0;
         barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 
-        m_deviceFuncs->vkResetCommandBuffer(m_commandBuffer, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
-
-        VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr };
-        VPA_VKFATAL(m_deviceFuncs->vkBeginCommandBuffer(m_commandBuffer, &beginInfo), qPrintable("begin transfer command buffer for allocation '" + imageAllocation.name + "'"));
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VPAError err = BeginTransfer(imageAllocation.name, pending, commandBuffer);
+        if (err != VPA_OK) {
+            Deallocate(stagingAllocation);
+            return err;
+        }
 
-        m_deviceFuncs->vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-        m_deviceFuncs->vkCmdCopyBufferToImage(m_commandBuffer, stagingAllocation.buffer, imageAllocation.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+        m_deviceFuncs->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        m_deviceFuncs->vkCmdCopyBufferToImage(commandBuffer, stagingAllocation.buffer, imageAllocation.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                              uint32_t(copyRegions.size()), copyRegions.data());
 
         barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
         barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT; // TODO decide how to include storage image with  | VK_ACCESS_SHADER_WRITE_BIT
-        m_deviceFuncs->vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, finalStageFlags, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        m_deviceFuncs->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, finalStageFlags, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        return SubmitTransfer(imageAllocation.name, commandBuffer, stagingAllocation, pending);
+    }
+
+    bool MemoryAllocator::TransferComplete(PendingTransfer& transfer) {
+        if (transfer.fence != VK_NULL_HANDLE && m_deviceFuncs->vkGetFenceStatus(m_main->Device(), transfer.fence) == VK_NOT_READY) return false;
+        transfer.blitMilliseconds = TimestampMilliseconds(transfer.timestamps);
+        FreeTransfer(transfer);
+        return true;
+    }
 
-        VPA_VKFATAL(m_deviceFuncs->vkEndCommandBuffer(m_commandBuffer), qPrintable("end transfer command buffer for allocation '" + imageAllocation.name + "'"));
+    void MemoryAllocator::WaitTransfer(PendingTransfer& transfer) {
+        if (transfer.fence != VK_NULL_HANDLE) m_deviceFuncs->vkWaitForFences(m_main->Device(), 1, &transfer.fence, VK_TRUE, UINT64_MAX);
+        transfer.blitMilliseconds = TimestampMilliseconds(transfer.timestamps);
+        FreeTransfer(transfer);
+    }
+
+    VPAError MemoryAllocator::BeginTransfer(const QString& name, PendingTransfer* pending, VkCommandBuffer& commandBuffer) {
+        if (pending) {
+            // Transfers which aren't waited on get their own command buffer so the shared one can still be used
+            VkCommandBufferAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = m_commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+            VPA_VKCRITICAL_PASS(m_deviceFuncs->vkAllocateCommandBuffers(m_main->Device(), &allocInfo, &pending->commandBuffer), qPrintable("allocate transfer command buffer for allocation '" + name + "'"));
+
+            VkFenceCreateInfo fenceInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr, 0 };
+            VPAError err = VPA_OK;
+            VPA_VKCRITICAL(m_deviceFuncs->vkCreateFence(m_main->Device(), &fenceInfo, nullptr, &pending->fence), qPrintable("create transfer fence for allocation '" + name + "'"), err);
+            if (err != VPA_OK) {
+                FreeTransfer(*pending);
+                return err;
+            }
+            commandBuffer = pending->commandBuffer;
+        }
+        else {
+            commandBuffer = m_commandBuffer;
+            m_deviceFuncs->vkResetCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+        }
+
+        VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr };
+        VPA_VKFATAL(m_deviceFuncs->vkBeginCommandBuffer(commandBuffer, &beginInfo), qPrintable("begin transfer command buffer for allocation '" + name + "'"));
+        return VPA_OK;
+    }
+
+    VPAError MemoryAllocator::SubmitTransfer(const QString& name, VkCommandBuffer commandBuffer, Allocation& staging, PendingTransfer* pending) {
+        VPA_VKFATAL(m_deviceFuncs->vkEndCommandBuffer(commandBuffer), qPrintable("end transfer command buffer for allocation '" + name + "'"));
 
         VkSubmitInfo submitInfo = { };
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &m_commandBuffer;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        VPA_VKFATAL(m_deviceFuncs->vkQueueSubmit(m_transferQueue, 1, &submitInfo, pending ? pending->fence : VK_NULL_HANDLE), qPrintable("transfer queue submit for allocation '" + name + "'"));
+        if (pending) {
+            // Freed by TransferComplete once the fence signals
+            pending->staging = staging;
+            staging = Allocation();
+        }
+        else {
+            m_deviceFuncs->vkQueueWaitIdle(m_transferQueue);
+            Deallocate(staging);
+        }
+        return VPA_OK;
+    }
+
+    void MemoryAllocator::FreeTransfer(PendingTransfer& transfer) {
+        if (transfer.commandBuffer != VK_NULL_HANDLE) {
+            m_deviceFuncs->vkFreeCommandBuffers(m_main->Device(), m_commandPool, 1, &transfer.commandBuffer);
+            transfer.commandBuffer = VK_NULL_HANDLE;
+        }
+        DESTROY_HANDLE(m_main->Device(), transfer.fence, m_deviceFuncs->vkDestroyFence);
+        DESTROY_HANDLE(m_main->Device(), transfer.timestamps, m_deviceFuncs->vkDestroyQueryPool);
+        Deallocate(transfer.staging);
+    }
+
+    const MemoryStatistics& MemoryAllocator::Statistics() {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget;
+        if (m_main->QueryMemoryBudget(budget)) {
+            for (int i = 0; i < m_statistics.heaps.size(); ++i) {
+                m_statistics.heaps[i].budget = budget.heapBudget[i];
+                m_statistics.heaps[i].usage = budget.heapUsage[i];
+            }
+        }
+        return m_statistics;
+    }
+
+    QByteArray MemoryAllocator::StatisticsJson() {
+        const MemoryStatistics& statistics = Statistics();
+        auto statsObject = [](const AllocationStatistics& stats) {
+            QJsonObject object;
+            object["count"] = double(stats.count);
+            object["bytes"] = double(stats.bytes);
+            object["totalCount"] = double(stats.totalCount);
+            return object;
+        };
+
+        QJsonArray heaps;
+        for (const HeapStatistics& heap : statistics.heaps) {
+            QJsonObject object;
+            object["size"] = double(heap.size);
+            object["deviceLocal"] = bool(heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT);
+            object["allocated"] = double(heap.allocated);
+            object["peak"] = double(heap.peak);
+            if (statistics.budgetSupported) {
+                object["budget"] = double(heap.budget);
+                object["usage"] = double(heap.usage);
+            }
+            heaps.append(object);
+        }
 
-        VPA_VKFATAL(m_deviceFuncs->vkQueueSubmit(m_transferQueue, 1, &submitInfo, VK_NULL_HANDLE), qPrintable("transfer queue submit for allocation '" + imageAllocation.name + "'"));
-        m_deviceFuncs->vkQueueWaitIdle(m_transferQueue);
+        QJsonObject categories;
+        for (auto it = statistics.categories.constBegin(); it != statistics.categories.constEnd(); ++it) {
+            categories[it.key()] = statsObject(it.value());
+        }
 
-        Deallocate(stagingAllocation);
+        QJsonObject root;
+        root["allocated"] = double(statistics.allocated);
+        root["peak"] = double(statistics.peak);
+        root["budgetSupported"] = statistics.budgetSupported;
+        root["buffers"] = statsObject(statistics.types[size_t(AllocationType::Buffer)]);
+        root["images"] = statsObject(statistics.types[size_t(AllocationType::Image)]);
+        root["heaps"] = heaps;
+        root["categories"] = categories;
+        return QJsonDocument(root).toJson(QJsonDocument::Indented);
+    }
 
+    VPAError MemoryAllocator::WriteStatistics(const QString& fileName) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return VPA_WARN("Could not open " + fileName + " for writing memory statistics");
+        file.write(StatisticsJson());
+        file.close();
         return VPA_OK;
     }
+
+    uint32_t MemoryAllocator::FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags flags) const {
+        const VkPhysicalDeviceMemoryProperties& memoryProperties = m_main->Details().memoryProperties;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+            if ((typeBits & (1U << i)) && (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags) return i;
+        }
+        return ~0U;
+    }
+
+    void MemoryAllocator::TrackAllocation(const Allocation& allocation) {
+        HeapStatistics& heap = m_statistics.heaps[int(m_main->Details().memoryProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex)];
+        heap.allocated += allocation.memorySize;
+        heap.peak = qMax(heap.peak, heap.allocated);
+        m_statistics.allocated += allocation.memorySize;
+        m_statistics.peak = qMax(m_statistics.peak, m_statistics.allocated);
+
+        for (AllocationStatistics* stats : { &m_statistics.categories[allocation.name], &m_statistics.types[size_t(allocation.type)] }) {
+            stats->count++;
+            stats->totalCount++;
+            stats->bytes += allocation.memorySize;
+        }
+    }
+
+    void MemoryAllocator::TrackDeallocation(const Allocation& allocation) {
+        if (allocation.memoryTypeIndex == ~0U) return;
+        m_statistics.heaps[int(m_main->Details().memoryProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex)].allocated -= allocation.memorySize;
+        m_statistics.allocated -= allocation.memorySize;
+
+        for (AllocationStatistics* stats : { &m_statistics.categories[allocation.name], &m_statistics.types[size_t(allocation.type)] }) {
+            stats->count--;
+            stats->bytes -= allocation.memorySize;
+        }
+    }
 }
@@ -3,6 +3,8 @@
 
 #include <vulkan/vulkan.h>
 #include <QString>
+#include <QVector>
+#include <QMap>
 
 #include "../common.h"
 
@@ -12,7 +14,7 @@ namespace vpa {
     class VulkanMain;
 
     enum class AllocationType {
-        Buffer, Image
+        Buffer, Image, Count_
     };
 
     struct Allocation {
@@ -20,13 +22,67 @@ namespace vpa {
         AllocationType type;
         VkDeviceMemory memory = VK_NULL_HANDLE;
         VkDeviceSize size = 0;
+        VkDeviceSize memorySize = 0; // Size of the device memory backing this allocation, may be larger than size
+        uint32_t memoryTypeIndex = ~0U;
         bool isMapped = false;
+        bool ownsMemory = true; // False for images bound in to a shared block of aliased memory
         union {
             VkBuffer buffer = VK_NULL_HANDLE;
             VkImage image;
         };
     };
 
+    // Images in the same group are live at the same time, images in different groups may share memory
+    struct AliasedImageInfo {
+        VkImageCreateInfo createInfo;
+        QString name;
+        uint32_t group = 0;
+        Allocation* allocation = nullptr;
+    };
+
+    // Already encoded texels for one subresource, such as a level of block compressed data
+    struct ImageUploadRegion {
+        const uchar* data = nullptr;
+        VkDeviceSize size = 0;
+        uint32_t mipLevel = 0;
+        uint32_t arrayLayer = 0;
+        VkExtent3D extent = { 0, 0, 0 };
+    };
+
+    // A transfer which was submitted without waiting, its command buffer and staging memory are held until the fence signals
+    struct PendingTransfer {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        Allocation staging;
+        VkQueryPool timestamps = VK_NULL_HANDLE; // Around the blits, when mips are blitted and the transfer queue writes timestamps
+        float blitMilliseconds = 0.0f; // Read from the timestamps once the transfer completes
+    };
+
+    struct AllocationStatistics {
+        uint32_t count = 0;
+        VkDeviceSize bytes = 0;
+        uint32_t totalCount = 0; // Includes allocations which have since been freed
+    };
+
+    struct HeapStatistics {
+        VkDeviceSize size = 0;
+        VkMemoryHeapFlags flags = 0;
+        VkDeviceSize allocated = 0;
+        VkDeviceSize peak = 0;
+        // Budget and usage are only filled in when VK_EXT_memory_budget is supported
+        VkDeviceSize budget = 0;
+        VkDeviceSize usage = 0;
+    };
+
+    struct MemoryStatistics {
+        QVector<HeapStatistics> heaps;
+        QMap<QString, AllocationStatistics> categories;
+        AllocationStatistics types[size_t(AllocationType::Count_)];
+        VkDeviceSize allocated = 0;
+        VkDeviceSize peak = 0;
+        bool budgetSupported = false;
+    };
+
     class MemoryAllocator final {
     public:
         MemoryAllocator(QVulkanDeviceFunctions* deviceFuncs, VulkanMain* main, VPAError& err);
@@ -37,16 +93,51 @@ namespace vpa {
         // If there is an error in the allocation then resources will be deallocated before return
         VPAError Allocate(VkDeviceSize size, VkBufferUsageFlags usageFlags, QString name, Allocation& allocation);
         VPAError Allocate(VkDeviceSize size, VkImageCreateInfo createInfo, QString name, Allocation& allocation);
+        // Creates the images and binds them all to one block, unaliasedSize is what they would need with their own memory.
+        // Lazily allocated memory is used when every image allows it.
+        VPAError AllocateAliased(QVector<AliasedImageInfo>& images, QString name, Allocation& block, VkDeviceSize& unaliasedSize);
         void Deallocate(Allocation& allocation);
-        VPAError TransferImageMemory(Allocation& imageAllocation, const VkExtent3D extent, const QImage& image, VkPipelineStageFlags finalStageFlags);
+        // Uploads the given levels, any further levels up to mipLevels are blitted down from the last one given.
+        // blitMilliseconds is the GPU time of the blits from timestamp queries, 0 if the transfer queue can't write timestamps.
+        // Transfers given pending are submitted without waiting, their blit time is left in pending by TransferComplete or WaitTransfer.
+        VPAError TransferImageMemory(Allocation& imageAllocation, const VkExtent3D extent, const QVector<QImage>& levels, uint32_t mipLevels,
+                                     VkPipelineStageFlags finalStageFlags, float& blitMilliseconds, PendingTransfer* pending = nullptr);
+        // Copies each region as is, every level and layer is left shader readable
+        VPAError TransferImageRegions(Allocation& imageAllocation, const QVector<ImageUploadRegion>& regions, uint32_t mipLevels, uint32_t arrayLayers,
+                                      VkPipelineStageFlags finalStageFlags, PendingTransfer* pending = nullptr);
+        // True once the image can be used, the transfer's resources are freed at that point
+        bool TransferComplete(PendingTransfer& transfer);
+        void WaitTransfer(PendingTransfer& transfer);
+        // vkCmdBlitImage needs a queue with graphics support
+        bool CanBlit() const { return m_transferQueueGraphics; }
+        bool CanTimeTransfers() const { return m_transferTimestampBits > 0; }
+
+        // Refreshes the driver budget if available before returning
+        const MemoryStatistics& Statistics();
+        QByteArray StatisticsJson();
+        VPAError WriteStatistics(const QString& fileName);
 
     private:
+        uint32_t FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags flags) const;
+        VPAError BeginTransfer(const QString& name, PendingTransfer* pending, VkCommandBuffer& commandBuffer);
+        // Staging is freed once the transfer completes
+        VPAError SubmitTransfer(const QString& name, VkCommandBuffer commandBuffer, Allocation& staging, PendingTransfer* pending);
+        void FreeTransfer(PendingTransfer& transfer);
+        // Between the two timestamps of a completed transfer, 0 if there are none
+        float TimestampMilliseconds(VkQueryPool timestamps) const;
+        void TrackAllocation(const Allocation& allocation);
+        void TrackDeallocation(const Allocation& allocation);
+
         QVulkanDeviceFunctions* m_deviceFuncs;
         VulkanMain* m_main;
         VkCommandPool m_commandPool;
         VkCommandBuffer m_commandBuffer;
         uint32_t m_transferQueueIdx;
         VkQueue m_transferQueue;
+        bool m_transferQueueGraphics;
+        uint32_t m_transferTimestampBits; // 0 when the transfer queue can't write timestamps
+
+        MemoryStatistics m_statistics;
     };
 }
 
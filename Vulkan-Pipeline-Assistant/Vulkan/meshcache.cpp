@@ -0,0 +1,122 @@
+#include "meshcache.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QSaveFile>
+
+namespace vpa {
+    static constexpr uint64_t StreamAlignment = 16;
+
+    static uint64_t AlignStream(uint64_t offset) {
+        return (offset + StreamAlignment - 1) & ~(StreamAlignment - 1);
+    }
+
+    bool operator==(const MeshCacheKey& a, const MeshCacheKey& b) {
+        if (a.sourceSize != b.sourceSize || a.sourceModified != b.sourceModified || a.indexed != b.indexed
+                || a.optimised != b.optimised || a.formats != b.formats || a.streamLayout != b.streamLayout || a.attributeCount != b.attributeCount) return false;
+        for (uint32_t i = 0; i < a.attributeCount; ++i) {
+            if (a.attributes[i] != b.attributes[i]) return false;
+        }
+        return true;
+    }
+
+    MeshCache::MeshCache(const QString& path) : m_file(path), m_data(nullptr), m_header({}) { }
+
+    MeshCache::~MeshCache() {
+        Close();
+    }
+
+    bool MeshCache::Open(const MeshCacheKey& key) {
+        Close();
+        if (!m_file.open(QIODevice::ReadOnly)) return false;
+        qint64 size = m_file.size();
+        if (size < qint64(sizeof(MeshCacheHeader))) {
+            Close();
+            return false;
+        }
+
+        m_data = m_file.map(0, size);
+        if (!m_data) {
+            Close();
+            return false;
+        }
+        memcpy(&m_header, m_data, sizeof(MeshCacheHeader));
+        if (m_header.magic != Magic || m_header.version != Version || m_header.headerSize != sizeof(MeshCacheHeader) || !(m_header.key == key)
+                || m_header.vertexOffset + m_header.vertexBytes > uint64_t(size) || m_header.indexOffset + m_header.indexBytes > uint64_t(size)
+                || m_header.subMeshOffset + m_header.subMeshCount * sizeof(SubMesh) > uint64_t(size)) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    QVector<SubMesh> MeshCache::SubMeshes() const {
+        QVector<SubMesh> subMeshes = QVector<SubMesh>(int(m_header.subMeshCount));
+        if (m_data && !subMeshes.isEmpty()) memcpy(subMeshes.data(), m_data + m_header.subMeshOffset, subMeshes.size() * sizeof(SubMesh));
+        return subMeshes;
+    }
+
+    void MeshCache::Close() {
+        if (m_data) m_file.unmap(m_data);
+        m_data = nullptr;
+        m_file.close();
+    }
+
+    MeshCacheKey MeshCache::MakeKey(const QString& sourcePath, const QVector<VertexAttribute>& attributes, bool indexed, bool optimised, const VertexFormatConfig& formats,
+                                    VertexStreamLayout streamLayout) {
+        QFileInfo info(sourcePath);
+        MeshCacheKey key;
+        key.sourceSize = info.size();
+        key.sourceModified = info.lastModified().toMSecsSinceEpoch();
+        key.indexed = indexed ? 1 : 0;
+        key.optimised = optimised ? 1 : 0;
+        key.formats = uint32_t(formats.position) | (uint32_t(formats.normal) << 8) | (uint32_t(formats.texCoord) << 16) | (uint32_t(formats.colour) << 24);
+        key.streamLayout = uint32_t(streamLayout);
+        key.attributeCount = uint32_t(qMin(attributes.size(), int(MeshCacheKey::MaxAttributes)));
+        for (uint32_t i = 0; i < key.attributeCount; ++i) {
+            key.attributes[i] = uint32_t(attributes[int(i)]);
+        }
+        return key;
+    }
+
+    QString MeshCache::CachePath(const QString& meshName, const MeshCacheKey& key) {
+        uint layoutHash = qHash(qMakePair(key.indexed, qMakePair(key.optimised, qMakePair(key.formats, key.streamLayout))));
+        for (uint32_t i = 0; i < key.attributeCount; ++i) {
+            layoutHash = layoutHash * 31 + key.attributes[i];
+        }
+        return QString(CONFIGDIR"%1_%2.vpamesh").arg(QFileInfo(meshName).fileName()).arg(layoutHash, 8, 16, QChar('0'));
+    }
+
+    VPAError MeshCache::Write(const QString& path, const MeshCacheKey& key, const MeshStatistics& statistics,
+                              const void* vertexData, VkDeviceSize vertexBytes, const void* indexData, VkDeviceSize indexBytes, const QVector<SubMesh>& subMeshes) {
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(MeshCacheHeader));
+        header.magic = Magic;
+        header.version = Version;
+        header.headerSize = sizeof(MeshCacheHeader);
+        header.key = key;
+        header.statistics = statistics;
+        header.vertexOffset = AlignStream(sizeof(MeshCacheHeader));
+        header.vertexBytes = vertexBytes;
+        header.indexOffset = AlignStream(header.vertexOffset + vertexBytes);
+        header.indexBytes = indexData ? indexBytes : 0;
+        header.subMeshOffset = AlignStream(header.indexOffset + header.indexBytes);
+        header.subMeshCount = uint64_t(subMeshes.size());
+
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        // Written to a temporary file and renamed so a half written cache is never picked up
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) return VPA_WARN("Could not open mesh cache " + path);
+        const QByteArray padding(int(StreamAlignment), '\0');
+        file.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+        file.write(padding.constData(), qint64(header.vertexOffset - sizeof(MeshCacheHeader)));
+        file.write(reinterpret_cast<const char*>(vertexData), qint64(vertexBytes));
+        file.write(padding.constData(), qint64(header.indexOffset - header.vertexOffset - vertexBytes));
+        if (header.indexBytes > 0) file.write(reinterpret_cast<const char*>(indexData), qint64(indexBytes));
+        file.write(padding.constData(), qint64(header.subMeshOffset - header.indexOffset - header.indexBytes));
+        file.write(reinterpret_cast<const char*>(subMeshes.constData()), qint64(subMeshes.size() * sizeof(SubMesh)));
+        if (!file.commit()) return VPA_WARN("Could not write mesh cache " + path);
+        return VPA_OK;
+    }
+}
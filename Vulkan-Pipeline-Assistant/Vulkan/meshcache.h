@@ -0,0 +1,73 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <QFile>
+
+#include "vertexinput.h"
+
+namespace vpa {
+    // Everything the processed streams depend on, a cache with a different key is regenerated
+    struct MeshCacheKey {
+        static constexpr int MaxAttributes = 16;
+
+        qint64 sourceSize = 0;
+        qint64 sourceModified = 0;
+        uint32_t indexed = 0;
+        uint32_t optimised = 0;
+        uint32_t formats = 0; // VertexFormatConfig, one byte per attribute kind
+        uint32_t streamLayout = 0;
+        uint32_t attributeCount = 0;
+        uint32_t attributes[MaxAttributes] = {};
+    };
+
+    bool operator==(const MeshCacheKey& a, const MeshCacheKey& b);
+
+    struct MeshCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t headerSize;
+        MeshCacheKey key;
+        MeshStatistics statistics;
+        uint64_t vertexOffset;
+        uint64_t vertexBytes;
+        uint64_t indexOffset;
+        uint64_t indexBytes;
+        uint64_t subMeshOffset;
+        uint64_t subMeshCount;
+    };
+
+    // Processed vertex and index streams stored exactly as they are uploaded, read back through a memory map
+    class MeshCache final {
+    public:
+        static constexpr uint32_t Magic = 0x4D415056; // "VPAM"
+        static constexpr uint32_t Version = 5;
+
+        MeshCache(const QString& path);
+        ~MeshCache();
+
+        // Maps the file and checks it against key, the data stays valid until Close
+        bool Open(const MeshCacheKey& key);
+        void Close();
+
+        const MeshStatistics& Statistics() const { return m_header.statistics; }
+        const uchar* VertexData() const { return m_data + m_header.vertexOffset; }
+        VkDeviceSize VertexBytes() const { return m_header.vertexBytes; }
+        const uchar* IndexData() const { return m_header.indexBytes > 0 ? m_data + m_header.indexOffset : nullptr; }
+        VkDeviceSize IndexBytes() const { return m_header.indexBytes; }
+        QVector<SubMesh> SubMeshes() const;
+
+        static MeshCacheKey MakeKey(const QString& sourcePath, const QVector<VertexAttribute>& attributes, bool indexed, bool optimised, const VertexFormatConfig& formats,
+                                    VertexStreamLayout streamLayout);
+        // One cache per source and layout, so switching between shaders doesn't evict the other layouts
+        static QString CachePath(const QString& meshName, const MeshCacheKey& key);
+        static VPAError Write(const QString& path, const MeshCacheKey& key, const MeshStatistics& statistics,
+                              const void* vertexData, VkDeviceSize vertexBytes, const void* indexData, VkDeviceSize indexBytes, const QVector<SubMesh>& subMeshes);
+
+    private:
+        QFile m_file;
+        uchar* m_data;
+        MeshCacheHeader m_header;
+    };
+}
+
+#endif // MESHCACHE_H
@@ -0,0 +1,156 @@
+#include "meshgenerator.h"
+
+#include <cmath>
+
+namespace vpa {
+    // Sphere faces as cube faces, U cross V points along the face's normal so every face winds the same way
+    static const float CubeFaces[6][3][3] = {
+        { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+        { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+        { { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 0 } },
+        { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+        { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+        { { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } }
+    };
+
+    // Integer hash so random values depend only on what they're for, not on which thread made them
+    static uint32_t Hash(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7FEB352D;
+        x ^= x >> 15;
+        x *= 0x846CA68B;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static float Random(uint32_t seed) {
+        return float(Hash(seed) >> 8) / float(1 << 24);
+    }
+
+    static void RandomColour(uint32_t seed, float* out) {
+        out[0] = Random(seed * 3 + 0);
+        out[1] = Random(seed * 3 + 1);
+        out[2] = Random(seed * 3 + 2);
+        out[3] = 1.0f;
+    }
+
+    static void Normalise(float* v) {
+        float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length <= 0.0f) return;
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+
+    MeshGenerator::MeshGenerator(MeshSource source, uint32_t triangleCount, float size)
+        : m_source(source), m_size(size), m_resolution(1), m_vertexCount(0), m_triangleCount(0) {
+        triangleCount = qMax(triangleCount, 1u);
+        if (m_source == MeshSource::Grid) {
+            m_resolution = qMax(uint32_t(std::lround(std::sqrt(double(triangleCount) / 2.0))), 1u);
+            m_vertexCount = (m_resolution + 1) * (m_resolution + 1);
+            m_triangleCount = 2 * m_resolution * m_resolution;
+        }
+        else if (m_source == MeshSource::Sphere) {
+            // Faces don't share their edge vertices so each face stays a plain grid
+            m_resolution = qMax(uint32_t(std::lround(std::sqrt(double(triangleCount) / 12.0))), 1u);
+            m_vertexCount = 6 * (m_resolution + 1) * (m_resolution + 1);
+            m_triangleCount = 12 * m_resolution * m_resolution;
+        }
+        else {
+            m_vertexCount = 3 * triangleCount;
+            m_triangleCount = triangleCount;
+        }
+    }
+
+    void MeshGenerator::Vertex(uint32_t index, GeneratedVertex& vertex) const {
+        if (m_source == MeshSource::Sphere) {
+            SphereVertex(index, vertex);
+        }
+        else if (m_source == MeshSource::TriangleSoup) {
+            SoupVertex(index, vertex);
+        }
+        else {
+            // A grid facing +Z spanning -size to size
+            uint32_t i = index % (m_resolution + 1);
+            uint32_t j = index / (m_resolution + 1);
+            vertex.texCoord[0] = float(i) / float(m_resolution);
+            vertex.texCoord[1] = float(j) / float(m_resolution);
+            vertex.position[0] = (vertex.texCoord[0] * 2.0f - 1.0f) * m_size;
+            vertex.position[1] = (vertex.texCoord[1] * 2.0f - 1.0f) * m_size;
+            vertex.position[2] = 0.0f;
+            vertex.normal[0] = 0.0f;
+            vertex.normal[1] = 0.0f;
+            vertex.normal[2] = 1.0f;
+            RandomColour(index, vertex.colour);
+        }
+    }
+
+    void MeshGenerator::Triangle(uint32_t triangle, uint32_t* indices) const {
+        if (m_source == MeshSource::TriangleSoup) {
+            indices[0] = 3 * triangle;
+            indices[1] = 3 * triangle + 1;
+            indices[2] = 3 * triangle + 2;
+            return;
+        }
+
+        // Two triangles per quad, quads in rows of each grid or sphere face
+        uint32_t quad = triangle / 2;
+        uint32_t quadsPerFace = m_resolution * m_resolution;
+        uint32_t face = quad / quadsPerFace;
+        uint32_t i = (quad % quadsPerFace) % m_resolution;
+        uint32_t j = (quad % quadsPerFace) / m_resolution;
+        uint32_t base = face * (m_resolution + 1) * (m_resolution + 1);
+        uint32_t a = base + j * (m_resolution + 1) + i;
+        uint32_t b = a + 1;
+        uint32_t c = a + m_resolution + 2;
+        uint32_t d = a + m_resolution + 1;
+        indices[0] = a;
+        indices[1] = triangle % 2 == 0 ? b : c;
+        indices[2] = triangle % 2 == 0 ? c : d;
+    }
+
+    void MeshGenerator::SphereVertex(uint32_t index, GeneratedVertex& vertex) const {
+        uint32_t perFace = (m_resolution + 1) * (m_resolution + 1);
+        const float (&face)[3][3] = CubeFaces[index / perFace];
+        uint32_t i = (index % perFace) % (m_resolution + 1);
+        uint32_t j = (index % perFace) / (m_resolution + 1);
+        vertex.texCoord[0] = float(i) / float(m_resolution);
+        vertex.texCoord[1] = float(j) / float(m_resolution);
+        float u = vertex.texCoord[0] * 2.0f - 1.0f;
+        float v = vertex.texCoord[1] * 2.0f - 1.0f;
+        for (int c = 0; c < 3; ++c) {
+            vertex.normal[c] = face[0][c] + u * face[1][c] + v * face[2][c];
+        }
+        Normalise(vertex.normal);
+        for (int c = 0; c < 3; ++c) {
+            vertex.position[c] = vertex.normal[c] * m_size;
+        }
+        RandomColour(index, vertex.colour);
+    }
+
+    void MeshGenerator::SoupVertex(uint32_t index, GeneratedVertex& vertex) const {
+        // Triangles are scattered through the -1 to 1 cube with corners up to size away from their centre
+        uint32_t triangle = index / 3;
+        float corners[3][3];
+        for (int corner = 0; corner < 3; ++corner) {
+            for (int c = 0; c < 3; ++c) {
+                float centre = Random(triangle * 12 + uint32_t(c)) * 2.0f - 1.0f;
+                corners[corner][c] = centre + (Random(triangle * 12 + 3 + uint32_t(corner) * 3 + uint32_t(c)) - 0.5f) * m_size;
+            }
+        }
+        float edge0[3] = { corners[1][0] - corners[0][0], corners[1][1] - corners[0][1], corners[1][2] - corners[0][2] };
+        float edge1[3] = { corners[2][0] - corners[0][0], corners[2][1] - corners[0][1], corners[2][2] - corners[0][2] };
+        vertex.normal[0] = edge0[1] * edge1[2] - edge0[2] * edge1[1];
+        vertex.normal[1] = edge0[2] * edge1[0] - edge0[0] * edge1[2];
+        vertex.normal[2] = edge0[0] * edge1[1] - edge0[1] * edge1[0];
+        Normalise(vertex.normal);
+
+        uint32_t corner = index % 3;
+        vertex.position[0] = corners[corner][0];
+        vertex.position[1] = corners[corner][1];
+        vertex.position[2] = corners[corner][2];
+        vertex.texCoord[0] = corner == 1 ? 1.0f : 0.0f;
+        vertex.texCoord[1] = corner == 2 ? 1.0f : 0.0f;
+        RandomColour(triangle, vertex.colour);
+    }
+}
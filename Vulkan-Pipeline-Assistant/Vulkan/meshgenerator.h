@@ -0,0 +1,38 @@
+#ifndef MESHGENERATOR_H
+#define MESHGENERATOR_H
+
+#include "pipelineconfig.h"
+
+namespace vpa {
+    struct GeneratedVertex {
+        float position[3];
+        float normal[3];
+        float texCoord[2];
+        float colour[4];
+    };
+
+    // Procedural stress geometry. Every vertex and triangle is computed independently so any range can be generated on any thread.
+    class MeshGenerator final {
+    public:
+        // The shape's resolution is picked so it has close to triangleCount triangles
+        MeshGenerator(MeshSource source, uint32_t triangleCount, float size);
+
+        uint32_t VertexCount() const { return m_vertexCount; }
+        uint32_t TriangleCount() const { return m_triangleCount; }
+
+        void Vertex(uint32_t index, GeneratedVertex& vertex) const;
+        void Triangle(uint32_t triangle, uint32_t* indices) const;
+
+    private:
+        void SphereVertex(uint32_t index, GeneratedVertex& vertex) const;
+        void SoupVertex(uint32_t index, GeneratedVertex& vertex) const;
+
+        MeshSource m_source;
+        float m_size;
+        uint32_t m_resolution; // Quads along each side of a grid or sphere face
+        uint32_t m_vertexCount;
+        uint32_t m_triangleCount;
+    };
+}
+
+#endif // MESHGENERATOR_H
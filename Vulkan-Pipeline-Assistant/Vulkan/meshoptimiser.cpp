@@ -0,0 +1,521 @@
+#include "meshoptimiser.h"
+
+#include <QVector3D>
+#include <QHash>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+namespace vpa {
+    // Scoring constants from Forsyth's paper
+    static constexpr float CacheDecayPower = 1.5f;
+    static constexpr float LastTriangleScore = 0.75f;
+    static constexpr float ValenceBoostScale = 2.0f;
+    static constexpr float ValenceBoostPower = 0.5f;
+
+    static constexpr uint32_t FetchLineSize = 64;
+    static constexpr uint32_t FetchCacheLines = 64;
+
+    static float VertexScore(int cachePosition, uint32_t remainingTriangles) {
+        if (remainingTriangles == 0) return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) score = LastTriangleScore;
+            else score = std::pow(1.0f - float(cachePosition - 3) / float(MeshOptimiser::CacheSize - 3), CacheDecayPower);
+        }
+        return score + ValenceBoostScale * std::pow(float(remainingTriangles), -ValenceBoostPower);
+    }
+
+    // Sum of squared distances to a set of planes, each weighted by its triangle's area
+    struct Quadric {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+        double weight;
+    };
+
+    static void AddPlane(Quadric& q, const double* n, double d, double weight) {
+        q.a2 += weight * n[0] * n[0];
+        q.ab += weight * n[0] * n[1];
+        q.ac += weight * n[0] * n[2];
+        q.ad += weight * n[0] * d;
+        q.b2 += weight * n[1] * n[1];
+        q.bc += weight * n[1] * n[2];
+        q.bd += weight * n[1] * d;
+        q.c2 += weight * n[2] * n[2];
+        q.cd += weight * n[2] * d;
+        q.d2 += weight * d * d;
+        q.weight += weight;
+    }
+
+    static void AddQuadric(Quadric& q, const Quadric& other) {
+        q.a2 += other.a2;
+        q.ab += other.ab;
+        q.ac += other.ac;
+        q.ad += other.ad;
+        q.b2 += other.b2;
+        q.bc += other.bc;
+        q.bd += other.bd;
+        q.c2 += other.c2;
+        q.cd += other.cd;
+        q.d2 += other.d2;
+        q.weight += other.weight;
+    }
+
+    // Area weighted mean squared distance of p from the planes
+    static double QuadricError(const Quadric& q, const float* p) {
+        if (q.weight <= 0.0) return 0.0;
+        double x = double(p[0]);
+        double y = double(p[1]);
+        double z = double(p[2]);
+        double error = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+                + 2.0 * (q.ad * x + q.bd * y + q.cd * z) + q.d2;
+        return std::abs(error) / q.weight;
+    }
+
+    static void TriangleNormal(const float* p0, const float* p1, const float* p2, double* normal) {
+        double e0[3] = { double(p1[0] - p0[0]), double(p1[1] - p0[1]), double(p1[2] - p0[2]) };
+        double e1[3] = { double(p2[0] - p0[0]), double(p2[1] - p0[1]), double(p2[2] - p0[2]) };
+        normal[0] = e0[1] * e1[2] - e0[2] * e1[1];
+        normal[1] = e0[2] * e1[0] - e0[0] * e1[2];
+        normal[2] = e0[0] * e1[1] - e0[1] * e1[0];
+    }
+
+    void MeshOptimiser::OptimiseVertexCache(QVector<uint32_t>& indices, uint32_t vertexCount) {
+        int triangleCount = indices.size() / 3;
+        if (triangleCount == 0) return;
+        const uint32_t* source = indices.constData();
+
+        // Remaining triangles of each vertex, packed in to one array which shrinks as triangles are emitted
+        QVector<uint32_t> remaining = QVector<uint32_t>(int(vertexCount), 0);
+        for (uint32_t index : indices) {
+            remaining[int(index)]++;
+        }
+        QVector<int> adjacencyOffsets = QVector<int>(int(vertexCount) + 1, 0);
+        for (int v = 0; v < int(vertexCount); ++v) {
+            adjacencyOffsets[v + 1] = adjacencyOffsets[v] + int(remaining[v]);
+        }
+        QVector<int> adjacency = QVector<int>(indices.size());
+        QVector<int> fill = adjacencyOffsets;
+        for (int t = 0; t < triangleCount; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                adjacency[fill[int(source[3 * t + k])]++] = t;
+            }
+        }
+
+        QVector<int> cachePositions = QVector<int>(int(vertexCount), -1);
+        QVector<float> vertexScores = QVector<float>(int(vertexCount));
+        for (int v = 0; v < int(vertexCount); ++v) {
+            vertexScores[v] = VertexScore(-1, remaining[v]);
+        }
+        QVector<float> triangleScores = QVector<float>(triangleCount);
+        for (int t = 0; t < triangleCount; ++t) {
+            triangleScores[t] = vertexScores[int(source[3 * t])] + vertexScores[int(source[3 * t + 1])] + vertexScores[int(source[3 * t + 2])];
+        }
+
+        QVector<bool> emitted = QVector<bool>(triangleCount, false);
+        QVector<uint32_t> output;
+        output.reserve(indices.size());
+        QVector<uint32_t> cache;
+        QVector<uint32_t> newCache;
+        int bestTriangle = -1;
+        int cursor = 0;
+
+        for (int emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+            // When nothing in the cache touches a remaining triangle the next one in the original order is taken
+            int triangle = bestTriangle;
+            if (triangle < 0) {
+                while (emitted[cursor]) ++cursor;
+                triangle = cursor;
+            }
+            emitted[triangle] = true;
+            const uint32_t* tri = source + 3 * triangle;
+            output.push_back(tri[0]);
+            output.push_back(tri[1]);
+            output.push_back(tri[2]);
+
+            for (int k = 0; k < 3; ++k) {
+                int v = int(tri[k]);
+                int begin = adjacencyOffsets[v];
+                int end = begin + int(remaining[v]);
+                for (int i = begin; i < end; ++i) {
+                    if (adjacency[i] == triangle) {
+                        adjacency[i] = adjacency[end - 1];
+                        break;
+                    }
+                }
+                remaining[v]--;
+            }
+
+            // The emitted triangle moves to the front of the cache, anything past the end is evicted
+            newCache.clear();
+            for (int k = 0; k < 3; ++k) {
+                if (!newCache.contains(tri[k])) newCache.push_back(tri[k]);
+            }
+            for (uint32_t v : cache) {
+                if (v != tri[0] && v != tri[1] && v != tri[2]) newCache.push_back(v);
+            }
+
+            for (int i = 0; i < newCache.size(); ++i) {
+                int v = int(newCache[i]);
+                cachePositions[v] = i < CacheSize ? i : -1;
+                float score = VertexScore(cachePositions[v], remaining[v]);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                for (int a = adjacencyOffsets[v]; a < adjacencyOffsets[v] + int(remaining[v]); ++a) {
+                    triangleScores[adjacency[a]] += delta;
+                }
+            }
+            if (newCache.size() > CacheSize) newCache.resize(CacheSize);
+            cache.swap(newCache);
+
+            bestTriangle = -1;
+            float bestScore = -1.0f;
+            for (uint32_t v : cache) {
+                for (int a = adjacencyOffsets[int(v)]; a < adjacencyOffsets[int(v)] + int(remaining[int(v)]); ++a) {
+                    if (triangleScores[adjacency[a]] > bestScore) {
+                        bestScore = triangleScores[adjacency[a]];
+                        bestTriangle = adjacency[a];
+                    }
+                }
+            }
+        }
+
+        indices.swap(output);
+    }
+
+    void MeshOptimiser::OptimiseOverdraw(QVector<uint32_t>& indices, const QVector<float>& vertices, uint32_t stride, uint32_t positionOffset, float threshold) {
+        int triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || stride == 0) return;
+        uint32_t vertexCount = uint32_t(vertices.size()) / stride;
+        auto position = [&](uint32_t index) {
+            const float* p = vertices.constData() + index * stride + positionOffset;
+            return QVector3D(p[0], p[1], p[2]);
+        };
+
+        // Split the cache optimised order where the simulated cache misses a whole triangle, which costs nothing to move,
+        // or where the cluster so far is within the threshold of the mesh ACMR, in which case the cache is restarted cold
+        float acmrLimit = AnalyseVertexCache(indices, vertexCount).acmr * threshold;
+        QVector<int> clusters = { 0 };
+        QVector<uint32_t> timestamps = QVector<uint32_t>(int(vertexCount), 0);
+        uint32_t timestamp = CacheSize + 1;
+        int clusterMisses = 0;
+        int clusterTriangles = 0;
+        for (int t = 0; t < triangleCount; ++t) {
+            if (clusterTriangles > 0 && float(clusterMisses) / float(clusterTriangles) <= acmrLimit) {
+                clusters.push_back(t);
+                timestamp += CacheSize + 1;
+                clusterMisses = 0;
+                clusterTriangles = 0;
+            }
+
+            int misses = 0;
+            for (int k = 0; k < 3; ++k) {
+                uint32_t index = indices[3 * t + k];
+                if (timestamp - timestamps[int(index)] > uint32_t(CacheSize)) {
+                    timestamps[int(index)] = timestamp++;
+                    ++misses;
+                }
+            }
+            if (misses == 3 && clusterTriangles > 0) {
+                clusters.push_back(t);
+                clusterMisses = 0;
+                clusterTriangles = 0;
+            }
+            clusterMisses += misses;
+            clusterTriangles++;
+        }
+        clusters.push_back(triangleCount);
+
+        // Clusters facing away from the centre of the mesh are most likely to occlude the rest so they are drawn first
+        int clusterCount = clusters.size() - 1;
+        QVector<QVector3D> centroids = QVector<QVector3D>(clusterCount);
+        QVector<QVector3D> normals = QVector<QVector3D>(clusterCount);
+        QVector3D meshCentroid;
+        float meshArea = 0.0f;
+        for (int c = 0; c < clusterCount; ++c) {
+            float clusterArea = 0.0f;
+            for (int t = clusters[c]; t < clusters[c + 1]; ++t) {
+                QVector3D p0 = position(indices[3 * t]);
+                QVector3D p1 = position(indices[3 * t + 1]);
+                QVector3D p2 = position(indices[3 * t + 2]);
+                QVector3D normal = QVector3D::crossProduct(p1 - p0, p2 - p0);
+                float area = normal.length();
+                centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+                normals[c] += normal;
+                clusterArea += area;
+            }
+            meshCentroid += centroids[c];
+            meshArea += clusterArea;
+            if (clusterArea > 0.0f) centroids[c] /= clusterArea;
+        }
+        if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+        QVector<float> sortKeys = QVector<float>(clusterCount);
+        QVector<int> order = QVector<int>(clusterCount);
+        for (int c = 0; c < clusterCount; ++c) {
+            sortKeys[c] = QVector3D::dotProduct(centroids[c] - meshCentroid, normals[c].normalized());
+            order[c] = c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](int a, int b) { return sortKeys[a] > sortKeys[b]; });
+
+        QVector<uint32_t> output;
+        output.reserve(indices.size());
+        for (int c : order) {
+            for (int i = 3 * clusters[c]; i < 3 * clusters[c + 1]; ++i) {
+                output.push_back(indices[i]);
+            }
+        }
+        indices.swap(output);
+    }
+
+    uint32_t MeshOptimiser::OptimiseVertexFetch(QVector<uint32_t>& indices, QVector<float>& vertices, uint32_t stride) {
+        if (stride == 0) return 0;
+        QVector<int> remap = QVector<int>(vertices.size() / int(stride), -1);
+        QVector<float> reordered;
+        reordered.reserve(vertices.size());
+        uint32_t next = 0;
+        for (uint32_t& index : indices) {
+            if (remap[int(index)] < 0) {
+                remap[int(index)] = int(next++);
+                for (uint32_t i = 0; i < stride; ++i) {
+                    reordered.push_back(vertices[int(index * stride + i)]);
+                }
+            }
+            index = uint32_t(remap[int(index)]);
+        }
+        vertices.swap(reordered);
+        return next;
+    }
+
+    float MeshOptimiser::SimplifyMesh(QVector<uint32_t>& indices, const QVector<float>& vertices, uint32_t stride, uint32_t positionOffset, uint32_t targetIndexCount) {
+        if (stride == 0 || uint32_t(indices.size()) <= targetIndexCount) return 0.0f;
+        int vertexCount = vertices.size() / int(stride);
+        auto position = [&](uint32_t index) { return vertices.constData() + index * stride + positionOffset; };
+        auto positionBits = [&](uint32_t index, uint32_t* bits) { memcpy(bits, position(index), 3 * sizeof(float)); };
+
+        // Vertices at the same position are welded on to the first of them so collapses see through normal and texcoord seams
+        QVector<uint32_t> order = QVector<uint32_t>(vertexCount);
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            uint32_t pa[3];
+            uint32_t pb[3];
+            positionBits(a, pa);
+            positionBits(b, pb);
+            if (pa[0] != pb[0]) return pa[0] < pb[0];
+            if (pa[1] != pb[1]) return pa[1] < pb[1];
+            if (pa[2] != pb[2]) return pa[2] < pb[2];
+            return a < b;
+        });
+        QVector<uint32_t> weld = QVector<uint32_t>(vertexCount);
+        for (int i = 0; i < vertexCount; ++i) {
+            uint32_t previous[3];
+            uint32_t current[3];
+            if (i > 0) {
+                positionBits(order[i - 1], previous);
+                positionBits(order[i], current);
+            }
+            weld[int(order[i])] = i > 0 && memcmp(previous, current, sizeof(current)) == 0 ? weld[int(order[i - 1])] : order[i];
+        }
+
+        QVector<uint32_t> triangles;
+        triangles.reserve(indices.size());
+        for (int i = 0; i + 2 < indices.size(); i += 3) {
+            uint32_t a = weld[int(indices[i])];
+            uint32_t b = weld[int(indices[i + 1])];
+            uint32_t c = weld[int(indices[i + 2])];
+            if (a == b || b == c || c == a) continue;
+            triangles.push_back(a);
+            triangles.push_back(b);
+            triangles.push_back(c);
+        }
+
+        // Errors are reported relative to the mesh's size so levels of different meshes compare
+        float minimum[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+        float maximum[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+        for (uint32_t index : triangles) {
+            for (int c = 0; c < 3; ++c) {
+                minimum[c] = qMin(minimum[c], position(index)[c]);
+                maximum[c] = qMax(maximum[c], position(index)[c]);
+            }
+        }
+        double extent = triangles.isEmpty() ? 0.0 : std::sqrt(double(maximum[0] - minimum[0]) * double(maximum[0] - minimum[0])
+                + double(maximum[1] - minimum[1]) * double(maximum[1] - minimum[1]) + double(maximum[2] - minimum[2]) * double(maximum[2] - minimum[2]));
+
+        QVector<Quadric> quadrics = QVector<Quadric>(vertexCount, Quadric());
+        for (int i = 0; i < triangles.size(); i += 3) {
+            double normal[3];
+            TriangleNormal(position(triangles[i]), position(triangles[i + 1]), position(triangles[i + 2]), normal);
+            double area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (area <= 0.0) continue;
+            normal[0] /= area;
+            normal[1] /= area;
+            normal[2] /= area;
+            const float* p = position(triangles[i]);
+            double d = -(normal[0] * double(p[0]) + normal[1] * double(p[1]) + normal[2] * double(p[2]));
+            for (int k = 0; k < 3; ++k) {
+                AddPlane(quadrics[int(triangles[i + k])], normal, d, area);
+            }
+        }
+
+        // Any edge without exactly two triangles is a border or non manifold, moving its vertices would open holes
+        QVector<bool> locked = QVector<bool>(vertexCount, false);
+        {
+            QHash<quint64, uint32_t> edgeCounts;
+            edgeCounts.reserve(triangles.size());
+            for (int i = 0; i < triangles.size(); ++i) {
+                uint32_t a = triangles[i];
+                uint32_t b = triangles[i % 3 == 2 ? i - 2 : i + 1];
+                edgeCounts[quint64(qMin(a, b)) << 32 | qMax(a, b)]++;
+            }
+            for (auto it = edgeCounts.constBegin(); it != edgeCounts.constEnd(); ++it) {
+                if (it.value() == 2) continue;
+                locked[int(it.key() >> 32)] = true;
+                locked[int(it.key() & 0xFFFFFFFF)] = true;
+            }
+        }
+
+        struct Collapse {
+            uint32_t from; // Removed, its triangles move to the position of to
+            uint32_t to;
+            double error;
+        };
+        QVector<int> adjacencyOffsets;
+        QVector<int> adjacency;
+        QVector<uint32_t> remap = QVector<uint32_t>(vertexCount);
+        QVector<bool> collapsed = QVector<bool>(vertexCount);
+        QVector<Collapse> collapses;
+        uint32_t targetTriangles = targetIndexCount / 3;
+        uint32_t triangleCount = uint32_t(triangles.size() / 3);
+        double maxError = 0.0;
+
+        // Each pass collapses the cheapest edges which don't share a vertex, so every collapse is costed against quadrics no other collapse has changed
+        while (triangleCount > targetTriangles) {
+            adjacencyOffsets.fill(0, vertexCount + 1);
+            for (uint32_t index : triangles) {
+                adjacencyOffsets[int(index) + 1]++;
+            }
+            for (int v = 0; v < vertexCount; ++v) {
+                adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+            }
+            adjacency.resize(triangles.size());
+            QVector<int> fill = adjacencyOffsets;
+            for (int i = 0; i < triangles.size(); ++i) {
+                adjacency[fill[int(triangles[i])]++] = i / 3;
+            }
+
+            // Interior edges are in two triangles in opposite directions, so taking them from lower to higher index finds each once
+            collapses.clear();
+            for (int i = 0; i < triangles.size(); ++i) {
+                uint32_t a = triangles[i];
+                uint32_t b = triangles[i % 3 == 2 ? i - 2 : i + 1];
+                if (a > b || (locked[int(a)] && locked[int(b)])) continue;
+                Quadric q = quadrics[int(a)];
+                AddQuadric(q, quadrics[int(b)]);
+                double toB = locked[int(a)] ? std::numeric_limits<double>::max() : QuadricError(q, position(b));
+                double toA = locked[int(b)] ? std::numeric_limits<double>::max() : QuadricError(q, position(a));
+                if (toB <= toA) collapses.push_back({ a, b, toB });
+                else collapses.push_back({ b, a, toA });
+            }
+            if (collapses.isEmpty()) break;
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+            // Each collapse removes about two triangles, edges much worse than the ones needed are left for later passes to re-cost
+            int needed = qMin(int((triangleCount - targetTriangles + 1) / 2), collapses.size());
+            double errorLimit = collapses[qMax(needed - 1, 0)].error * 1.5;
+
+            std::iota(remap.begin(), remap.end(), 0u);
+            collapsed.fill(false);
+            auto corner = [&](int triangle, int k) { return remap[int(triangles[3 * triangle + k])]; };
+            int passCollapses = 0;
+            for (const Collapse& collapse : collapses) {
+                if (triangleCount <= targetTriangles || collapse.error > errorLimit) break;
+                if (collapsed[int(collapse.from)] || collapsed[int(collapse.to)]) continue;
+
+                // Triangles which keep their area must not turn over
+                bool flips = false;
+                uint32_t removed = 0;
+                for (int a = adjacencyOffsets[int(collapse.from)]; a < adjacencyOffsets[int(collapse.from) + 1] && !flips; ++a) {
+                    uint32_t tri[3] = { corner(adjacency[a], 0), corner(adjacency[a], 1), corner(adjacency[a], 2) };
+                    if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0]) continue;
+                    if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+                        ++removed;
+                        continue;
+                    }
+                    double before[3];
+                    double after[3];
+                    TriangleNormal(position(tri[0]), position(tri[1]), position(tri[2]), before);
+                    for (uint32_t& index : tri) {
+                        if (index == collapse.from) index = collapse.to;
+                    }
+                    TriangleNormal(position(tri[0]), position(tri[1]), position(tri[2]), after);
+                    flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0;
+                }
+                if (flips) continue;
+
+                remap[int(collapse.from)] = collapse.to;
+                AddQuadric(quadrics[int(collapse.to)], quadrics[int(collapse.from)]);
+                collapsed[int(collapse.from)] = true;
+                collapsed[int(collapse.to)] = true;
+                triangleCount -= qMin(removed, triangleCount);
+                maxError = qMax(maxError, collapse.error);
+                ++passCollapses;
+            }
+            if (passCollapses == 0) break;
+
+            QVector<uint32_t> remaining;
+            remaining.reserve(triangles.size());
+            for (int t = 0; t < triangles.size() / 3; ++t) {
+                uint32_t a = corner(t, 0);
+                uint32_t b = corner(t, 1);
+                uint32_t c = corner(t, 2);
+                if (a == b || b == c || c == a) continue;
+                remaining.push_back(a);
+                remaining.push_back(b);
+                remaining.push_back(c);
+            }
+            triangles.swap(remaining);
+            triangleCount = uint32_t(triangles.size() / 3);
+        }
+
+        indices.swap(triangles);
+        return extent > 0.0 ? float(std::sqrt(maxError) / extent) : 0.0f;
+    }
+
+    VertexCacheStatistics MeshOptimiser::AnalyseVertexCache(const QVector<uint32_t>& indices, uint32_t vertexCount, int cacheSize) {
+        VertexCacheStatistics statistics;
+        if (indices.size() < 3 || vertexCount == 0) return statistics;
+
+        // A vertex is still in the FIFO if fewer than cacheSize misses have happened since it was loaded
+        QVector<uint32_t> timestamps = QVector<uint32_t>(int(vertexCount), 0);
+        uint32_t timestamp = uint32_t(cacheSize) + 1;
+        uint32_t misses = 0;
+        for (uint32_t index : indices) {
+            if (timestamp - timestamps[int(index)] > uint32_t(cacheSize)) {
+                timestamps[int(index)] = timestamp++;
+                ++misses;
+            }
+        }
+        statistics.acmr = float(misses) / float(indices.size() / 3);
+        statistics.atvr = float(misses) / float(vertexCount);
+        return statistics;
+    }
+
+    float MeshOptimiser::AnalyseVertexFetch(const QVector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexSize) {
+        if (vertexCount == 0 || vertexSize == 0) return 0.0f;
+        uint32_t lineCount = (vertexCount * vertexSize + FetchLineSize - 1) / FetchLineSize;
+        QVector<uint32_t> timestamps = QVector<uint32_t>(int(lineCount), 0);
+        uint32_t timestamp = FetchCacheLines + 1;
+        uint64_t fetched = 0;
+        for (uint32_t index : indices) {
+            uint32_t first = index * vertexSize / FetchLineSize;
+            uint32_t last = (index * vertexSize + vertexSize - 1) / FetchLineSize;
+            for (uint32_t line = first; line <= last; ++line) {
+                if (timestamp - timestamps[int(line)] > FetchCacheLines) {
+                    timestamps[int(line)] = timestamp++;
+                    fetched += FetchLineSize;
+                }
+            }
+        }
+        return float(double(fetched) / double(uint64_t(vertexCount) * vertexSize));
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef MESHOPTIMISER_H
+#define MESHOPTIMISER_H
+
+#include <QVector>
+
+namespace vpa {
+    struct VertexCacheStatistics {
+        float acmr = 0.0f; // Vertex shader invocations per triangle
+        float atvr = 0.0f; // Vertex shader invocations per vertex, 1.0 is optimal
+    };
+
+    // Index reordering for indexed triangle lists, every function expects indices.size() to be a multiple of 3
+    class MeshOptimiser final {
+    public:
+        static constexpr int CacheSize = 32;
+
+        // Forsyth's linear speed vertex cache optimisation
+        static void OptimiseVertexCache(QVector<uint32_t>& indices, uint32_t vertexCount);
+        // Reorders clusters of the cache optimised order front to back, giving up at most threshold times the ACMR.
+        // stride and positionOffset are in floats.
+        static void OptimiseOverdraw(QVector<uint32_t>& indices, const QVector<float>& vertices, uint32_t stride, uint32_t positionOffset, float threshold = 1.05f);
+        // Moves vertices in to the order they are first used, dropping unused ones. Returns the new vertex count.
+        static uint32_t OptimiseVertexFetch(QVector<uint32_t>& indices, QVector<float>& vertices, uint32_t stride);
+        // Quadric error metric edge collapse until at most targetIndexCount indices remain or nothing more can be collapsed.
+        // Only the indices change, vertices at the same position are welded and those on open or non manifold edges stay put.
+        // Returns the largest collapse's error as a fraction of the mesh's bounding box diagonal.
+        static float SimplifyMesh(QVector<uint32_t>& indices, const QVector<float>& vertices, uint32_t stride, uint32_t positionOffset, uint32_t targetIndexCount);
+
+        static VertexCacheStatistics AnalyseVertexCache(const QVector<uint32_t>& indices, uint32_t vertexCount, int cacheSize = CacheSize);
+        // Bytes fetched through a small cache of 64 byte lines over the size of the vertex buffer, 1.0 is optimal
+        static float AnalyseVertexFetch(const QVector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexSize);
+    };
+}
+
+#endif // MESHOPTIMISER_H
@@ -0,0 +1,462 @@
+#include "objparser.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrentMap>
+#include <cmath>
+#include <cstring>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "../tiny_obj_loader.h"
+
+namespace vpa {
+    // Chunks smaller than this aren't worth handing to another thread
+    static constexpr qint64 MinChunkSize = 1 << 20;
+
+    static constexpr uchar RelativeVertex = 1;
+    static constexpr uchar RelativeTexcoord = 2;
+    static constexpr uchar RelativeNormal = 4;
+
+    static const double Pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    struct ObjChunk {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        bool failed = false;
+
+        QVector<float> positions;
+        QVector<float> texcoords;
+        QVector<float> normals;
+        // Negative obj indices are relative to the count so far, those are stored relative to the start of this chunk and flagged
+        QVector<ObjIndex> indices;
+        QVector<uchar> relative;
+        QVector<ObjShape> shapes;
+
+        // Where this chunk lands in the merged mesh
+        int positionOffset = 0;
+        int texcoordOffset = 0;
+        int normalOffset = 0;
+        int indexOffset = 0;
+    };
+
+    static inline bool IsSpace(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    static inline bool IsDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static inline const char* SkipSpaces(const char* p, const char* end) {
+        while (p < end && IsSpace(*p)) ++p;
+        return p;
+    }
+
+    // Decimal and scientific notation only, anything else (nan, inf, hex) is left to tinyobj
+    static inline bool ParseFloat(const char*& p, const char* end, float& value) {
+        p = SkipSpaces(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            ++p;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+        for (; p < end && IsDigit(*p); ++p) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                if (mantissa > 0) ++digits;
+            }
+            else {
+                ++exponent;
+            }
+            any = true;
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && IsDigit(*p); ++p) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + uint64_t(*p - '0');
+                    if (mantissa > 0) ++digits;
+                    --exponent;
+                }
+                any = true;
+            }
+        }
+        if (!any) return false;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negativeExponent = *p == '-';
+                ++p;
+            }
+            if (p >= end || !IsDigit(*p)) return false;
+            int e = 0;
+            for (; p < end && IsDigit(*p); ++p) {
+                if (e < 10000) e = e * 10 + (*p - '0');
+            }
+            exponent += negativeExponent ? -e : e;
+        }
+        if (p < end && !IsSpace(*p)) return false;
+
+        double result = double(mantissa);
+        if (exponent < 0) result = exponent >= -22 ? result / Pow10[-exponent] : result * std::pow(10.0, exponent);
+        else if (exponent > 0) result = exponent <= 22 ? result * Pow10[exponent] : result * std::pow(10.0, exponent);
+        value = float(negative ? -result : result);
+        return true;
+    }
+
+    static inline bool ParseIndex(const char*& p, const char* end, int localCount, int& index, uchar& relative, uchar relativeBit) {
+        bool negative = false;
+        if (p < end && *p == '-') {
+            negative = true;
+            ++p;
+        }
+        int value = 0;
+        bool any = false;
+        for (; p < end && IsDigit(*p); ++p) {
+            if (value < 100000000) value = value * 10 + (*p - '0');
+            any = true;
+        }
+        if (!any || value == 0) return false;
+
+        if (negative) {
+            index = localCount - value;
+            relative |= relativeBit;
+        }
+        else {
+            index = value - 1;
+        }
+        return true;
+    }
+
+    static bool ParseFace(ObjChunk& chunk, const char* p, const char* end, QVector<ObjIndex>& face, QVector<uchar>& faceRelative) {
+        face.clear();
+        faceRelative.clear();
+        while ((p = SkipSpaces(p, end)) < end) {
+            ObjIndex corner;
+            uchar relative = 0;
+            if (!ParseIndex(p, end, chunk.positions.size() / 3, corner.vertex, relative, RelativeVertex)) return false;
+            if (p < end && *p == '/') {
+                ++p;
+                if (p < end && *p != '/') {
+                    if (!ParseIndex(p, end, chunk.texcoords.size() / 2, corner.texcoord, relative, RelativeTexcoord)) return false;
+                }
+                if (p < end && *p == '/') {
+                    ++p;
+                    if (!ParseIndex(p, end, chunk.normals.size() / 3, corner.normal, relative, RelativeNormal)) return false;
+                }
+            }
+            if (p < end && !IsSpace(*p)) return false;
+            face.push_back(corner);
+            faceRelative.push_back(relative);
+        }
+        if (face.size() < 3) return false;
+
+        // Polygons are triangulated as a fan, the same as tinyobj
+        for (int i = 1; i + 1 < face.size(); ++i) {
+            chunk.indices.push_back(face[0]);
+            chunk.indices.push_back(face[i]);
+            chunk.indices.push_back(face[i + 1]);
+            chunk.relative.push_back(faceRelative[0]);
+            chunk.relative.push_back(faceRelative[i]);
+            chunk.relative.push_back(faceRelative[i + 1]);
+        }
+        return true;
+    }
+
+    static bool ParseLine(ObjChunk& chunk, const char* p, const char* end, QVector<ObjIndex>& face, QVector<uchar>& faceRelative) {
+        if (p == end || *p == '#') return true;
+
+        if (p[0] == 'v' && end - p > 1 && IsSpace(p[1])) {
+            // Optional w or vertex colours after the position are ignored
+            float x, y, z;
+            p += 1;
+            if (!ParseFloat(p, end, x) || !ParseFloat(p, end, y) || !ParseFloat(p, end, z)) return false;
+            chunk.positions.push_back(x);
+            chunk.positions.push_back(y);
+            chunk.positions.push_back(z);
+            return true;
+        }
+        if (p[0] == 'v' && end - p > 2 && p[1] == 't' && IsSpace(p[2])) {
+            float u, v = 0.0f;
+            p += 2;
+            if (!ParseFloat(p, end, u)) return false;
+            if (SkipSpaces(p, end) < end && !ParseFloat(p, end, v)) return false;
+            chunk.texcoords.push_back(u);
+            chunk.texcoords.push_back(v);
+            return true;
+        }
+        if (p[0] == 'v' && end - p > 2 && p[1] == 'n' && IsSpace(p[2])) {
+            float x, y, z;
+            p += 2;
+            if (!ParseFloat(p, end, x) || !ParseFloat(p, end, y) || !ParseFloat(p, end, z)) return false;
+            chunk.normals.push_back(x);
+            chunk.normals.push_back(y);
+            chunk.normals.push_back(z);
+            return true;
+        }
+        if (p[0] == 'f' && end - p > 1 && IsSpace(p[1])) {
+            return ParseFace(chunk, p + 1, end, face, faceRelative);
+        }
+        if ((p[0] == 'o' || p[0] == 'g') && (end - p == 1 || IsSpace(p[1]))) {
+            const char* name = SkipSpaces(p + 1, end);
+            const char* nameEnd = end;
+            while (nameEnd > name && IsSpace(nameEnd[-1])) --nameEnd;
+            ObjShape shape;
+            shape.name = QString::fromUtf8(name, int(nameEnd - name));
+            shape.firstIndex = chunk.indices.size();
+            chunk.shapes.push_back(shape);
+            return true;
+        }
+        if (p[0] == '\\' || (end > p && end[-1] == '\\')) return false; // Line continuations
+        // Materials, smoothing groups, lines and points aren't used
+        return true;
+    }
+
+    static void ParseChunk(ObjChunk& chunk) {
+        QVector<ObjIndex> face;
+        QVector<uchar> faceRelative;
+        const char* p = chunk.begin;
+        while (p < chunk.end) {
+            const char* lineEnd = static_cast<const char*>(memchr(p, '\n', size_t(chunk.end - p)));
+            if (!lineEnd) lineEnd = chunk.end;
+            const char* contentEnd = lineEnd;
+            if (contentEnd > p && contentEnd[-1] == '\r') --contentEnd;
+            if (!ParseLine(chunk, SkipSpaces(p, contentEnd), contentEnd, face, faceRelative)) {
+                chunk.failed = true;
+                return;
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    VPAError ObjParser::Parse(const QString& path, ObjMesh& mesh, int threadCount) {
+        mesh = ObjMesh();
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) return VPA_WARN("Could not open " + path);
+        qint64 size = file.size();
+        if (size == 0) return VPA_WARN(path + " is empty");
+        uchar* data = file.map(0, size);
+        if (!data) return VPA_WARN("Could not map " + path);
+        const char* begin = reinterpret_cast<const char*>(data);
+        const char* end = begin + size;
+
+        if (threadCount <= 0) threadCount = QThread::idealThreadCount();
+        int chunkCount = int(qBound(qint64(1), size / MinChunkSize, qint64(qMax(threadCount, 1))));
+        QVector<ObjChunk> chunks(chunkCount);
+        const char* chunkBegin = begin;
+        for (int i = 0; i < chunkCount; ++i) {
+            const char* chunkEnd = begin + size * (i + 1) / chunkCount;
+            // Splits move forward to just past a line break so every line belongs to exactly one chunk
+            if (chunkEnd < chunkBegin) chunkEnd = chunkBegin;
+            if (chunkEnd < end) {
+                const char* lineBreak = static_cast<const char*>(memchr(chunkEnd, '\n', size_t(end - chunkEnd)));
+                chunkEnd = lineBreak ? lineBreak + 1 : end;
+            }
+            chunks[i].begin = chunkBegin;
+            chunks[i].end = chunkEnd;
+            chunkBegin = chunkEnd;
+        }
+
+        QtConcurrent::blockingMap(chunks, ParseChunk);
+
+        int positionCount = 0;
+        int texcoordCount = 0;
+        int normalCount = 0;
+        int indexCount = 0;
+        for (ObjChunk& chunk : chunks) {
+            if (chunk.failed) {
+                file.unmap(data);
+                return VPA_WARN("Unsupported obj syntax in " + path);
+            }
+            chunk.positionOffset = positionCount;
+            chunk.texcoordOffset = texcoordCount;
+            chunk.normalOffset = normalCount;
+            chunk.indexOffset = indexCount;
+            positionCount += chunk.positions.size();
+            texcoordCount += chunk.texcoords.size();
+            normalCount += chunk.normals.size();
+            indexCount += chunk.indices.size();
+        }
+
+        // Chunks are merged in file order so the result doesn't depend on the thread count
+        mesh.positions.resize(positionCount);
+        mesh.texcoords.resize(texcoordCount);
+        mesh.normals.resize(normalCount);
+        mesh.indices.resize(indexCount);
+        float* positions = mesh.positions.data();
+        float* texcoords = mesh.texcoords.data();
+        float* normals = mesh.normals.data();
+        ObjIndex* indices = mesh.indices.data();
+        int vertexTotal = positionCount / 3;
+        int texcoordTotal = texcoordCount / 2;
+        int normalTotal = normalCount / 3;
+
+        QtConcurrent::blockingMap(chunks, [=](ObjChunk& chunk) {
+            memcpy(positions + chunk.positionOffset, chunk.positions.constData(), size_t(chunk.positions.size()) * sizeof(float));
+            memcpy(texcoords + chunk.texcoordOffset, chunk.texcoords.constData(), size_t(chunk.texcoords.size()) * sizeof(float));
+            memcpy(normals + chunk.normalOffset, chunk.normals.constData(), size_t(chunk.normals.size()) * sizeof(float));
+
+            ObjIndex* out = indices + chunk.indexOffset;
+            for (int i = 0; i < chunk.indices.size(); ++i) {
+                ObjIndex index = chunk.indices[i];
+                uchar relative = chunk.relative[i];
+                if (relative & RelativeVertex) index.vertex += chunk.positionOffset / 3;
+                if (relative & RelativeTexcoord) index.texcoord += chunk.texcoordOffset / 2;
+                if (relative & RelativeNormal) index.normal += chunk.normalOffset / 3;
+                if (index.vertex < 0 || index.vertex >= vertexTotal || index.texcoord >= texcoordTotal || index.normal >= normalTotal
+                        || (relative & RelativeTexcoord && index.texcoord < 0) || (relative & RelativeNormal && index.normal < 0)) {
+                    chunk.failed = true;
+                    return;
+                }
+                out[i] = index;
+            }
+        });
+        file.unmap(data);
+
+        for (const ObjChunk& chunk : chunks) {
+            if (chunk.failed) {
+                mesh = ObjMesh();
+                return VPA_WARN("Face index out of range in " + path);
+            }
+        }
+
+        // Faces before the first o or g line belong to an unnamed shape, shapes without faces are dropped
+        QVector<ObjShape> shapes = { ObjShape() };
+        for (const ObjChunk& chunk : chunks) {
+            for (ObjShape shape : chunk.shapes) {
+                shape.firstIndex += chunk.indexOffset;
+                shapes.push_back(shape);
+            }
+        }
+        for (int i = 0; i < shapes.size(); ++i) {
+            int next = i + 1 < shapes.size() ? shapes[i + 1].firstIndex : indexCount;
+            shapes[i].indexCount = next - shapes[i].firstIndex;
+            if (shapes[i].indexCount > 0) mesh.shapes.push_back(shapes[i]);
+        }
+        return VPA_OK;
+    }
+
+    VPAError ObjParser::ParseTinyObj(const QString& path, ObjMesh& mesh) {
+        mesh = ObjMesh();
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string objErr;
+        std::string warn;
+        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &objErr, path.toLatin1().data())) {
+            if (!objErr.empty()) return VPA_WARN(QString::fromStdString(objErr));
+            return VPA_WARN("Obj mesh loading failed.");
+        }
+        if (!warn.empty()) qDebug(warn.c_str());
+
+        mesh.positions.resize(int(attrib.vertices.size()));
+        memcpy(mesh.positions.data(), attrib.vertices.data(), attrib.vertices.size() * sizeof(float));
+        mesh.texcoords.resize(int(attrib.texcoords.size()));
+        memcpy(mesh.texcoords.data(), attrib.texcoords.data(), attrib.texcoords.size() * sizeof(float));
+        mesh.normals.resize(int(attrib.normals.size()));
+        memcpy(mesh.normals.data(), attrib.normals.data(), attrib.normals.size() * sizeof(float));
+
+        for (const auto& shape : shapes) {
+            ObjShape objShape;
+            objShape.name = QString::fromStdString(shape.name);
+            objShape.firstIndex = mesh.indices.size();
+            objShape.indexCount = int(shape.mesh.indices.size());
+            for (const auto& index : shape.mesh.indices) {
+                ObjIndex objIndex;
+                objIndex.vertex = index.vertex_index;
+                objIndex.texcoord = index.texcoord_index;
+                objIndex.normal = index.normal_index;
+                mesh.indices.push_back(objIndex);
+            }
+            if (objShape.indexCount > 0) mesh.shapes.push_back(objShape);
+        }
+        return VPA_OK;
+    }
+
+    // Patches of a displaced grid with texcoords and normals, alternating between absolute and relative face indices
+    static VPAError WriteBenchmarkMesh(const QString& path, qint64 targetSize) {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) return VPA_WARN("Could not open " + path);
+
+        const int patchSize = 64;
+        char line[128];
+        QByteArray buffer;
+        int vertexBase = 0;
+        for (int patch = 0; file.size() < targetSize; ++patch) {
+            buffer.clear();
+            buffer += "o patch" + QByteArray::number(patch) + "\n";
+            for (int y = 0; y < patchSize; ++y) {
+                for (int x = 0; x < patchSize; ++x) {
+                    float px = float(x + patch * (patchSize - 1));
+                    float pz = float(y);
+                    buffer.append(line, snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", double(px), std::sin(double(px) * 0.1) * std::cos(double(pz) * 0.1), double(pz)));
+                    buffer.append(line, snprintf(line, sizeof(line), "vt %.6f %.6f\n", double(x) / (patchSize - 1), double(y) / (patchSize - 1)));
+                    buffer.append(line, snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", 0.0, 1.0, 0.0));
+                }
+            }
+            const int patchVertices = patchSize * patchSize;
+            for (int y = 0; y < patchSize - 1; ++y) {
+                for (int x = 0; x < patchSize - 1; ++x) {
+                    int a = y * patchSize + x;
+                    int b = a + 1;
+                    int c = a + patchSize;
+                    int d = c + 1;
+                    if (patch % 2 == 0) {
+                        int o = vertexBase + 1;
+                        buffer.append(line, snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                                                     a + o, a + o, a + o, c + o, c + o, c + o, d + o, d + o, d + o, b + o, b + o, b + o));
+                    }
+                    else {
+                        a -= patchVertices; b -= patchVertices; c -= patchVertices; d -= patchVertices;
+                        buffer.append(line, snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                                                     a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d));
+                    }
+                }
+            }
+            vertexBase += patchVertices;
+            if (file.write(buffer) != buffer.size()) return VPA_WARN("Could not write " + path);
+        }
+        return VPA_OK;
+    }
+
+    VPAError ObjParser::Benchmark(const QString& path, int sizeMB) {
+        qDebug("Generating %d MB benchmark obj at %s", sizeMB, qPrintable(path));
+        VPAError err = WriteBenchmarkMesh(path, qint64(sizeMB) * 1024 * 1024);
+        if (err != VPA_OK) {
+            QFile::remove(path);
+            return err;
+        }
+        double megabytes = double(QFileInfo(path).size()) / (1024.0 * 1024.0);
+
+        ObjMesh mesh;
+        QElapsedTimer timer;
+        int threads = QThread::idealThreadCount();
+        for (int threadCount : { threads, 1 }) {
+            timer.start();
+            err = Parse(path, mesh, threadCount);
+            if (err != VPA_OK) break;
+            double seconds = timer.nsecsElapsed() / 1e9;
+            qDebug("ObjParser, %d threads: %.1f MB/s (%.2f s, %d vertices, %d triangles)", threadCount, megabytes / seconds, seconds,
+                   mesh.positions.size() / 3, mesh.indices.size() / 3);
+        }
+        if (err == VPA_OK) {
+            timer.start();
+            err = ParseTinyObj(path, mesh);
+            double seconds = timer.nsecsElapsed() / 1e9;
+            if (err == VPA_OK) qDebug("tinyobj: %.1f MB/s (%.2f s)", megabytes / seconds, seconds);
+        }
+        QFile::remove(path);
+        return err;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include <QVector>
+#include <QHash>
+
+#include "../common.h"
+
+namespace vpa {
+    // Zero based indices in to the ObjMesh arrays, -1 when the face corner doesn't have one
+    struct ObjIndex {
+        int vertex = -1;
+        int texcoord = -1;
+        int normal = -1;
+    };
+
+    inline bool operator==(const ObjIndex& a, const ObjIndex& b) {
+        return a.vertex == b.vertex && a.texcoord == b.texcoord && a.normal == b.normal;
+    }
+
+    inline uint qHash(const ObjIndex& key, uint seed = 0) {
+        return ::qHash(qMakePair(key.vertex, qMakePair(key.texcoord, key.normal)), seed);
+    }
+
+    struct ObjShape {
+        QString name;
+        int firstIndex = 0;
+        int indexCount = 0;
+    };
+
+    struct ObjMesh {
+        QVector<float> positions; // xyz
+        QVector<float> texcoords; // uv
+        QVector<float> normals; // xyz
+        QVector<ObjIndex> indices; // Triangulated face corners of every shape
+        QVector<ObjShape> shapes;
+    };
+
+    class ObjParser final {
+    public:
+        // Maps the file and parses it in chunks split on line boundaries, one chunk per thread.
+        // Fails on syntax it doesn't understand, in which case ParseTinyObj should be used.
+        static VPAError Parse(const QString& path, ObjMesh& mesh, int threadCount = 0);
+        static VPAError ParseTinyObj(const QString& path, ObjMesh& mesh);
+
+        // Generates an obj of roughly sizeMB at path and logs the throughput of each parser
+        static VPAError Benchmark(const QString& path, int sizeMB);
+
+    private:
+        ObjParser() = default;
+        ~ObjParser() = default;
+    };
+}
+
+#endif // OBJPARSER_H
@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <QFile>
+#include <QSet>
 
 #include "spirvresource.h"
 #include "../common.h"
@@ -77,6 +78,97 @@ namespace vpa {
         float blendConstants[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
     };
 
+    // Vertex buffer formats, all of which decode to floats in the shader
+    enum class VertexPositionFormat {
+        Float32,
+        Float16,
+        Count_
+    };
+
+    enum class VertexNormalFormat {
+        Float32,
+        Snorm8,
+        Snorm10, // A2B10G10R10
+        Count_
+    };
+
+    enum class VertexTexCoordFormat {
+        Float32,
+        Float16,
+        Unorm16, // Falls back to Float16 for meshes with texcoords outside 0 to 1
+        Count_
+    };
+
+    enum class VertexColourFormat {
+        Float32,
+        Unorm8,
+        Count_
+    };
+
+    struct VertexFormatConfig {
+        VertexPositionFormat position = VertexPositionFormat::Float32;
+        VertexNormalFormat normal = VertexNormalFormat::Float32;
+        VertexTexCoordFormat texCoord = VertexTexCoordFormat::Float32;
+        VertexColourFormat colour = VertexColourFormat::Float32;
+    };
+
+    // How vertex attributes are split between vertex buffer bindings
+    enum class VertexStreamLayout {
+        Interleaved, // Every attribute in binding 0
+        PositionSplit, // Position in binding 0, everything else interleaved in binding 1
+        PerAttribute, // One binding per attribute
+        Count_
+    };
+
+    // Where the preview's mesh comes from, the generated shapes are for stressing vertex and raster throughput
+    enum class MeshSource {
+        File,
+        Grid,
+        Sphere, // Cube mapped on to a sphere
+        TriangleSoup, // Unconnected triangles scattered through a cube
+        Count_
+    };
+
+    // How the mip chains of loaded textures are made, storage images only ever have one level
+    enum class MipGeneration {
+        None,
+        Blit, // vkCmdBlitImage from each level to the next, falls back to Cpu when the format can't be linearly blitted
+        Cpu, // 2x2 box filter on the host, every level is uploaded
+        Count_
+    };
+
+    struct TextureConfig {
+        MipGeneration mipGeneration = MipGeneration::Blit;
+        uint32_t mipLevels = 0; // 0 for the full chain
+        float lodBias = 0.0f;
+        bool transcode = false; // Decoded images are encoded to BC1 or BC3 once and read from the texture cache after that
+        uint32_t residencyBudget = 512; // MiB of loaded images kept on the device, unused images beyond it are evicted
+    };
+
+    // How the shaders' descriptors are laid out and bound, changing any of it reloads the shaders
+    struct DescriptorConfig {
+        QSet<QString> dynamicBuffers; // Binding keys of buffers bound at a dynamic offset in to a per frame ring, see Descriptors::BindingKey
+        int pushDescriptorSet = -1; // Set written in to the command buffer with vkCmdPushDescriptorSetKHR instead of being allocated, -1 for none
+        uint32_t bindlessCapacity = 1024; // Descriptors given to each runtime array of sampled images, clamped to the device's update after bind limits
+    };
+
+    // Settings for how the preview is drawn, these are not part of the pipeline and are not written out
+    struct PreviewConfig {
+        MeshSource source = MeshSource::File;
+        QString mesh = MESHDIR"Teapot.obj"; // .obj, .gltf or .glb
+        float generatedTriangles = 1.0f; // Millions
+        float generatedSize = 1.0f; // Half extent of grids and spheres, triangle size of soups
+        bool optimiseMesh = true;
+        VertexFormatConfig vertexFormats;
+        VertexStreamLayout streamLayout = VertexStreamLayout::Interleaved;
+        uint32_t instanceCount = 1;
+        bool indirectDraw = false; // An indexed indirect command per obj shape or glTF primitive
+        bool interactiveLod = false; // Draw a simplified level while settings are being changed
+        uint32_t lodTriangleBudget = 100000; // Across every instance
+        TextureConfig textures;
+        DescriptorConfig descriptors;
+    };
+
     struct PipelineConfig {
         VPAError LoadConfiguration(std::vector<char>& buffer, const int bufferSize);
 
@@ -109,6 +201,7 @@ namespace vpa {
         uint32_t attachmentCount = 0;
 
         WritablePipelineConfig writables;
+        PreviewConfig preview;
     };
 
     std::ostream& operator<<(std::ostream& out, const WritablePipelineConfig& config);
@@ -9,7 +9,8 @@ namespace vpa {
         Pipeline = 1,
         RenderPass = 2,
         Shaders = 4,
-        Validation = 8
+        Validation = 8,
+        Mesh = 16
     };
 
     inline constexpr size_t operator|(const ReloadFlagBits& f0, const ReloadFlagBits& f1) {
@@ -22,7 +23,8 @@ namespace vpa {
         RenderPass = ReloadFlagBits::RenderPass | ReloadFlagBits::Pipeline, // 0011
         Shaders = ReloadFlagBits::Shaders | ReloadFlagBits::Pipeline, // 0101
         EverythingNoValidation = (ReloadFlagBits::Shaders | ReloadFlagBits::RenderPass) | size_t(ReloadFlagBits::Pipeline), // 0111
-        Everything = (ReloadFlagBits::Shaders | ReloadFlagBits::RenderPass) | (ReloadFlagBits::Pipeline | ReloadFlagBits::Validation) // 1111
+        Everything = (ReloadFlagBits::Shaders | ReloadFlagBits::RenderPass) | (ReloadFlagBits::Pipeline | ReloadFlagBits::Validation), // 01111
+        Mesh = ReloadFlagBits::Mesh | ReloadFlagBits::Pipeline // 10001
     };
 
     inline constexpr bool operator&(const ReloadFlags& f0, const ReloadFlagBits& f1) {
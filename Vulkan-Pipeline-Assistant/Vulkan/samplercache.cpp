@@ -0,0 +1,96 @@
+#include "samplercache.h"
+
+#include <QVulkanDeviceFunctions>
+#include <cstddef>
+
+#include "vulkanmain.h"
+
+namespace vpa {
+    SamplerCache::SamplerCache(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs) : m_main(main), m_deviceFuncs(deviceFuncs), m_uses(0) { }
+
+    SamplerCache::~SamplerCache() {
+        // Only destroyed once the device is idle
+        for (Entry& entry : m_entries) {
+            DESTROY_HANDLE(m_main->Device(), entry.sampler, m_deviceFuncs->vkDestroySampler);
+        }
+    }
+
+    VPAError SamplerCache::Acquire(const VkSamplerCreateInfo& info, VkSampler& sampler) {
+        if (info.pNext != nullptr) return VPA_CRITICAL("Sampler create info with a pNext chain can't be cached");
+        const QByteArray key = Key(info);
+        auto it = m_entries.find(key);
+        if (it != m_entries.end()) {
+            if (it->references++ == 0) {
+                --m_statistics.unused;
+                ++m_statistics.live;
+            }
+            it->lastUsed = ++m_uses;
+            ++m_statistics.reused;
+            sampler = it->sampler;
+            return VPA_OK;
+        }
+
+        Entry entry;
+        VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreateSampler(m_main->Device(), &info, nullptr, &entry.sampler), "create cached sampler");
+        entry.references = 1;
+        entry.lastUsed = ++m_uses;
+        m_entries.insert(key, entry);
+        m_keys.insert(entry.sampler, key);
+        ++m_statistics.created;
+        ++m_statistics.live;
+        sampler = entry.sampler;
+        // Only trimmed here, so releasing everything while the renderer is torn down retires nothing
+        EvictUnused();
+        return VPA_OK;
+    }
+
+    void SamplerCache::Release(VkSampler& sampler) {
+        auto key = m_keys.find(sampler);
+        sampler = VK_NULL_HANDLE;
+        if (key == m_keys.end()) return;
+        Entry& entry = m_entries[*key];
+        if (--entry.references > 0) return;
+        --m_statistics.live;
+        ++m_statistics.unused;
+    }
+
+    VkSamplerCreateInfo SamplerCache::MakeCreateInfo(const SamplerState& state, float mipLodBias, float maxLod) {
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = state.magFilter;
+        samplerInfo.minFilter = state.minFilter;
+        samplerInfo.addressModeU = state.addressModeU;
+        samplerInfo.addressModeV = state.addressModeV;
+        samplerInfo.addressModeW = state.addressModeW;
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxAnisotropy = 0.0f;
+        samplerInfo.borderColor = state.borderColor;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+        samplerInfo.mipmapMode = state.mipmapMode;
+        samplerInfo.mipLodBias = mipLodBias;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = maxLod;
+        return samplerInfo;
+    }
+
+    QByteArray SamplerCache::Key(const VkSamplerCreateInfo& info) {
+        // Everything after pNext is a 32 bit value, so there is no padding to compare
+        const size_t offset = offsetof(VkSamplerCreateInfo, flags);
+        return QByteArray(reinterpret_cast<const char*>(&info) + offset, int(sizeof(VkSamplerCreateInfo) - offset));
+    }
+
+    void SamplerCache::EvictUnused() {
+        while (m_statistics.unused > uint32_t(MaxUnused)) {
+            auto oldest = m_entries.end();
+            for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+                if (it->references == 0 && (oldest == m_entries.end() || it->lastUsed < oldest->lastUsed)) oldest = it;
+            }
+            m_keys.remove(oldest->sampler);
+            m_main->RetireHandle(oldest->sampler, &QVulkanDeviceFunctions::vkDestroySampler);
+            m_entries.erase(oldest);
+            --m_statistics.unused;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef SAMPLERCACHE_H
+#define SAMPLERCACHE_H
+
+#include <QHash>
+#include <QByteArray>
+#include <vulkan/vulkan.h>
+
+#include "../common.h"
+
+class QVulkanDeviceFunctions;
+namespace vpa {
+    class VulkanMain;
+
+    // The parts of a sampler which can be edited per image binding, the LOD range and bias follow the image and TextureConfig
+    struct SamplerState {
+        VkFilter magFilter = VK_FILTER_LINEAR;
+        VkFilter minFilter = VK_FILTER_LINEAR;
+        VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        VkSamplerAddressMode addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        VkSamplerAddressMode addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        VkSamplerAddressMode addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        VkBorderColor borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    };
+
+    struct SamplerStatistics {
+        uint32_t live = 0; // Referenced by at least one descriptor
+        uint32_t unused = 0; // No longer referenced but kept for reuse
+        uint32_t created = 0;
+        uint32_t reused = 0; // Acquires answered by an existing sampler
+    };
+
+    // Samplers shared between every descriptor with the same create info, reference counted so reloads and edits reuse them
+    class SamplerCache final {
+    public:
+        // Unreferenced samplers beyond this are destroyed when the next one is created, least recently used first
+        static constexpr int MaxUnused = 32;
+
+        SamplerCache(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs);
+        ~SamplerCache();
+
+        // Every acquire must be matched by a release. pNext isn't part of the key so it must be null.
+        VPAError Acquire(const VkSamplerCreateInfo& info, VkSampler& sampler);
+        // Sampler is reset to VK_NULL_HANDLE, frames in flight may keep using it as destruction is deferred
+        void Release(VkSampler& sampler);
+
+        const SamplerStatistics& Statistics() const { return m_statistics; }
+
+        // The default create info with state applied
+        static VkSamplerCreateInfo MakeCreateInfo(const SamplerState& state, float mipLodBias, float maxLod);
+
+    private:
+        struct Entry {
+            VkSampler sampler = VK_NULL_HANDLE;
+            uint32_t references = 0;
+            uint64_t lastUsed = 0;
+        };
+
+        static QByteArray Key(const VkSamplerCreateInfo& info);
+        void EvictUnused();
+
+        VulkanMain* m_main;
+        QVulkanDeviceFunctions* m_deviceFuncs;
+        QHash<QByteArray, Entry> m_entries;
+        QHash<VkSampler, QByteArray> m_keys;
+        uint64_t m_uses;
+        SamplerStatistics m_statistics;
+    };
+}
+
+#endif // SAMPLERCACHE_H
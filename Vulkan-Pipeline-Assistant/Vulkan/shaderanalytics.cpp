@@ -490,7 +490,9 @@ namespace vpa {
                         res->name = QString::fromStdString(m_compilers[i]->get_name(resource.id));
                         if (res->name == "") res->name = QString::fromStdString(m_compilers[i]->get_name(resource.base_type_id));
                         res->group = new SpvDescriptorGroup(set, binding, StageToVkStageFlag(ShaderStage(i)), groups[k]);
-                        res->type = CreateType(m_compilers[i], resource);
+                        // The base type has any arrays stripped, arrays of images are kept so runtime arrays can be given a partially bound binding
+                        if (groups[k] == SpvGroupName::Image) res->type = CreateType(m_compilers[i], m_compilers[i]->get_type(resource.type_id));
+                        else res->type = CreateType(m_compilers[i], resource);
 
                         auto key = QPair<uint32_t, uint32_t>(set, binding);
                         if (m_descriptorLayoutMap.contains(key)) {
@@ -164,6 +164,14 @@ namespace vpa {
         SpvTypeName Type() const override {
             return SpvTypeName::Array;
         }
+        // Over every dimension, unsized dimensions count as 1
+        size_t ElementCount() const {
+            size_t count = 1;
+            for (size_t length : lengths) count *= length;
+            return count;
+        }
+        // Runtime arrays, which are only declared with descriptor indexing
+        bool Unsized() const { return lengthsUnsized.contains(true); }
         bool operator==(const SpvType* other) const override {
             return Type() == other->Type() &&
                     lengths == (reinterpret_cast<const SpvArrayType*>(other))->lengths &&
@@ -238,6 +246,12 @@ namespace vpa {
         }
     };
 
+    // Image descriptors may be arrays of images, every element has the subtype
+    inline const SpvImageType* ImageElementType(const SpvType* type) {
+        if (type->Type() == SpvTypeName::Array) type = reinterpret_cast<const SpvArrayType*>(type)->subtype;
+        return reinterpret_cast<const SpvImageType*>(type);
+    }
+
     inline QDebug operator<<(QDebug stream, const SpvType* type) {
         stream << "SpvType " << SpvTypeNameStrings[size_t(type->Type())] << " ";
         type->Print(stream);
@@ -0,0 +1,123 @@
+#include "texturecache.h"
+
+#include <QVulkanDeviceFunctions>
+#include <QFileInfo>
+#include <QDateTime>
+
+#include "vulkanmain.h"
+
+namespace vpa {
+    static VkDeviceSize ImageBytes(const ImageInfo& imageInfo) {
+        return qMax(imageInfo.descriptor.allocation.memorySize, imageInfo.descriptor.allocation.size);
+    }
+
+    TextureCache::TextureCache(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs, MemoryAllocator* allocator)
+        : m_main(main), m_deviceFuncs(deviceFuncs), m_allocator(allocator), m_uses(0) { }
+
+    TextureCache::~TextureCache() {
+        // Only destroyed once the device is idle
+        for (Entry& entry : m_entries) {
+            DESTROY_HANDLE(m_main->Device(), entry.image.view, m_deviceFuncs->vkDestroyImageView);
+            m_allocator->Deallocate(entry.image.descriptor.allocation);
+        }
+    }
+
+    QString TextureCache::MakeKey(const QString& source, const DecodeSettings& settings, const SpvImageType* type) {
+        QFileInfo info(source);
+        return QString("%1|%2|%3|%4|%5|%6|%7").arg(info.absoluteFilePath()).arg(info.lastModified().toMSecsSinceEpoch())
+                .arg(int(settings.textures.mipGeneration)).arg(settings.textures.mipLevels).arg(int(settings.transcode))
+                .arg(int(type->imageTypename)).arg(int(type->isArrayed));
+    }
+
+    bool TextureCache::Acquire(const QString& key, ImageInfo& imageInfo) {
+        auto it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            ++m_statistics.misses;
+            return false;
+        }
+        if (it->references++ == 0) {
+            --m_statistics.unused;
+            m_statistics.unusedBytes -= ImageBytes(it->image);
+        }
+        it->lastUsed = ++m_uses;
+        ++m_statistics.hits;
+
+        const ImageInfo& resident = it->image;
+        imageInfo.view = resident.view;
+        imageInfo.descriptor.allocation = resident.descriptor.allocation;
+        imageInfo.source = resident.source;
+        imageInfo.mipLevels = resident.mipLevels;
+        imageInfo.mipGeneration = resident.mipGeneration;
+        imageInfo.precompressed = resident.precompressed;
+        imageInfo.transcoded = resident.transcoded;
+        imageInfo.cacheHit = resident.cacheHit;
+        imageInfo.transcodeMilliseconds = resident.transcodeMilliseconds;
+        imageInfo.uploadMilliseconds = resident.uploadMilliseconds;
+        imageInfo.mipMilliseconds = resident.mipMilliseconds;
+        imageInfo.residentKey = key;
+        return true;
+    }
+
+    void TextureCache::Insert(const QString& key, ImageInfo& imageInfo) {
+        // Two loads of the same file can finish together, the later one stays with its binding
+        if (m_entries.contains(key)) return;
+
+        Entry entry;
+        entry.image = imageInfo;
+        entry.image.sampler = VK_NULL_HANDLE; // Samplers belong to the binding
+        entry.image.residentKey = key;
+        entry.references = 1;
+        entry.lastUsed = ++m_uses;
+        m_entries.insert(key, entry);
+        imageInfo.residentKey = key;
+
+        ++m_statistics.resident;
+        m_statistics.bytes += ImageBytes(imageInfo);
+        Evict();
+    }
+
+    bool TextureCache::Release(ImageInfo& imageInfo) {
+        auto it = m_entries.find(imageInfo.residentKey);
+        if (imageInfo.residentKey.isEmpty() || it == m_entries.end()) return false;
+        if (--it->references == 0) {
+            ++m_statistics.unused;
+            m_statistics.unusedBytes += ImageBytes(it->image);
+        }
+        imageInfo.view = VK_NULL_HANDLE;
+        imageInfo.descriptor.allocation = Allocation();
+        imageInfo.residentKey.clear();
+        return true;
+    }
+
+    void TextureCache::SetBudget(VkDeviceSize budget) {
+        m_statistics.budget = budget;
+        Evict();
+    }
+
+    void TextureCache::RememberBinding(const QString& binding, const QString& source, const SamplerState& samplerState) {
+        m_bindings[binding] = { source, samplerState };
+    }
+
+    void TextureCache::Evict() {
+        while (m_statistics.bytes > m_statistics.budget && m_statistics.unused > 0) {
+            auto oldest = m_entries.end();
+            for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+                if (it->references == 0 && (oldest == m_entries.end() || it->lastUsed < oldest->lastUsed)) oldest = it;
+            }
+
+            // Frames in flight may still sample an image which was unbound this frame
+            const VkDeviceSize bytes = ImageBytes(oldest->image);
+            m_main->RetireHandle(oldest->image.view, &QVulkanDeviceFunctions::vkDestroyImageView);
+            MemoryAllocator* allocator = m_allocator;
+            Allocation allocation = oldest->image.descriptor.allocation;
+            m_main->Retire([allocator, allocation]() mutable { allocator->Deallocate(allocation); });
+            m_entries.erase(oldest);
+
+            --m_statistics.resident;
+            --m_statistics.unused;
+            m_statistics.bytes -= bytes;
+            m_statistics.unusedBytes -= bytes;
+            ++m_statistics.evictions;
+        }
+    }
+}
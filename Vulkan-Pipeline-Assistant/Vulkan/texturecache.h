@@ -0,0 +1,69 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <QHash>
+
+#include "descriptors.h"
+
+namespace vpa {
+    // What a binding last showed, restored when the shaders are reloaded
+    struct TextureBinding {
+        QString source; // Empty until an image is loaded in to the binding
+        SamplerState samplerState;
+    };
+
+    struct TextureCacheStatistics {
+        uint32_t resident = 0;
+        uint32_t unused = 0; // Resident but not bound, the first to be evicted
+        VkDeviceSize bytes = 0;
+        VkDeviceSize unusedBytes = 0;
+        VkDeviceSize budget = 0;
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint32_t evictions = 0;
+    };
+
+    // Sampled images kept on the device across shader reloads and shared between bindings which load the same file with the same settings.
+    // Unreferenced images are evicted least recently used first once the resident total is over budget.
+    class TextureCache final {
+    public:
+        TextureCache(VulkanMain* main, QVulkanDeviceFunctions* deviceFuncs, MemoryAllocator* allocator);
+        ~TextureCache();
+
+        // Keyed on the file and its modification time along with everything that changes the uploaded image or its view
+        static QString MakeKey(const QString& source, const DecodeSettings& settings, const SpvImageType* type);
+
+        // Fills in the image, view and load details of imageInfo and adds a reference, false if key isn't resident
+        bool Acquire(const QString& key, ImageInfo& imageInfo);
+        // Takes ownership of a loaded image, which holds the first reference. Nothing is taken if key is already resident.
+        void Insert(const QString& key, ImageInfo& imageInfo);
+        // Returns false if the cache doesn't own the image
+        bool Release(ImageInfo& imageInfo);
+        void SetBudget(VkDeviceSize budget);
+
+        void RememberBinding(const QString& binding, const QString& source, const SamplerState& samplerState);
+        TextureBinding Binding(const QString& binding) const { return m_bindings.value(binding); }
+
+        const TextureCacheStatistics& Statistics() const { return m_statistics; }
+
+    private:
+        struct Entry {
+            ImageInfo image;
+            uint32_t references = 0;
+            uint64_t lastUsed = 0;
+        };
+
+        // Only called when images are added or the budget shrinks, so releasing everything on shutdown retires nothing
+        void Evict();
+
+        VulkanMain* m_main;
+        QVulkanDeviceFunctions* m_deviceFuncs;
+        MemoryAllocator* m_allocator;
+        QHash<QString, Entry> m_entries;
+        QHash<QString, TextureBinding> m_bindings;
+        uint64_t m_uses;
+        TextureCacheStatistics m_statistics;
+    };
+}
+
+#endif // TEXTURECACHE_H
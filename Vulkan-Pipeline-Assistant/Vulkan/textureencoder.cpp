@@ -0,0 +1,335 @@
+#include "textureencoder.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QtConcurrent/QtConcurrent>
+#include <limits>
+
+namespace vpa {
+    // Rows of texels, or of blocks when encoding, handled by one task
+    static constexpr int RowsPerTask = 64;
+    static constexpr int BlocksPerTask = 16;
+
+    static constexpr uchar Ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    // Khronos data format colour models and the BC channel ids used in a KTX2 data format descriptor
+    static constexpr uint8_t DfdModelBc1 = 128;
+    static constexpr uint8_t DfdModelBc3 = 130;
+    static constexpr uint8_t DfdChannelColour = 0;
+    static constexpr uint8_t DfdChannelAlpha = 15;
+
+    template<typename T>
+    static void Append(QByteArray& data, T value) {
+        data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static uint16_t To565(const float colour[3]) {
+        uint16_t r = uint16_t(qBound(0.0f, colour[0], 255.0f) * 31.0f / 255.0f + 0.5f);
+        uint16_t g = uint16_t(qBound(0.0f, colour[1], 255.0f) * 63.0f / 255.0f + 0.5f);
+        uint16_t b = uint16_t(qBound(0.0f, colour[2], 255.0f) * 31.0f / 255.0f + 0.5f);
+        return uint16_t(r << 11 | g << 5 | b);
+    }
+
+    static void From565(uint16_t colour, int out[3]) {
+        int r = colour >> 11;
+        int g = (colour >> 5) & 63;
+        int b = colour & 31;
+        out[0] = r << 3 | r >> 2;
+        out[1] = g << 2 | g >> 4;
+        out[2] = b << 3 | b >> 2;
+    }
+
+    uint32_t TextureEncoder::MipChainLength(uint32_t width, uint32_t height) {
+        uint32_t levels = 1;
+        for (uint32_t size = qMax(width, height); size > 1; size >>= 1) levels++;
+        return levels;
+    }
+
+    QImage TextureEncoder::Downsample(const QImage& source) {
+        const int width = qMax(source.width() / 2, 1);
+        const int height = qMax(source.height() / 2, 1);
+        QImage level(width, height, QImage::Format_RGBA8888);
+
+        const uchar* sourceBits = source.constBits();
+        const int sourceStride = source.bytesPerLine();
+        uchar* levelBits = level.bits();
+        const int levelStride = level.bytesPerLine();
+        // A one texel wide or high source is averaged with itself
+        const int nextColumn = source.width() > 1 ? 4 : 0;
+        const int nextRow = source.height() > 1 ? sourceStride : 0;
+
+        QVector<int> bands;
+        for (int y = 0; y < height; y += RowsPerTask) bands.push_back(y);
+        QtConcurrent::blockingMap(bands, [&](const int& firstRow) {
+            const int lastRow = qMin(firstRow + RowsPerTask, height);
+            for (int y = firstRow; y < lastRow; ++y) {
+                const uchar* row0 = sourceBits + 2 * y * sourceStride;
+                const uchar* row1 = row0 + nextRow;
+                uchar* out = levelBits + y * levelStride;
+                // Branch free over whole texels so the compiler can vectorise it
+                for (int x = 0; x < width; ++x) {
+                    const int left = x * 2 * nextColumn;
+                    const int right = left + nextColumn;
+                    for (int c = 0; c < 4; ++c) {
+                        out[x * 4 + c] = uchar((row0[left + c] + row0[right + c] + row1[left + c] + row1[right + c] + 2) >> 2);
+                    }
+                }
+            }
+        });
+        return level;
+    }
+
+    VkFormat TextureEncoder::ChooseFormat(const QImage& image) {
+        if (image.hasAlphaChannel()) {
+            for (int y = 0; y < image.height(); ++y) {
+                const uchar* row = image.constScanLine(y);
+                for (int x = 0; x < image.width(); ++x) {
+                    if (row[x * 4 + 3] != 255) return VK_FORMAT_BC3_UNORM_BLOCK;
+                }
+            }
+        }
+        return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    }
+
+    QByteArray TextureEncoder::Encode(const QImage& image, VkFormat format) {
+        const bool alpha = format == VK_FORMAT_BC3_UNORM_BLOCK;
+        const int blockBytes = alpha ? 16 : 8;
+        const int blocksWide = (image.width() + 3) / 4;
+        const int blocksHigh = (image.height() + 3) / 4;
+        QByteArray encoded(blocksWide * blocksHigh * blockBytes, '\0');
+        uchar* out = reinterpret_cast<uchar*>(encoded.data());
+
+        QVector<int> bands;
+        for (int y = 0; y < blocksHigh; y += BlocksPerTask) bands.push_back(y);
+        QtConcurrent::blockingMap(bands, [&](const int& firstRow) {
+            const int lastRow = qMin(firstRow + BlocksPerTask, blocksHigh);
+            uchar texels[64];
+            for (int blockY = firstRow; blockY < lastRow; ++blockY) {
+                for (int blockX = 0; blockX < blocksWide; ++blockX) {
+                    // Blocks hanging over the edge of small levels repeat the last row and column
+                    for (int y = 0; y < 4; ++y) {
+                        const uchar* row = image.constScanLine(qMin(blockY * 4 + y, image.height() - 1));
+                        for (int x = 0; x < 4; ++x) {
+                            memcpy(texels + (y * 4 + x) * 4, row + qMin(blockX * 4 + x, image.width() - 1) * 4, 4);
+                        }
+                    }
+                    uchar* block = out + (blockY * blocksWide + blockX) * blockBytes;
+                    if (alpha) {
+                        EncodeAlphaBlock(texels, block);
+                        block += 8;
+                    }
+                    EncodeColourBlock(texels, block);
+                }
+            }
+        });
+        return encoded;
+    }
+
+    void TextureEncoder::EncodeColourBlock(const uchar texels[64], uchar* out) {
+        // Endpoints are the extremes along the principal axis of the block's colours, found by power iteration
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i) {
+            for (int c = 0; c < 3; ++c) mean[c] += texels[i * 4 + c] / 16.0f;
+        }
+        float covariance[3][3] = {};
+        for (int i = 0; i < 16; ++i) {
+            float d[3] = { texels[i * 4] - mean[0], texels[i * 4 + 1] - mean[1], texels[i * 4 + 2] - mean[2] };
+            for (int a = 0; a < 3; ++a) {
+                for (int b = 0; b < 3; ++b) covariance[a][b] += d[a] * d[b];
+            }
+        }
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 4; ++iteration) {
+            float next[3];
+            for (int a = 0; a < 3; ++a) next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+            float length = qMax(qAbs(next[0]), qMax(qAbs(next[1]), qAbs(next[2])));
+            if (length < 1e-6f) break; // A flat block, any axis will do
+            for (int a = 0; a < 3; ++a) axis[a] = next[a] / length;
+        }
+
+        int minIndex = 0;
+        int maxIndex = 0;
+        float minDot = std::numeric_limits<float>::max();
+        float maxDot = -std::numeric_limits<float>::max();
+        for (int i = 0; i < 16; ++i) {
+            float dot = texels[i * 4] * axis[0] + texels[i * 4 + 1] * axis[1] + texels[i * 4 + 2] * axis[2];
+            if (dot < minDot) {
+                minDot = dot;
+                minIndex = i;
+            }
+            if (dot > maxDot) {
+                maxDot = dot;
+                maxIndex = i;
+            }
+        }
+        const float maxColour[3] = { float(texels[maxIndex * 4]), float(texels[maxIndex * 4 + 1]), float(texels[maxIndex * 4 + 2]) };
+        const float minColour[3] = { float(texels[minIndex * 4]), float(texels[minIndex * 4 + 1]), float(texels[minIndex * 4 + 2]) };
+        uint16_t colour0 = To565(maxColour);
+        uint16_t colour1 = To565(minColour);
+        // colour0 > colour1 selects the four colour mode, which BC3 always uses
+        if (colour0 < colour1) std::swap(colour0, colour1);
+        memcpy(out, &colour0, 2);
+        memcpy(out + 2, &colour1, 2);
+
+        uint32_t indices = 0;
+        if (colour0 != colour1) {
+            int palette[4][3];
+            From565(colour0, palette[0]);
+            From565(colour1, palette[1]);
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; ++i) {
+                uint32_t best = 0;
+                int bestDistance = std::numeric_limits<int>::max();
+                for (uint32_t p = 0; p < 4; ++p) {
+                    int distance = 0;
+                    for (int c = 0; c < 3; ++c) distance += (texels[i * 4 + c] - palette[p][c]) * (texels[i * 4 + c] - palette[p][c]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= best << (2 * i);
+            }
+        }
+        memcpy(out + 4, &indices, 4);
+    }
+
+    void TextureEncoder::EncodeAlphaBlock(const uchar texels[64], uchar* out) {
+        int alpha0 = 0;
+        int alpha1 = 255;
+        for (int i = 0; i < 16; ++i) {
+            alpha0 = qMax(alpha0, int(texels[i * 4 + 3]));
+            alpha1 = qMin(alpha1, int(texels[i * 4 + 3]));
+        }
+        out[0] = uchar(alpha0);
+        out[1] = uchar(alpha1);
+
+        // alpha0 > alpha1 selects eight interpolated values
+        uint64_t indices = 0;
+        if (alpha0 != alpha1) {
+            int palette[8] = { alpha0, alpha1 };
+            for (int p = 2; p < 8; ++p) palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+            for (int i = 0; i < 16; ++i) {
+                uint64_t best = 0;
+                int bestDistance = 256;
+                for (uint64_t p = 0; p < 8; ++p) {
+                    int distance = qAbs(int(texels[i * 4 + 3]) - palette[p]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= best << (3 * i);
+            }
+        }
+        memcpy(out + 2, &indices, 6);
+    }
+
+    QString TextureEncoder::CachePath(const QString& source, uint32_t mipLevels) {
+        QFile file(source);
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        if (file.open(QIODevice::ReadOnly)) hash.addData(&file);
+        hash.addData(QByteArray::number(Version) + " " + QByteArray::number(mipLevels));
+        return QString(CONFIGDIR"TextureCache/%1_%2.ktx2").arg(QFileInfo(source).completeBaseName()).arg(QString(hash.result().toHex().left(16)));
+    }
+
+    bool TextureEncoder::Transcode(const QString& source, const QString& cachePath, uint32_t mipLevels, QString& error) {
+        QImage image(source);
+        if (image.isNull()) {
+            error = "Failed to load image " + source;
+            return false;
+        }
+        image = image.convertToFormat(QImage::Format_RGBA8888);
+
+        const VkFormat format = ChooseFormat(image);
+        const uint32_t width = uint32_t(image.width());
+        const uint32_t height = uint32_t(image.height());
+        const uint32_t levelCount = mipLevels > 0 ? qMin(mipLevels, MipChainLength(width, height)) : MipChainLength(width, height);
+        QVector<QByteArray> levels;
+        for (uint32_t level = 0; level < levelCount; ++level) {
+            if (level > 0) image = Downsample(image);
+            levels.push_back(Encode(image, format));
+        }
+
+        // Header, level index and data format descriptor, with the levels stored smallest first as KTX2 requires
+        const bool alpha = format == VK_FORMAT_BC3_UNORM_BLOCK;
+        const uint32_t blockBytes = alpha ? 16 : 8;
+        const uint32_t samples = alpha ? 2 : 1;
+        const uint32_t dfdOffset = uint32_t(sizeof(Ktx2Identifier)) + 68 + levelCount * 24;
+        const uint32_t dfdSize = 4 + 24 + 16 * samples;
+        QVector<uint64_t> levelOffsets = QVector<uint64_t>(int(levelCount));
+        uint64_t offset = dfdOffset + dfdSize;
+        for (int level = int(levelCount) - 1; level >= 0; --level) {
+            offset = (offset + blockBytes - 1) / blockBytes * blockBytes;
+            levelOffsets[level] = offset;
+            offset += uint64_t(levels[level].size());
+        }
+
+        QByteArray file;
+        file.append(reinterpret_cast<const char*>(Ktx2Identifier), sizeof(Ktx2Identifier));
+        Append<uint32_t>(file, format);
+        Append<uint32_t>(file, 1); // typeSize
+        Append<uint32_t>(file, width);
+        Append<uint32_t>(file, height);
+        Append<uint32_t>(file, 0); // pixelDepth
+        Append<uint32_t>(file, 0); // layerCount
+        Append<uint32_t>(file, 1); // faceCount
+        Append<uint32_t>(file, levelCount);
+        Append<uint32_t>(file, 0); // supercompressionScheme
+        Append<uint32_t>(file, dfdOffset);
+        Append<uint32_t>(file, dfdSize);
+        Append<uint32_t>(file, 0); // kvdByteOffset
+        Append<uint32_t>(file, 0); // kvdByteLength
+        Append<uint64_t>(file, 0); // sgdByteOffset
+        Append<uint64_t>(file, 0); // sgdByteLength
+        for (uint32_t level = 0; level < levelCount; ++level) {
+            Append<uint64_t>(file, levelOffsets[int(level)]);
+            Append<uint64_t>(file, uint64_t(levels[int(level)].size()));
+            Append<uint64_t>(file, uint64_t(levels[int(level)].size()));
+        }
+
+        Append<uint32_t>(file, dfdSize);
+        Append<uint32_t>(file, 0); // Khronos basic descriptor block
+        Append<uint16_t>(file, 2); // versionNumber
+        Append<uint16_t>(file, uint16_t(24 + 16 * samples));
+        Append<uint8_t>(file, alpha ? DfdModelBc3 : DfdModelBc1);
+        Append<uint8_t>(file, 1); // BT.709 primaries
+        Append<uint8_t>(file, 1); // Linear transfer, the data is uploaded as UNORM
+        Append<uint8_t>(file, 0); // Straight alpha
+        Append<uint32_t>(file, 3 | 3 << 8); // 4x4 texel blocks, stored as dimension - 1
+        Append<uint64_t>(file, blockBytes); // bytesPlane0, the other planes are unused
+        for (uint32_t sample = 0; sample < samples; ++sample) {
+            const bool alphaSample = alpha && sample == 0;
+            Append<uint16_t>(file, uint16_t(sample * 64)); // bitOffset
+            Append<uint8_t>(file, 63); // bitLength - 1
+            Append<uint8_t>(file, alphaSample ? DfdChannelAlpha : DfdChannelColour);
+            Append<uint32_t>(file, 0); // samplePosition
+            Append<uint32_t>(file, 0); // sampleLower
+            Append<uint32_t>(file, 0xFFFFFFFF); // sampleUpper
+        }
+
+        for (int level = int(levelCount) - 1; level >= 0; --level) {
+            file.append(QByteArray(int(levelOffsets[level] - uint64_t(file.size())), '\0'));
+            file.append(levels[level]);
+        }
+
+        QDir().mkpath(QFileInfo(cachePath).absolutePath());
+        // Written to a temporary file and renamed so a half written cache is never picked up
+        QSaveFile output(cachePath);
+        if (!output.open(QIODevice::WriteOnly)) {
+            error = "Could not open texture cache " + cachePath;
+            return false;
+        }
+        output.write(file);
+        if (!output.commit()) {
+            error = "Could not write texture cache " + cachePath;
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef TEXTUREENCODER_H
+#define TEXTUREENCODER_H
+
+#include <QVector>
+#include <QImage>
+#include <vulkan/vulkan.h>
+
+#include "../common.h"
+
+namespace vpa {
+    // Mip generation and block compression of RGBA8888 images on the host, work is split across the global thread pool
+    class TextureEncoder final {
+    public:
+        // Bumped whenever the encoded output changes so older cache files are not used
+        static constexpr uint32_t Version = 1;
+
+        static uint32_t MipChainLength(uint32_t width, uint32_t height);
+        // 2x2 box filter, odd sizes round down like the Vulkan mip chain and the last row or column is dropped
+        static QImage Downsample(const QImage& source);
+
+        // BC1 for opaque images and BC3 when any texel has alpha, both as UNORM to match the RGBA8 upload
+        static VkFormat ChooseFormat(const QImage& image);
+        static QByteArray Encode(const QImage& image, VkFormat format);
+
+        // Where the encoded copy of source is kept, keyed by its contents and everything which affects the encoding
+        static QString CachePath(const QString& source, uint32_t mipLevels);
+        // Decodes source, builds up to mipLevels levels (0 for the full chain), encodes them and writes a KTX2 file to cachePath.
+        // Runs on worker threads, so failures are reported through error rather than VPAError.
+        static bool Transcode(const QString& source, const QString& cachePath, uint32_t mipLevels, QString& error);
+
+    private:
+        static void EncodeColourBlock(const uchar texels[64], uchar* out);
+        static void EncodeAlphaBlock(const uchar texels[64], uchar* out);
+    };
+}
+
+#endif // TEXTUREENCODER_H
@@ -0,0 +1,274 @@
+#include "textureparser.h"
+
+#include <QFileInfo>
+#include <algorithm>
+
+namespace vpa {
+    static constexpr uchar Ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    static constexpr qint64 Ktx2HeaderSize = 80; // Identifier, header and index, the level index follows
+    static constexpr qint64 Ktx2LevelSize = 24;
+
+    static constexpr uint32_t DdsMagic = 0x20534444; // "DDS "
+    static constexpr qint64 DdsHeaderSize = 128; // Magic and DDS_HEADER
+    static constexpr qint64 DdsDx10HeaderSize = 20;
+    static constexpr uint32_t DdsMipMapCount = 0x20000;
+    static constexpr uint32_t DdsFourCC = 0x4;
+    static constexpr uint32_t DdsRgb = 0x40;
+    static constexpr uint32_t DdsCubeMap = 0x200;
+    static constexpr uint32_t DdsVolume = 0x200000;
+    static constexpr uint32_t DdsResourceCube = 0x4;
+
+    static constexpr uint32_t FourCC(char a, char b, char c, char d) {
+        return uint32_t(uchar(a)) | uint32_t(uchar(b)) << 8 | uint32_t(uchar(c)) << 16 | uint32_t(uchar(d)) << 24;
+    }
+
+    template<typename T>
+    static T ReadValue(const uchar* data) {
+        T value;
+        memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    static VkFormat FourCCFormat(uint32_t fourCC) {
+        switch (fourCC) {
+        case FourCC('D', 'X', 'T', '1'): return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case FourCC('D', 'X', 'T', '2'):
+        case FourCC('D', 'X', 'T', '3'): return VK_FORMAT_BC2_UNORM_BLOCK;
+        case FourCC('D', 'X', 'T', '4'):
+        case FourCC('D', 'X', 'T', '5'): return VK_FORMAT_BC3_UNORM_BLOCK;
+        case FourCC('A', 'T', 'I', '1'):
+        case FourCC('B', 'C', '4', 'U'): return VK_FORMAT_BC4_UNORM_BLOCK;
+        case FourCC('B', 'C', '4', 'S'): return VK_FORMAT_BC4_SNORM_BLOCK;
+        case FourCC('A', 'T', 'I', '2'):
+        case FourCC('B', 'C', '5', 'U'): return VK_FORMAT_BC5_UNORM_BLOCK;
+        case FourCC('B', 'C', '5', 'S'): return VK_FORMAT_BC5_SNORM_BLOCK;
+        case 113: return VK_FORMAT_R16G16B16A16_SFLOAT; // D3DFMT_A16B16G16R16F
+        case 116: return VK_FORMAT_R32G32B32A32_SFLOAT; // D3DFMT_A32B32G32R32F
+        default: return VK_FORMAT_UNDEFINED;
+        }
+    }
+
+    static VkFormat DxgiFormat(uint32_t dxgiFormat) {
+        switch (dxgiFormat) {
+        case 2: return VK_FORMAT_R32G32B32A32_SFLOAT;
+        case 10: return VK_FORMAT_R16G16B16A16_SFLOAT;
+        case 26: return VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+        case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+        case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+        case 49: return VK_FORMAT_R8G8_UNORM;
+        case 61: return VK_FORMAT_R8_UNORM;
+        case 67: return VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
+        case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+        case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+        case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+        case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+        case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+        case 87: return VK_FORMAT_B8G8R8A8_UNORM;
+        case 91: return VK_FORMAT_B8G8R8A8_SRGB;
+        case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+        case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+        case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+        }
+    }
+
+    TextureFile::~TextureFile() {
+        Close();
+    }
+
+    VPAError TextureFile::Open(const QString& path) {
+        Close();
+        m_file.setFileName(path);
+        if (!m_file.open(QIODevice::ReadOnly) || m_file.size() == 0) return VPA_WARN("Could not open " + path);
+        qint64 size = m_file.size();
+        const uchar* data = m_file.map(0, size);
+        if (!data) return VPA_WARN("Could not map " + path);
+
+        VPAError err = size >= qint64(sizeof(Ktx2Identifier)) && memcmp(data, Ktx2Identifier, sizeof(Ktx2Identifier)) == 0 ? ParseKtx2(data, size) : ParseDds(data, size);
+        if (err != VPA_OK) {
+            Close();
+            return VPA_WARN(VPAError::lastMessage + " in " + path);
+        }
+        return VPA_OK;
+    }
+
+    void TextureFile::Close() {
+        m_file.close();
+        m_format = VK_FORMAT_UNDEFINED;
+        m_extent = { 0, 0, 0 };
+        m_mipLevels = 0;
+        m_arrayLayers = 0;
+        m_cube = false;
+        m_regions.clear();
+    }
+
+    bool TextureFile::IsContainer(const QString& path) {
+        QString suffix = QFileInfo(path).suffix().toLower();
+        return suffix == "ktx2" || suffix == "dds";
+    }
+
+    TextureBlock TextureFile::BlockOf(VkFormat format) {
+        // ASTC formats are in pairs of UNORM and SRGB, in this order of block sizes
+        static const uint32_t astcBlocks[][2] = {
+            { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 }, { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 }
+        };
+        if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+            const uint32_t* block = astcBlocks[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+            return { block[0], block[1], 16 };
+        }
+
+        switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+        case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+        case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+            return { 4, 4, 8 };
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+        case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+        case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+            return { 4, 4, 16 };
+        case VK_FORMAT_R8_UNORM:
+            return { 1, 1, 1 };
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+            return { 1, 1, 2 };
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+        case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+            return { 1, 1, 4 };
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return { 1, 1, 8 };
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return { 1, 1, 16 };
+        default:
+            return { 1, 1, 0 };
+        }
+    }
+
+    VPAError TextureFile::ParseKtx2(const uchar* data, qint64 size) {
+        if (size < Ktx2HeaderSize) return VPA_WARN("Truncated KTX2 header");
+        m_format = VkFormat(ReadValue<uint32_t>(data + 12));
+        m_extent = { ReadValue<uint32_t>(data + 20), ReadValue<uint32_t>(data + 24), 1 };
+        uint32_t depth = ReadValue<uint32_t>(data + 28);
+        uint32_t layers = qMax(ReadValue<uint32_t>(data + 32), 1u);
+        uint32_t faces = ReadValue<uint32_t>(data + 36);
+        // A level count of 0 asks the loader to generate mips, the file only holds level 0
+        m_mipLevels = qMax(ReadValue<uint32_t>(data + 40), 1u);
+        uint32_t supercompression = ReadValue<uint32_t>(data + 44);
+
+        if (m_format == VK_FORMAT_UNDEFINED) return VPA_WARN("Basis Universal KTX2 textures have to be transcoded first");
+        if (supercompression != 0) return VPA_WARN("Supercompressed KTX2 textures are not supported");
+        if (depth > 1) return VPA_WARN("3D KTX2 textures are not supported");
+        if (faces != 1 && faces != 6) return VPA_WARN("Invalid KTX2 face count");
+        if (BlockOf(m_format).bytes == 0) return VPA_WARN(QString("Unsupported KTX2 format %1").arg(m_format));
+        if (m_extent.width == 0 || m_extent.height == 0) return VPA_WARN("1D KTX2 textures are not supported");
+        if (Ktx2HeaderSize + m_mipLevels * Ktx2LevelSize > size) return VPA_WARN("Truncated KTX2 level index");
+        m_cube = faces == 6;
+        m_arrayLayers = layers * faces;
+
+        // Each level holds every face of every layer, one after the other
+        for (uint32_t level = 0; level < m_mipLevels; ++level) {
+            const uchar* index = data + Ktx2HeaderSize + level * Ktx2LevelSize;
+            uint64_t levelOffset = ReadValue<uint64_t>(index);
+            uint64_t levelBytes = ReadValue<uint64_t>(index + 8);
+            if (ImageBytes(level) * m_arrayLayers > levelBytes) return VPA_WARN(QString("KTX2 level %1 is too small").arg(level));
+            for (uint32_t layer = 0; layer < m_arrayLayers; ++layer) {
+                if (!AddRegion(data, size, qint64(levelOffset + ImageBytes(level) * layer), level, layer)) return VPA_WARN(QString("Truncated KTX2 level %1").arg(level));
+            }
+        }
+        return VPA_OK;
+    }
+
+    VPAError TextureFile::ParseDds(const uchar* data, qint64 size) {
+        if (size < DdsHeaderSize || ReadValue<uint32_t>(data) != DdsMagic || ReadValue<uint32_t>(data + 4) != 124) return VPA_WARN("Not a KTX2 or DDS file");
+        uint32_t flags = ReadValue<uint32_t>(data + 8);
+        m_extent = { ReadValue<uint32_t>(data + 16), ReadValue<uint32_t>(data + 12), 1 };
+        m_mipLevels = flags & DdsMipMapCount ? qMax(ReadValue<uint32_t>(data + 28), 1u) : 1;
+        uint32_t pixelFlags = ReadValue<uint32_t>(data + 80);
+        uint32_t fourCC = ReadValue<uint32_t>(data + 84);
+        uint32_t caps2 = ReadValue<uint32_t>(data + 112);
+        if (caps2 & DdsVolume) return VPA_WARN("Volume DDS textures are not supported");
+
+        qint64 offset = DdsHeaderSize;
+        uint32_t layers = 1;
+        // Legacy cube maps are assumed to have all six faces
+        m_cube = (caps2 & DdsCubeMap) != 0;
+        if (pixelFlags & DdsFourCC && fourCC == FourCC('D', 'X', '1', '0')) {
+            if (size < DdsHeaderSize + DdsDx10HeaderSize) return VPA_WARN("Truncated DDS DX10 header");
+            m_format = DxgiFormat(ReadValue<uint32_t>(data + 128));
+            m_cube = (ReadValue<uint32_t>(data + 136) & DdsResourceCube) != 0;
+            layers = qMax(ReadValue<uint32_t>(data + 140), 1u);
+            offset += DdsDx10HeaderSize;
+        }
+        else if (pixelFlags & DdsFourCC) {
+            m_format = FourCCFormat(fourCC);
+        }
+        else if (pixelFlags & DdsRgb && ReadValue<uint32_t>(data + 88) == 32) {
+            uint32_t redMask = ReadValue<uint32_t>(data + 92);
+            if (redMask == 0x000000FF) m_format = VK_FORMAT_R8G8B8A8_UNORM;
+            else if (redMask == 0x00FF0000) m_format = VK_FORMAT_B8G8R8A8_UNORM;
+        }
+        if (m_format == VK_FORMAT_UNDEFINED || BlockOf(m_format).bytes == 0) return VPA_WARN("Unsupported DDS pixel format");
+        if (m_extent.width == 0 || m_extent.height == 0) return VPA_WARN("Empty DDS texture");
+        m_arrayLayers = layers * (m_cube ? 6 : 1);
+
+        // Unlike KTX2 each layer holds its whole mip chain
+        for (uint32_t layer = 0; layer < m_arrayLayers; ++layer) {
+            for (uint32_t level = 0; level < m_mipLevels; ++level) {
+                if (!AddRegion(data, size, offset, level, layer)) return VPA_WARN("Truncated DDS data");
+                offset += qint64(ImageBytes(level));
+            }
+        }
+        std::stable_sort(m_regions.begin(), m_regions.end(), [](const ImageUploadRegion& a, const ImageUploadRegion& b) { return a.mipLevel < b.mipLevel; });
+        return VPA_OK;
+    }
+
+    bool TextureFile::AddRegion(const uchar* data, qint64 size, qint64 offset, uint32_t level, uint32_t layer) {
+        ImageUploadRegion region;
+        region.size = ImageBytes(level);
+        if (offset < 0 || offset + qint64(region.size) > size) return false;
+        region.data = data + offset;
+        region.mipLevel = level;
+        region.arrayLayer = layer;
+        region.extent = { qMax(m_extent.width >> level, 1u), qMax(m_extent.height >> level, 1u), 1 };
+        m_regions.push_back(region);
+        return true;
+    }
+
+    VkDeviceSize TextureFile::ImageBytes(uint32_t level) const {
+        TextureBlock block = BlockOf(m_format);
+        VkDeviceSize blocksWide = (qMax(m_extent.width >> level, 1u) + block.width - 1) / block.width;
+        VkDeviceSize blocksHigh = (qMax(m_extent.height >> level, 1u) + block.height - 1) / block.height;
+        return blocksWide * blocksHigh * block.bytes;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef TEXTUREPARSER_H
+#define TEXTUREPARSER_H
+
+#include <QVector>
+#include <QFile>
+
+#include "../common.h"
+#include "memoryallocator.h"
+
+namespace vpa {
+    // Texel block of a format, 1x1 for uncompressed formats
+    struct TextureBlock {
+        uint32_t width = 1;
+        uint32_t height = 1;
+        uint32_t bytes = 0; // 0 for formats that can't be loaded
+    };
+
+    // Maps a .ktx2 or .dds file and exposes every level and layer as it is stored, nothing is decoded.
+    // Regions point in to the mapping so the file must stay open while they are used.
+    class TextureFile final {
+    public:
+        TextureFile() = default;
+        ~TextureFile();
+
+        VPAError Open(const QString& path);
+        void Close();
+
+        VkFormat Format() const { return m_format; }
+        VkExtent3D Extent() const { return m_extent; }
+        uint32_t MipLevels() const { return m_mipLevels; }
+        uint32_t ArrayLayers() const { return m_arrayLayers; } // Every face of every layer
+        bool IsCube() const { return m_cube; }
+        // Ordered by level then layer
+        const QVector<ImageUploadRegion>& Regions() const { return m_regions; }
+
+        // Files which go through here rather than QImage
+        static bool IsContainer(const QString& path);
+        static TextureBlock BlockOf(VkFormat format);
+
+    private:
+        VPAError ParseKtx2(const uchar* data, qint64 size);
+        VPAError ParseDds(const uchar* data, qint64 size);
+        // Checks the image fits in the file and adds it as a region
+        bool AddRegion(const uchar* data, qint64 size, qint64 offset, uint32_t level, uint32_t layer);
+        VkDeviceSize ImageBytes(uint32_t level) const;
+
+        QFile m_file;
+        VkFormat m_format = VK_FORMAT_UNDEFINED;
+        VkExtent3D m_extent = { 0, 0, 0 };
+        uint32_t m_mipLevels = 0;
+        uint32_t m_arrayLayers = 0;
+        bool m_cube = false;
+        QVector<ImageUploadRegion> m_regions;
+    };
+}
+
+#endif // TEXTUREPARSER_H
@@ -1,19 +1,127 @@
 #include "vertexinput.h"
+#include "meshcache.h"
+#include "objparser.h"
+#include "gltfparser.h"
+#include "meshgenerator.h"
 
 #include <time.h>
 #include <QCoreApplication>
 #include <QVulkanDeviceFunctions>
 #include <QMap>
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include <QHash>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QFloat16>
+#include <cmath>
 
 namespace vpa {
+    static constexpr VkDeviceSize StreamAlignment = 16;
+    static constexpr uint32_t MinLodTriangles = 128;
+
+    static const char* GltfSemantic(VertexAttribute attribute) {
+        if (attribute == VertexAttribute::Position) return "POSITION";
+        if (attribute == VertexAttribute::Normal) return "NORMAL";
+        if (attribute == VertexAttribute::TexCoord) return "TEXCOORD_0";
+        return "COLOR_0";
+    }
+
+    static VkFormat InstanceColumnFormat(uint32_t rows) {
+        if (rows == 2) return VK_FORMAT_R32G32_SFLOAT;
+        if (rows == 3) return VK_FORMAT_R32G32B32_SFLOAT;
+        return VK_FORMAT_R32G32B32A32_SFLOAT;
+    }
+
+    // Fully saturated colour for a hue between 0 and 1
+    static void HueColour(float hue, float* out) {
+        for (int c = 0; c < 3; ++c) {
+            float k = std::fmod(float(5 - 2 * c) + hue * 6.0f, 6.0f);
+            out[c] = 1.0f - qBound(0.0f, qMin(k, 4.0f - k), 1.0f);
+        }
+        out[3] = 1.0f;
+    }
+
+    static void RandomColour(float* out) {
+        out[0] = rand() / float(RAND_MAX);
+        out[1] = rand() / float(RAND_MAX);
+        out[2] = rand() / float(RAND_MAX);
+        out[3] = 1.0f;
+    }
+
+    static uint32_t ComponentCount(VertexAttribute attribute) {
+        if (attribute == VertexAttribute::TexCoord) return 2;
+        if (attribute == VertexAttribute::Position || attribute == VertexAttribute::Normal) return 3;
+        return 4;
+    }
+
+    static int8_t PackSnorm8(float value) {
+        return int8_t(std::round(qBound(-1.0f, value, 1.0f) * 127.0f));
+    }
+
+    static uint32_t PackSnorm10(float value) {
+        return uint32_t(int32_t(std::round(qBound(-1.0f, value, 1.0f) * 511.0f))) & 0x3FF;
+    }
+
+    static uint16_t PackUnorm16(float value) {
+        return uint16_t(std::round(qBound(0.0f, value, 1.0f) * 65535.0f));
+    }
+
+    static uint8_t PackUnorm8(float value) {
+        return uint8_t(std::round(qBound(0.0f, value, 1.0f) * 255.0f));
+    }
+
+    // Missing components are filled the same way the vertex fetch would, so a vec4 position still has w = 1
+    static void PackAttribute(VkFormat format, uint32_t components, const float* in, uchar* out) {
+        float w = components > 3 ? in[3] : 1.0f;
+        float z = components > 2 ? in[2] : 0.0f;
+        switch (format) {
+        case VK_FORMAT_R16G16B16A16_SFLOAT: {
+            qfloat16 halves[4] = { qfloat16(in[0]), qfloat16(in[1]), qfloat16(z), qfloat16(w) };
+            memcpy(out, halves, sizeof(halves));
+            break;
+        }
+        case VK_FORMAT_R16G16_SFLOAT: {
+            qfloat16 halves[2] = { qfloat16(in[0]), qfloat16(in[1]) };
+            memcpy(out, halves, sizeof(halves));
+            break;
+        }
+        case VK_FORMAT_R16G16_UNORM: {
+            uint16_t values[2] = { PackUnorm16(in[0]), PackUnorm16(in[1]) };
+            memcpy(out, values, sizeof(values));
+            break;
+        }
+        case VK_FORMAT_R8G8B8A8_SNORM: {
+            int8_t values[4] = { PackSnorm8(in[0]), PackSnorm8(in[1]), PackSnorm8(z), PackSnorm8(components > 3 ? in[3] : 0.0f) };
+            memcpy(out, values, sizeof(values));
+            break;
+        }
+        case VK_FORMAT_A2B10G10R10_SNORM_PACK32: {
+            uint32_t packed = PackSnorm10(in[0]) | (PackSnorm10(in[1]) << 10) | (PackSnorm10(z) << 20);
+            memcpy(out, &packed, sizeof(packed));
+            break;
+        }
+        case VK_FORMAT_R8G8B8A8_UNORM: {
+            uint8_t values[4] = { PackUnorm8(in[0]), PackUnorm8(in[1]), PackUnorm8(z), PackUnorm8(w) };
+            memcpy(out, values, sizeof(values));
+            break;
+        }
+        default:
+            memcpy(out, in, components * sizeof(float));
+            break;
+        }
+    }
+
     VertexInput::VertexInput(QVulkanDeviceFunctions* deviceFuncs, MemoryAllocator* allocator,
-                             QVector<SpvResource*> inputResources, QString meshName, bool isIndexed, VPAError& err)
-        : m_indexed(isIndexed), m_indexCount(0), m_deviceFuncs(deviceFuncs), m_vertexAllocation({}), m_indexAllocation({}), m_allocator(allocator) {
-        CalculateData(inputResources);
-        err = LoadMesh(meshName, SupportedFormats::Obj);
+                             QVector<SpvResource*> inputResources, QString meshPath, bool isIndexed, const PreviewConfig& preview, VPAError& err)
+        : m_indexed(isIndexed), m_optimise(preview.optimiseMesh), m_formats(preview.vertexFormats), m_streamLayout(preview.streamLayout), m_indexCount(0), m_indexType(VK_INDEX_TYPE_UINT32), m_deviceFuncs(deviceFuncs), m_vertexAllocation({}), m_indexAllocation({}),
+          m_instanceCount(qMax(preview.instanceCount, 1u)), m_instanceAllocation({}), m_indirectAllocation({}), m_allocator(allocator) {
+        err = CalculateData(inputResources);
+        if (err != VPA_OK) return;
+        QString suffix = QFileInfo(meshPath).suffix().toLower();
+        if (preview.source != MeshSource::File) err = GenerateMesh(preview);
+        else err = LoadMesh(meshPath, suffix == "gltf" || suffix == "glb" ? SupportedFormats::Gltf : SupportedFormats::Obj);
+        if (err == VPA_OK) err = CreateInstances();
+        if (err == VPA_OK) err = CreateIndirectCommands();
     }
 
     VertexInput::~VertexInput() {
@@ -21,93 +129,716 @@ namespace vpa {
         if (m_indexed) {
             m_allocator->Deallocate(m_indexAllocation);
         }
+        if (m_instanceAllocation.buffer != VK_NULL_HANDLE) {
+            m_allocator->Deallocate(m_instanceAllocation);
+        }
+        if (m_indirectAllocation.buffer != VK_NULL_HANDLE) {
+            m_allocator->Deallocate(m_indirectAllocation);
+        }
     }
 
     void VertexInput::BindBuffers(VkCommandBuffer& cmdBuffer) {
-        VkDeviceSize offset = 0;
-        m_deviceFuncs->vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &m_vertexAllocation.buffer, &offset);
+        // Every stream lives in the one vertex buffer at its own offset, followed by the instance buffer if there is one
+        QVector<VkBuffer> buffers(m_streamOffsets.size(), m_vertexAllocation.buffer);
+        QVector<VkDeviceSize> offsets = m_streamOffsets;
+        if (m_instanceAllocation.buffer != VK_NULL_HANDLE) {
+            buffers.push_back(m_instanceAllocation.buffer);
+            offsets.push_back(0);
+        }
+        if (!buffers.isEmpty()) m_deviceFuncs->vkCmdBindVertexBuffers(cmdBuffer, 0, uint32_t(buffers.size()), buffers.constData(), offsets.constData());
         if (m_indexed) {
-            m_deviceFuncs->vkCmdBindIndexBuffer(cmdBuffer, m_indexAllocation.buffer, offset, VK_INDEX_TYPE_UINT32);
+            m_deviceFuncs->vkCmdBindIndexBuffer(cmdBuffer, m_indexAllocation.buffer, 0, m_indexType);
         }
     }
 
-    VPAError VertexInput::LoadMesh(QString& meshName, SupportedFormats format) {
-        if (format == SupportedFormats::Obj) {
-            return LoadObj(meshName);
+    VPAError VertexInput::LoadMesh(const QString& meshPath, SupportedFormats format) {
+        QElapsedTimer timer;
+        timer.start();
+        // glTF buffers are already binary and are read straight from the mapped file, so they aren't cached
+        if (format == SupportedFormats::Gltf) {
+            VPA_PASS_ERROR(LoadGltf(meshPath));
+            m_statistics.loadMilliseconds = float(timer.nsecsElapsed() / 1e6);
+            return VPA_OK;
         }
-        return VPA_WARN("Unsupported format for loading mesh");
-    }
+        if (format != SupportedFormats::Obj) return VPA_WARN("Unsupported format for loading mesh");
 
-    VPAError VertexInput::LoadObj(QString& meshName) {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string objErr;
-        std::string warn;
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &objErr, (meshName + ".obj").toLatin1().data())) {
-            if (!objErr.empty()) return VPA_WARN(QString::fromStdString(objErr));
-            return VPA_WARN("Obj mesh loading failed.");
+        MeshCacheKey key = MeshCache::MakeKey(meshPath, m_attributes, m_indexed, m_optimise, m_formats, m_streamLayout);
+        QString cachePath = MeshCache::CachePath(meshPath, key);
+        MeshCache cache(cachePath);
+        if (cache.Open(key)) {
+            m_statistics = cache.Statistics();
+            m_formats = m_statistics.formats;
+            m_subMeshes = cache.SubMeshes();
+            CalculateStreams(m_statistics.uniqueVertices);
+            VPA_PASS_ERROR(UploadBuffers(cache.VertexData(), cache.VertexBytes(), cache.IndexData(), cache.IndexBytes()));
+            m_statistics.cached = true;
+            m_statistics.loadMilliseconds = float(timer.nsecsElapsed() / 1e6);
+            qDebug("Loaded mesh %s from cache in %.2f ms", qPrintable(meshPath), double(m_statistics.loadMilliseconds));
+            return VPA_OK;
         }
-        if (!warn.empty()) qDebug(warn.c_str());
 
-        QVector<uint32_t> indices;
         QVector<float> verts;
-        uint32_t count = 0;
-        srand(static_cast<unsigned int>(time(NULL)));
+        QVector<uint32_t> indices;
+        VPA_PASS_ERROR(LoadObj(meshPath, verts, indices));
 
-        for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {
-                for (int i = 0; i < m_attributes.size(); ++i) {
-                    if (m_attributes[i] == VertexAttribute::Position) {
-                        verts.push_back(attrib.vertices[3 * size_t(index.vertex_index) + 0]);
-                        verts.push_back(attrib.vertices[3 * size_t(index.vertex_index) + 1]);
-                        verts.push_back(attrib.vertices[3 * size_t(index.vertex_index) + 2]);
-                    }
-                    else if (attrib.texcoords.size() > 0 && m_attributes[i] == VertexAttribute::TexCoord) {
-                        verts.push_back(attrib.texcoords[2 * size_t(index.texcoord_index) + 0]);
-                        verts.push_back(1.0f - attrib.texcoords[2 * size_t(index.texcoord_index) + 1]);
-                    }
-                    else if (attrib.normals.size() > 0 && m_attributes[i] == VertexAttribute::Normal) {
-                        verts.push_back(attrib.normals[3 * size_t(index.normal_index) + 0]);
-                        verts.push_back(attrib.normals[3 * size_t(index.normal_index) + 1]);
-                        verts.push_back(attrib.normals[3 * size_t(index.normal_index) + 2]);
-                    }
-                    else if (m_attributes[i] == VertexAttribute::RgbaColour) {
-                        verts.push_back(rand() / float(RAND_MAX));
-                        verts.push_back(rand() / float(RAND_MAX));
-                        verts.push_back(rand() / float(RAND_MAX));
-                        verts.push_back(1.0f);
-                    }
+        // Indices are kept in the type they are drawn with so the cache can be uploaded as it is
+        const void* indexData = nullptr;
+        QVector<uint16_t> shortIndices;
+        if (m_indexed) {
+            // 0xFFFF is kept free as it is the primitive restart index for 16 bit indices
+            m_statistics.indexType = m_statistics.uniqueVertices < 0xFFFF ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+            if (m_statistics.indexType == VK_INDEX_TYPE_UINT16) {
+                shortIndices.resize(indices.size());
+                for (int i = 0; i < indices.size(); ++i) {
+                    shortIndices[i] = uint16_t(indices[i]);
                 }
-                indices.push_back(count++);
+                indexData = shortIndices.constData();
+                m_statistics.indexBytes = VkDeviceSize(shortIndices.size()) * sizeof(uint16_t);
             }
+            else {
+                indexData = indices.constData();
+                m_statistics.indexBytes = VkDeviceSize(indices.size()) * sizeof(uint32_t);
+            }
+        }
+        CalculateStreams(m_statistics.uniqueVertices);
+        QByteArray vertexData = PackVertices(verts);
+        m_statistics.vertexBytes = VkDeviceSize(vertexData.size());
+
+        VPA_PASS_ERROR(UploadBuffers(vertexData.constData(), m_statistics.vertexBytes, indexData, m_statistics.indexBytes));
+        if (MeshCache::Write(cachePath, key, m_statistics, vertexData.constData(), m_statistics.vertexBytes, indexData, m_statistics.indexBytes, m_subMeshes) != VPA_OK) {
+            qDebug("Mesh cache for %s was not written, it will be parsed again next time", qPrintable(meshPath));
         }
+        m_statistics.loadMilliseconds = float(timer.nsecsElapsed() / 1e6);
+        return VPA_OK;
+    }
 
-        VPA_PASS_ERROR(m_allocator->Allocate(size_t(verts.size()) * sizeof(float), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "Vertex buffer", m_vertexAllocation));
+    VPAError VertexInput::UploadBuffers(const void* vertexData, VkDeviceSize vertexBytes, const void* indexData, VkDeviceSize indexBytes) {
+        VPA_PASS_ERROR(m_allocator->Allocate(vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "Vertex buffer", m_vertexAllocation));
         unsigned char* data = m_allocator->MapMemory(m_vertexAllocation);
-        memcpy(data, verts.data(), size_t(verts.size()) * sizeof(float));
+        memcpy(data, vertexData, size_t(vertexBytes));
         m_allocator->UnmapMemory(m_vertexAllocation);
 
         if (m_indexed) {
-            m_indexCount = uint32_t(indices.size());
-            VPA_PASS_ERROR(m_allocator->Allocate(m_indexCount * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "Index buffer", m_indexAllocation));
+            m_indexCount = m_statistics.indexCount;
+            m_indexType = m_statistics.indexType;
+            VPA_PASS_ERROR(m_allocator->Allocate(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "Index buffer", m_indexAllocation));
             data = m_allocator->MapMemory(m_indexAllocation);
-            memcpy(data, indices.data(), size_t(indices.size()) * sizeof(uint32_t));
+            memcpy(data, indexData, size_t(indexBytes));
             m_allocator->UnmapMemory(m_indexAllocation);
         }
+        return VPA_OK;
+    }
+
+    void VertexInput::CalculateStreams(uint32_t vertexCount) {
+        m_bindings.resize(m_attributes.size());
+        bool hasPosition = m_attributes.contains(VertexAttribute::Position);
+        uint32_t bindingCount = m_attributes.isEmpty() ? 0 : 1;
+        for (int i = 0; i < m_attributes.size(); ++i) {
+            if (m_streamLayout == VertexStreamLayout::PerAttribute) m_bindings[i] = uint32_t(i);
+            else if (m_streamLayout == VertexStreamLayout::PositionSplit && hasPosition) m_bindings[i] = m_attributes[i] == VertexAttribute::Position ? 0 : 1;
+            else m_bindings[i] = 0;
+            bindingCount = qMax(bindingCount, m_bindings[i] + 1);
+        }
+
+        // Streams are placed back to back, each starting aligned
+        m_streamOffsets.resize(int(bindingCount));
+        VkDeviceSize offset = 0;
+        for (uint32_t binding = 0; binding < bindingCount; ++binding) {
+            m_streamOffsets[int(binding)] = offset;
+            offset = (offset + VkDeviceSize(vertexCount) * StreamStride(binding) + StreamAlignment - 1) & ~(StreamAlignment - 1);
+        }
+        m_statistics.streamLayout = m_streamLayout;
+        m_statistics.streamCount = bindingCount;
+    }
+
+    QByteArray VertexInput::PackVertices(const QVector<float>& verts) const {
+        uint32_t floatStride = 0;
+        for (VertexAttribute attribute : m_attributes) {
+            floatStride += ComponentCount(attribute);
+        }
+        int vertexCount = floatStride > 0 ? verts.size() / int(floatStride) : 0;
+        int lastBinding = m_streamOffsets.size() - 1;
+        int bytes = lastBinding >= 0 ? int(m_streamOffsets[lastBinding] + VkDeviceSize(vertexCount) * StreamStride(uint32_t(lastBinding))) : 0;
+        QByteArray packed = QByteArray(bytes, '\0');
+
+        // Each attribute is written at its offset within its own binding's stream
+        QVector<uint32_t> attributeOffsets = AttributeOffsets();
+        QVector<uint32_t> bindingStrides(m_streamOffsets.size());
+        for (int i = 0; i < bindingStrides.size(); ++i) {
+            bindingStrides[i] = StreamStride(uint32_t(i));
+        }
+
+        const float* in = verts.constData();
+        uchar* out = reinterpret_cast<uchar*>(packed.data());
+        for (int v = 0; v < vertexCount; ++v) {
+            for (int i = 0; i < m_attributes.size(); ++i) {
+                int binding = int(m_bindings[i]);
+                uchar* dst = out + m_streamOffsets[binding] + VkDeviceSize(v) * bindingStrides[binding] + attributeOffsets[i];
+                PackAttribute(AttributeFormat(m_attributes[i], m_formats), ComponentCount(m_attributes[i]), in, dst);
+                in += ComponentCount(m_attributes[i]);
+            }
+        }
+        return packed;
+    }
+
+    QVector<uint32_t> VertexInput::AttributeOffsets() const {
+        QVector<uint32_t> attributeOffsets(m_attributes.size());
+        QVector<uint32_t> bindingOffsets(m_streamOffsets.size(), 0);
+        for (int i = 0; i < m_attributes.size(); ++i) {
+            attributeOffsets[i] = bindingOffsets[int(m_bindings[i])];
+            bindingOffsets[int(m_bindings[i])] += AttributeSize(m_attributes[i], m_formats);
+        }
+        return attributeOffsets;
+    }
+
+    VPAError VertexInput::GenerateMesh(const PreviewConfig& preview) {
+        if (!m_indexed) return VPA_WARN("Generated meshes can only be drawn indexed");
+        QElapsedTimer timer;
+        timer.start();
+        MeshGenerator generator(preview.source, uint32_t(qBound(0.0, double(preview.generatedTriangles) * 1e6, 1e9)), preview.generatedSize);
+        uint32_t vertexCount = generator.VertexCount();
+
+        m_statistics = {};
+        m_statistics.generated = true;
+        m_statistics.uniqueVertices = vertexCount;
+        m_statistics.indexCount = 3 * generator.TriangleCount();
+        m_statistics.sourceVertices = m_statistics.indexCount;
+        m_statistics.indexType = vertexCount < 0xFFFF ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        m_statistics.indexBytes = VkDeviceSize(m_statistics.indexCount) * (m_statistics.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t));
+        m_statistics.formats = m_formats;
+        m_statistics.stride = CalculateStride();
+        m_statistics.uncompressedStride = CalculateStride(VertexFormatConfig());
+        CalculateStreams(vertexCount);
+        int lastBinding = m_streamOffsets.size() - 1;
+        m_statistics.vertexBytes = lastBinding >= 0 ? m_streamOffsets[lastBinding] + VkDeviceSize(vertexCount) * StreamStride(uint32_t(lastBinding)) : 0;
+
+        VPA_PASS_ERROR(m_allocator->Allocate(m_statistics.vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "Vertex buffer", m_vertexAllocation));
+        VPA_PASS_ERROR(m_allocator->Allocate(m_statistics.indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "Index buffer", m_indexAllocation));
+        uchar* vertexOut = m_allocator->MapMemory(m_vertexAllocation);
+        uchar* indexOut = m_allocator->MapMemory(m_indexAllocation);
+
+        // Vertices and triangles are generated straight in to the mapped buffers in ranges spread over the thread pool
+        struct GenerateRange {
+            uint32_t first;
+            uint32_t count;
+        };
+        const uint32_t rangeSize = 1 << 16;
+        QVector<GenerateRange> vertexRanges;
+        for (uint32_t first = 0; first < vertexCount; first += rangeSize) {
+            vertexRanges.push_back({ first, qMin(rangeSize, vertexCount - first) });
+        }
+        QVector<GenerateRange> triangleRanges;
+        for (uint32_t first = 0; first < generator.TriangleCount(); first += rangeSize) {
+            triangleRanges.push_back({ first, qMin(rangeSize, generator.TriangleCount() - first) });
+        }
+
+        QVector<uint32_t> attributeOffsets = AttributeOffsets();
+        QVector<uint32_t> attributeStrides(m_attributes.size());
+        for (int i = 0; i < m_attributes.size(); ++i) {
+            attributeStrides[i] = StreamStride(m_bindings[i]);
+        }
+        QtConcurrent::blockingMap(vertexRanges, [&](GenerateRange& range) {
+            GeneratedVertex vertex;
+            for (uint32_t v = range.first; v < range.first + range.count; ++v) {
+                generator.Vertex(v, vertex);
+                for (int i = 0; i < m_attributes.size(); ++i) {
+                    const float* values = vertex.colour;
+                    if (m_attributes[i] == VertexAttribute::Position) values = vertex.position;
+                    else if (m_attributes[i] == VertexAttribute::Normal) values = vertex.normal;
+                    else if (m_attributes[i] == VertexAttribute::TexCoord) values = vertex.texCoord;
+                    uchar* dst = vertexOut + m_streamOffsets[int(m_bindings[i])] + VkDeviceSize(v) * attributeStrides[i] + attributeOffsets[i];
+                    PackAttribute(AttributeFormat(m_attributes[i], m_formats), ComponentCount(m_attributes[i]), values, dst);
+                }
+            }
+        });
+        bool shortIndices = m_statistics.indexType == VK_INDEX_TYPE_UINT16;
+        QtConcurrent::blockingMap(triangleRanges, [&](GenerateRange& range) {
+            uint32_t triangle[3];
+            for (uint32_t t = range.first; t < range.first + range.count; ++t) {
+                generator.Triangle(t, triangle);
+                if (shortIndices) {
+                    uint16_t values[3] = { uint16_t(triangle[0]), uint16_t(triangle[1]), uint16_t(triangle[2]) };
+                    memcpy(indexOut + size_t(t) * sizeof(values), values, sizeof(values));
+                }
+                else {
+                    memcpy(indexOut + size_t(t) * sizeof(triangle), triangle, sizeof(triangle));
+                }
+            }
+        });
+
+        m_allocator->UnmapMemory(m_indexAllocation);
+        m_allocator->UnmapMemory(m_vertexAllocation);
+        m_indexCount = m_statistics.indexCount;
+        m_indexType = m_statistics.indexType;
+        m_subMeshes = { { 0, m_statistics.indexCount } };
+        m_statistics.loadMilliseconds = float(timer.nsecsElapsed() / 1e6);
+        qDebug("Generated %u triangles in %.2f ms", generator.TriangleCount(), double(m_statistics.loadMilliseconds));
+        return VPA_OK;
+    }
+
+    void VertexInput::BuildLods(QVector<uint32_t>& indices, const QVector<float>& vertices, uint32_t stride, uint32_t positionOffset, uint32_t vertexCount) {
+        struct LodLevel {
+            uint32_t targetIndexCount;
+            QVector<uint32_t> indices;
+            float error;
+        };
+
+        // Each level aims for a quarter of the triangles of the one before, all simplified from the full mesh at once
+        uint32_t triangleCount = uint32_t(indices.size() / 3);
+        QVector<LodLevel> levels;
+        for (uint32_t level = 1; level < MeshStatistics::MaxLods; ++level) {
+            uint32_t target = triangleCount >> (2 * level);
+            if (target < MinLodTriangles) break;
+            levels.push_back({ 3 * target, indices, 0.0f });
+        }
+        QtConcurrent::blockingMap(levels, [&](LodLevel& level) {
+            level.error = MeshOptimiser::SimplifyMesh(level.indices, vertices, stride, positionOffset, level.targetIndexCount);
+            if (m_optimise) MeshOptimiser::OptimiseVertexCache(level.indices, vertexCount);
+        });
+
+        m_statistics.lodCount = 1;
+        m_statistics.lodFirstIndex[0] = 0;
+        m_statistics.lodIndexCount[0] = uint32_t(indices.size());
+        m_statistics.lodError[0] = 0.0f;
+        for (const LodLevel& level : levels) {
+            // Borders and flips can stop a level well short of its target, one that barely shrank isn't worth drawing
+            uint32_t previous = m_statistics.lodIndexCount[m_statistics.lodCount - 1];
+            if (level.indices.isEmpty() || float(level.indices.size()) > float(previous) * 0.8f) continue;
+            m_statistics.lodFirstIndex[m_statistics.lodCount] = uint32_t(indices.size());
+            m_statistics.lodIndexCount[m_statistics.lodCount] = uint32_t(level.indices.size());
+            m_statistics.lodError[m_statistics.lodCount] = level.error;
+            m_statistics.lodCount++;
+            indices += level.indices;
+        }
+    }
+
+    VPAError VertexInput::CreateInstances() {
+        m_statistics.instanceCount = m_instanceCount;
+        m_statistics.instanceAttributes = uint32_t(m_instanceAttributes.size());
+        m_statistics.instanceBytes = 0;
+        if (m_instanceAttributes.isEmpty()) return VPA_OK;
+
+        // Instances fill a cube the size of a mesh spanning -1 to 1, each scaled down to its cell
+        uint32_t side = uint32_t(std::ceil(std::cbrt(double(m_instanceCount))));
+        while (side * side * side < m_instanceCount) ++side;
+        float spacing = 2.0f / float(side);
+        float scale = spacing * 0.5f;
+
+        uint32_t stride = InstanceStride();
+        m_statistics.instanceBytes = VkDeviceSize(stride) * m_instanceCount;
+        VPA_PASS_ERROR(m_allocator->Allocate(m_statistics.instanceBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "Instance buffer", m_instanceAllocation));
+        uchar* out = m_allocator->MapMemory(m_instanceAllocation);
+        for (uint32_t i = 0; i < m_instanceCount; ++i) {
+            float offset[3] = { -1.0f + spacing * (float(i % side) + 0.5f), -1.0f + spacing * (float((i / side) % side) + 0.5f), -1.0f + spacing * (float(i / (side * side)) + 0.5f) };
+            for (int a = 0; a < m_instanceAttributes.size(); ++a) {
+                InstanceAttribute attribute = m_instanceAttributes[a];
+                float values[16] = {};
+                if (attribute == InstanceAttribute::Transform) {
+                    // Column major, a mat4x3 is the affine part and a mat3 only scales
+                    uint32_t rows = m_instanceRows[a];
+                    for (uint32_t c = 0; c < m_instanceColumns[a]; ++c) {
+                        for (uint32_t r = 0; r < rows; ++r) {
+                            if (c == r) values[c * rows + r] = c < 3 ? scale : 1.0f;
+                            else if (c == 3 && r < 3) values[c * rows + r] = offset[r];
+                        }
+                    }
+                }
+                else if (attribute == InstanceAttribute::Offset) {
+                    values[0] = offset[0];
+                    values[1] = offset[1];
+                    values[2] = offset[2];
+                    values[3] = scale;
+                }
+                else {
+                    // Golden ratio steps keep neighbouring instances' hues apart
+                    HueColour(std::fmod(float(i) * 0.618034f, 1.0f), values);
+                }
+                memcpy(out, values, InstanceAttributeSize(a));
+                out += InstanceAttributeSize(a);
+            }
+        }
+        m_allocator->UnmapMemory(m_instanceAllocation);
+        return VPA_OK;
+    }
+
+    VPAError VertexInput::CreateIndirectCommands() {
+        m_statistics.subMeshCount = uint32_t(m_subMeshes.size());
+        if (!m_indexed || m_subMeshes.isEmpty()) return VPA_OK;
+
+        VkDeviceSize bytes = VkDeviceSize(m_subMeshes.size()) * sizeof(VkDrawIndexedIndirectCommand);
+        VPA_PASS_ERROR(m_allocator->Allocate(bytes, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, "Indirect buffer", m_indirectAllocation));
+        VkDrawIndexedIndirectCommand* commands = reinterpret_cast<VkDrawIndexedIndirectCommand*>(m_allocator->MapMemory(m_indirectAllocation));
+        for (int i = 0; i < m_subMeshes.size(); ++i) {
+            commands[i].indexCount = m_subMeshes[i].indexCount;
+            commands[i].instanceCount = m_instanceCount;
+            commands[i].firstIndex = m_subMeshes[i].firstIndex;
+            commands[i].vertexOffset = 0;
+            commands[i].firstInstance = 0;
+        }
+        m_allocator->UnmapMemory(m_indirectAllocation);
+        return VPA_OK;
+    }
+
+    void VertexInput::OptimiseSubMeshes(QVector<uint32_t>& indices, const QVector<float>* vertices, uint32_t stride, uint32_t positionOffset) const {
+        uint32_t vertexCount = m_statistics.uniqueVertices;
+        if (m_subMeshes.size() <= 1) {
+            MeshOptimiser::OptimiseVertexCache(indices, vertexCount);
+            if (vertices) MeshOptimiser::OptimiseOverdraw(indices, *vertices, stride, positionOffset);
+            return;
+        }
+
+        // Each sub mesh is reordered within its own range so its indirect draw still covers it.
+        // Its vertices are numbered from 0 while it is optimised so the per vertex arrays are only as large as the sub mesh.
+        uint32_t* out = indices.data();
+        QVector<SubMesh> subMeshes = m_subMeshes;
+        QtConcurrent::blockingMap(subMeshes, [&](SubMesh& subMesh) {
+            QHash<uint32_t, uint32_t> localIndices;
+            QVector<uint32_t> globalIndices;
+            QVector<uint32_t> local = QVector<uint32_t>(int(subMesh.indexCount));
+            QVector<float> localVertices;
+            for (uint32_t i = 0; i < subMesh.indexCount; ++i) {
+                uint32_t index = out[subMesh.firstIndex + i];
+                auto found = localIndices.constFind(index);
+                if (found != localIndices.constEnd()) {
+                    local[int(i)] = found.value();
+                    continue;
+                }
+                local[int(i)] = uint32_t(globalIndices.size());
+                localIndices.insert(index, local[int(i)]);
+                globalIndices.push_back(index);
+                if (vertices) localVertices.append(vertices->mid(int(index * stride), int(stride)));
+            }
+
+            MeshOptimiser::OptimiseVertexCache(local, uint32_t(globalIndices.size()));
+            if (vertices) MeshOptimiser::OptimiseOverdraw(local, localVertices, stride, positionOffset);
+            for (uint32_t i = 0; i < subMesh.indexCount; ++i) {
+                out[subMesh.firstIndex + i] = globalIndices[int(local[int(i)])];
+            }
+        });
+    }
+
+    uint32_t VertexInput::InstanceStride() const {
+        uint32_t stride = 0;
+        for (int i = 0; i < m_instanceAttributes.size(); ++i) {
+            stride += InstanceAttributeSize(i);
+        }
+        return stride;
+    }
+
+    uint32_t VertexInput::InstanceAttributeSize(int index) const {
+        return m_instanceColumns[index] * m_instanceRows[index] * uint32_t(sizeof(float));
+    }
+
+    VPAError VertexInput::LoadObj(const QString& path, QVector<float>& verts, QVector<uint32_t>& indices) {
+        ObjMesh mesh;
+        if (ObjParser::Parse(path, mesh) != VPA_OK) {
+            qDebug("Falling back to tinyobj for %s", qPrintable(path));
+            VPA_PASS_ERROR(ObjParser::ParseTinyObj(path, mesh));
+        }
+
+        QHash<ObjIndex, uint32_t> uniqueVertices;
+        uint32_t count = 0;
+        bool texCoordsNormalised = true;
+        srand(static_cast<unsigned int>(time(NULL)));
+
+        for (const ObjIndex& index : mesh.indices) {
+            // Face corners which share position, texcoord and normal indices are the same vertex
+            // Non indexed drawing needs every corner so only indexed meshes are deduplicated
+            if (m_indexed) {
+                auto existing = uniqueVertices.constFind(index);
+                if (existing != uniqueVertices.constEnd()) {
+                    indices.push_back(existing.value());
+                    continue;
+                }
+                uniqueVertices.insert(index, count);
+            }
+
+            // Texcoords and normals the mesh doesn't have are zero so every vertex matches the shader's layout
+            for (int i = 0; i < m_attributes.size(); ++i) {
+                if (m_attributes[i] == VertexAttribute::Position) {
+                    verts.push_back(mesh.positions[3 * index.vertex + 0]);
+                    verts.push_back(mesh.positions[3 * index.vertex + 1]);
+                    verts.push_back(mesh.positions[3 * index.vertex + 2]);
+                }
+                else if (m_attributes[i] == VertexAttribute::TexCoord) {
+                    float u = index.texcoord >= 0 ? mesh.texcoords[2 * index.texcoord + 0] : 0.0f;
+                    float v = index.texcoord >= 0 ? 1.0f - mesh.texcoords[2 * index.texcoord + 1] : 0.0f;
+                    texCoordsNormalised = texCoordsNormalised && u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f;
+                    verts.push_back(u);
+                    verts.push_back(v);
+                }
+                else if (m_attributes[i] == VertexAttribute::Normal) {
+                    verts.push_back(index.normal >= 0 ? mesh.normals[3 * index.normal + 0] : 0.0f);
+                    verts.push_back(index.normal >= 0 ? mesh.normals[3 * index.normal + 1] : 0.0f);
+                    verts.push_back(index.normal >= 0 ? mesh.normals[3 * index.normal + 2] : 0.0f);
+                }
+                else if (m_attributes[i] == VertexAttribute::RgbaColour) {
+                    float colour[4];
+                    RandomColour(colour);
+                    verts.push_back(colour[0]);
+                    verts.push_back(colour[1]);
+                    verts.push_back(colour[2]);
+                    verts.push_back(colour[3]);
+                }
+            }
+            indices.push_back(count++);
+        }
+
+        m_statistics = {};
+        m_statistics.uniqueVertices = count;
+        m_statistics.sourceVertices = uint32_t(mesh.indices.size());
+
+        // Unorm16 can only hold texcoords within 0 to 1, wrapping ones keep their range as half floats
+        if (m_formats.texCoord == VertexTexCoordFormat::Unorm16 && !texCoordsNormalised) {
+            m_formats.texCoord = VertexTexCoordFormat::Float16;
+            m_statistics.texCoordFallback = true;
+        }
+        m_statistics.formats = m_formats;
+        m_statistics.stride = CalculateStride();
+        m_statistics.uncompressedStride = CalculateStride(VertexFormatConfig());
+
+        if (m_indexed && count > 0) {
+            // Stride and position offset in floats of the unpacked vertices
+            uint32_t stride = 0;
+            int positionOffset = -1;
+            for (VertexAttribute attribute : m_attributes) {
+                if (attribute == VertexAttribute::Position && positionOffset < 0) positionOffset = int(stride);
+                stride += ComponentCount(attribute);
+            }
+
+            // Indices are pushed in face corner order so each shape's range carries over as it is
+            for (const ObjShape& shape : mesh.shapes) {
+                m_subMeshes.push_back({ uint32_t(shape.firstIndex), uint32_t(shape.indexCount) });
+            }
+            if (m_subMeshes.isEmpty()) m_subMeshes.push_back({ 0, uint32_t(indices.size()) });
 
-        qDebug("Loaded mesh %s.obj", qPrintable(meshName));
+            m_statistics.sourceCache = MeshOptimiser::AnalyseVertexCache(indices, count);
+            m_statistics.sourceOverfetch = MeshOptimiser::AnalyseVertexFetch(indices, count, m_statistics.stride);
+            if (m_optimise) {
+                OptimiseSubMeshes(indices, positionOffset >= 0 ? &verts : nullptr, stride, uint32_t(qMax(positionOffset, 0)));
+                count = MeshOptimiser::OptimiseVertexFetch(indices, verts, stride);
+                m_statistics.optimised = true;
+            }
+            m_statistics.optimisedCache = MeshOptimiser::AnalyseVertexCache(indices, count);
+            m_statistics.optimisedOverfetch = MeshOptimiser::AnalyseVertexFetch(indices, count, m_statistics.stride);
+            m_statistics.indexCount = uint32_t(indices.size());
+            if (positionOffset >= 0) BuildLods(indices, verts, stride, uint32_t(positionOffset), count);
+        }
+        qDebug("Loaded mesh %s, %u vertices from %u face corners", qPrintable(path), m_statistics.uniqueVertices, m_statistics.sourceVertices);
         return VPA_OK;
     }
 
-    void VertexInput::CalculateData(QVector<SpvResource*>& inputResources) {
+    VPAError VertexInput::LoadGltf(const QString& path) {
+        if (!m_indexed) return VPA_WARN("glTF meshes can only be drawn indexed");
+        GltfFile file;
+        VPA_PASS_ERROR(file.Open(path));
+        const QVector<GltfPrimitive>& primitives = file.Primitives();
+
+        // Primitives are concatenated, so their indices are rebased on to the vertices of the primitives before them
+        QVector<uint32_t> indices;
+        uint32_t vertexCount = 0;
+        bool texCoordsNormalised = true;
+        srand(static_cast<unsigned int>(time(NULL)));
+        for (const GltfPrimitive& primitive : primitives) {
+            uint32_t primitiveVertices = primitive.attributes.value("POSITION").count;
+            uint32_t firstIndex = uint32_t(indices.size());
+            for (VertexAttribute attribute : m_attributes) {
+                auto accessor = primitive.attributes.constFind(GltfSemantic(attribute));
+                if (accessor != primitive.attributes.constEnd() && accessor->count < primitiveVertices) return VPA_WARN(QString("glTF %1 accessor is shorter than POSITION").arg(GltfSemantic(attribute)));
+            }
+            if (primitive.indices.count > 0) {
+                for (uint32_t i = 0; i < primitive.indices.count; ++i) {
+                    uint32_t index = primitive.indices.ReadIndex(i);
+                    if (index >= primitiveVertices) return VPA_WARN("glTF index out of range in " + path);
+                    indices.push_back(vertexCount + index);
+                }
+            }
+            else {
+                for (uint32_t i = 0; i < primitiveVertices; ++i) {
+                    indices.push_back(vertexCount + i);
+                }
+            }
+
+            auto texCoords = primitive.attributes.constFind("TEXCOORD_0");
+            if (m_formats.texCoord == VertexTexCoordFormat::Unorm16 && texCoords != primitive.attributes.constEnd()) {
+                for (uint32_t v = 0; v < primitiveVertices && texCoordsNormalised; ++v) {
+                    float uv[2] = { 0.0f, 0.0f };
+                    texCoords->Read(v, uv);
+                    texCoordsNormalised = uv[0] >= 0.0f && uv[0] <= 1.0f && uv[1] >= 0.0f && uv[1] <= 1.0f;
+                }
+            }
+            if (uint32_t(indices.size()) > firstIndex) m_subMeshes.push_back({ firstIndex, uint32_t(indices.size()) - firstIndex });
+            vertexCount += primitiveVertices;
+        }
+        if (indices.isEmpty()) return VPA_WARN("No triangles in " + path);
+
+        m_statistics = {};
+        m_statistics.uniqueVertices = vertexCount;
+        m_statistics.sourceVertices = uint32_t(indices.size());
+        m_statistics.indexCount = uint32_t(indices.size());
+        if (m_formats.texCoord == VertexTexCoordFormat::Unorm16 && !texCoordsNormalised) {
+            m_formats.texCoord = VertexTexCoordFormat::Float16;
+            m_statistics.texCoordFallback = true;
+        }
+        m_statistics.formats = m_formats;
+        m_statistics.stride = CalculateStride();
+        m_statistics.uncompressedStride = CalculateStride(VertexFormatConfig());
+        CalculateStreams(vertexCount);
+
+        // Vertices aren't reordered as they are written straight from the file, and overdraw needs float positions, so only the vertex cache order is optimised
+        m_statistics.sourceCache = MeshOptimiser::AnalyseVertexCache(indices, vertexCount);
+        m_statistics.sourceOverfetch = MeshOptimiser::AnalyseVertexFetch(indices, vertexCount, m_statistics.stride);
+        if (m_optimise) {
+            OptimiseSubMeshes(indices, nullptr, 0, 0);
+            m_statistics.optimised = true;
+        }
+        m_statistics.optimisedCache = MeshOptimiser::AnalyseVertexCache(indices, vertexCount);
+        m_statistics.optimisedOverfetch = MeshOptimiser::AnalyseVertexFetch(indices, vertexCount, m_statistics.stride);
+
+        // Simplification needs float positions whatever format they are stored in
+        QVector<float> positions;
+        positions.reserve(3 * int(vertexCount));
+        for (const GltfPrimitive& primitive : primitives) {
+            const GltfAccessor& accessor = primitive.attributes.value("POSITION");
+            for (uint32_t v = 0; v < accessor.count; ++v) {
+                float position[3] = { 0.0f, 0.0f, 0.0f };
+                accessor.Read(v, position);
+                positions.push_back(position[0]);
+                positions.push_back(position[1]);
+                positions.push_back(position[2]);
+            }
+        }
+        BuildLods(indices, positions, 3, 0, vertexCount);
+
+        // A single primitive's 16 or 32 bit indices are uploaded as they are unless they were reordered or have levels after them, 8 bit ones are widened as Vulkan can't draw them
+        const GltfAccessor& nativeIndices = primitives[0].indices;
+        bool nativeIndexUpload = primitives.size() == 1 && nativeIndices.count > 0 && !m_optimise && m_statistics.lodCount <= 1
+                && (nativeIndices.componentType == GltfComponentType::UnsignedInt || (nativeIndices.componentType == GltfComponentType::UnsignedShort && vertexCount < 0xFFFF));
+        if (nativeIndexUpload) m_statistics.indexType = nativeIndices.componentType == GltfComponentType::UnsignedShort ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        else m_statistics.indexType = vertexCount < 0xFFFF ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        m_statistics.indexBytes = VkDeviceSize(indices.size()) * (m_statistics.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t));
+        int lastBinding = m_streamOffsets.size() - 1;
+        m_statistics.vertexBytes = lastBinding >= 0 ? m_streamOffsets[lastBinding] + VkDeviceSize(vertexCount) * StreamStride(uint32_t(lastBinding)) : 0;
+
+        VPA_PASS_ERROR(m_allocator->Allocate(m_statistics.vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "Vertex buffer", m_vertexAllocation));
+        VPA_PASS_ERROR(m_allocator->Allocate(m_statistics.indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "Index buffer", m_indexAllocation));
+
+        // Attributes are written from the mapped file in to the mapped buffer, float attributes matching the chosen format are copied as they are
+        QVector<uint32_t> attributeOffsets = AttributeOffsets();
+        uchar* out = m_allocator->MapMemory(m_vertexAllocation);
+        uint32_t baseVertex = 0;
+        for (const GltfPrimitive& primitive : primitives) {
+            uint32_t primitiveVertices = primitive.attributes.value("POSITION").count;
+            for (int i = 0; i < m_attributes.size(); ++i) {
+                VertexAttribute attribute = m_attributes[i];
+                VkFormat format = AttributeFormat(attribute, m_formats);
+                uint32_t size = AttributeSize(attribute, m_formats);
+                uint32_t stride = StreamStride(m_bindings[i]);
+                uchar* dst = out + m_streamOffsets[int(m_bindings[i])] + VkDeviceSize(baseVertex) * stride + attributeOffsets[i];
+
+                auto found = primitive.attributes.constFind(GltfSemantic(attribute));
+                if (found == primitive.attributes.constEnd()) {
+                    // Missing attributes are filled the same way as obj files without them
+                    for (uint32_t v = 0; v < primitiveVertices; ++v) {
+                        float values[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                        if (attribute == VertexAttribute::RgbaColour) RandomColour(values);
+                        PackAttribute(format, ComponentCount(attribute), values, dst + VkDeviceSize(v) * stride);
+                    }
+                    continue;
+                }
+
+                const GltfAccessor& accessor = found.value();
+                bool copyable = accessor.componentType == GltfComponentType::Float && accessor.components == ComponentCount(attribute)
+                        && format == AttributeFormat(attribute, VertexFormatConfig());
+                if (copyable && accessor.Tight() && stride == size) {
+                    memcpy(dst, accessor.data, size_t(size) * primitiveVertices);
+                }
+                else if (copyable) {
+                    for (uint32_t v = 0; v < primitiveVertices; ++v) {
+                        memcpy(dst + VkDeviceSize(v) * stride, accessor.data + size_t(v) * accessor.stride, size);
+                    }
+                }
+                else {
+                    for (uint32_t v = 0; v < primitiveVertices; ++v) {
+                        float values[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                        accessor.Read(v, values);
+                        PackAttribute(format, ComponentCount(attribute), values, dst + VkDeviceSize(v) * stride);
+                    }
+                }
+            }
+            baseVertex += primitiveVertices;
+        }
+        m_allocator->UnmapMemory(m_vertexAllocation);
+
+        uchar* indexOut = m_allocator->MapMemory(m_indexAllocation);
+        if (nativeIndexUpload && nativeIndices.Tight()) {
+            memcpy(indexOut, nativeIndices.data, size_t(m_statistics.indexBytes));
+        }
+        else if (nativeIndexUpload) {
+            for (uint32_t i = 0; i < nativeIndices.count; ++i) {
+                memcpy(indexOut + size_t(i) * nativeIndices.ComponentSize(), nativeIndices.data + size_t(i) * nativeIndices.stride, nativeIndices.ComponentSize());
+            }
+        }
+        else if (m_statistics.indexType == VK_INDEX_TYPE_UINT16) {
+            uint16_t* shortIndices = reinterpret_cast<uint16_t*>(indexOut);
+            for (int i = 0; i < indices.size(); ++i) {
+                shortIndices[i] = uint16_t(indices[i]);
+            }
+        }
+        else {
+            memcpy(indexOut, indices.constData(), size_t(m_statistics.indexBytes));
+        }
+        m_allocator->UnmapMemory(m_indexAllocation);
+        m_indexCount = m_statistics.indexCount;
+        m_indexType = m_statistics.indexType;
+
+        qDebug("Loaded mesh %s, %u vertices in %d primitives", qPrintable(path), vertexCount, primitives.size());
+        return VPA_OK;
+    }
+
+    VPAError VertexInput::CalculateData(QVector<SpvResource*>& inputResources) {
+        struct InstanceInput {
+            InstanceAttribute attribute;
+            uint32_t columns;
+            uint32_t rows;
+        };
+
         bool usedPos = false;
         QMap<uint32_t, VertexAttribute> attribData;
+        QMap<uint32_t, InstanceInput> instanceData;
         for (int i = 0; i < inputResources.size(); ++i) {
             // TODO allow different attrib sizes than float
             uint32_t location = reinterpret_cast<SpvInputAttribGroup*>(inputResources[i]->group)->location;
+            // The input's name says what it is when it can, otherwise it is guessed from its size
+            QString name = inputResources[i]->name.toLower();
+            if (name.contains("instance")) {
+                if (inputResources[i]->type->Type() == SpvTypeName::Matrix) {
+                    const SpvMatrixType* matrix = reinterpret_cast<const SpvMatrixType*>(inputResources[i]->type);
+                    // Double matrices take two locations for some columns, which the instance data isn't laid out for
+                    if (matrix->size != matrix->columns * matrix->rows * sizeof(float)) {
+                        return VPA_WARN("Instance input " + inputResources[i]->name + " is not a float matrix, which instanced drawing doesn't support");
+                    }
+                    instanceData[location] = { InstanceAttribute::Transform, uint32_t(matrix->columns), uint32_t(matrix->rows) };
+                }
+                else if (name.contains("col")) instanceData[location] = { InstanceAttribute::Colour, 1, 4 };
+                else instanceData[location] = { InstanceAttribute::Offset, 1, 4 };
+                continue;
+            }
             SpvVectorType* type = reinterpret_cast<SpvVectorType*>(inputResources[i]->type); // TODO deal with other types
-            if (type->length == 2) {
+            if (name.contains("pos") && !usedPos) {
+                attribData[location] = VertexAttribute::Position;
+                usedPos = true;
+            }
+            else if (name.contains("norm")) {
+                attribData[location] = VertexAttribute::Normal;
+            }
+            else if (name.contains("tex") || name.contains("uv")) {
+                attribData[location] = VertexAttribute::TexCoord;
+            }
+            else if (name.contains("col")) {
+                attribData[location] = VertexAttribute::RgbaColour;
+            }
+            else if (type->length == 2) {
                 attribData[location] = VertexAttribute::TexCoord;
             }
             else if (type->length == 3 && !usedPos) {
@@ -122,61 +853,113 @@ namespace vpa {
             }
         }
 
-        m_attributes.resize(inputResources.size());
-        int i = 0;
-        for (auto attrib : attribData) {
-            m_attributes[i++] = attrib;
+        // Ordered by location, which the attribute descriptions use rather than their index
+        m_attributes = attribData.values().toVector();
+        m_locations = attribData.keys().toVector();
+        m_instanceAttributes.clear();
+        m_instanceColumns.clear();
+        m_instanceRows.clear();
+        for (const InstanceInput& input : instanceData) {
+            m_instanceAttributes.push_back(input.attribute);
+            m_instanceColumns.push_back(input.columns);
+            m_instanceRows.push_back(input.rows);
         }
+        m_instanceLocations = instanceData.keys().toVector();
+        return VPA_OK;
     }
 
-    VkVertexInputBindingDescription VertexInput::InputBindingDescription() {
-        VkVertexInputBindingDescription desc;
-        desc.binding = 0;
-        desc.stride = CalculateStride();
-        desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-        return desc;
+    QVector<VkVertexInputBindingDescription> VertexInput::InputBindingDescriptions() {
+        QVector<VkVertexInputBindingDescription> descs(m_streamOffsets.size());
+        for (int i = 0; i < descs.size(); ++i) {
+            descs[i].binding = uint32_t(i);
+            descs[i].stride = StreamStride(uint32_t(i));
+            descs[i].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        }
+        if (!m_instanceAttributes.isEmpty()) {
+            VkVertexInputBindingDescription instanceDesc;
+            instanceDesc.binding = uint32_t(descs.size());
+            instanceDesc.stride = InstanceStride();
+            instanceDesc.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+            descs.push_back(instanceDesc);
+        }
+        return descs;
     }
 
     QVector<VkVertexInputAttributeDescription> VertexInput::InputAttribDescription() {
         QVector<VkVertexInputAttributeDescription> attribDescs(m_attributes.size());
-        uint32_t location = 0;
-        uint32_t offset = 0;
+        QVector<uint32_t> offsets(m_streamOffsets.size(), 0);
         for (int i = 0; i < m_attributes.size(); ++i) {
-            VkFormat format;
-            uint32_t tmpOffset;
-            if (m_attributes[i] == VertexAttribute::TexCoord) {
-                format = VK_FORMAT_R32G32_SFLOAT;
-                tmpOffset = 2 * sizeof(float);
-            }
-            else if (m_attributes[i] == VertexAttribute::Position || m_attributes[i] == VertexAttribute::Normal) {
-                format = VK_FORMAT_R32G32B32_SFLOAT;
-                tmpOffset = 3 * sizeof(float);
-            }
-            else {
-                format = VK_FORMAT_R32G32B32A32_SFLOAT;
-                tmpOffset = 4 * sizeof(float);
+            int binding = int(m_bindings[i]);
+            attribDescs[i].format = AttributeFormat(m_attributes[i], m_formats);
+            attribDescs[i].offset = offsets[binding];
+            attribDescs[i].binding = uint32_t(binding);
+            attribDescs[i].location = m_locations[i];
+            offsets[binding] += AttributeSize(m_attributes[i], m_formats);
+        }
+
+        // A matrix input takes a location per column
+        uint32_t instanceOffset = 0;
+        for (int i = 0; i < m_instanceAttributes.size(); ++i) {
+            for (uint32_t c = 0; c < m_instanceColumns[i]; ++c) {
+                VkVertexInputAttributeDescription desc;
+                desc.format = InstanceColumnFormat(m_instanceRows[i]);
+                desc.offset = instanceOffset + c * m_instanceRows[i] * uint32_t(sizeof(float));
+                desc.binding = uint32_t(m_streamOffsets.size());
+                desc.location = m_instanceLocations[i] + c;
+                attribDescs.push_back(desc);
             }
-            attribDescs[i].format = format;
-            attribDescs[i].offset = offset;
-            attribDescs[i].binding = 0;
-            attribDescs[i].location = location++;
-            offset += tmpOffset;
+            instanceOffset += InstanceAttributeSize(i);
         }
         return attribDescs;
     }
 
-    uint32_t VertexInput::CalculateStride() {
+    VkFormat VertexInput::AttributeFormat(VertexAttribute attribute, const VertexFormatConfig& formats) {
+        if (attribute == VertexAttribute::Position) {
+            return formats.position == VertexPositionFormat::Float16 ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R32G32B32_SFLOAT;
+        }
+        else if (attribute == VertexAttribute::Normal) {
+            if (formats.normal == VertexNormalFormat::Snorm8) return VK_FORMAT_R8G8B8A8_SNORM;
+            if (formats.normal == VertexNormalFormat::Snorm10) return VK_FORMAT_A2B10G10R10_SNORM_PACK32;
+            return VK_FORMAT_R32G32B32_SFLOAT;
+        }
+        else if (attribute == VertexAttribute::TexCoord) {
+            if (formats.texCoord == VertexTexCoordFormat::Float16) return VK_FORMAT_R16G16_SFLOAT;
+            if (formats.texCoord == VertexTexCoordFormat::Unorm16) return VK_FORMAT_R16G16_UNORM;
+            return VK_FORMAT_R32G32_SFLOAT;
+        }
+        return formats.colour == VertexColourFormat::Unorm8 ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32A32_SFLOAT;
+    }
+
+    uint32_t VertexInput::AttributeSize(VertexAttribute attribute, const VertexFormatConfig& formats) {
+        switch (AttributeFormat(attribute, formats)) {
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return 8;
+        default:
+            return 4;
+        }
+    }
+
+    uint32_t VertexInput::StreamStride(uint32_t binding) const {
         uint32_t stride = 0;
         for (int i = 0; i < m_attributes.size(); ++i) {
-            if (m_attributes[i] == VertexAttribute::TexCoord) {
-                stride += 2 * sizeof(float);
-            }
-            else if (m_attributes[i] == VertexAttribute::Position || m_attributes[i] == VertexAttribute::Normal) {
-                stride += 3 * sizeof(float);
-            }
-            else {
-                stride += 4 * sizeof(float);
-            }
+            if (m_bindings[i] == binding) stride += AttributeSize(m_attributes[i], m_formats);
+        }
+        return stride;
+    }
+
+    uint32_t VertexInput::CalculateStride() const {
+        return CalculateStride(m_formats);
+    }
+
+    uint32_t VertexInput::CalculateStride(const VertexFormatConfig& formats) const {
+        uint32_t stride = 0;
+        for (VertexAttribute attribute : m_attributes) {
+            stride += AttributeSize(attribute, formats);
         }
         return stride;
     }
@@ -5,6 +5,8 @@
 
 #include "spirvresource.h"
 #include "memoryallocator.h"
+#include "meshoptimiser.h"
+#include "pipelineconfig.h"
 
 
 class QVulkanDeviceFunctions;
@@ -18,39 +20,131 @@ namespace vpa {
         Count_
     };
 
+    // Per instance shader inputs, recognised by having "instance" in their name
+    enum class InstanceAttribute {
+        Transform, // Any float matrix, filled with as much of a 4x4 scale and translation as fits
+        Offset, // vec4, xyz translation and w uniform scale
+        Colour, // vec4
+        Count_
+    };
+
     enum class SupportedFormats {
         Obj,
+        Gltf, // .gltf and .glb
         Count_
     };
 
+    // A range of the full mesh's indices with its own indirect draw, one per obj shape or glTF primitive
+    struct SubMesh {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    struct MeshStatistics {
+        static constexpr uint32_t MaxLods = 4;
+
+        uint32_t sourceVertices = 0; // One per face corner as read from the file
+        uint32_t uniqueVertices = 0;
+        uint32_t indexCount = 0;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+        VkDeviceSize vertexBytes = 0;
+        VkDeviceSize indexBytes = 0;
+        bool optimised = false;
+        // Simulated with a FIFO post transform cache, before and after the index order was optimised
+        VertexCacheStatistics sourceCache;
+        VertexCacheStatistics optimisedCache;
+        float sourceOverfetch = 0.0f;
+        float optimisedOverfetch = 0.0f;
+        bool cached = false; // Read from a .vpamesh cache rather than parsed
+        bool generated = false; // Made by MeshGenerator
+        VertexFormatConfig formats; // What was actually used after any fallbacks
+        bool texCoordFallback = false;
+        uint32_t stride = 0; // Sum of every stream's stride
+        uint32_t uncompressedStride = 0; // With every attribute as 32 bit floats
+        VertexStreamLayout streamLayout = VertexStreamLayout::Interleaved;
+        uint32_t streamCount = 0;
+        uint32_t instanceCount = 1;
+        uint32_t instanceAttributes = 0; // Per instance inputs the shader declares
+        VkDeviceSize instanceBytes = 0;
+        uint32_t subMeshCount = 0;
+        // Simplified levels are appended to the index buffer after the full mesh, which is level 0. None are made for generated meshes.
+        uint32_t lodCount = 0;
+        uint32_t lodFirstIndex[MaxLods] = {};
+        uint32_t lodIndexCount[MaxLods] = {};
+        float lodError[MaxLods] = {}; // Fraction of the bounding box diagonal
+        float loadMilliseconds = 0.0f;
+    };
+
     class VertexInput final {
     public:
         VertexInput(QVulkanDeviceFunctions* deviceFuncs, MemoryAllocator* allocator,
-                    QVector<SpvResource*> inputResources, QString meshName, bool isIndexed, VPAError& err);
+                    QVector<SpvResource*> inputResources, QString meshPath, bool isIndexed, const PreviewConfig& preview, VPAError& err);
         ~VertexInput();
 
         VkBuffer VertexBuffer() const { return m_vertexAllocation.buffer;  }
         VkBuffer IndexBuffer() const { return m_indexAllocation.buffer; }
         bool IsIndexed() const {  return m_indexed; }
         uint32_t IndexCount() const { return m_indexCount; }
+        uint32_t InstanceCount() const { return m_instanceCount; }
+        uint32_t LodCount() const { return qMax(m_statistics.lodCount, 1u); }
+        uint32_t LodFirstIndex(uint32_t level) const { return m_statistics.lodCount > 0 ? m_statistics.lodFirstIndex[level] : 0; }
+        uint32_t LodIndexCount(uint32_t level) const { return m_statistics.lodCount > 0 ? m_statistics.lodIndexCount[level] : m_indexCount; }
+        VkIndexType IndexType() const { return m_indexType; }
+        VkBuffer IndirectBuffer() const { return m_indirectAllocation.buffer; }
+        uint32_t SubMeshCount() const { return uint32_t(m_subMeshes.size()); }
+        const MeshStatistics& Statistics() const { return m_statistics; }
 
         void BindBuffers(VkCommandBuffer& cmdBuffer);
 
-        VkVertexInputBindingDescription InputBindingDescription();
+        QVector<VkVertexInputBindingDescription> InputBindingDescriptions();
         QVector<VkVertexInputAttributeDescription> InputAttribDescription();
+        uint32_t StreamCount() const { return uint32_t(m_streamOffsets.size()); }
+        uint32_t StreamStride(uint32_t binding) const;
+
+        static VkFormat AttributeFormat(VertexAttribute attribute, const VertexFormatConfig& formats);
+        static uint32_t AttributeSize(VertexAttribute attribute, const VertexFormatConfig& formats);
 
     private:
-        VPAError LoadMesh(QString& meshName, SupportedFormats format);
-        VPAError LoadObj(QString& meshName);
+        VPAError LoadMesh(const QString& meshPath, SupportedFormats format);
+        VPAError LoadObj(const QString& path, QVector<float>& verts, QVector<uint32_t>& indices);
+        VPAError LoadGltf(const QString& path);
+        VPAError GenerateMesh(const PreviewConfig& preview);
+        void BuildLods(QVector<uint32_t>& indices, const QVector<float>& vertices, uint32_t stride, uint32_t positionOffset, uint32_t vertexCount);
+        QByteArray PackVertices(const QVector<float>& verts) const;
+        QVector<uint32_t> AttributeOffsets() const;
+        VPAError CreateInstances();
+        VPAError CreateIndirectCommands();
+        void OptimiseSubMeshes(QVector<uint32_t>& indices, const QVector<float>* vertices, uint32_t stride, uint32_t positionOffset) const;
+        uint32_t InstanceStride() const;
+        uint32_t InstanceAttributeSize(int index) const;
+        void CalculateStreams(uint32_t vertexCount);
+        VPAError UploadBuffers(const void* vertexData, VkDeviceSize vertexBytes, const void* indexData, VkDeviceSize indexBytes);
 
         void AssignDefaultMeaning(QVector<SpvResource*>& inputResources);
-        void CalculateData(QVector<SpvResource*>& inputResources);
-        uint32_t CalculateStride();
+        VPAError CalculateData(QVector<SpvResource*>& inputResources);
+        uint32_t CalculateStride() const;
+        uint32_t CalculateStride(const VertexFormatConfig& formats) const;
 
         bool m_indexed;
+        bool m_optimise;
+        VertexFormatConfig m_formats;
+        VertexStreamLayout m_streamLayout;
+        QVector<uint32_t> m_bindings; // Binding of each attribute
+        QVector<VkDeviceSize> m_streamOffsets; // Offset of each binding's stream within the vertex buffer
         uint32_t m_indexCount;
+        VkIndexType m_indexType;
+        MeshStatistics m_statistics;
         QVulkanDeviceFunctions* m_deviceFuncs;
         QVector<VertexAttribute> m_attributes;
+        QVector<uint32_t> m_locations; // Shader input location of each attribute
+        uint32_t m_instanceCount;
+        QVector<InstanceAttribute> m_instanceAttributes;
+        QVector<uint32_t> m_instanceLocations;
+        QVector<uint32_t> m_instanceColumns; // Each column takes its own location, one for vectors
+        QVector<uint32_t> m_instanceRows;
+        Allocation m_instanceAllocation; // Bound after the vertex streams when the shader has per instance inputs
+        QVector<SubMesh> m_subMeshes;
+        Allocation m_indirectAllocation; // A VkDrawIndexedIndirectCommand per sub mesh
         Allocation m_vertexAllocation;
         Allocation m_indexAllocation;
         MemoryAllocator* m_allocator;
@@ -18,6 +18,10 @@
 
 namespace vpa {
     const QVector<const char*> VulkanMain::LayerNames = { QByteArrayLiteral("VK_LAYER_LUNARG_standard_validation") };
+    // Enabled when the physical device supports them, features depending on these must check ExtensionEnabled
+    const QVector<const char*> VulkanMain::OptionalDeviceExtensions = { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME,
+                                                                   VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME, VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+                                                                   VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME };
 
     void VulkanWindow::resizeEvent(QResizeEvent* event) {
         Q_UNUSED(event)
@@ -87,14 +91,14 @@ namespace vpa {
 
     void VulkanWindow::hideEvent(QHideEvent* event) {
         Q_UNUSED(event)
-        if (m_main->Details().device != VK_NULL_HANDLE) {
-            m_main->Details().deviceFunctions->vkDeviceWaitIdle(m_main->Details().device);
-        }
+        if (m_main->Details().device != VK_NULL_HANDLE) m_main->CollectRetired();
     }
 
     VulkanMain::VulkanMain(QWidget* parent, std::function<void(void)> physDeviceCallback, std::function<void(void)> creationCallback)
-        : m_renderer(nullptr), m_container(nullptr), m_parent(parent), m_creationCallback(creationCallback), m_currentState(VulkanState::Pending) {
+        : m_renderer(nullptr), m_container(nullptr), m_parent(parent), m_creationCallback(creationCallback), m_submittedFrame(0), m_completedFrame(0),
+          m_currentState(VulkanState::Pending) {
         m_details.window = nullptr;
+        memset(m_inFlightFrames, 0, sizeof(m_inFlightFrames));
         m_renderer = new VulkanRenderer(this, creationCallback);
         memset(m_renderFinished, 0, sizeof(m_renderFinished));
         memset(m_imagesAvailable, 0, sizeof(m_renderFinished));
@@ -141,6 +145,9 @@ namespace vpa {
         if (!m_details.deviceFunctions) return; // Cannot destroy if functions todestroy don't exist
         if (m_details.device != VK_NULL_HANDLE) m_details.deviceFunctions->vkDeviceWaitIdle(m_details.device);
         m_frameIndex = 0;
+        m_deletionQueue.Flush();
+        m_completedFrame = m_submittedFrame;
+        memset(m_inFlightFrames, 0, sizeof(m_inFlightFrames));
         m_renderer->Release();
         DestroySwapchain();
         for (uint32_t i = 0; i < MaxFramesInFlight; ++i) {
@@ -160,6 +167,9 @@ namespace vpa {
         if (m_details.device != VK_NULL_HANDLE) {
             m_details.deviceFunctions->vkDestroyDevice(m_details.device, nullptr);
             m_details.device = VK_NULL_HANDLE;
+            m_details.extensionFunctions = {};
+            m_details.maxPushDescriptors = 0;
+            m_details.maxBindlessImages = 0;
         }
         m_currentState = VulkanState::Pending;
     }
@@ -176,11 +186,13 @@ namespace vpa {
     void VulkanMain::RecreateSwapchain() {
         if (m_details.device == VK_NULL_HANDLE) return;
 
-        m_details.deviceFunctions->vkDeviceWaitIdle(m_details.device);
-        DestroySwapchain();
-
+        // The old swapchain is handed to the new one and retired along with everything sized to it
+        SwapchainDetails oldSwapchain = m_details.swapchainDetails;
         VPAError err = CreateSwapchain(m_details.swapchainDetails);
+        if (err != VPA_OK && m_details.swapchainDetails.swapchain == oldSwapchain.swapchain) m_details.swapchainDetails.swapchain = VK_NULL_HANDLE;
+        RetireSwapchain(oldSwapchain);
         if (err != VPA_OK) {
+            memset(m_details.swapchainDetails.imageViews, 0, sizeof(m_details.swapchainDetails.imageViews));
             MainWindow::Console()->setText("Failed to recreate swapchain");
             m_currentState = VulkanState::Disabled;
             return;
@@ -189,6 +201,19 @@ namespace vpa {
         if (RendererValid()) Reload(ReloadFlags::RenderPass);
     }
 
+    void VulkanMain::RetireSwapchain(SwapchainDetails& swapchain) {
+        for (uint32_t i = 0; i < swapchain.imageCount; ++i) {
+            RetireHandle(swapchain.imageViews[i], &QVulkanDeviceFunctions::vkDestroyImageView);
+        }
+        if (swapchain.swapchain != VK_NULL_HANDLE) {
+            VkSwapchainKHR retired = swapchain.swapchain;
+            VkDevice device = m_details.device;
+            PFN_vkDestroySwapchainKHR destroySwapchain = m_iFunctions.vkDestroySwapchainKHR;
+            Retire([retired, device, destroySwapchain]() { destroySwapchain(device, retired, nullptr); });
+            swapchain.swapchain = VK_NULL_HANDLE;
+        }
+    }
+
     VPAError VulkanMain::Create(bool destroy) {
         if (destroy) Destroy();
         m_frameIndex = 0;
@@ -209,7 +234,7 @@ namespace vpa {
              << "VK_LAYER_LUNARG_image"
              << "VK_LAYER_LUNARG_swapchain"
              << "VK_LAYER_GOOGLE_unique_objects");
-        instance.setExtensions(QByteArrayList() << VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        instance.setExtensions(QByteArrayList() << VK_EXT_DEBUG_UTILS_EXTENSION_NAME << VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
         if (!instance.create()) return VPA_CRITICAL("Could not create Vulkan Instance " + QString::number(instance.errorCode()));
 
         m_details.functions = m_details.instance.functions();
@@ -259,7 +284,14 @@ namespace vpa {
             return VPA_CRITICAL("Physical device surface queries not available");
         }
 
-        VkPhysicalDeviceMemoryProperties memoryProperties;
+        m_iFunctions.vkGetPhysicalDeviceMemoryProperties2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+                    m_details.instance.getInstanceProcAddr("vkGetPhysicalDeviceMemoryProperties2KHR"));
+        m_iFunctions.vkGetPhysicalDeviceProperties2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+                    m_details.instance.getInstanceProcAddr("vkGetPhysicalDeviceProperties2KHR"));
+        m_iFunctions.vkGetPhysicalDeviceFeatures2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+                    m_details.instance.getInstanceProcAddr("vkGetPhysicalDeviceFeatures2KHR"));
+
+        VkPhysicalDeviceMemoryProperties& memoryProperties = m_details.memoryProperties;
         m_details.functions->vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
         for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
             if (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
@@ -282,6 +314,7 @@ namespace vpa {
     }
 
     bool VulkanMain::HasExtensions(VkPhysicalDevice& physicalDevice) {
+        m_deviceExtensions.clear();
         m_requiredExtensions = m_details.instance.extensions();
         m_requiredExtensions.append("VK_KHR_swapchain");
 
@@ -311,6 +344,9 @@ namespace vpa {
         for (const QByteArray& ext : m_requiredExtensions) {
             if (exts.contains(ext)) m_deviceExtensions.append(ext.constData());
         }
+        for (const char* ext : OptionalDeviceExtensions) {
+            if (exts.contains(ext) && !ExtensionEnabled(ext)) m_deviceExtensions.append(ext);
+        }
 
         return true;
     }
@@ -400,6 +436,27 @@ namespace vpa {
             if (exts.contains(ext)) devExts.append(ext.constData());
         }
 
+        // Only what runtime sampled image arrays need is enabled, and only when all of it is there
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        bool bindless = false;
+        if (ExtensionEnabled(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) && m_iFunctions.vkGetPhysicalDeviceFeatures2KHR && m_iFunctions.vkGetPhysicalDeviceProperties2KHR) {
+            VkPhysicalDeviceFeatures2KHR features = {};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+            features.pNext = &indexingFeatures;
+            m_iFunctions.vkGetPhysicalDeviceFeatures2KHR(m_details.physicalDevice, &features);
+            bindless = indexingFeatures.runtimeDescriptorArray && indexingFeatures.descriptorBindingPartiallyBound
+                    && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind && indexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+            const VkBool32 nonUniformIndexing = indexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+            indexingFeatures = {};
+            indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+            indexingFeatures.runtimeDescriptorArray = bindless;
+            indexingFeatures.descriptorBindingPartiallyBound = bindless;
+            indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = bindless;
+            indexingFeatures.descriptorBindingUpdateUnusedWhilePending = bindless;
+            indexingFeatures.shaderSampledImageArrayNonUniformIndexing = bindless && nonUniformIndexing;
+        }
+
         VkDeviceCreateInfo deviceCreateInfo = {};
         CalculateLayers(deviceCreateInfo);
 
@@ -409,10 +466,45 @@ namespace vpa {
         deviceCreateInfo.pEnabledFeatures = &m_details.physicalDeviceFeatures;
         deviceCreateInfo.enabledExtensionCount = uint32_t(m_deviceExtensions.size());
         deviceCreateInfo.ppEnabledExtensionNames = m_deviceExtensions.constData();
-        deviceCreateInfo.pNext = nullptr;
+        deviceCreateInfo.pNext = bindless ? &indexingFeatures : nullptr;
         deviceCreateInfo.flags = 0;
         VPA_VKCRITICAL_PASS(m_details.functions->vkCreateDevice(m_details.physicalDevice, &deviceCreateInfo, nullptr, &device), "Failed to create device");
         m_details.deviceFunctions = m_details.instance.deviceFunctions(m_details.device);
+        m_details.memoryBudgetSupported = ExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) && m_iFunctions.vkGetPhysicalDeviceMemoryProperties2KHR;
+
+        ExtensionFunctions& extFuncs = m_details.extensionFunctions;
+        extFuncs = {};
+        if (ExtensionEnabled(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME)) {
+            extFuncs.vkCreateDescriptorUpdateTemplateKHR = reinterpret_cast<PFN_vkCreateDescriptorUpdateTemplateKHR>(
+                        m_details.functions->vkGetDeviceProcAddr(device, "vkCreateDescriptorUpdateTemplateKHR"));
+            extFuncs.vkDestroyDescriptorUpdateTemplateKHR = reinterpret_cast<PFN_vkDestroyDescriptorUpdateTemplateKHR>(
+                        m_details.functions->vkGetDeviceProcAddr(device, "vkDestroyDescriptorUpdateTemplateKHR"));
+            extFuncs.vkUpdateDescriptorSetWithTemplateKHR = reinterpret_cast<PFN_vkUpdateDescriptorSetWithTemplateKHR>(
+                        m_details.functions->vkGetDeviceProcAddr(device, "vkUpdateDescriptorSetWithTemplateKHR"));
+        }
+        m_details.maxPushDescriptors = 0;
+        if (ExtensionEnabled(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME) && m_iFunctions.vkGetPhysicalDeviceProperties2KHR) {
+            extFuncs.vkCmdPushDescriptorSetKHR = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(m_details.functions->vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetKHR"));
+            VkPhysicalDevicePushDescriptorPropertiesKHR pushProperties = {};
+            pushProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR;
+            VkPhysicalDeviceProperties2KHR properties = {};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+            properties.pNext = &pushProperties;
+            m_iFunctions.vkGetPhysicalDeviceProperties2KHR(m_details.physicalDevice, &properties);
+            m_details.maxPushDescriptors = pushProperties.maxPushDescriptors;
+        }
+        m_details.maxBindlessImages = 0;
+        if (bindless) {
+            VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+            indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+            VkPhysicalDeviceProperties2KHR properties = {};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+            properties.pNext = &indexingProperties;
+            m_iFunctions.vkGetPhysicalDeviceProperties2KHR(m_details.physicalDevice, &properties);
+            // Combined image samplers count as both samplers and sampled images
+            m_details.maxBindlessImages = qMin(qMin(indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages),
+                                               qMin(indexingProperties.maxDescriptorSetUpdateAfterBindSamplers, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages));
+        }
 
         m_details.deviceFunctions->vkGetDeviceQueue(device, m_details.graphicsQueueIndex, 0, &m_details.graphicsQueue);
         if (m_details.graphicsQueueIndex == m_details.presentQueueIndex) m_details.presentQueue = m_details.graphicsQueue;
@@ -584,8 +676,10 @@ namespace vpa {
 
         uint32_t imageIdx;
         VPA_PASS_ERROR(AquireImage(imageIdx));
+        CollectRetired();
 
-        VkCommandBuffer cmdBuffer = m_details.mainCommandBuffers[imageIdx];
+        // Command buffers follow the in flight fences so the one being reset is known to have completed
+        VkCommandBuffer cmdBuffer = m_details.mainCommandBuffers[m_frameIndex];
 
         VkSemaphore signalSemaphores[] = { m_renderFinished[m_frameIndex] };
 
@@ -600,7 +694,7 @@ namespace vpa {
 
         VPA_VKCRITICAL_PASS(m_details.deviceFunctions->vkEndCommandBuffer(cmdBuffer), "End main command buffer");
 
-        VPA_PASS_ERROR(SubmitQueue(imageIdx, signalSemaphores));
+        VPA_PASS_ERROR(SubmitQueue(signalSemaphores));
         VPA_PASS_ERROR(PresentImage(imageIdx, signalSemaphores));
 
         return VPA_OK;
@@ -619,7 +713,7 @@ namespace vpa {
         return VPA_OK;
     }
 
-    VPAError VulkanMain::SubmitQueue(const uint32_t imageIdx, VkSemaphore signalSemaphores[]) {
+    VPAError VulkanMain::SubmitQueue(VkSemaphore signalSemaphores[]) {
         VkSubmitInfo submitInfo = {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -629,13 +723,14 @@ namespace vpa {
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &m_details.mainCommandBuffers[imageIdx];
+        submitInfo.pCommandBuffers = &m_details.mainCommandBuffers[m_frameIndex];
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
         m_details.deviceFunctions->vkResetFences(m_details.device, 1, &m_inFlight[m_frameIndex]);
 
         VPA_VKCRITICAL_PASS(m_details.deviceFunctions->vkQueueSubmit(m_details.graphicsQueue, 1, &submitInfo, m_inFlight[m_frameIndex]), "Graphics queue submit");
+        m_inFlightFrames[m_frameIndex] = ++m_submittedFrame;
 
         return VPA_OK;
     }
@@ -687,10 +782,75 @@ namespace vpa {
         return m_renderer ? m_renderer->GetDescriptors() : nullptr;
     }
 
+    MemoryAllocator* VulkanMain::Allocator() {
+        return m_renderer ? m_renderer->Allocator() : nullptr;
+    }
+
+    const AttachmentStatistics* VulkanMain::AttachmentStats() {
+        return m_renderer ? &m_renderer->AttachmentStats() : nullptr;
+    }
+
+    const PipelineStatistics* VulkanMain::PipelineStats() {
+        return m_renderer ? &m_renderer->PipelineStats() : nullptr;
+    }
+
+    const MeshStatistics* VulkanMain::MeshStats() {
+        return m_renderer ? m_renderer->MeshStats() : nullptr;
+    }
+
+    const SamplerStatistics* VulkanMain::SamplerStats() {
+        return m_renderer ? m_renderer->SamplerStats() : nullptr;
+    }
+
+    const TextureCacheStatistics* VulkanMain::TextureCacheStats() {
+        return m_renderer ? m_renderer->TextureCacheStats() : nullptr;
+    }
+
+    const DescriptorCacheStatistics* VulkanMain::DescriptorCacheStats() {
+        return m_renderer ? m_renderer->DescriptorCacheStats() : nullptr;
+    }
+
+    bool VulkanMain::ExtensionEnabled(const char* name) const {
+        for (const char* ext : m_deviceExtensions) {
+            if (!strcmp(ext, name)) return true;
+        }
+        return false;
+    }
+
+    bool VulkanMain::QueryMemoryBudget(VkPhysicalDeviceMemoryBudgetPropertiesEXT& budget) const {
+        if (!m_details.memoryBudgetSupported || m_details.physicalDevice == VK_NULL_HANDLE) return false;
+        memset(&budget, 0, sizeof(budget));
+        budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2KHR properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+        properties.pNext = &budget;
+        m_iFunctions.vkGetPhysicalDeviceMemoryProperties2KHR(m_details.physicalDevice, &properties);
+        return true;
+    }
+
     QStringList VulkanMain::AttachmentNames() const {
         return m_renderer ? m_renderer->AttachmentNames() : QStringList("INVALID");
     }
 
+    bool VulkanMain::VertexFormatSupported(VkFormat format) const {
+        VkFormatProperties properties;
+        m_details.functions->vkGetPhysicalDeviceFormatProperties(m_details.physicalDevice, format, &properties);
+        return (properties.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT) != 0;
+    }
+
+    bool VulkanMain::LinearBlitSupported(VkFormat format) const {
+        VkFormatProperties properties;
+        m_details.functions->vkGetPhysicalDeviceFormatProperties(m_details.physicalDevice, format, &properties);
+        const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        return (properties.optimalTilingFeatures & required) == required;
+    }
+
+    bool VulkanMain::SampledFormatSupported(VkFormat format) const {
+        VkFormatProperties properties;
+        m_details.functions->vkGetPhysicalDeviceFormatProperties(m_details.physicalDevice, format, &properties);
+        return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+    }
+
     const VkPhysicalDeviceLimits& VulkanMain::Limits() const {
         return m_details.physicalDeviceProperties.limits;
     }
@@ -712,4 +872,31 @@ namespace vpa {
     void VulkanMain::RequestUpdate() {
         m_details.window->requestUpdate();
     }
+
+    void VulkanMain::Retire(std::function<void(void)> deleter) {
+        m_deletionQueue.Push(m_submittedFrame, deleter);
+    }
+
+    void VulkanMain::CollectRetired() {
+        if (m_details.device == VK_NULL_HANDLE) return;
+        // Every frame older than those tracked by the in flight fences has already been waited on
+        uint64_t completed = m_submittedFrame;
+        for (uint32_t i = 0; i < MaxFramesInFlight; ++i) {
+            if (m_inFlightFrames[i] != 0 && m_details.deviceFunctions->vkGetFenceStatus(m_details.device, m_inFlight[i]) != VK_SUCCESS) {
+                completed = qMin(completed, m_inFlightFrames[i] - 1);
+            }
+        }
+        m_completedFrame = completed;
+        m_deletionQueue.Collect(m_completedFrame);
+    }
+
+    void VulkanMain::WaitForFramesInFlight() {
+        if (m_details.device == VK_NULL_HANDLE) return;
+        for (uint32_t i = 0; i < MaxFramesInFlight; ++i) {
+            if (m_inFlightFrames[i] != 0) {
+                m_details.deviceFunctions->vkWaitForFences(m_details.device, 1, &m_inFlight[i], VK_TRUE, std::numeric_limits<uint64_t>::max());
+            }
+        }
+        CollectRetired();
+    }
 }
@@ -2,9 +2,11 @@
 #define VULKANMAIN_H
 
 #include <QVulkanInstance>
+#include <QVulkanFunctions>
 #include <QWindow>
 
 #include "reloadflags.h"
+#include "deletionqueue.h"
 
 class QWidget;
 class QDockWidget;
@@ -16,6 +18,12 @@ namespace vpa {
     class Descriptors;
     class VulkanWindow;
     class VulkanMain;
+    struct AttachmentStatistics;
+    struct PipelineStatistics;
+    struct MeshStatistics;
+    struct SamplerStatistics;
+    struct TextureCacheStatistics;
+    struct DescriptorCacheStatistics;
 
     constexpr uint32_t MaxFrameImages = 3;
     constexpr uint32_t MaxFramesInFlight = 2;
@@ -35,6 +43,14 @@ namespace vpa {
         VkExtent2D extent;
     };
 
+    // Device entry points of optional extensions, null unless the extension is enabled
+    struct ExtensionFunctions {
+        PFN_vkCreateDescriptorUpdateTemplateKHR vkCreateDescriptorUpdateTemplateKHR = nullptr;
+        PFN_vkDestroyDescriptorUpdateTemplateKHR vkDestroyDescriptorUpdateTemplateKHR = nullptr;
+        PFN_vkUpdateDescriptorSetWithTemplateKHR vkUpdateDescriptorSetWithTemplateKHR = nullptr;
+        PFN_vkCmdPushDescriptorSetKHR vkCmdPushDescriptorSetKHR = nullptr;
+    };
+
     struct VulkanDetails {
         VulkanWindow* window = nullptr;
         VkSurfaceKHR surface = VK_NULL_HANDLE;
@@ -53,9 +69,15 @@ namespace vpa {
         VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
         VkPhysicalDeviceProperties physicalDeviceProperties;
         VkPhysicalDeviceFeatures physicalDeviceFeatures;
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        bool memoryBudgetSupported = false;
         QVulkanInstance instance;
         QVulkanFunctions* functions = nullptr;
         QVulkanDeviceFunctions* deviceFunctions = nullptr;
+        ExtensionFunctions extensionFunctions;
+        uint32_t maxPushDescriptors = 0; // 0 unless VK_KHR_push_descriptor is enabled
+        // Elements of a runtime sampled image array, 0 unless VK_EXT_descriptor_indexing is enabled with partially bound update after bind bindings
+        uint32_t maxBindlessImages = 0;
         SwapchainDetails swapchainDetails;
     };
 
@@ -67,6 +89,9 @@ namespace vpa {
         PFN_vkQueuePresentKHR vkQueuePresentKHR = nullptr;
         PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR vkGetPhysicalDeviceSurfaceCapabilitiesKHR = nullptr;
         PFN_vkGetPhysicalDeviceSurfaceSupportKHR vkGetPhysicalDeviceSurfaceSupportKHR = nullptr;
+        PFN_vkGetPhysicalDeviceMemoryProperties2KHR vkGetPhysicalDeviceMemoryProperties2KHR = nullptr;
+        PFN_vkGetPhysicalDeviceProperties2KHR vkGetPhysicalDeviceProperties2KHR = nullptr;
+        PFN_vkGetPhysicalDeviceFeatures2KHR vkGetPhysicalDeviceFeatures2KHR = nullptr;
     };
 
     class VulkanWindow : public QWindow {
@@ -105,13 +130,38 @@ namespace vpa {
 
         void SetActiveAttachment(uint32_t index);
         Descriptors* GetDescriptors();
+        MemoryAllocator* Allocator();
+        const AttachmentStatistics* AttachmentStats();
+        const PipelineStatistics* PipelineStats();
+        const MeshStatistics* MeshStats();
+        const SamplerStatistics* SamplerStats();
+        const TextureCacheStatistics* TextureCacheStats();
+        const DescriptorCacheStatistics* DescriptorCacheStats();
         QStringList AttachmentNames() const;
         const VkPhysicalDeviceLimits& Limits() const;
         const VulkanDetails& Details() const { return m_details; }
         VkDevice Device() const { return m_details.device; }
+        bool ExtensionEnabled(const char* name) const;
+        bool VertexFormatSupported(VkFormat format) const;
+        bool LinearBlitSupported(VkFormat format) const;
+        bool SampledFormatSupported(VkFormat format) const;
+        // Returns false if VK_EXT_memory_budget is not supported
+        bool QueryMemoryBudget(VkPhysicalDeviceMemoryBudgetPropertiesEXT& budget) const;
 
         VulkanState State() const { return m_currentState; }
 
+        // Defers the deleter until every frame submitted so far has completed
+        void Retire(std::function<void(void)> deleter);
+        template<typename T>
+        void RetireHandle(T& handle, void (QVulkanDeviceFunctions::*destroy)(VkDevice, T, const VkAllocationCallbacks*));
+        void CollectRetired();
+        // Blocks until the frames in flight complete, only for when a resource cannot be replaced without waiting
+        void WaitForFramesInFlight();
+        int PendingDeletions() const { return m_deletionQueue.Size(); }
+        uint64_t SubmittedFrame() const { return m_submittedFrame; }
+        uint64_t CompletedFrame() const { return m_completedFrame; }
+        uint32_t FrameIndex() const { return m_frameIndex; }
+
     private:
         void Destroy();
         void DestroySwapchain();
@@ -128,12 +178,13 @@ namespace vpa {
         void CalculateLayers(VkDeviceCreateInfo& createInfo);
 
         VPAError CreateSwapchain(SwapchainDetails& swapchain);
+        void RetireSwapchain(SwapchainDetails& swapchain);
         VkExtent2D CalculateExtent();
         VPAError CreateSync();
 
         VPAError ExecuteFrame();
         VPAError AquireImage(uint32_t& imageIdx);
-        VPAError SubmitQueue(const uint32_t imageIdx, VkSemaphore signalSemaphores[]);
+        VPAError SubmitQueue(VkSemaphore signalSemaphores[]);
         VPAError PresentImage(const uint32_t imageIdx, VkSemaphore signalSemaphores[]);
 
         VulkanRenderer* m_renderer;
@@ -151,10 +202,26 @@ namespace vpa {
         VkFence m_inFlight[MaxFramesInFlight];
         uint32_t m_frameIndex;
 
+        DeletionQueue m_deletionQueue;
+        uint64_t m_inFlightFrames[MaxFramesInFlight]; // Frame number last submitted with each in flight fence
+        uint64_t m_submittedFrame;
+        uint64_t m_completedFrame;
+
         VulkanState m_currentState;
 
         static const QVector<const char*> LayerNames;
+        static const QVector<const char*> OptionalDeviceExtensions;
     };
+
+    template<typename T>
+    inline void VulkanMain::RetireHandle(T& handle, void (QVulkanDeviceFunctions::*destroy)(VkDevice, T, const VkAllocationCallbacks*)) {
+        if (handle == VK_NULL_HANDLE) return;
+        T retired = handle;
+        VkDevice device = m_details.device;
+        QVulkanDeviceFunctions* funcs = m_details.deviceFunctions;
+        Retire([retired, device, funcs, destroy]() { (funcs->*destroy)(device, retired, nullptr); });
+        handle = VK_NULL_HANDLE;
+    }
 }
 
 #endif // VULKANMAIN_H
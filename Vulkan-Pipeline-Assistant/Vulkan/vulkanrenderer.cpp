@@ -14,14 +14,20 @@
 #include "configvalidator.h"
 
 namespace vpa {
+    // How long after the last change the preview is still treated as being interacted with
+    static constexpr qint64 InteractionMilliseconds = 250;
+
     VulkanRenderer::VulkanRenderer(VulkanMain* main, std::function<void(void)> creationCallback)
         : m_initialised(false), m_valid(false), m_main(main), m_deviceFuncs(nullptr), m_renderPass(VK_NULL_HANDLE), m_pipeline(VK_NULL_HANDLE),
-          m_pipelineLayout(VK_NULL_HANDLE), m_pipelineCache(VK_NULL_HANDLE), m_shaderAnalytics(nullptr), m_allocator(nullptr), m_vertexInput(nullptr),
-          m_descriptors(nullptr), m_validator(nullptr), m_creationCallback(creationCallback), m_activeAttachment(0), m_outputPipeline(VK_NULL_HANDLE),
-          m_outputPipelineLayout(VK_NULL_HANDLE), m_defaultRenderPass(VK_NULL_HANDLE) {
+          m_pipelineLayout(VK_NULL_HANDLE), m_pipelineCache(VK_NULL_HANDLE), m_shaderAnalytics(nullptr), m_allocator(nullptr), m_samplers(nullptr), m_textures(nullptr),
+          m_descriptorCache(nullptr), m_vertexInput(nullptr), m_descriptors(nullptr), m_validator(nullptr), m_creationCallback(creationCallback), m_activeAttachment(0), m_outputPipeline(VK_NULL_HANDLE),
+          m_outputPipelineLayout(VK_NULL_HANDLE), m_defaultRenderPass(VK_NULL_HANDLE), m_statisticsPool(VK_NULL_HANDLE), m_timestampPool(VK_NULL_HANDLE) {
         m_main->m_renderer = this;
         m_config = {};
         m_defaultDepthAttachment.view = VK_NULL_HANDLE;
+        // Owned by the renderer, so the timeout can't outlive it
+        m_idleRedrawTimer.setSingleShot(true);
+        QObject::connect(&m_idleRedrawTimer, &QTimer::timeout, [this]() { m_main->RequestUpdate(); });
     }
 
     VulkanRenderer::~VulkanRenderer() {
@@ -34,8 +40,12 @@ namespace vpa {
             VPAError err = VPA_OK;
             m_allocator = new MemoryAllocator(m_deviceFuncs, m_main, err);
             if (err != VPA_OK) VPA_FATAL("Device memory allocator fatal error. " + VPAError::lastMessage);
+            m_samplers = new SamplerCache(m_main, m_deviceFuncs);
+            m_textures = new TextureCache(m_main, m_deviceFuncs, m_allocator);
+            m_descriptorCache = new DescriptorCache(m_main, m_deviceFuncs);
             m_shaderAnalytics = new ShaderAnalytics(m_deviceFuncs, m_main->Device(), &m_config);
             m_validator = new ConfigValidator(m_config, m_main->Limits());
+            if (CreateStatisticsQueries() != VPA_OK) qDebug("Pipeline statistics unavailable: %s", qPrintable(VPAError::lastMessage));
             CreateDefaultObjects();
             m_main->Reload(ReloadFlags::EverythingNoValidation);
             m_initialised = true;
@@ -43,16 +53,27 @@ namespace vpa {
     }
 
     void VulkanRenderer::Release() {
+        m_idleRedrawTimer.stop();
         CleanUp();
+        if (m_deviceFuncs) DESTROY_HANDLE(m_main->Device(), m_statisticsPool, m_deviceFuncs->vkDestroyQueryPool);
+        if (m_deviceFuncs) DESTROY_HANDLE(m_main->Device(), m_timestampPool, m_deviceFuncs->vkDestroyQueryPool);
+        m_pipelineStats = {};
         if (m_shaderAnalytics) delete m_shaderAnalytics;
         if (m_vertexInput) delete m_vertexInput;
         if (m_descriptors) delete m_descriptors;
+        // After everything holding a reference to one of its samplers
+        if (m_samplers) delete m_samplers;
+        if (m_textures) delete m_textures;
+        if (m_descriptorCache) delete m_descriptorCache;
         if (m_config.viewports) delete[] m_config.viewports;
         if (m_allocator) delete m_allocator;
         if (m_validator) delete m_validator;
         m_shaderAnalytics = nullptr;
         m_vertexInput = nullptr;
         m_descriptors = nullptr;
+        m_samplers = nullptr;
+        m_textures = nullptr;
+        m_descriptorCache = nullptr;
         m_config.viewports = nullptr;
         m_allocator = nullptr;
         m_validator = nullptr;
@@ -62,13 +83,13 @@ namespace vpa {
 
     void VulkanRenderer::CleanUp() {
         DESTROY_HANDLE(m_main->Device(), m_outputPipeline, m_deviceFuncs->vkDestroyPipeline);
-        DESTROY_HANDLE(m_main->Device(), m_outputPipelineLayout, m_deviceFuncs->vkDestroyPipelineLayout);
-        for (VkSampler sampler : m_outputSamplers) {
-            DESTROY_HANDLE(m_main->Device(), sampler, m_deviceFuncs->vkDestroySampler);
+        if (m_descriptorCache) m_descriptorCache->ReleasePipelineLayout(m_outputPipelineLayout);
+        for (VkSampler& sampler : m_outputSamplers) {
+            if (m_samplers) m_samplers->Release(sampler);
         }
         m_outputSamplers.clear();
         DESTROY_HANDLE(m_main->Device(), m_pipeline, m_deviceFuncs->vkDestroyPipeline);
-        DESTROY_HANDLE(m_main->Device(), m_pipelineLayout, m_deviceFuncs->vkDestroyPipelineLayout);
+        if (m_descriptorCache) m_descriptorCache->ReleasePipelineLayout(m_pipelineLayout);
         DESTROY_HANDLE(m_main->Device(), m_pipelineCache, m_deviceFuncs->vkDestroyPipelineCache);
         DESTROY_HANDLE(m_main->Device(), m_renderPass, m_deviceFuncs->vkDestroyRenderPass);
         for (int i = 0; i < m_attachmentImages.size(); ++i) {
@@ -87,10 +108,44 @@ namespace vpa {
         for (int i = 0; i < m_defaultFramebuffers.size(); ++i) {
             DESTROY_HANDLE(m_main->Device(), m_defaultFramebuffers[i], m_deviceFuncs->vkDestroyFramebuffer);
         }
+        m_allocator->Deallocate(m_transientMemory);
     }
 
     VPAError VulkanRenderer::RenderFrame(VkCommandBuffer cmdBuffer, const uint32_t frameIdx) {
+        // Queries follow the frame in flight, whose fence has been waited on so its previous result is ready
+        uint32_t query = m_main->FrameIndex();
+        bool pending = !m_statisticsPending.isEmpty() && m_statisticsPending[int(query)];
+        if (m_statisticsPool != VK_NULL_HANDLE) {
+            uint64_t results[2];
+            if (pending && m_deviceFuncs->vkGetQueryPoolResults(m_main->Device(), m_statisticsPool, query, 1, sizeof(results), results,
+                    sizeof(results), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+                m_pipelineStats.inputAssemblyPrimitives = results[0];
+                m_pipelineStats.vertexShaderInvocations = results[1];
+            }
+            m_deviceFuncs->vkCmdResetQueryPool(cmdBuffer, m_statisticsPool, query, 1);
+        }
+        if (m_timestampPool != VK_NULL_HANDLE) {
+            uint64_t timestamps[2];
+            if (pending && m_deviceFuncs->vkGetQueryPoolResults(m_main->Device(), m_timestampPool, 2 * query, 2, sizeof(timestamps), timestamps,
+                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS && timestamps[1] >= timestamps[0] && m_queryLods[int(query)] == 0) {
+                // Smoothed as single draws of small meshes are noisy, reset whenever the vertex input changes
+                double milliseconds = double(timestamps[1] - timestamps[0]) * double(m_main->Limits().timestampPeriod) / 1e6;
+                m_pipelineStats.drawMilliseconds = m_pipelineStats.drawMilliseconds > 0.0 ? m_pipelineStats.drawMilliseconds * 0.9 + milliseconds * 0.1 : milliseconds;
+            }
+            m_deviceFuncs->vkCmdResetQueryPool(cmdBuffer, m_timestampPool, 2 * query, 2);
+        }
+        if (pending) m_statisticsPending[int(query)] = false;
+
+        // Frame boundary, so images loaded in the background can be swapped in and dynamic buffers written before the sets are bound
+        if (m_descriptors) {
+            m_descriptors->CompletePendingImages();
+            m_descriptors->WriteDynamicBuffers(query);
+        }
+
         if (m_valid) {
+            // Only the host side, which is where allocated and pushed descriptor sets differ
+            QElapsedTimer recordTimer;
+            recordTimer.start();
             QVector<VkClearValue> clearValues = QVector<VkClearValue>(int(m_shaderAnalytics->NumColourAttachments()) + 1);
             for (int i = 0; i < int(m_shaderAnalytics->NumColourAttachments()); ++i) {
                 clearValues[i].color = VkClearColorValue({{0.0f, 0.0f, 0.0f, 1.0f}});
@@ -111,13 +166,42 @@ namespace vpa {
             m_descriptors->CmdBindSets(cmdBuffer, m_pipelineLayout);
             m_vertexInput->BindBuffers(cmdBuffer);
             m_deviceFuncs->vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-            if (m_vertexInput->IsIndexed()) {
-                m_deviceFuncs->vkCmdDrawIndexed(cmdBuffer, m_vertexInput->IndexCount(), 1, 0, 0, 0);
+            m_pipelineStats.drawnLod = m_vertexInput->IsIndexed() ? DrawLevel() : 0;
+            if (!m_queryLods.isEmpty()) m_queryLods[int(query)] = m_pipelineStats.drawnLod;
+            if (m_statisticsPool != VK_NULL_HANDLE) m_deviceFuncs->vkCmdBeginQuery(cmdBuffer, m_statisticsPool, query, 0);
+            if (m_timestampPool != VK_NULL_HANDLE) m_deviceFuncs->vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, 2 * query);
+            // Sub meshes only cover the full mesh, a simplified level is always one draw
+            uint32_t level = m_pipelineStats.drawnLod;
+            bool indirect = m_config.preview.indirectDraw && m_vertexInput->IsIndexed() && level == 0 && m_vertexInput->SubMeshCount() > 0;
+            if (indirect != m_pipelineStats.indirectDraw) m_pipelineStats.drawMilliseconds = 0.0;
+            m_pipelineStats.indirectDraw = indirect;
+            m_pipelineStats.drawCalls = 1;
+            if (indirect) {
+                // Without multiDrawIndirect every command needs its own call, which is the per draw overhead being measured
+                uint32_t subMeshes = m_vertexInput->SubMeshCount();
+                uint32_t perCall = m_main->Details().physicalDeviceFeatures.multiDrawIndirect ? qMax(m_main->Limits().maxDrawIndirectCount, 1u) : 1;
+                m_pipelineStats.drawCalls = 0;
+                for (uint32_t first = 0; first < subMeshes; first += perCall) {
+                    m_deviceFuncs->vkCmdDrawIndexedIndirect(cmdBuffer, m_vertexInput->IndirectBuffer(), VkDeviceSize(first) * sizeof(VkDrawIndexedIndirectCommand),
+                                                            qMin(perCall, subMeshes - first), sizeof(VkDrawIndexedIndirectCommand));
+                    m_pipelineStats.drawCalls++;
+                }
+            }
+            else if (m_vertexInput->IsIndexed()) {
+                m_deviceFuncs->vkCmdDrawIndexed(cmdBuffer, m_vertexInput->LodIndexCount(level), m_vertexInput->InstanceCount(), m_vertexInput->LodFirstIndex(level), 0, 0);
             }
             else {
-                m_deviceFuncs->vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+                m_deviceFuncs->vkCmdDraw(cmdBuffer, 3, m_vertexInput->InstanceCount(), 0, 0);
             }
+            if (m_statisticsPool != VK_NULL_HANDLE) m_deviceFuncs->vkCmdEndQuery(cmdBuffer, m_statisticsPool, query);
+            if (m_timestampPool != VK_NULL_HANDLE) m_deviceFuncs->vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampPool, 2 * query + 1);
+            if (!m_statisticsPending.isEmpty()) m_statisticsPending[int(query)] = true;
             m_deviceFuncs->vkCmdEndRenderPass(cmdBuffer);
+
+            const double recordMicroseconds = double(recordTimer.nsecsElapsed()) / 1000.0;
+            if (m_descriptors->PushedSet() != m_pipelineStats.pushedSet) m_pipelineStats.recordMicroseconds = 0.0;
+            m_pipelineStats.pushedSet = m_descriptors->PushedSet();
+            m_pipelineStats.recordMicroseconds = m_pipelineStats.recordMicroseconds > 0.0 ? m_pipelineStats.recordMicroseconds * 0.9 + recordMicroseconds * 0.1 : recordMicroseconds;
         }
 
         VkClearValue outputClearValues[2];
@@ -160,11 +244,26 @@ namespace vpa {
 
     void VulkanRenderer::SetActiveAttachment(uint32_t index) {
         if (m_valid) {
+            bool changed = m_activeAttachment != index;
             m_activeAttachment = index;
-            m_main->RequestUpdate();
+            // Only the displayed attachment is stored, so a different one needs the render pass rebuilt
+            if (changed) m_main->Reload(ReloadFlags::RenderPass);
+            else m_main->RequestUpdate();
         }
     }
 
+    const MeshStatistics* VulkanRenderer::MeshStats() const {
+        return m_vertexInput ? &m_vertexInput->Statistics() : nullptr;
+    }
+
+    const AttachmentStatistics& VulkanRenderer::AttachmentStats() {
+        m_attachmentStats.committedBytes = m_transientMemory.memorySize;
+        if (m_attachmentStats.lazilyAllocated && m_transientMemory.memory != VK_NULL_HANDLE) {
+            m_deviceFuncs->vkGetDeviceMemoryCommitment(m_main->Device(), m_transientMemory.memory, &m_attachmentStats.committedBytes);
+        }
+        return m_attachmentStats;
+    }
+
     VPAError VulkanRenderer::WritePipelineCache() {
         size_t size;
         char* data = nullptr;
@@ -202,8 +301,10 @@ namespace vpa {
     }
 
     VPAError VulkanRenderer::Reload(const ReloadFlags flag) {
-        m_deviceFuncs->vkDeviceWaitIdle(m_main->Device());
-        if (!m_valid && (flag == ReloadFlags::RenderPass || flag == ReloadFlags::Pipeline)) return VPA_CRITICAL(""); // Silent critical so actual erro isn't hidden
+        // Replaced objects are retired rather than destroyed so frames in flight can finish with them
+        m_main->CollectRetired();
+        m_lastReload.restart();
+        if (!m_valid && (flag == ReloadFlags::RenderPass || flag == ReloadFlags::Pipeline || flag == ReloadFlags::Mesh)) return VPA_CRITICAL(""); // Silent critical so actual erro isn't hidden
         else m_valid = true;
 
         if (flag & ReloadFlagBits::Validation) VPA_PASS_ERROR(m_validator->Validate(m_config));
@@ -211,16 +312,18 @@ namespace vpa {
             m_activeAttachment = 0;
             VPAError err = CreateShaders();
             if (err != VPA_OK) {
-                if (m_descriptors) {
-                    delete m_descriptors;
-                    m_descriptors = nullptr;
-                }
+                RetireDescriptors();
                 m_valid = false;
             }
             m_creationCallback();
             if (err != VPA_OK) return err;
         }
-        if (flag & ReloadFlagBits::RenderPass) {
+        else if (flag & ReloadFlagBits::Mesh) {
+            // The attributes come from the untouched shaders but their formats and bindings may change, so the pipeline is rebuilt too
+            VPA_PASS_ERROR(CreateVertexInput());
+        }
+        // Attachments are dropped when the swapchain is recreated, in which case the render pass is rebuilt whatever the flag
+        if ((flag & ReloadFlagBits::RenderPass) || m_attachmentImages.isEmpty()) {
             VPA_PASS_ERROR(CreateRenderPass(m_renderPass, m_framebuffers, m_attachmentImages, int(m_shaderAnalytics->NumColourAttachments()), true));
             VPA_PASS_ERROR(MakeOutputPostPass());
         }
@@ -232,7 +335,7 @@ namespace vpa {
             layoutInfo.pushConstantRangeCount = uint32_t(m_descriptors->PushConstantRanges().size());
             layoutInfo.pPushConstantRanges = m_descriptors->PushConstantRanges().data();
 
-            auto bindingDescription = m_vertexInput->InputBindingDescription();
+            auto bindingDescriptions = m_vertexInput->InputBindingDescriptions();
             auto attribDescriptions = m_vertexInput->InputAttribDescription();
 
             QVector<VkPipelineColorBlendAttachmentState> colourBlendAttachments;
@@ -240,7 +343,7 @@ namespace vpa {
                 colourBlendAttachments.push_back(MakeColourBlendAttachmentState(m_config.writables.attachments));
             }
 
-            VPA_PASS_ERROR(CreatePipeline(m_config, bindingDescription, attribDescriptions, m_shaderStageInfos, colourBlendAttachments, layoutInfo, m_renderPass, m_pipelineLayout, m_pipeline, m_pipelineCache));
+            VPA_PASS_ERROR(CreatePipeline(m_config, bindingDescriptions, attribDescriptions, m_shaderStageInfos, colourBlendAttachments, layoutInfo, m_renderPass, m_pipelineLayout, m_pipeline, m_pipelineCache));
         }
         return VPA_OK;
     }
@@ -270,7 +373,7 @@ namespace vpa {
     }
 
     VkSubpassDependency VulkanRenderer::MakeSubpassDependency(uint32_t srcIdx, uint32_t dstIdx, VkPipelineStageFlags srcStage,
-        VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkDependencyFlags flags) {
         VkSubpassDependency dependency = {};
         dependency.srcSubpass = srcIdx;
         dependency.dstSubpass = dstIdx;
@@ -278,14 +381,12 @@ namespace vpa {
         dependency.srcAccessMask = srcAccess;
         dependency.dstStageMask = dstStage;
         dependency.dstAccessMask = dstAccess;
-        dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        dependency.dependencyFlags = flags;
         return dependency;
     }
 
-     VPAError VulkanRenderer::MakeAttachmentImage(AttachmentImage& image, uint32_t height, uint32_t width, VkFormat format, VkImageUsageFlags usage, QString name, bool present) {
-        image.isPresenting = present;
-
-        VkImageCreateInfo createInfo = {
+    VkImageCreateInfo VulkanRenderer::MakeAttachmentImageCI(uint32_t height, uint32_t width, VkFormat format, VkImageUsageFlags usage) const {
+        return {
             VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
             nullptr, 0,
             VK_IMAGE_TYPE_2D, format,
@@ -296,27 +397,19 @@ namespace vpa {
             0, nullptr,
             VK_IMAGE_LAYOUT_UNDEFINED
         };
+    }
+
+    VPAError VulkanRenderer::MakeAttachmentImage(AttachmentImage& image, uint32_t height, uint32_t width, VkFormat format, VkImageUsageFlags usage, QString name, bool present) {
+        image.isPresenting = present;
+        image.isTransient = false;
+        image.format = format;
+        image.usage = usage;
 
-        size_t size = width * height * 4;
-        VPA_PASS_ERROR(m_allocator->Allocate(size, createInfo, name, image.allocation));
+        VPA_PASS_ERROR(m_allocator->Allocate(0, MakeAttachmentImageCI(height, width, format, usage), name, image.allocation));
 
         if (!present) {
-            VkImageViewCreateInfo viewInfo = {};
-            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            viewInfo.image = image.allocation.image;
-            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            viewInfo.format = createInfo.format;
-            viewInfo.subresourceRange.aspectMask = usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
-            viewInfo.subresourceRange.baseMipLevel = 0;
-            viewInfo.subresourceRange.levelCount = createInfo.mipLevels;
-            viewInfo.subresourceRange.baseArrayLayer = 0;
-            viewInfo.subresourceRange.layerCount = createInfo.arrayLayers;
-
-            VPAError err = VPA_OK;
-            VPA_VKCRITICAL(m_deviceFuncs->vkCreateImageView(m_main->Device(), &viewInfo, nullptr, &image.view),
-                             qPrintable("create attachment image view for allocation '" + name + "'"), err);
+            VPAError err = MakeAttachmentView(image, name);
             if (err != VPA_OK) {
-                DESTROY_HANDLE(m_main->Device(), image.view, m_deviceFuncs->vkDestroyImageView);
                 m_allocator->Deallocate(image.allocation);
                 return err;
             }
@@ -328,9 +421,63 @@ namespace vpa {
         return VPA_OK;
     }
 
+    VPAError VulkanRenderer::MakeAttachmentView(AttachmentImage& image, QString name) {
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image.allocation.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = image.format;
+        viewInfo.subresourceRange.aspectMask = image.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VPAError err = VPA_OK;
+        VPA_VKCRITICAL(m_deviceFuncs->vkCreateImageView(m_main->Device(), &viewInfo, nullptr, &image.view),
+                         qPrintable("create attachment image view for allocation '" + name + "'"), err);
+        if (err != VPA_OK) {
+            DESTROY_HANDLE(m_main->Device(), image.view, m_deviceFuncs->vkDestroyImageView);
+        }
+        return err;
+    }
+
+    VPAError VulkanRenderer::MakeTransientAttachments() {
+        // Every image bound to the old block is replaced along with it
+        RetireAttachmentImage(m_defaultDepthAttachment);
+        RetireAllocation(m_transientMemory);
+
+        uint32_t width = m_main->Details().swapchainDetails.extent.width;
+        uint32_t height = m_main->Details().swapchainDetails.extent.height;
+        m_defaultDepthAttachment.isTransient = true;
+        m_defaultDepthAttachment.format = m_main->Details().swapchainDetails.depthFormat;
+        m_defaultDepthAttachment.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        m_defaultDepthAttachment.allocation.name = "Default depth stencil attachment";
+
+        // The user pass and output pass never run at the same time so their attachments are in separate alias groups
+        QVector<AliasedImageInfo> images;
+        for (AttachmentImage& image : m_attachmentImages) {
+            if (image.isTransient) images.push_back({ MakeAttachmentImageCI(height, width, image.format, image.usage), image.allocation.name, 0, &image.allocation });
+        }
+        images.push_back({ MakeAttachmentImageCI(height, width, m_defaultDepthAttachment.format, m_defaultDepthAttachment.usage),
+                           m_defaultDepthAttachment.allocation.name, 1, &m_defaultDepthAttachment.allocation });
+
+        VPA_PASS_ERROR(m_allocator->AllocateAliased(images, "transient attachment memory", m_transientMemory, m_attachmentStats.transientBytes));
+        m_attachmentStats.aliasedBytes = m_transientMemory.memorySize;
+        m_attachmentStats.lazilyAllocated = (m_main->Details().memoryProperties.memoryTypes[m_transientMemory.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+
+        for (AttachmentImage& image : m_attachmentImages) {
+            if (image.isTransient) VPA_PASS_ERROR(MakeAttachmentView(image, image.allocation.name));
+        }
+        VPA_PASS_ERROR(MakeAttachmentView(m_defaultDepthAttachment, m_defaultDepthAttachment.allocation.name));
+
+        QVector<VkImageView> attachmentImageViews = { VK_NULL_HANDLE, m_defaultDepthAttachment.view };
+        return MakeFrameBuffers(m_defaultRenderPass, m_defaultFramebuffers, attachmentImageViews, width, height);
+    }
+
     VPAError VulkanRenderer::MakeFrameBuffers(VkRenderPass& renderPass, QVector<VkFramebuffer>& framebuffers, QVector<VkImageView>& imageViews, uint32_t width, uint32_t height) {
         for (int i = 0; i < framebuffers.size(); ++i) {
-            DESTROY_HANDLE(m_main->Device(), framebuffers[i], m_deviceFuncs->vkDestroyFramebuffer);
+            m_main->RetireHandle(framebuffers[i], &QVulkanDeviceFunctions::vkDestroyFramebuffer);
         }
 
         int presentIdx = -1;
@@ -360,12 +507,9 @@ namespace vpa {
     }
 
     VPAError VulkanRenderer::CreateRenderPass(VkRenderPass& renderPass, QVector<VkFramebuffer>& framebuffers, QVector<AttachmentImage>& attachmentImages, int colourAttachmentCount, bool hasDepth) {
-        DESTROY_HANDLE(m_main->Device(), renderPass, m_deviceFuncs->vkDestroyRenderPass);
+        m_main->RetireHandle(renderPass, &QVulkanDeviceFunctions::vkDestroyRenderPass);
         for (int i = 0; i < attachmentImages.size(); ++i) {
-            if (!attachmentImages[i].isPresenting) {
-                DESTROY_HANDLE(m_main->Device(), attachmentImages[i].view, m_deviceFuncs->vkDestroyImageView);
-            }
-            m_allocator->Deallocate(attachmentImages[i].allocation);
+            RetireAttachmentImage(attachmentImages[i]);
         }
         attachmentImages.clear();
 
@@ -378,42 +522,66 @@ namespace vpa {
         VkAttachmentReference depthAttachmentRef = {};
         QVector<VkImageView> attachmentImageViews = QVector<VkImageView>(int(colourAttachmentCount) + (hasDepth ? 1 : 0));
 
+        // Only the displayed attachment is stored and sampled by the output pass, the rest are transient and never leave the render pass
+        if (m_activeAttachment >= uint32_t(attachmentImageViews.size())) m_activeAttachment = 0;
         attachmentImages.resize(attachmentImageViews.size());
+        auto makeImage = [&](int index, VkFormat format, VkImageUsageFlags usage, QString name) -> VPAError {
+            if (uint32_t(index) == m_activeAttachment) return MakeAttachmentImage(attachmentImages[index], height, width, format, usage | VK_IMAGE_USAGE_SAMPLED_BIT, name, false);
+            attachmentImages[index].isTransient = true;
+            attachmentImages[index].format = format;
+            attachmentImages[index].usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            attachmentImages[index].allocation.name = name;
+            return VPA_OK;
+        };
+
         for (int i = 0; i < colourAttachmentCount; ++i) {
+            bool displayed = uint32_t(i) == m_activeAttachment;
             VkFormat colourFormat = m_main->Details().swapchainDetails.surfaceFormat.format;
-            attachments.push_back(MakeAttachment(colourFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
-                VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+            attachments.push_back(MakeAttachment(colourFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, displayed ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED,
+                displayed ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
 
             VkAttachmentReference positionsRef = {};
             positionsRef.attachment = uint32_t(i);
             positionsRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
             colourAttachmentRefs[i] = positionsRef;
 
-            VPA_PASS_ERROR(MakeAttachmentImage(attachmentImages[i], height, width,
-                    colourFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, "colour attachment " + QString::number(i), false));
-            attachmentImageViews[i] = attachmentImages[i].view;
+            VPA_PASS_ERROR(makeImage(i, colourFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, "colour attachment " + QString::number(i)));
         }
 
         if (hasDepth) {
             int index = attachmentImages.size() - 1;
+            bool displayed = uint32_t(index) == m_activeAttachment;
             VkFormat depthFormat = m_main->Details().swapchainDetails.depthFormat;
-            attachments.push_back(MakeAttachment(depthFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+            attachments.push_back(MakeAttachment(depthFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, displayed ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED,
+                displayed ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL));
 
             depthAttachmentRef.attachment = uint32_t(colourAttachmentCount);
             depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-            VPA_PASS_ERROR(MakeAttachmentImage(attachmentImages[index], height, width, depthFormat,
-                    VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, "depth attachment", false));
-            attachmentImageViews[index] = attachmentImages[index].view;
+            VPA_PASS_ERROR(makeImage(index, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, "depth attachment"));
+        }
+
+        VPA_PASS_ERROR(MakeTransientAttachments());
+        m_attachmentStats.sampledBytes = 0;
+        for (int i = 0; i < attachmentImages.size(); ++i) {
+            attachmentImageViews[i] = attachmentImages[i].view;
+            if (!attachmentImages[i].isTransient) m_attachmentStats.sampledBytes += attachmentImages[i].allocation.memorySize;
         }
 
         subpasses.push_back(MakeSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, colourAttachmentRefs, &depthAttachmentRef, nullptr));
 
-        dependencies.push_back(MakeSubpassDependency(VK_SUBPASS_EXTERNAL, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT));
-        dependencies.push_back(MakeSubpassDependency(0, VK_SUBPASS_EXTERNAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT));
+        // Transient attachments share memory with the output pass depth attachment, so depth writes are ordered between the passes as well.
+        // Aliased images do not line up pixel for pixel so these cannot be by region.
+        dependencies.push_back(MakeSubpassDependency(VK_SUBPASS_EXTERNAL, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, 0));
+        dependencies.push_back(MakeSubpassDependency(0, VK_SUBPASS_EXTERNAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, 0));
 
         VkRenderPassCreateInfo renderPassInfo = {};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -431,14 +599,15 @@ namespace vpa {
         return VPA_OK;
     }
 
-    VPAError VulkanRenderer::CreatePipeline(const PipelineConfig& config, const VkVertexInputBindingDescription& bindingDescription,
+    VPAError VulkanRenderer::CreatePipeline(const PipelineConfig& config, const QVector<VkVertexInputBindingDescription>& bindingDescriptions,
             const QVector<VkVertexInputAttributeDescription>& attribDescriptions, QVector<VkPipelineShaderStageCreateInfo>& shaderStageInfos,
             QVector<VkPipelineColorBlendAttachmentState> colourBlendAttachments, VkPipelineLayoutCreateInfo& layoutInfo,
             VkRenderPass& renderPass, VkPipelineLayout& layout, VkPipeline& pipeline, VkPipelineCache& cache) {
-        DESTROY_HANDLE(m_main->Device(), pipeline, m_deviceFuncs->vkDestroyPipeline);
-        DESTROY_HANDLE(m_main->Device(), layout, m_deviceFuncs->vkDestroyPipelineLayout);
+        m_main->RetireHandle(pipeline, &QVulkanDeviceFunctions::vkDestroyPipeline);
+        // Released before acquiring so an unchanged interface gets the same layout back, unused layouts are retired by the cache
+        m_descriptorCache->ReleasePipelineLayout(layout);
 
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo = MakeVertexInputStateCI(bindingDescription, attribDescriptions);
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = MakeVertexInputStateCI(bindingDescriptions, attribDescriptions);
         VkPipelineInputAssemblyStateCreateInfo inputAssembly = MakeInputAssemblyStateCI(config);
         QVector<VkViewport> viewports = { MakeViewport() };
 
@@ -455,7 +624,7 @@ namespace vpa {
 
         VkPipelineColorBlendStateCreateInfo colourBlending = MakeColourBlendStateCI(config, colourBlendAttachments);
 
-        VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreatePipelineLayout(m_main->Device(), &layoutInfo, nullptr, &layout), "Failed to create pipeline layout");
+        VPA_PASS_ERROR(m_descriptorCache->AcquirePipelineLayout(layoutInfo, layout));
 
         VkGraphicsPipelineCreateInfo pipelineInfo = MakeGraphicsPipelineCI(config, shaderStageInfos, vertexInputInfo, inputAssembly, viewportState, rasterizer, multisampling, depthStencil, colourBlending, layout, renderPass);
 
@@ -471,6 +640,33 @@ namespace vpa {
         return VPA_OK;
     }
 
+    VPAError VulkanRenderer::CreateStatisticsQueries() {
+        m_statisticsPending = QVector<bool>(int(MaxFramesInFlight), false);
+        m_queryLods = QVector<uint32_t>(int(MaxFramesInFlight), 0);
+        // A pair of timestamps around the user draw for each frame in flight
+        if (m_main->Limits().timestampComputeAndGraphics) {
+            VkQueryPoolCreateInfo timestampInfo = {};
+            timestampInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            timestampInfo.queryCount = 2 * MaxFramesInFlight;
+            VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreateQueryPool(m_main->Device(), &timestampInfo, nullptr, &m_timestampPool), "create timestamp query pool");
+            m_pipelineStats.timestampsSupported = true;
+        }
+
+        if (!m_main->Details().physicalDeviceFeatures.pipelineStatisticsQuery) return VPA_WARN("pipelineStatisticsQuery is not supported by the device");
+
+        // Results are written in bit order, input assembly primitives then vertex shader invocations
+        VkQueryPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        poolInfo.queryCount = MaxFramesInFlight;
+        poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT;
+
+        VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreateQueryPool(m_main->Device(), &poolInfo, nullptr, &m_statisticsPool), "create pipeline statistics query pool");
+        m_pipelineStats.supported = true;
+        return VPA_OK;
+    }
+
     VPAError VulkanRenderer::CreateShaders() {
         m_shaderStageInfos.clear();
         VPA_PASS_ERROR(m_shaderAnalytics->LoadShaders(m_config.vertShader, m_config.fragShader));//, "/../shaders/tesc_test.spv", "/../shaders/tese_test.spv", "/../shaders/gs_test.spv");
@@ -481,27 +677,76 @@ namespace vpa {
         if (m_shaderAnalytics->GetStageCreateInfo(ShaderStage::TessellationEvaluation, shaderCreateInfo)) m_shaderStageInfos.push_back(shaderCreateInfo);
         if (m_shaderAnalytics->GetStageCreateInfo(ShaderStage::Geometry, shaderCreateInfo)) m_shaderStageInfos.push_back(shaderCreateInfo);
 
-        if (m_vertexInput) delete m_vertexInput;
+        VPA_PASS_ERROR(CreateVertexInput());
+
+        RetireDescriptors();
         VPAError err = VPA_OK;
-        m_vertexInput = new VertexInput(m_deviceFuncs, m_allocator, m_shaderAnalytics->InputAttributes(), MESHDIR"Teapot", true, err);
+        m_descriptors = new Descriptors(m_main, m_deviceFuncs, m_allocator, m_samplers, m_textures, m_descriptorCache,
+                                        uint32_t(m_shaderAnalytics->NumColourAttachments()) + 1,
+                                        m_shaderAnalytics->DescriptorLayoutMap(), m_shaderAnalytics->PushConstantRanges(), m_main->Limits(), m_config.preview.textures,
+                                        m_config.preview.descriptors, err);
         if (err != VPA_OK) {
-            delete m_vertexInput;
-            m_vertexInput = nullptr;
+            delete m_descriptors;
+            m_descriptors = nullptr;
             return err;
         }
+        return VPA_OK;
+    }
 
-        if (m_descriptors) delete m_descriptors;
-        m_descriptors = new Descriptors(m_main, m_deviceFuncs, m_allocator, uint32_t(m_shaderAnalytics->NumColourAttachments()) + 1,
-                                        m_shaderAnalytics->DescriptorLayoutMap(), m_shaderAnalytics->PushConstantRanges(), m_main->Limits(), err);
+    VPAError VulkanRenderer::CreateVertexInput() {
+        if (m_vertexInput) {
+            VertexInput* retired = m_vertexInput;
+            m_main->Retire([retired]() { delete retired; });
+            m_vertexInput = nullptr;
+        }
+        // Formats the device can't fetch from fall back to 32 bit floats
+        PreviewConfig preview = m_config.preview;
+        VertexFormatConfig& formats = preview.vertexFormats;
+        if (!m_main->VertexFormatSupported(VertexInput::AttributeFormat(VertexAttribute::Position, formats))) formats.position = VertexPositionFormat::Float32;
+        if (!m_main->VertexFormatSupported(VertexInput::AttributeFormat(VertexAttribute::Normal, formats))) formats.normal = VertexNormalFormat::Float32;
+        if (!m_main->VertexFormatSupported(VertexInput::AttributeFormat(VertexAttribute::TexCoord, formats))) formats.texCoord = VertexTexCoordFormat::Float32;
+        if (!m_main->VertexFormatSupported(VertexInput::AttributeFormat(VertexAttribute::RgbaColour, formats))) formats.colour = VertexColourFormat::Float32;
+        // Leaves room for the per instance binding
+        if (preview.streamLayout == VertexStreamLayout::PerAttribute && uint32_t(m_shaderAnalytics->InputAttributes().size()) + 1 > m_main->Limits().maxVertexInputBindings) {
+            preview.streamLayout = VertexStreamLayout::PositionSplit;
+        }
+
+        m_pipelineStats.drawMilliseconds = 0.0;
+        VPAError err = VPA_OK;
+        m_vertexInput = new VertexInput(m_deviceFuncs, m_allocator, m_shaderAnalytics->InputAttributes(), preview.mesh, true, preview, err);
         if (err != VPA_OK) {
-            delete m_descriptors;
-            m_descriptors = nullptr;
+            delete m_vertexInput;
+            m_vertexInput = nullptr;
             return err;
         }
         return VPA_OK;
     }
 
+    uint32_t VulkanRenderer::DrawLevel() {
+        const PreviewConfig& preview = m_config.preview;
+        if (!preview.interactiveLod || m_vertexInput->LodCount() < 2 || !m_lastReload.isValid() || m_lastReload.elapsed() >= InteractionMilliseconds) return 0;
+
+        // The finest level within the budget, or the coarsest there is
+        uint32_t level = 0;
+        while (level + 1 < m_vertexInput->LodCount() && uint64_t(m_vertexInput->LodIndexCount(level) / 3) * m_vertexInput->InstanceCount() > preview.lodTriangleBudget) {
+            ++level;
+        }
+        // Frames are only drawn on request, so one is asked for once the settings have been left alone to bring the full mesh back
+        if (level > 0 && !m_idleRedrawTimer.isActive()) {
+            m_idleRedrawTimer.start(int(InteractionMilliseconds - m_lastReload.elapsed()) + 1);
+        }
+        return level;
+    }
+
     VPAError VulkanRenderer::CreateDefaultObjects() {
+        m_main->RetireHandle(m_defaultRenderPass, &QVulkanDeviceFunctions::vkDestroyRenderPass);
+        // User attachments are sized for the old swapchain and share its transient memory, they are rebuilt by the render pass reload that follows
+        for (int i = 0; i < m_attachmentImages.size(); ++i) {
+            RetireAttachmentImage(m_attachmentImages[i]);
+        }
+        m_attachmentImages.clear();
+        m_attachmentStats.sampledBytes = 0;
+
         uint32_t width = m_main->Details().swapchainDetails.extent.width;
         uint32_t height = m_main->Details().swapchainDetails.extent.height;
         QVector<VkAttachmentDescription> attachments(2);
@@ -509,13 +754,10 @@ namespace vpa {
         QVector<VkSubpassDependency> dependencies(2);
         QVector<VkAttachmentReference> colourAttachmentRefs(1);
         VkAttachmentReference depthAttachmentRef = {};
-        QVector<VkImageView> attachmentImageViews(2);
-        VPA_PASS_ERROR(MakeAttachmentImage(m_defaultDepthAttachment, height, width, m_main->Details().swapchainDetails.depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, "Default depth stencil attachment", false));
-        attachmentImageViews[1] = m_defaultDepthAttachment.view;
 
         attachments[0] = MakeAttachment(m_main->Details().swapchainDetails.surfaceFormat.format, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
             VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-        attachments[1] = MakeAttachment(m_main->Details().swapchainDetails.depthFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
+        attachments[1] = MakeAttachment(m_main->Details().swapchainDetails.depthFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE,
             VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 
         VkAttachmentReference colourRef = {};
@@ -544,9 +786,7 @@ namespace vpa {
 
         VPA_VKCRITICAL_PASS(m_deviceFuncs->vkCreateRenderPass(m_main->Device(), &renderPassInfo, nullptr, &m_defaultRenderPass), "Failed to create render pass");
 
-        VPA_PASS_ERROR(MakeFrameBuffers(m_defaultRenderPass, m_defaultFramebuffers, attachmentImageViews, width, height));
-
-        return VPA_OK;
+        return MakeTransientAttachments();
     }
 
     VPAError VulkanRenderer::MakeOutputPostPass() {
@@ -609,33 +849,23 @@ namespace vpa {
             return err;
         }
 
-        for (VkSampler sampler : m_outputSamplers) {
-            DESTROY_HANDLE(m_main->Device(), sampler, m_deviceFuncs->vkDestroySampler);
+        // The cache keeps released samplers, so acquiring the same state again below reuses them
+        for (VkSampler& sampler : m_outputSamplers) {
+            m_samplers->Release(sampler);
+        }
+
+        // Transient attachments cannot be sampled, their slots point at the displayed attachment which is the only one the shader reads
+        VkImageView displayedView = VK_NULL_HANDLE;
+        for (const AttachmentImage& image : m_attachmentImages) {
+            if (!image.isTransient) displayedView = image.view;
         }
 
         m_outputSamplers.clear();
         m_outputSamplers.resize(m_attachmentImages.size());
         QVector<VkDescriptorImageInfo> imageInfos = QVector<VkDescriptorImageInfo>(m_outputSamplers.size());
+        const VkSamplerCreateInfo samplerInfo = SamplerCache::MakeCreateInfo(SamplerState(), 0.0f, 1.0f);
         for (int i = 0; i < m_attachmentImages.size(); ++i) {
-            VkSamplerCreateInfo samplerInfo = {};
-            samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-            samplerInfo.magFilter = VK_FILTER_LINEAR;
-            samplerInfo.minFilter = VK_FILTER_LINEAR;
-            samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-            samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-            samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-            samplerInfo.anisotropyEnable = VK_FALSE;
-            samplerInfo.maxAnisotropy = 0.0f;
-            samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-            samplerInfo.unnormalizedCoordinates = VK_FALSE;
-            samplerInfo.compareEnable = VK_FALSE;
-            samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-            samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-            samplerInfo.mipLodBias = 0.0f;
-            samplerInfo.minLod = 0.0f;
-            samplerInfo.maxLod = 1.0f;
-
-            VPA_VKCRITICAL(m_deviceFuncs->vkCreateSampler(m_main->Device(), &samplerInfo, nullptr, &m_outputSamplers[i]), "create sampler for output post pass", err);
+            err = m_samplers->Acquire(samplerInfo, m_outputSamplers[i]);
             if (err != VPA_OK) {
                 DESTROY_HANDLE(m_main->Device(), vertModule, m_deviceFuncs->vkDestroyShaderModule);
                 DESTROY_HANDLE(m_main->Device(), fragModule, m_deviceFuncs->vkDestroyShaderModule);
@@ -644,7 +874,7 @@ namespace vpa {
 
             VkDescriptorImageInfo imageInfo = {};
             imageInfo = {};
-            imageInfo.imageView = m_attachmentImages[i].view;
+            imageInfo.imageView = m_attachmentImages[i].isTransient ? displayedView : m_attachmentImages[i].view;
             imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
             imageInfo.sampler = m_outputSamplers[i];
 
@@ -653,6 +883,13 @@ namespace vpa {
 
         VkWriteDescriptorSet writeSet = {};
         writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        // The current output set may still be bound by a frame in flight so it is replaced rather than updated
+        err = m_descriptors->RenewBuiltInSet(BuiltInSets::OutputPostPass);
+        if (err != VPA_OK) {
+            DESTROY_HANDLE(m_main->Device(), vertModule, m_deviceFuncs->vkDestroyShaderModule);
+            DESTROY_HANDLE(m_main->Device(), fragModule, m_deviceFuncs->vkDestroyShaderModule);
+            return err;
+        }
         writeSet.dstSet = m_descriptors->BuiltInSet(BuiltInSets::OutputPostPass);
         writeSet.dstBinding = 0;
         writeSet.dstArrayElement = 0;
@@ -667,13 +904,37 @@ namespace vpa {
         return VPA_OK;
     }
 
-    VkPipelineVertexInputStateCreateInfo VulkanRenderer::MakeVertexInputStateCI(const VkVertexInputBindingDescription& bindingDescription,
+    void VulkanRenderer::RetireAttachmentImage(AttachmentImage& image) {
+        if (!image.isPresenting) m_main->RetireHandle(image.view, &QVulkanDeviceFunctions::vkDestroyImageView);
+        RetireAllocation(image.allocation);
+    }
+
+    void VulkanRenderer::RetireAllocation(Allocation& allocation) {
+        if (allocation.memory != VK_NULL_HANDLE || allocation.image != VK_NULL_HANDLE) {
+            MemoryAllocator* allocator = m_allocator;
+            Allocation retired = allocation;
+            m_main->Retire([allocator, retired]() mutable { allocator->Deallocate(retired); });
+            allocation.memory = VK_NULL_HANDLE;
+            allocation.image = VK_NULL_HANDLE;
+            allocation.size = 0;
+            allocation.memorySize = 0;
+        }
+    }
+
+    void VulkanRenderer::RetireDescriptors() {
+        if (!m_descriptors) return;
+        Descriptors* retired = m_descriptors;
+        m_main->Retire([retired]() { delete retired; });
+        m_descriptors = nullptr;
+    }
+
+    VkPipelineVertexInputStateCreateInfo VulkanRenderer::MakeVertexInputStateCI(const QVector<VkVertexInputBindingDescription>& bindingDescriptions,
             const QVector<VkVertexInputAttributeDescription>& attribDescriptions) const {
         VkPipelineVertexInputStateCreateInfo vertexInput = {};
         vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInput.vertexBindingDescriptionCount = 1;
+        vertexInput.vertexBindingDescriptionCount = uint32_t(bindingDescriptions.size());
         vertexInput.vertexAttributeDescriptionCount = uint32_t(attribDescriptions.size());
-        vertexInput.pVertexBindingDescriptions = &bindingDescription;
+        vertexInput.pVertexBindingDescriptions = bindingDescriptions.data();
         vertexInput.pVertexAttributeDescriptions = attribDescriptions.data();
         return vertexInput;
     }
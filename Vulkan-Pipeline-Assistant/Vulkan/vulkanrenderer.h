@@ -2,9 +2,14 @@
 #define VULKANRENDERER_H
 
 #include <QVulkanWindowRenderer>
+#include <QElapsedTimer>
+#include <QTimer>
 
 #include "pipelineconfig.h"
 #include "memoryallocator.h"
+#include "samplercache.h"
+#include "texturecache.h"
+#include "descriptorcache.h"
 #include "reloadflags.h"
 
 namespace vpa {
@@ -12,13 +17,40 @@ namespace vpa {
     class VulkanMain;
     class ShaderAnalytics;
     class VertexInput;
+    struct MeshStatistics;
     class Descriptors;
     class ConfigValidator;
 
     struct AttachmentImage {
-        VkImageView view;
+        VkImageView view = VK_NULL_HANDLE;
         Allocation allocation;
-        bool isPresenting;
+        bool isPresenting = false;
+        // Transient attachments are never sampled and live in memory shared with attachments of the other pass
+        bool isTransient = false;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkImageUsageFlags usage = 0;
+    };
+
+    struct AttachmentStatistics {
+        VkDeviceSize sampledBytes = 0;
+        VkDeviceSize transientBytes = 0; // Memory the transient attachments would need without aliasing
+        VkDeviceSize aliasedBytes = 0;
+        VkDeviceSize committedBytes = 0; // Less than aliasedBytes only when lazily allocated memory is in use
+        bool lazilyAllocated = false;
+    };
+
+    // Counters for the user draw from the most recently completed frame
+    struct PipelineStatistics {
+        bool supported = false;
+        uint64_t inputAssemblyPrimitives = 0;
+        uint64_t vertexShaderInvocations = 0;
+        bool timestampsSupported = false;
+        double drawMilliseconds = 0.0; // GPU time of the user draw, only measured while the full mesh is drawn
+        uint32_t drawnLod = 0;
+        bool indirectDraw = false; // The full mesh was drawn as its sub meshes
+        uint32_t drawCalls = 0;
+        double recordMicroseconds = 0.0; // CPU time recording the user pass, smoothed and reset whenever the pushed set changes
+        int pushedSet = -1; // Set written with vkCmdPushDescriptorSetKHR, -1 when every set was bound
     };
 
     class VulkanRenderer {
@@ -35,8 +67,15 @@ namespace vpa {
         void SetValid(bool valid) { m_valid = valid; }
         PipelineConfig& GetConfig() { return m_config; }
         Descriptors* GetDescriptors() { return m_descriptors; }
+        MemoryAllocator* Allocator() { return m_allocator; }
+        const SamplerStatistics* SamplerStats() const { return m_samplers ? &m_samplers->Statistics() : nullptr; }
+        const TextureCacheStatistics* TextureCacheStats() const { return m_textures ? &m_textures->Statistics() : nullptr; }
+        const DescriptorCacheStatistics* DescriptorCacheStats() const { return m_descriptorCache ? &m_descriptorCache->Statistics() : nullptr; }
         QStringList AttachmentNames() const;
         void SetActiveAttachment(uint32_t index);
+        const AttachmentStatistics& AttachmentStats();
+        const PipelineStatistics& PipelineStats() const { return m_pipelineStats; }
+        const MeshStatistics* MeshStats() const;
 
         VPAError WritePipelineCache();
 
@@ -50,12 +89,15 @@ namespace vpa {
 
     private:
         VPAError CreateRenderPass(VkRenderPass& renderPass, QVector<VkFramebuffer>& framebuffers, QVector<AttachmentImage>& attachmentImages, int colourAttachmentCount, bool hasDepth);
-        VPAError CreatePipeline(const PipelineConfig& config, const VkVertexInputBindingDescription& bindingDescription, const QVector<VkVertexInputAttributeDescription>& attribDescriptions,
+        VPAError CreatePipeline(const PipelineConfig& config, const QVector<VkVertexInputBindingDescription>& bindingDescriptions, const QVector<VkVertexInputAttributeDescription>& attribDescriptions,
                                 QVector<VkPipelineShaderStageCreateInfo>& shaderStageInfos, QVector<VkPipelineColorBlendAttachmentState> colourBlendAttachments, VkPipelineLayoutCreateInfo& layoutInfo,
                                 VkRenderPass& renderPass, VkPipelineLayout& layout,
                                 VkPipeline& pipeline, VkPipelineCache& cache);
         VPAError CreatePipelineCache();
+        VPAError CreateStatisticsQueries();
         VPAError CreateShaders();
+        VPAError CreateVertexInput();
+        uint32_t DrawLevel();
 
         bool DepthDrawing() const { return m_attachmentImages.size() == 1; }
 
@@ -65,13 +107,20 @@ namespace vpa {
         VkSubpassDescription MakeSubpass(VkPipelineBindPoint pipelineType, QVector<VkAttachmentReference>& colourReferences,
             VkAttachmentReference* depthReference, VkAttachmentReference* resolve);
         VkSubpassDependency MakeSubpassDependency(uint32_t srcIdx, uint32_t dstIdx, VkPipelineStageFlags srcStage,
-            VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+            VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess, VkDependencyFlags flags = VK_DEPENDENCY_BY_REGION_BIT);
+        VkImageCreateInfo MakeAttachmentImageCI(uint32_t height, uint32_t width, VkFormat format, VkImageUsageFlags usage) const;
         VPAError MakeAttachmentImage(AttachmentImage& image, uint32_t height, uint32_t width, VkFormat format, VkImageUsageFlags usage, QString name, bool present);
+        VPAError MakeAttachmentView(AttachmentImage& image, QString name);
+        // Rebuilds every transient attachment in one aliased block along with the default framebuffers that use it
+        VPAError MakeTransientAttachments();
         VPAError MakeFrameBuffers(VkRenderPass& renderPass, QVector<VkFramebuffer>& framebuffers, QVector<VkImageView>& imageViews, uint32_t width, uint32_t height);
         VPAError MakeOutputPostPass();
+        void RetireAttachmentImage(AttachmentImage& image);
+        void RetireAllocation(Allocation& allocation);
+        void RetireDescriptors();
 
         // Helper functions for making a graphics pipeline
-        VkPipelineVertexInputStateCreateInfo MakeVertexInputStateCI(const VkVertexInputBindingDescription& bindingDescription, const QVector<VkVertexInputAttributeDescription>& attribDescriptions) const;
+        VkPipelineVertexInputStateCreateInfo MakeVertexInputStateCI(const QVector<VkVertexInputBindingDescription>& bindingDescriptions, const QVector<VkVertexInputAttributeDescription>& attribDescriptions) const;
         VkPipelineInputAssemblyStateCreateInfo MakeInputAssemblyStateCI(const PipelineConfig& config) const;
         VkViewport MakeViewport() const;
         VkRect2D MakeScissor() const;
@@ -98,6 +147,9 @@ namespace vpa {
 
         ShaderAnalytics* m_shaderAnalytics;
         MemoryAllocator* m_allocator;
+        SamplerCache* m_samplers;
+        TextureCache* m_textures;
+        DescriptorCache* m_descriptorCache;
         VertexInput* m_vertexInput;
         Descriptors* m_descriptors;
         ConfigValidator* m_validator;
@@ -113,11 +165,23 @@ namespace vpa {
 
         VkPipeline m_outputPipeline;
         VkPipelineLayout m_outputPipelineLayout;
-        QVector<VkSampler> m_outputSamplers;
+        QVector<VkSampler> m_outputSamplers; // One reference to the cached sampler per attachment
 
         VkRenderPass m_defaultRenderPass;
         QVector<VkFramebuffer> m_defaultFramebuffers;
         AttachmentImage m_defaultDepthAttachment;
+
+        Allocation m_transientMemory;
+        AttachmentStatistics m_attachmentStats;
+
+        VkQueryPool m_statisticsPool;
+        VkQueryPool m_timestampPool;
+        QVector<bool> m_statisticsPending; // Per frame in flight, set when its queries have been written
+        QVector<uint32_t> m_queryLods; // Per frame in flight, the level its queries measured
+        PipelineStatistics m_pipelineStats;
+
+        QElapsedTimer m_lastReload; // Frames soon after a reload count as interactive
+        QTimer m_idleRedrawTimer; // Asks for a full detail frame once interaction stops
     };
 }
 
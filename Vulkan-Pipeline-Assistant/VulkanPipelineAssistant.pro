@@ -1,5 +1,6 @@
 QT       += core gui
 QT       += xml
+QT       += concurrent
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++14
@@ -16,10 +17,22 @@ debug {
 
 SOURCES += \
     Vulkan/configvalidator.cpp \
+    Vulkan/deletionqueue.cpp \
+    Vulkan/descriptorbenchmark.cpp \
+    Vulkan/descriptorcache.cpp \
     Vulkan/descriptors.cpp \
+    Vulkan/gltfparser.cpp \
     Vulkan/memoryallocator.cpp \
+    Vulkan/meshcache.cpp \
+    Vulkan/meshgenerator.cpp \
+    Vulkan/meshoptimiser.cpp \
+    Vulkan/objparser.cpp \
     Vulkan/pipelineconfig.cpp \
+    Vulkan/samplercache.cpp \
     Vulkan/shaderanalytics.cpp \
+    Vulkan/texturecache.cpp \
+    Vulkan/textureencoder.cpp \
+    Vulkan/textureparser.cpp \
     Vulkan/vertexinput.cpp \
     Vulkan/vulkanmain.cpp \
     Vulkan/vulkanrenderer.cpp \
@@ -32,6 +45,7 @@ SOURCES += \
     Widgets/spvmatrixwidget.cpp \
     Widgets/spvstructwidget.cpp \
     Widgets/spvvectorwidget.cpp \
+    Widgets/statisticswidget.cpp \
     glslhighlighter.cpp \
     main.cpp \
     mainwindow.cpp \
@@ -39,12 +53,24 @@ SOURCES += \
 HEADERS += \
     Vulkan/compileerror.h \
     Vulkan/configvalidator.h \
+    Vulkan/deletionqueue.h \
+    Vulkan/descriptorbenchmark.h \
+    Vulkan/descriptorcache.h \
     Vulkan/descriptors.h \
+    Vulkan/gltfparser.h \
     Vulkan/memoryallocator.h \
+    Vulkan/meshcache.h \
+    Vulkan/meshgenerator.h \
+    Vulkan/meshoptimiser.h \
+    Vulkan/objparser.h \
     Vulkan/pipelineconfig.h \
     Vulkan/reloadflags.h \
+    Vulkan/samplercache.h \
     Vulkan/shaderanalytics.h \
     Vulkan/spirvresource.h \
+    Vulkan/texturecache.h \
+    Vulkan/textureencoder.h \
+    Vulkan/textureparser.h \
     Vulkan/vertexinput.h \
     Vulkan/vulkanmain.h \
     Vulkan/vulkanrenderer.h \
@@ -58,6 +84,7 @@ HEADERS += \
     Widgets/spvstructwidget.h \
     Widgets/spvvectorwidget.h \
     Widgets/spvwidget.h \
+    Widgets/statisticswidget.h \
     common.h \
     filemanager.h \
     glslhighlighter.h \
@@ -28,6 +28,18 @@ namespace vpa {
         tree->WriteDescriptorData(this, fileName);
     }
 
+    void DescriptorNodeRoot::WriteSamplerState(const SamplerState& state) {
+        tree->WriteSamplerState(this, state);
+    }
+
+    void DescriptorNodeRoot::AddArrayImage(QString fileName) {
+        tree->AddArrayImage(this, fileName);
+    }
+
+    const ImageInfo& DescriptorNodeRoot::Image() const {
+        return tree->Image(this);
+    }
+
     DescriptorNodeLeaf::~DescriptorNodeLeaf() {
         root->tree->m_descriptorNodes[treeItem] = nullptr;
         delete widget;
@@ -76,6 +88,7 @@ namespace vpa {
             delete nodeKey;
         }
         QObject::disconnect(m_clickConnection);
+        QObject::disconnect(m_changeConnection);
     }
 
     void DescriptorTree::WriteDescriptorData(DescriptorNodeRoot* root) {
@@ -101,6 +114,24 @@ namespace vpa {
         m_descriptors->LoadImage(root->descriptorSet, root->descriptorIndex, fileName);
     }
 
+    void DescriptorTree::WriteSamplerState(DescriptorNodeRoot* root, const SamplerState& state) {
+        assert(root->resource->group->Group() == SpvGroupName::Image);
+        m_descriptors->SetSamplerState(root->descriptorSet, root->descriptorIndex, state);
+    }
+
+    void DescriptorTree::AddArrayImage(DescriptorNodeRoot* root, QString fileName) {
+        assert(root->resource->group->Group() == SpvGroupName::Image);
+        int index = -1;
+        if (m_descriptors->AddArrayImage(root->descriptorSet, root->descriptorIndex, fileName, index) == VPA_OK) {
+            CreateDescriptorWidgetTree(root->descriptorSet, index, root->resource);
+        }
+    }
+
+    const ImageInfo& DescriptorTree::Image(const DescriptorNodeRoot* root) const {
+        assert(root->resource->group->Group() == SpvGroupName::Image);
+        return m_descriptors->Images()[root->descriptorSet][root->descriptorIndex];
+    }
+
     QString DescriptorTree::MakeGroupInfoText(DescriptorNodeRoot& root) {
         if (root.resource->group->Group() != SpvGroupName::PushConstant) {
         return "layout(set = " + QString::number(root.descriptorSet) + ", binding = " + QString::number(static_cast<SpvDescriptorGroup*>(root.resource->group)->binding) + ") " +
@@ -165,7 +196,7 @@ namespace vpa {
         else {
             DescriptorNodeRoot* root = reinterpret_cast<DescriptorNodeRoot*>(node);
             m_groupInfo->setText(MakeGroupInfoText(*root));
-            if (root->resource->type->Type() == SpvTypeName::Image || root->child->children.size() == 1) {
+            if (root->child->type->Type() == SpvTypeName::Image || root->child->children.size() == 1) {
                 m_typeInfo->setText(MakeTypeInfoText(root->child->type));
                 m_typeWidget->ShowWidget(root->child->widget);
             }
@@ -176,6 +207,17 @@ namespace vpa {
         }
     }
 
+    void DescriptorTree::HandleItemChanged(QTreeWidgetItem* item, int column) {
+        if (column != 0 || !(item->flags() & Qt::ItemIsUserCheckable)) return;
+        DescriptorNode* node = m_descriptorNodes.value(item);
+        if (!node || node->Type() != NodeType::Root) return;
+        DescriptorNodeRoot* root = reinterpret_cast<DescriptorNodeRoot*>(node);
+        // Through an iterator, as the const operator[] of QHash returns a copy
+        const BufferInfo& buffer = m_descriptors->Buffers().constFind(root->descriptorSet).value()[root->descriptorIndex];
+        const bool dynamic = item->checkState(0) == Qt::Checked;
+        if (dynamic != buffer.dynamic) m_dynamicToggled(Descriptors::BindingKey(buffer.descriptor), dynamic);
+    }
+
     DescriptorNodeLeaf* DescriptorTree::CreateDescriptorWidgetLeaf(SpvType* type, DescriptorNodeRoot* root, QTreeWidgetItem* parentTreeItem, bool topLevel, ArrayLeafInfo arrayParentInfo) {
         DescriptorNodeLeaf* leaf = new DescriptorNodeLeaf();
         leaf->root = root;
@@ -231,13 +273,26 @@ namespace vpa {
         root->resource = res;
         root->tree = this;
 
+        // Every element of an array of images is a separate image in the tree
+        SpvType* type = res->type;
+        QString name = res->name;
+        if (res->group->Group() == SpvGroupName::Image && type->Type() == SpvTypeName::Array) {
+            type = reinterpret_cast<SpvArrayType*>(type)->subtype;
+            name += QString("[%1]").arg(m_descriptors->Images()[set][index].descriptor.arrayElement);
+        }
+
         QTreeWidgetItem* treeItem = new QTreeWidgetItem();
-        treeItem->setText(0, res->name);
-        root->child = CreateDescriptorWidgetLeaf(res->type, root, treeItem, true, {});
+        treeItem->setText(0, name);
+        if (res->group->Group() == SpvGroupName::UniformBuffer || res->group->Group() == SpvGroupName::StorageBuffer) {
+            treeItem->setFlags(treeItem->flags() | Qt::ItemIsUserCheckable);
+            treeItem->setCheckState(0, m_descriptors->Buffers()[set][index].dynamic ? Qt::Checked : Qt::Unchecked);
+            treeItem->setToolTip(0, "Checked buffers are bound at a dynamic offset in to a ring with a copy for each frame in flight");
+        }
+        root->child = CreateDescriptorWidgetLeaf(type, root, treeItem, true, {});
 
         m_descriptorNodes.insert(treeItem, root);
         m_tree->addTopLevelItem(treeItem);
 
-        if (res->type->Type() != SpvTypeName::Image) WriteDescriptorData(root);
+        if (type->Type() != SpvTypeName::Image) WriteDescriptorData(root);
     }
 }
@@ -4,6 +4,7 @@
 #include "../common.h"
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
+#include <functional>
 
 class QTextEdit;
 
@@ -15,6 +16,8 @@ namespace vpa {
     class ContainerWidget;
     class DescriptorTree;
     class Descriptors;
+    struct SamplerState;
+    struct ImageInfo;
 
     struct ArrayLeafInfo {
         SpvArrayWidget* arr = nullptr;
@@ -41,6 +44,9 @@ namespace vpa {
 
         void WriteDescriptorData();
         void WriteDescriptorData(QString fileName);
+        void WriteSamplerState(const SamplerState& state);
+        void AddArrayImage(QString fileName);
+        const ImageInfo& Image() const;
 
         ~DescriptorNodeRoot();
 
@@ -72,9 +78,12 @@ namespace vpa {
         friend struct DescriptorNodeRoot;
         friend struct DescriptorNodeLeaf;
     public:
-        DescriptorTree(QTreeWidget* tree, QTextEdit* groupInfoWidget, QTextEdit* typeInfoWidget, ContainerWidget* typeWidget, Descriptors* descriptors)
-            : m_tree(tree), m_descriptors(descriptors), m_groupInfo(groupInfoWidget), m_typeInfo(typeInfoWidget), m_typeWidget(typeWidget) {
+        // dynamicToggled is given the binding key of a buffer whose check box was changed, applying it needs new descriptors so it must not be done from within the call
+        DescriptorTree(QTreeWidget* tree, QTextEdit* groupInfoWidget, QTextEdit* typeInfoWidget, ContainerWidget* typeWidget, Descriptors* descriptors,
+                       std::function<void(const QString&, bool)> dynamicToggled)
+            : m_tree(tree), m_descriptors(descriptors), m_groupInfo(groupInfoWidget), m_typeInfo(typeInfoWidget), m_typeWidget(typeWidget), m_dynamicToggled(dynamicToggled) {
             m_clickConnection = QObject::connect(m_tree, QOverload<QTreeWidgetItem*, int>::of(&QTreeWidget::itemClicked), [this](QTreeWidgetItem* item, int col){ HandleButtonClick(item, col); });
+            m_changeConnection = QObject::connect(m_tree, &QTreeWidget::itemChanged, [this](QTreeWidgetItem* item, int col){ HandleItemChanged(item, col); });
         }
         ~DescriptorTree();
 
@@ -85,9 +94,14 @@ namespace vpa {
 
         void WriteDescriptorData(DescriptorNodeRoot* root);
         void WriteDescriptorData(DescriptorNodeRoot* root, QString fileName);
+        void WriteSamplerState(DescriptorNodeRoot* root, const SamplerState& state);
+        // The new element of the runtime array gets a tree of its own
+        void AddArrayImage(DescriptorNodeRoot* root, QString fileName);
+        const ImageInfo& Image(const DescriptorNodeRoot* root) const;
 
     private slots:
         void HandleButtonClick(QTreeWidgetItem* item, int column);
+        void HandleItemChanged(QTreeWidgetItem* item, int column);
 
     private:
         QTreeWidget* m_tree;
@@ -97,7 +111,9 @@ namespace vpa {
         QTextEdit* m_groupInfo;
         QTextEdit* m_typeInfo;
         ContainerWidget* m_typeWidget;
+        std::function<void(const QString&, bool)> m_dynamicToggled;
         QMetaObject::Connection m_clickConnection;
+        QMetaObject::Connection m_changeConnection;
     };
 }
 
@@ -3,11 +3,16 @@
 #include <QPushButton>
 #include <QLabel>
 #include <QLayout>
+#include <QFormLayout>
+#include <QComboBox>
 #include <QFileDialog>
 #include <QCoreApplication>
+#include <QFileInfo>
+#include <functional>
 
 #include "../Vulkan/spirvresource.h"
 #include "../Vulkan/descriptors.h"
+#include "../Vulkan/textureparser.h"
 #include "descriptortree.h"
 
 namespace vpa {
@@ -18,18 +23,69 @@ namespace vpa {
 
         QPushButton* imgPreview = new QPushButton(this);
         imgPreview->setMinimumSize(200, 200);
-        imgPreview->setIcon(QIcon(TEXDIR"default.png"));
-        imgPreview->setIconSize(QSize(200, 200));
+        // Block compressed files can't be previewed, so they're shown by name
+        auto showSource = [imgPreview](const QString& source) {
+            bool container = TextureFile::IsContainer(source);
+            imgPreview->setIcon(container ? QIcon() : QIcon(source));
+            imgPreview->setText(container ? QFileInfo(source).fileName() : "");
+            imgPreview->setIconSize(QSize(200, 200));
+        };
+        // The binding may have kept its image and sampler through a shader reload
+        const ImageInfo& image = m_root->Image();
+        m_samplerState = image.samplerState;
+        showSource(image.source);
         layout->addWidget(imgPreview);
-        QObject::connect(imgPreview, &QPushButton::pressed, [this, imgPreview]{
-            QString imgFileName = QFileDialog::getOpenFileName(this, tr("Open File"), ".", tr("Image Files (*.png)"));
+        QObject::connect(imgPreview, &QPushButton::pressed, [this, showSource]{
+            QString imgFileName = QFileDialog::getOpenFileName(this, tr("Open File"), ".", tr("Image Files (*.png *.jpg *.ktx2 *.dds)"));
             if (imgFileName != "") {
-                imgPreview->setIcon(QIcon(imgFileName));
-                imgPreview->setIconSize(QSize(200, 200));
+                showSource(imgFileName);
                 m_root->WriteDescriptorData(imgFileName);
             }
         });
 
+        // Runtime arrays grow in place, this image stays where it is
+        if (image.descriptor.bindless) {
+            QPushButton* addButton = new QPushButton("Add image to array", this);
+            QObject::connect(addButton, &QPushButton::pressed, [this]{
+                QString imgFileName = QFileDialog::getOpenFileName(this, tr("Open File"), ".", tr("Image Files (*.png *.jpg *.ktx2 *.dds)"));
+                if (imgFileName != "") m_root->AddArrayImage(imgFileName);
+            });
+            layout->addWidget(addButton);
+        }
+
+        // Samplers come from a cache, so flicking between states reuses the ones already created
+        if (m_type->sampled) {
+            QFormLayout* samplerLayout = new QFormLayout();
+            auto addCombo = [this, samplerLayout](const QString& label, const QStringList& items, QVector<int> values, int current, std::function<void(int)> apply) {
+                QComboBox* box = new QComboBox(this);
+                box->addItems(items);
+                box->setCurrentIndex(values.indexOf(current));
+                QObject::connect(box, QOverload<int>::of(&QComboBox::currentIndexChanged), [this, values, apply](int index) {
+                    apply(values[index]);
+                    m_root->WriteSamplerState(m_samplerState);
+                });
+                samplerLayout->addRow(label, box);
+            };
+            const QStringList filters = { "Nearest", "Linear" };
+            const QVector<int> filterValues = { VK_FILTER_NEAREST, VK_FILTER_LINEAR };
+            addCombo("Mag filter", filters, filterValues, m_samplerState.magFilter, [this](int value) { m_samplerState.magFilter = VkFilter(value); });
+            addCombo("Min filter", filters, filterValues, m_samplerState.minFilter, [this](int value) { m_samplerState.minFilter = VkFilter(value); });
+            addCombo("Mip filter", filters, { VK_SAMPLER_MIPMAP_MODE_NEAREST, VK_SAMPLER_MIPMAP_MODE_LINEAR }, m_samplerState.mipmapMode,
+                     [this](int value) { m_samplerState.mipmapMode = VkSamplerMipmapMode(value); });
+
+            const QStringList addressModes = { "Repeat", "Mirrored repeat", "Clamp to edge", "Clamp to border" };
+            const QVector<int> addressValues = { VK_SAMPLER_ADDRESS_MODE_REPEAT, VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                                 VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER };
+            addCombo("Address U", addressModes, addressValues, m_samplerState.addressModeU, [this](int value) { m_samplerState.addressModeU = VkSamplerAddressMode(value); });
+            addCombo("Address V", addressModes, addressValues, m_samplerState.addressModeV, [this](int value) { m_samplerState.addressModeV = VkSamplerAddressMode(value); });
+            addCombo("Address W", addressModes, addressValues, m_samplerState.addressModeW, [this](int value) { m_samplerState.addressModeW = VkSamplerAddressMode(value); });
+            // Every loadable format is sampled as float, so only the float border colours apply
+            addCombo("Border colour", { "Transparent black", "Opaque black", "Opaque white" },
+                     { VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK, VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK, VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE }, m_samplerState.borderColor,
+                     [this](int value) { m_samplerState.borderColor = VkBorderColor(value); });
+            layout->addLayout(samplerLayout);
+        }
+
         setLayout(layout);
     }
 }
@@ -2,6 +2,7 @@
 #define SPVIMAGEWIDGET_H
 
 #include "spvwidget.h"
+#include "../Vulkan/samplercache.h"
 
 namespace vpa {
     struct SpvImageType;
@@ -15,6 +16,7 @@ namespace vpa {
 
     private:
         SpvImageType* m_type;
+        SamplerState m_samplerState; // Edited for sampled images only
     };
 }
 
@@ -0,0 +1,57 @@
+#include "statisticswidget.h"
+
+#include <QTreeWidget>
+#include <QPushButton>
+#include <QHeaderView>
+#include <QLayout>
+
+namespace vpa {
+    StatisticsWidget::StatisticsWidget(QWidget* parent) : QWidget(parent) {
+        m_tree = new QTreeWidget(this);
+        m_tree->setColumnCount(2);
+        m_tree->setHeaderLabels({ "Statistic", "Value" });
+        m_tree->header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
+        m_writeButton = new QPushButton("Write JSON", this);
+        m_benchmarkButton = new QPushButton("Benchmark descriptors", this);
+
+        QVBoxLayout* layout = new QVBoxLayout(this);
+        layout->addWidget(m_tree);
+        layout->addWidget(m_writeButton);
+        layout->addWidget(m_benchmarkButton);
+        setLayout(layout);
+
+        QObject::connect(m_writeButton, &QPushButton::released, this, &StatisticsWidget::WriteRequested);
+        QObject::connect(m_benchmarkButton, &QPushButton::released, this, &StatisticsWidget::BenchmarkRequested);
+    }
+
+    void StatisticsWidget::SetSection(const QString& section, const StatisticRows& rows) {
+        QTreeWidgetItem* sectionItem = nullptr;
+        for (int i = 0; i < m_tree->topLevelItemCount(); ++i) {
+            if (m_tree->topLevelItem(i)->text(0) == section) {
+                sectionItem = m_tree->topLevelItem(i);
+                break;
+            }
+        }
+        if (!sectionItem) {
+            sectionItem = new QTreeWidgetItem(m_tree, { section });
+            sectionItem->setExpanded(true);
+        }
+
+        // Items are reused so that refreshing doesn't reset the selection or scroll position
+        while (sectionItem->childCount() > rows.size()) {
+            delete sectionItem->takeChild(sectionItem->childCount() - 1);
+        }
+        for (int i = 0; i < rows.size(); ++i) {
+            QTreeWidgetItem* item = i < sectionItem->childCount() ? sectionItem->child(i) : new QTreeWidgetItem(sectionItem);
+            item->setText(0, rows[i].first);
+            item->setText(1, rows[i].second);
+        }
+    }
+
+    QString StatisticsWidget::FormatBytes(quint64 bytes) {
+        if (bytes >= 1024 * 1024 * 1024) return QString::number(double(bytes) / (1024.0 * 1024.0 * 1024.0), 'f', 2) + " GiB";
+        if (bytes >= 1024 * 1024) return QString::number(double(bytes) / (1024.0 * 1024.0), 'f', 2) + " MiB";
+        if (bytes >= 1024) return QString::number(double(bytes) / 1024.0, 'f', 2) + " KiB";
+        return QString::number(bytes) + " B";
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef STATISTICSWIDGET_H
+#define STATISTICSWIDGET_H
+
+#include <QWidget>
+#include <QVector>
+#include <QPair>
+
+#include "../common.h"
+
+class QTreeWidget;
+class QPushButton;
+
+namespace vpa {
+    using StatisticRows = QVector<QPair<QString, QString>>;
+
+    // Read only tree of named sections, each section holding label and value rows
+    class StatisticsWidget : public QWidget {
+        Q_OBJECT
+    public:
+        StatisticsWidget(QWidget* parent = nullptr);
+
+        // Replaces the rows of a section, creating the section if it does not exist
+        void SetSection(const QString& section, const StatisticRows& rows);
+        static QString FormatBytes(quint64 bytes);
+
+    signals:
+        void WriteRequested();
+        void BenchmarkRequested();
+
+    private:
+        QTreeWidget* m_tree;
+        QPushButton* m_writeButton;
+        QPushButton* m_benchmarkButton;
+    };
+}
+
+#endif // STATISTICSWIDGET_H
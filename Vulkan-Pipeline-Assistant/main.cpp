@@ -1,11 +1,22 @@
 #include "mainwindow.h"
+#include "Vulkan/objparser.h"
 
 #include <QApplication>
 #include <QPushButton>
+#include <QDir>
 
 int main(int argc, char *argv[]) {
     QApplication a(argc, argv);
     qDebug() << "App path: " << a.applicationDirPath();
+
+    // --benchmark-obj [MB] measures obj parsing throughput on a generated mesh and exits
+    int benchmarkArg = a.arguments().indexOf("--benchmark-obj");
+    if (benchmarkArg >= 0) {
+        int sizeMB = a.arguments().value(benchmarkArg + 1, "500").toInt();
+        vpa::VPAError err = vpa::ObjParser::Benchmark(QDir::temp().filePath("vpa_benchmark.obj"), sizeMB > 0 ? sizeMB : 500);
+        if (err.level != vpa::VPAErrorLevel::Ok) qDebug() << vpa::VPAError::lastMessage;
+        return err.level == vpa::VPAErrorLevel::Ok ? 0 : 1;
+    }
     vpa::MainWindow w;
     w.show();
     return a.exec();
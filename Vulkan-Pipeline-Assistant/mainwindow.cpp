@@ -6,18 +6,51 @@
 #include <QFileDialog>
 #include <QKeyEvent>
 #include <QDockWidget>
+#include <QTimer>
+#include <QSpinBox>
+#include <QDoubleSpinBox>
+#include <QMap>
 #include <qt_windows.h>
 
 #include "./Vulkan/pipelineconfig.h"
 #include "./Vulkan/descriptors.h"
+#include "./Vulkan/descriptorbenchmark.h"
 #include "./Vulkan/shaderanalytics.h"
+#include "./Vulkan/memoryallocator.h"
+#include "./Vulkan/vulkanrenderer.h"
+#include "./Vulkan/vertexinput.h"
 #include "./Widgets/containerwidget.h"
 #include "./Widgets/descriptortree.h"
+#include "./Widgets/statisticswidget.h"
 #include "glslhighlighter.h"
 
 namespace vpa {
     QString VPAError::lastMessage = "";
 
+    DrawTimeKey DrawTimeKey::Baseline() const {
+        DrawTimeKey baseline = *this;
+        baseline.formats.position = VertexPositionFormat::Float32;
+        baseline.formats.normal = VertexNormalFormat::Float32;
+        baseline.formats.texCoord = VertexTexCoordFormat::Float32;
+        baseline.formats.colour = VertexColourFormat::Float32;
+        baseline.streamLayout = VertexStreamLayout::Interleaved;
+        return baseline;
+    }
+
+    bool DrawTimeKey::SameLayout(const DrawTimeKey& other) const {
+        return formats.position == other.formats.position && formats.normal == other.formats.normal && formats.texCoord == other.formats.texCoord
+                && formats.colour == other.formats.colour && streamLayout == other.streamLayout && indirect == other.indirect;
+    }
+
+    bool operator==(const DrawTimeKey& a, const DrawTimeKey& b) {
+        return a.SameLayout(b) && a.instanceCount == b.instanceCount;
+    }
+
+    uint qHash(const DrawTimeKey& key, uint seed) {
+        return qHash(qMakePair(qMakePair(int(key.formats.position), int(key.formats.normal)), qMakePair(int(key.formats.texCoord), int(key.formats.colour))), seed)
+                ^ qHash(qMakePair(int(key.streamLayout), qMakePair(key.instanceCount, key.indirect)), seed);
+    }
+
     bool DockWidget::nativeEvent(const QByteArray& eventType, void* message, long* result) {
         Q_UNUSED(result)
         Q_UNUSED(eventType)
@@ -56,6 +89,9 @@ namespace vpa {
         m_vkDockWidget->show();
         m_vulkan = new VulkanMain(m_vkDockUi->gwDisplayArea, std::bind(&MainWindow::PostVulkanSetup, this), std::bind(&MainWindow::VulkanCreationCallback, this));
 
+        MakeStatisticsDock();
+        m_ui->ConfigTabs->addTab(MakePreviewBlock(), "Preview");
+
         m_vulkan->GetConfig().vertShader = SHADERSRCDIR"vs_test.vert";
         m_vulkan->GetConfig().fragShader = SHADERSRCDIR"fs_test.frag";
 
@@ -85,7 +121,9 @@ namespace vpa {
     }
 
     void MainWindow::closeEvent(QCloseEvent* event) {
+        m_statsTimer->stop();
         delete m_vulkan;
+        m_vulkan = nullptr;
         event->accept();
     }
 
@@ -301,6 +339,13 @@ namespace vpa {
             this->HandleViewChangeApply(viewportBoxes);
         });
 
+        QCheckBox* transcodeBox = new QCheckBox("Transcode images to BC1/BC3 through the texture cache", container);
+        transcodeBox->setChecked(Config().preview.textures.transcode);
+        QObject::connect(transcodeBox, QOverload<int>::of(&QCheckBox::stateChanged), [this, applyTextures](int state) {
+            Config().preview.textures.transcode = state != 0;
+            applyTextures();
+        });
+
         QGridLayout* layout = new QGridLayout(container);
         container->setLayout(layout);
 
@@ -360,6 +405,219 @@ namespace vpa {
         return container;
     }
 
+    QWidget* MainWindow::MakePreviewBlock() {
+        QWidget* container = new QWidget();
+        QComboBox* sourceBox = MakeComboBox(container, { "File", "Grid", "Sphere", "Triangle soup" });
+        sourceBox->setCurrentIndex(int(Config().preview.source));
+        QObject::connect(sourceBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+            HandleConfigValueChange<MeshSource>(Config().preview.source, ReloadFlags::Mesh, index);
+        });
+        QDoubleSpinBox* trianglesBox = new QDoubleSpinBox(container);
+        trianglesBox->setRange(0.001, 50.0);
+        trianglesBox->setDecimals(3);
+        trianglesBox->setSuffix(" M");
+        trianglesBox->setKeyboardTracking(false);
+        trianglesBox->setValue(double(Config().preview.generatedTriangles));
+        QObject::connect(trianglesBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), [this](double value) {
+            Config().preview.generatedTriangles = float(value);
+            if (Config().preview.source != MeshSource::File) WriteAndReload(ReloadFlags::Mesh);
+        });
+        // Small triangles leave the vertex stage as the bottleneck, large overlapping ones the fragment stage
+        QDoubleSpinBox* sizeBox = new QDoubleSpinBox(container);
+        sizeBox->setRange(0.001, 10.0);
+        sizeBox->setDecimals(3);
+        sizeBox->setKeyboardTracking(false);
+        sizeBox->setValue(double(Config().preview.generatedSize));
+        QObject::connect(sizeBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), [this](double value) {
+            Config().preview.generatedSize = float(value);
+            if (Config().preview.source != MeshSource::File) WriteAndReload(ReloadFlags::Mesh);
+        });
+
+        QLineEdit* meshField = new QLineEdit(Config().preview.mesh, container);
+        meshField->setReadOnly(true);
+        QPushButton* meshButton = new QPushButton("...", container);
+        QObject::connect(meshButton, &QPushButton::released, [this, meshField]() {
+            QString path = QFileDialog::getOpenFileName(this, tr("Open Mesh"), MESHDIR, tr("Mesh Files (*.obj *.gltf *.glb)"));
+            if (path.isEmpty()) return;
+            meshField->setText(path);
+            Config().preview.mesh = path;
+            if (Config().preview.source == MeshSource::File) WriteAndReload(ReloadFlags::Mesh);
+        });
+
+        QCheckBox* optimiseBox = new QCheckBox("Optimise mesh index order", container);
+        optimiseBox->setChecked(Config().preview.optimiseMesh);
+        QObject::connect(optimiseBox, QOverload<int>::of(&QCheckBox::stateChanged), [this](int state) {
+            HandleConfigValueChange<bool>(Config().preview.optimiseMesh, ReloadFlags::Mesh, state != 0);
+        });
+
+        VertexFormatConfig& formats = Config().preview.vertexFormats;
+        QComboBox* positionBox = MakeComboBox(container, { "Float32", "Float16" });
+        QComboBox* normalBox = MakeComboBox(container, { "Float32", "Snorm8", "Snorm 10:10:10:2" });
+        QComboBox* texCoordBox = MakeComboBox(container, { "Float32", "Float16", "Unorm16" });
+        QComboBox* colourBox = MakeComboBox(container, { "Float32", "Unorm8" });
+        QComboBox* streamsBox = MakeComboBox(container, { "Interleaved", "Position + attributes", "One per attribute" });
+        streamsBox->setCurrentIndex(int(Config().preview.streamLayout));
+        positionBox->setCurrentIndex(int(formats.position));
+        normalBox->setCurrentIndex(int(formats.normal));
+        texCoordBox->setCurrentIndex(int(formats.texCoord));
+        colourBox->setCurrentIndex(int(formats.colour));
+        QObject::connect(positionBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+            HandleConfigValueChange<VertexPositionFormat>(Config().preview.vertexFormats.position, ReloadFlags::Mesh, index);
+        });
+        QObject::connect(normalBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+            HandleConfigValueChange<VertexNormalFormat>(Config().preview.vertexFormats.normal, ReloadFlags::Mesh, index);
+        });
+        QObject::connect(texCoordBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+            HandleConfigValueChange<VertexTexCoordFormat>(Config().preview.vertexFormats.texCoord, ReloadFlags::Mesh, index);
+        });
+        QObject::connect(colourBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+            HandleConfigValueChange<VertexColourFormat>(Config().preview.vertexFormats.colour, ReloadFlags::Mesh, index);
+        });
+        QObject::connect(streamsBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+            HandleConfigValueChange<VertexStreamLayout>(Config().preview.streamLayout, ReloadFlags::Mesh, index);
+        });
+
+        // Only applied once editing finishes so typing a large count doesn't rebuild every intermediate one
+        QSpinBox* instancesBox = new QSpinBox(container);
+        instancesBox->setRange(1, 100000);
+        instancesBox->setKeyboardTracking(false);
+        instancesBox->setValue(int(Config().preview.instanceCount));
+        QObject::connect(instancesBox, QOverload<int>::of(&QSpinBox::valueChanged), [this](int value) {
+            HandleConfigValueChange<uint32_t>(Config().preview.instanceCount, ReloadFlags::Mesh, value);
+        });
+
+        // Every sub mesh's command is already in the indirect buffer, so switching only needs a new frame
+        QCheckBox* indirectBox = new QCheckBox("Draw each sub mesh with an indirect command", container);
+        indirectBox->setChecked(Config().preview.indirectDraw);
+        QObject::connect(indirectBox, QOverload<int>::of(&QCheckBox::stateChanged), [this](int state) {
+            Config().preview.indirectDraw = state != 0;
+            m_vulkan->RequestUpdate();
+        });
+
+        // Drawing doesn't depend on these until the next interaction, so nothing needs rebuilding
+        QCheckBox* lodBox = new QCheckBox("Draw a simplified level while editing", container);
+        lodBox->setChecked(Config().preview.interactiveLod);
+        QObject::connect(lodBox, QOverload<int>::of(&QCheckBox::stateChanged), [this](int state) {
+            Config().preview.interactiveLod = state != 0;
+        });
+        QSpinBox* budgetBox = new QSpinBox(container);
+        budgetBox->setRange(1000, 100000000);
+        budgetBox->setSingleStep(10000);
+        budgetBox->setKeyboardTracking(false);
+        budgetBox->setValue(int(Config().preview.lodTriangleBudget));
+        QObject::connect(budgetBox, QOverload<int>::of(&QSpinBox::valueChanged), [this](int value) {
+            Config().preview.lodTriangleBudget = uint32_t(value);
+        });
+
+        // Loaded images are recreated from their files rather than reloading the shaders, which would reset them to the default
+        auto applyTextures = [this]() {
+            Descriptors* descriptors = m_vulkan ? m_vulkan->GetDescriptors() : nullptr;
+            if (descriptors) descriptors->SetTextureConfig(Config().preview.textures);
+        };
+        QComboBox* mipBox = MakeComboBox(container, { "None", "Blit", "CPU box filter" });
+        mipBox->setCurrentIndex(int(Config().preview.textures.mipGeneration));
+        QObject::connect(mipBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this, applyTextures](int index) {
+            Config().preview.textures.mipGeneration = MipGeneration(index);
+            applyTextures();
+        });
+        QSpinBox* mipLevelsBox = new QSpinBox(container);
+        mipLevelsBox->setRange(0, 16);
+        mipLevelsBox->setSpecialValueText("Full chain");
+        mipLevelsBox->setKeyboardTracking(false);
+        mipLevelsBox->setValue(int(Config().preview.textures.mipLevels));
+        QObject::connect(mipLevelsBox, QOverload<int>::of(&QSpinBox::valueChanged), [this, applyTextures](int value) {
+            Config().preview.textures.mipLevels = uint32_t(value);
+            applyTextures();
+        });
+        QDoubleSpinBox* lodBiasBox = new QDoubleSpinBox(container);
+        lodBiasBox->setRange(-16.0, 16.0);
+        lodBiasBox->setSingleStep(0.25);
+        lodBiasBox->setKeyboardTracking(false);
+        lodBiasBox->setValue(double(Config().preview.textures.lodBias));
+        QObject::connect(lodBiasBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), [this, applyTextures](double value) {
+            Config().preview.textures.lodBias = float(value);
+            applyTextures();
+        });
+        QSpinBox* residencyBox = new QSpinBox(container);
+        residencyBox->setRange(0, 16384);
+        residencyBox->setSingleStep(64);
+        residencyBox->setSuffix(" MiB");
+        residencyBox->setKeyboardTracking(false);
+        residencyBox->setValue(int(Config().preview.textures.residencyBudget));
+        QObject::connect(residencyBox, QOverload<int>::of(&QSpinBox::valueChanged), [this, applyTextures](int value) {
+            Config().preview.textures.residencyBudget = uint32_t(value);
+            applyTextures();
+        });
+
+        // A pushed set has its own layout flag, so the shaders are reloaded
+        QSpinBox* pushSetBox = new QSpinBox(container);
+        pushSetBox->setRange(-1, 31);
+        pushSetBox->setSpecialValueText("None");
+        pushSetBox->setKeyboardTracking(false);
+        pushSetBox->setToolTip("Set written in to the command buffer with VK_KHR_push_descriptor, ignored when the device doesn't support it");
+        pushSetBox->setValue(Config().preview.descriptors.pushDescriptorSet);
+        QObject::connect(pushSetBox, QOverload<int>::of(&QSpinBox::valueChanged), [this](int value) {
+            HandleConfigValueChange<int>(Config().preview.descriptors.pushDescriptorSet, ReloadFlags::Shaders, value);
+        });
+
+        // Capacity is part of the set layout, so the shaders are reloaded
+        QSpinBox* bindlessBox = new QSpinBox(container);
+        bindlessBox->setRange(1, 1 << 20);
+        bindlessBox->setKeyboardTracking(false);
+        bindlessBox->setToolTip("Descriptors given to each runtime array of sampled images, clamped to the device's update after bind limits");
+        bindlessBox->setValue(int(Config().preview.descriptors.bindlessCapacity));
+        QObject::connect(bindlessBox, QOverload<int>::of(&QSpinBox::valueChanged), [this](int value) {
+            HandleConfigValueChange<uint32_t>(Config().preview.descriptors.bindlessCapacity, ReloadFlags::Shaders, value);
+        });
+
+        QGridLayout* layout = new QGridLayout(container);
+        container->setLayout(layout);
+
+        int row = 0;
+        layout->addWidget(new QLabel("Mesh source", container), row, 0);
+        layout->addWidget(sourceBox, row++, 1);
+        layout->addWidget(new QLabel("Mesh", container), row, 0);
+        layout->addWidget(meshField, row, 1);
+        layout->addWidget(meshButton, row++, 2);
+        layout->addWidget(new QLabel("Generated triangles", container), row, 0);
+        layout->addWidget(trianglesBox, row++, 1);
+        layout->addWidget(new QLabel("Generated size", container), row, 0);
+        layout->addWidget(sizeBox, row++, 1);
+        layout->addWidget(optimiseBox, row++, 0, 1, 2);
+        layout->addWidget(new QLabel("Position format", container), row, 0);
+        layout->addWidget(positionBox, row++, 1);
+        layout->addWidget(new QLabel("Normal format", container), row, 0);
+        layout->addWidget(normalBox, row++, 1);
+        layout->addWidget(new QLabel("TexCoord format", container), row, 0);
+        layout->addWidget(texCoordBox, row++, 1);
+        layout->addWidget(new QLabel("Colour format", container), row, 0);
+        layout->addWidget(colourBox, row++, 1);
+        layout->addWidget(new QLabel("Vertex streams", container), row, 0);
+        layout->addWidget(streamsBox, row++, 1);
+        layout->addWidget(new QLabel("Instances", container), row, 0);
+        layout->addWidget(instancesBox, row++, 1);
+        layout->addWidget(indirectBox, row++, 0, 1, 2);
+        layout->addWidget(lodBox, row++, 0, 1, 2);
+        layout->addWidget(new QLabel("Editing triangle budget", container), row, 0);
+        layout->addWidget(budgetBox, row++, 1);
+        layout->addWidget(new QLabel("Mip generation", container), row, 0);
+        layout->addWidget(mipBox, row++, 1);
+        layout->addWidget(new QLabel("Mip levels", container), row, 0);
+        layout->addWidget(mipLevelsBox, row++, 1);
+        layout->addWidget(new QLabel("LOD bias", container), row, 0);
+        layout->addWidget(lodBiasBox, row++, 1);
+        layout->addWidget(new QLabel("Texture residency budget", container), row, 0);
+        layout->addWidget(residencyBox, row++, 1);
+        layout->addWidget(transcodeBox, row++, 0, 1, 2);
+        layout->addWidget(new QLabel("Push descriptor set", container), row, 0);
+        layout->addWidget(pushSetBox, row++, 1);
+        layout->addWidget(new QLabel("Runtime array capacity", container), row, 0);
+        layout->addWidget(bindlessBox, row++, 1);
+        layout->setRowStretch(row, 1);
+
+        return container;
+    }
+
     void MainWindow::MakeDescriptorBlock() {
         m_descriptorTypeWidget->Clear();
         delete m_descriptorTree;
@@ -368,7 +626,13 @@ namespace vpa {
 
         Descriptors* descriptors = m_vulkan->GetDescriptors();
         if (!descriptors) return;
-        m_descriptorTree = new DescriptorTree(m_ui->gtDescriptors, m_ui->gtxDescriptorGroupInfo, m_ui->gtxDescriptorTypeInfo, m_descriptorTypeWidget, descriptors);
+        // Switching between static and dynamic changes the set layouts, so the shaders are reloaded once the tree is done with the change
+        m_descriptorTree = new DescriptorTree(m_ui->gtDescriptors, m_ui->gtxDescriptorGroupInfo, m_ui->gtxDescriptorTypeInfo, m_descriptorTypeWidget, descriptors,
+                                              [this](const QString& bindingKey, bool dynamic) {
+            if (dynamic) Config().preview.descriptors.dynamicBuffers.insert(bindingKey);
+            else Config().preview.descriptors.dynamicBuffers.remove(bindingKey);
+            QTimer::singleShot(0, this, [this]() { if (m_vulkan) m_vulkan->Reload(ReloadFlags::Shaders); });
+        });
 
         for (auto& set : descriptors->Buffers().keys()) {
             for (int i = 0; i < descriptors->Buffers()[set].size(); ++i) {
@@ -376,7 +640,7 @@ namespace vpa {
                 m_descriptorTree->CreateDescriptorWidgetTree(set, i, resource);
             }
         }
-        for (auto& set : descriptors->Buffers().keys()) {
+        for (auto& set : descriptors->Images().keys()) {
             for (int i = 0; i < descriptors->Images()[set].size(); ++i) {
                 SpvResource* resource = descriptors->Images()[set][i].descriptor.resource;
                 m_descriptorTree->CreateDescriptorWidgetTree(set, i, resource);
@@ -398,6 +662,264 @@ namespace vpa {
         });
     }
 
+    void MainWindow::MakeStatisticsDock() {
+        m_statsDockWidget = new QDockWidget("Statistics", this);
+        m_statsDockWidget->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
+        m_statsWidget = new StatisticsWidget(m_statsDockWidget);
+        m_statsDockWidget->setWidget(m_statsWidget);
+        addDockWidget(Qt::RightDockWidgetArea, m_statsDockWidget);
+
+        QObject::connect(m_statsWidget, &StatisticsWidget::WriteRequested, [this](){ WriteStatistics(); });
+        QObject::connect(m_statsWidget, &StatisticsWidget::BenchmarkRequested, [this](){ BenchmarkDescriptors(); });
+
+        m_statsTimer = new QTimer(this);
+        QObject::connect(m_statsTimer, &QTimer::timeout, [this](){ UpdateStatistics(); });
+        m_statsTimer->start(1000);
+    }
+
+    void MainWindow::UpdateStatistics() {
+        if (!m_vulkan || m_vulkan->State() != VulkanState::Ok || !m_statsDockWidget->isVisible()) return;
+        MemoryAllocator* allocator = m_vulkan->Allocator();
+        if (!allocator) return;
+
+        const MemoryStatistics& stats = allocator->Statistics();
+        auto countAndBytes = [](const AllocationStatistics& allocStats) {
+            return QString("%1 live, %2 (%3 total)").arg(allocStats.count).arg(StatisticsWidget::FormatBytes(allocStats.bytes)).arg(allocStats.totalCount);
+        };
+
+        StatisticRows memoryRows;
+        memoryRows.push_back({ "Allocated", StatisticsWidget::FormatBytes(stats.allocated) });
+        memoryRows.push_back({ "Peak", StatisticsWidget::FormatBytes(stats.peak) });
+        memoryRows.push_back({ "Buffers", countAndBytes(stats.types[size_t(AllocationType::Buffer)]) });
+        memoryRows.push_back({ "Images", countAndBytes(stats.types[size_t(AllocationType::Image)]) });
+        for (int i = 0; i < stats.heaps.size(); ++i) {
+            const HeapStatistics& heap = stats.heaps[i];
+            QString label = "Heap " + QString::number(i) + ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "");
+            QString value = StatisticsWidget::FormatBytes(heap.allocated) + " / " + StatisticsWidget::FormatBytes(heap.size) + ", peak " + StatisticsWidget::FormatBytes(heap.peak);
+            if (stats.budgetSupported) {
+                value += ", driver usage " + StatisticsWidget::FormatBytes(heap.usage) + " / budget " + StatisticsWidget::FormatBytes(heap.budget);
+            }
+            memoryRows.push_back({ label, value });
+        }
+        if (!stats.budgetSupported) memoryRows.push_back({ "Driver budget", "VK_EXT_memory_budget not supported" });
+        m_statsWidget->SetSection("Memory", memoryRows);
+
+        StatisticRows categoryRows;
+        for (auto it = stats.categories.constBegin(); it != stats.categories.constEnd(); ++it) {
+            categoryRows.push_back({ it.key(), countAndBytes(it.value()) });
+        }
+        m_statsWidget->SetSection("Allocations", categoryRows);
+
+        const AttachmentStatistics* attachmentStats = m_vulkan->AttachmentStats();
+        if (attachmentStats) {
+            StatisticRows attachmentRows;
+            attachmentRows.push_back({ "Sampled attachments", StatisticsWidget::FormatBytes(attachmentStats->sampledBytes) });
+            attachmentRows.push_back({ "Transient attachments", StatisticsWidget::FormatBytes(attachmentStats->transientBytes) });
+            attachmentRows.push_back({ "Aliased memory", StatisticsWidget::FormatBytes(attachmentStats->aliasedBytes) });
+            attachmentRows.push_back({ "Saved by aliasing", StatisticsWidget::FormatBytes(qMax(attachmentStats->transientBytes, attachmentStats->aliasedBytes) - attachmentStats->aliasedBytes) });
+            if (attachmentStats->lazilyAllocated) {
+                attachmentRows.push_back({ "Lazily allocated", StatisticsWidget::FormatBytes(attachmentStats->committedBytes) + " committed" });
+            }
+            else {
+                attachmentRows.push_back({ "Lazily allocated", "No lazily allocated memory type" });
+            }
+            m_statsWidget->SetSection("Attachments", attachmentRows);
+        }
+
+        Descriptors* descriptors = m_vulkan->GetDescriptors();
+        if (descriptors) {
+            const TextureStatistics textureStats = descriptors->Statistics();
+            StatisticRows textureRows;
+            textureRows.push_back({ "Images", QString("%1, %2").arg(textureStats.imageCount).arg(StatisticsWidget::FormatBytes(textureStats.bytes)) });
+            textureRows.push_back({ "Mip levels", QString("Up to %1").arg(textureStats.maxMipLevels) });
+            textureRows.push_back({ "Mip generation", QString("%1 blitted, %2 on the CPU, %3 single level, %4 from KTX2 or DDS").arg(textureStats.generated[size_t(MipGeneration::Blit)])
+                                    .arg(textureStats.generated[size_t(MipGeneration::Cpu)]).arg(textureStats.generated[size_t(MipGeneration::None)]).arg(textureStats.precompressed) });
+            if (textureStats.transcoded > 0) {
+                textureRows.push_back({ "Transcoded", QString("%1, %2 from the texture cache, %3 ms encoding").arg(textureStats.transcoded).arg(textureStats.cacheHits)
+                                        .arg(double(textureStats.transcodeMilliseconds), 0, 'f', 2) });
+            }
+            textureRows.push_back({ "Upload time", QString("%1 ms, %2 ms generating mips").arg(double(textureStats.uploadMilliseconds), 0, 'f', 2)
+                                    .arg(double(textureStats.mipMilliseconds), 0, 'f', 2) });
+
+            // Only comparable between methods when every image used the same one and the chains are the same size
+            for (size_t method = size_t(MipGeneration::Blit); method < size_t(MipGeneration::Count_); ++method) {
+                if (method == size_t(MipGeneration::Blit) && !textureStats.blitsTimed) continue;
+                if (textureStats.imageCount > 0 && textureStats.generated[method] == textureStats.imageCount) {
+                    m_mipTimes[quint64(textureStats.bytes) << 2 | method] = double(textureStats.mipMilliseconds);
+                }
+            }
+            const quint64 blitKey = quint64(textureStats.bytes) << 2 | quint64(MipGeneration::Blit);
+            const quint64 cpuKey = quint64(textureStats.bytes) << 2 | quint64(MipGeneration::Cpu);
+            if (m_mipTimes.contains(blitKey) && m_mipTimes.contains(cpuKey)) {
+                textureRows.push_back({ "Mip time comparison", QString("%1 ms of GPU blits, %2 ms of CPU downsampling").arg(m_mipTimes[blitKey], 0, 'f', 2).arg(m_mipTimes[cpuKey], 0, 'f', 2) });
+            }
+            const SamplerStatistics* samplerStats = m_vulkan->SamplerStats();
+            if (samplerStats) {
+                textureRows.push_back({ "Samplers", QString("%1 in use, %2 kept for reuse, %3 created, %4 reused").arg(samplerStats->live).arg(samplerStats->unused)
+                                        .arg(samplerStats->created).arg(samplerStats->reused) });
+            }
+            const TextureCacheStatistics* residencyStats = m_vulkan->TextureCacheStats();
+            if (residencyStats) {
+                textureRows.push_back({ "Residency", QString("%1 images, %2 of %3, %4 unbound (%5), %6 hits, %7 misses, %8 evicted").arg(residencyStats->resident)
+                                        .arg(StatisticsWidget::FormatBytes(residencyStats->bytes)).arg(StatisticsWidget::FormatBytes(residencyStats->budget))
+                                        .arg(residencyStats->unused).arg(StatisticsWidget::FormatBytes(residencyStats->unusedBytes)).arg(residencyStats->hits)
+                                        .arg(residencyStats->misses).arg(residencyStats->evictions) });
+            }
+            m_statsWidget->SetSection("Textures", textureRows);
+
+            const DescriptorCacheStatistics* descriptorStats = m_vulkan->DescriptorCacheStats();
+            if (descriptorStats) {
+                StatisticRows descriptorRows;
+                descriptorRows.push_back({ "Last rebuild", QString("%1 ms").arg(double(descriptors->BuildMilliseconds()), 0, 'f', 2) });
+                descriptorRows.push_back({ "Set layouts", QString("%1 created, %2 reused").arg(descriptorStats->setLayoutsCreated).arg(descriptorStats->setLayoutsReused) });
+                descriptorRows.push_back({ "Pipeline layouts", QString("%1 created, %2 reused").arg(descriptorStats->pipelineLayoutsCreated)
+                                           .arg(descriptorStats->pipelineLayoutsReused) });
+                descriptorRows.push_back({ "Pools", QString("%1 created, %2 reset and reused, %3 free").arg(descriptorStats->poolsCreated).arg(descriptorStats->poolsReused)
+                                           .arg(descriptorStats->freePools) });
+                descriptorRows.push_back({ "Update templates", descriptorStats->updateTemplates ? "Yes" : "No" });
+                QString pushed = m_vulkan->Details().maxPushDescriptors == 0 ? "Not supported" : "None";
+                if (descriptors->PushedSet() >= 0) pushed = QString("Set %1, up to %2 descriptors").arg(descriptors->PushedSet()).arg(m_vulkan->Details().maxPushDescriptors);
+                descriptorRows.push_back({ "Pushed set", pushed });
+                descriptorRows.push_back({ "Dynamic buffers", QString("%1 in a %2 ring").arg(descriptors->DynamicBufferCount())
+                                           .arg(StatisticsWidget::FormatBytes(descriptors->RingBytes())) });
+                QString runtimeArrays = m_vulkan->Details().maxBindlessImages == 0 ? "Not supported" : "None";
+                if (textureStats.arrayCapacity > 0) runtimeArrays = QString("%1 of %2 elements written").arg(textureStats.arrayImages).arg(textureStats.arrayCapacity);
+                descriptorRows.push_back({ "Runtime image arrays", runtimeArrays });
+                m_statsWidget->SetSection("Descriptors", descriptorRows);
+            }
+        }
+
+        const MeshStatistics* meshStats = m_vulkan->MeshStats();
+        const PipelineStatistics* pipelineStats = m_vulkan->PipelineStats();
+        if (meshStats) {
+            StatisticRows meshRows;
+            meshRows.push_back({ "Face corners", QString::number(meshStats->sourceVertices) });
+            meshRows.push_back({ "Unique vertices", QString::number(meshStats->uniqueVertices) });
+            meshRows.push_back({ "Load time", QString("%1 ms, %2").arg(double(meshStats->loadMilliseconds), 0, 'f', 2)
+                                 .arg(meshStats->generated ? "generated" : meshStats->cached ? "from mesh cache" : "parsed") });
+            meshRows.push_back({ "Vertex buffer", StatisticsWidget::FormatBytes(meshStats->vertexBytes) });
+            meshRows.push_back({ "Index buffer", QString("%1 x %2 bit, %3").arg(meshStats->indexCount).arg(meshStats->indexType == VK_INDEX_TYPE_UINT16 ? 16 : 32)
+                                 .arg(StatisticsWidget::FormatBytes(meshStats->indexBytes)) });
+            // Generated meshes aren't analysed, their size would make the simulation slower than generating them
+            if (!meshStats->generated) {
+                meshRows.push_back({ "ATVR", QString("%1 source, %2 drawn").arg(double(meshStats->sourceCache.atvr), 0, 'f', 3).arg(double(meshStats->optimisedCache.atvr), 0, 'f', 3) });
+                meshRows.push_back({ "Vertex overfetch", QString("%1 source, %2 drawn").arg(double(meshStats->sourceOverfetch), 0, 'f', 3).arg(double(meshStats->optimisedOverfetch), 0, 'f', 3) });
+            }
+            meshRows.push_back({ "Index order", meshStats->generated ? "As generated" : meshStats->optimised ? "Optimised" : "As loaded" });
+            meshRows.push_back({ "Vertex stride", QString("%1 B, %2 B as float32, -%3%").arg(meshStats->stride).arg(meshStats->uncompressedStride)
+                                 .arg(meshStats->uncompressedStride > 0 ? 100.0 * (1.0 - double(meshStats->stride) / double(meshStats->uncompressedStride)) : 0.0, 0, 'f', 1) });
+            meshRows.push_back({ "Vertex streams", QString("%1 binding%2, %3").arg(meshStats->streamCount).arg(meshStats->streamCount == 1 ? "" : "s")
+                                 .arg(meshStats->streamLayout == VertexStreamLayout::Interleaved ? "interleaved" : "split") });
+            if (meshStats->instanceAttributes > 0) {
+                meshRows.push_back({ "Instances", QString("%1, %2 per instance inputs, %3").arg(meshStats->instanceCount).arg(meshStats->instanceAttributes)
+                                     .arg(StatisticsWidget::FormatBytes(meshStats->instanceBytes)) });
+            }
+            else {
+                meshRows.push_back({ "Instances", QString("%1, the vertex shader has no per instance inputs").arg(meshStats->instanceCount) });
+            }
+            if (pipelineStats && pipelineStats->indirectDraw) {
+                meshRows.push_back({ "Sub meshes", QString("%1 in %2 indirect draw call%3").arg(meshStats->subMeshCount).arg(pipelineStats->drawCalls)
+                                     .arg(pipelineStats->drawCalls == 1 ? "" : "s") });
+            }
+            else {
+                meshRows.push_back({ "Sub meshes", QString("%1, drawn as one").arg(meshStats->subMeshCount) });
+            }
+            if (meshStats->texCoordFallback) meshRows.push_back({ "TexCoord format", "Coordinates outside 0-1, using Float16" });
+            if (meshStats->lodCount > 1) {
+                QStringList levels;
+                for (uint32_t level = 1; level < meshStats->lodCount; ++level) {
+                    levels.push_back(QString("%1 (%2%)").arg(meshStats->lodIndexCount[level] / 3).arg(100.0 * double(meshStats->lodError[level]), 0, 'f', 2));
+                }
+                meshRows.push_back({ "Simplified levels", QString("%1 triangles, error of the bounding box diagonal").arg(levels.join(", ")) });
+                if (pipelineStats) meshRows.push_back({ "Drawn level", pipelineStats->drawnLod == 0 ? "Full mesh" : QString::number(pipelineStats->drawnLod) });
+            }
+            if (pipelineStats && pipelineStats->supported) {
+                meshRows.push_back({ "Vertex shader invocations", QString::number(pipelineStats->vertexShaderInvocations) });
+                meshRows.push_back({ "Primitives", QString::number(pipelineStats->inputAssemblyPrimitives) });
+            }
+            else {
+                meshRows.push_back({ "Vertex shader invocations", "Pipeline statistics queries not supported" });
+            }
+            // Simulated on the CPU, so the effect of reordering can be seen without pipeline statistics queries
+            if (!meshStats->generated) {
+                meshRows.push_back({ "Estimated ACMR", QString("%1 before reordering, %2 drawn").arg(double(meshStats->sourceCache.acmr), 0, 'f', 3).arg(double(meshStats->optimisedCache.acmr), 0, 'f', 3) });
+            }
+            if (pipelineStats && pipelineStats->supported && pipelineStats->inputAssemblyPrimitives > 0) {
+                meshRows.push_back({ "Measured ACMR", QString::number(double(pipelineStats->vertexShaderInvocations) / double(pipelineStats->inputAssemblyPrimitives), 'f', 3) });
+            }
+            if (pipelineStats && pipelineStats->timestampsSupported && pipelineStats->drawMilliseconds > 0.0) {
+                // Remembered per layout so compressed and split layouts can be compared against interleaved float32 at the same instance count and draw mode
+                DrawTimeKey key;
+                key.formats = meshStats->formats;
+                key.streamLayout = meshStats->streamLayout;
+                key.instanceCount = meshStats->instanceCount;
+                key.indirect = pipelineStats->indirectDraw;
+                const DrawTimeKey baseline = key.Baseline();
+                m_drawTimes[key] = pipelineStats->drawMilliseconds;
+                QString drawTime = QString("%1 ms").arg(pipelineStats->drawMilliseconds, 0, 'f', 4);
+                if (meshStats->instanceCount > 1) drawTime += QString(" (%1 us per instance)").arg(pipelineStats->drawMilliseconds * 1000.0 / meshStats->instanceCount, 0, 'f', 3);
+                if (!(key == baseline) && m_drawTimes.contains(baseline)) drawTime += QString(", %1 ms interleaved float32").arg(m_drawTimes[baseline], 0, 'f', 4);
+                meshRows.push_back({ "Draw time (GPU)", drawTime });
+
+                // Every instance count measured with this layout and draw mode, in increasing order
+                QMap<uint32_t, double> scaling;
+                for (auto it = m_drawTimes.constBegin(); it != m_drawTimes.constEnd(); ++it) {
+                    if (it.key().SameLayout(key)) scaling.insert(it.key().instanceCount, it.value());
+                }
+                if (scaling.size() > 1) {
+                    QStringList times;
+                    for (auto it = scaling.constBegin(); it != scaling.constEnd(); ++it) {
+                        times.push_back(QString("%1: %2 ms").arg(it.key()).arg(it.value(), 0, 'f', 3));
+                    }
+                    meshRows.push_back({ "Instance scaling", times.join(", ") });
+                }
+            }
+            else if (pipelineStats && !pipelineStats->timestampsSupported) {
+                meshRows.push_back({ "Draw time (GPU)", "Timestamp queries not supported" });
+            }
+            m_statsWidget->SetSection("Mesh", meshRows);
+        }
+
+        StatisticRows frameRows;
+        frameRows.push_back({ "Submitted frame", QString::number(m_vulkan->SubmittedFrame()) });
+        frameRows.push_back({ "Completed frame", QString::number(m_vulkan->CompletedFrame()) });
+        frameRows.push_back({ "Pending deletions", QString::number(m_vulkan->PendingDeletions()) });
+        if (pipelineStats && pipelineStats->recordMicroseconds > 0.0) {
+            m_recordTimes[pipelineStats->pushedSet] = pipelineStats->recordMicroseconds;
+            QString recordTime = QString("%1 us").arg(pipelineStats->recordMicroseconds, 0, 'f', 1);
+            if (pipelineStats->pushedSet >= 0 && m_recordTimes.contains(-1)) recordTime += QString(", %1 us with every set bound").arg(m_recordTimes[-1], 0, 'f', 1);
+            frameRows.push_back({ "Command recording (CPU)", recordTime });
+        }
+        m_statsWidget->SetSection("Frames", frameRows);
+    }
+
+    void MainWindow::WriteStatistics() {
+        MemoryAllocator* allocator = m_vulkan ? m_vulkan->Allocator() : nullptr;
+        if (!allocator) return;
+        if (allocator->WriteStatistics(CONFIGDIR"memory_statistics.json") == VPA_OK) {
+            Console()->setText("Memory statistics written to " CONFIGDIR "memory_statistics.json");
+        }
+        else {
+            Console()->setText(VPAError::lastMessage);
+        }
+    }
+
+    void MainWindow::BenchmarkDescriptors() {
+        if (!m_vulkan || m_vulkan->State() != VulkanState::Ok) return;
+        QVector<DescriptorBenchmarkResult> results;
+        if (BenchmarkDescriptorUpdates(m_vulkan, m_vulkan->Allocator(), results) != VPA_OK) {
+            Console()->setText(VPAError::lastMessage);
+            return;
+        }
+
+        StatisticRows rows;
+        for (const DescriptorBenchmarkResult& result : results) {
+            const QString templated = result.templateMicroseconds > 0.0 ? QString("%1 us with a template").arg(result.templateMicroseconds, 0, 'f', 2) : "no templates";
+            rows.push_back({ QString("%1 bindings").arg(result.bindings), QString("%1 us written, %2").arg(result.writeMicroseconds, 0, 'f', 2).arg(templated) });
+        }
+        m_statsWidget->SetSection("Descriptor updates", rows);
+    }
+
     QComboBox* MainWindow::MakeComboBox(QWidget* parent, QVector<QString> items) {
         QComboBox* box = new QComboBox(parent);
         for (QString& str : items) {
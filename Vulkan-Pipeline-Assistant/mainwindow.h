@@ -3,8 +3,10 @@
 
 #include <QMainWindow>
 #include <QDockWidget>
+#include <QHash>
 
 #include "Vulkan/vulkanmain.h"
+#include "Vulkan/pipelineconfig.h"
 #include "Vulkan/spirvresource.h"
 #include "common.h"
 
@@ -19,6 +21,7 @@ class QPushButton;
 class QLineEdit;
 class QComboBox;
 class QPlainTextEdit;
+class QTimer;
 
 namespace vpa {
     class DrawerWidget;
@@ -27,6 +30,21 @@ namespace vpa {
     class DescriptorTree;
     class GLSLHighlighter;
     class CodeEditor;
+    class StatisticsWidget;
+
+    // What a GPU draw time was measured with, times are only compared when everything but the compared setting matches
+    struct DrawTimeKey {
+        VertexFormatConfig formats;
+        VertexStreamLayout streamLayout = VertexStreamLayout::Interleaved;
+        uint32_t instanceCount = 1;
+        bool indirect = false;
+
+        // Every attribute as float32 in one interleaved binding, at the same instance count and draw mode
+        DrawTimeKey Baseline() const;
+        bool SameLayout(const DrawTimeKey& other) const; // Ignores the instance count
+    };
+    bool operator==(const DrawTimeKey& a, const DrawTimeKey& b);
+    uint qHash(const DrawTimeKey& key, uint seed = 0);
 
     class MainWindow : public QMainWindow {
         Q_OBJECT
@@ -58,8 +76,13 @@ namespace vpa {
 
         QWidget* MakeViewportStateBlock();
         QWidget* MakeRenderPassBlock();
+        QWidget* MakePreviewBlock();
         void MakeDescriptorBlock();
         void SetupDisplayAttachments();
+        void MakeStatisticsDock();
+        void UpdateStatistics();
+        void WriteStatistics();
+        void BenchmarkDescriptors();
 
         void VulkanCreationCallback();
         void WriteAndReload(ReloadFlags flag) const;
@@ -76,6 +99,13 @@ namespace vpa {
         QDockWidget* m_vkDockWidget;
         Ui::DockWidget* m_vkDockUi;
 
+        QDockWidget* m_statsDockWidget;
+        StatisticsWidget* m_statsWidget;
+        QTimer* m_statsTimer;
+        QHash<DrawTimeKey, double> m_drawTimes; // Last GPU draw time of each vertex format, stream layout, instance count and draw mode
+        QHash<quint64, double> m_mipTimes; // Last mip generation time of each method and texture size
+        QHash<int, double> m_recordTimes; // Last command recording time with each set pushed, -1 with none
+
         GLSLHighlighter* m_glslHighlighters[5];
         CodeEditor* m_codeEditors[size_t(ShaderStage::Count_)];
 